@@ -1,4 +1,5 @@
 #include <stdarg.h>
+#include <stdlib.h>
 #include <math.h>
 
 #include "fractalNoise.h"
@@ -143,3 +144,313 @@ double getXYFractal( int inX, int inY, double inRoughness, double inScale ) {
     
     return sum * oneOverIntMax;
     }
+
+
+
+
+// scratch buffers for the rect functions, grown as needed and kept
+enum ScratchBuffer {
+    SCRATCH_OCTAVES = 0,
+    SCRATCH_COL_LATTICE,
+    SCRATCH_COL_OFFSET,
+    SCRATCH_ROW_LATTICE,
+    SCRATCH_ROW_OFFSET,
+    SCRATCH_LATTICE_X,
+    SCRATCH_LATTICE_Y,
+    SCRATCH_LATTICE_HASH,
+    SCRATCH_LATTICE_NEEDED,
+    NUM_SCRATCH
+    };
+
+static void *scratchBuffers[ NUM_SCRATCH ] = { NULL };
+static size_t scratchBufferSizes[ NUM_SCRATCH ] = { 0 };
+
+
+static void *getScratch( int inBuffer, size_t inBytes ) {
+    if( scratchBufferSizes[ inBuffer ] < inBytes ) {
+        if( scratchBuffers[ inBuffer ] != NULL ) {
+            free( scratchBuffers[ inBuffer ] );
+            }
+        scratchBuffers[ inBuffer ] = malloc( inBytes );
+        scratchBufferSizes[ inBuffer ] = inBytes;
+        }
+    return scratchBuffers[ inBuffer ];
+    }
+
+
+
+void getXYRandomRect( int inX, int inY, int inWidth, int inHeight,
+                      double *outValues, const char *inMask ) {
+    
+    for( int y=0; y<inHeight; y++ ) {
+        double *rowValues = &( outValues[ y * inWidth ] );
+        
+        if( inMask == NULL ) {
+            for( int x=0; x<inWidth; x++ ) {
+                rowValues[x] = 
+                    xxTweakedHash2D( inX + x, inY + y ) * oneOverIntMax;
+                }
+            }
+        else {
+            const char *rowMask = &( inMask[ y * inWidth ] );
+            
+            for( int x=0; x<inWidth; x++ ) {
+                if( rowMask[x] ) {
+                    rowValues[x] = 
+                        xxTweakedHash2D( inX + x, inY + y ) * oneOverIntMax;
+                    }
+                }
+            }
+        }
+    }
+
+
+
+// finds lattice line below each of inNumCells coordinates along one axis
+// and builds the list of lattice lines needed, where each cell's
+// lower line is followed directly by its upper line
+//
+// returns number of lattice lines
+static int buildLatticeLines( int inStart, int inNumCells, double inDivisor,
+                              int *outCellLattice, double *outCellOffset,
+                              int *outLines ) {
+    int numLines = 0;
+    
+    for( int i=0; i<inNumCells; i++ ) {
+        int cell = inStart + i;
+        
+        // same steps as getXYRandomBN
+        double v = cell / inDivisor;
+        
+        int floorV = lrint( floor( v ) );
+        
+        outCellOffset[i] = v - floorV;
+        
+        // floorV never decreases along the axis, and list always
+        // ends with upper line of the previous cell
+        if( numLines == 0 || outLines[ numLines - 1 ] < floorV ) {
+            outLines[ numLines++ ] = floorV;
+            outLines[ numLines++ ] = floorV + 1;
+            }
+        else if( outLines[ numLines - 1 ] == floorV ) {
+            outLines[ numLines++ ] = floorV + 1;
+            }
+        
+        outCellLattice[i] = numLines - 2;
+        }
+    
+    return numLines;
+    }
+
+
+
+// getXYRandomBN( ( inX + x ) / inDivisor, ( inY + y ) / inDivisor )
+// for every cell in rect
+static void getXYRandomBNRect( int inX, int inY, int inWidth, int inHeight,
+                               double inDivisor,
+                               double *outValues, const char *inMask ) {
+    
+    if( ! ( inDivisor > 0 ) ) {
+        // lattice lines not in increasing order, do it cell by cell
+        for( int y=0; y<inHeight; y++ ) {
+            for( int x=0; x<inWidth; x++ ) {
+                int i = y * inWidth + x;
+                
+                if( inMask == NULL || inMask[i] ) {
+                    int cellX = inX + x;
+                    int cellY = inY + y;
+                    
+                    outValues[i] = getXYRandomBN( cellX / inDivisor,
+                                                  cellY / inDivisor );
+                    }
+                }
+            }
+        return;
+        }
+    
+
+    int *colLattice = 
+        (int*)getScratch( SCRATCH_COL_LATTICE, inWidth * sizeof( int ) );
+    double *colOffset = 
+        (double*)getScratch( SCRATCH_COL_OFFSET, inWidth * sizeof( double ) );
+    int *latticeX = 
+        (int*)getScratch( SCRATCH_LATTICE_X, 2 * inWidth * sizeof( int ) );
+
+    int *rowLattice = 
+        (int*)getScratch( SCRATCH_ROW_LATTICE, inHeight * sizeof( int ) );
+    double *rowOffset = 
+        (double*)getScratch( SCRATCH_ROW_OFFSET, 
+                             inHeight * sizeof( double ) );
+    int *latticeY = 
+        (int*)getScratch( SCRATCH_LATTICE_Y, 2 * inHeight * sizeof( int ) );
+    
+    int numLatticeX = buildLatticeLines( inX, inWidth, inDivisor,
+                                         colLattice, colOffset, latticeX );
+    int numLatticeY = buildLatticeLines( inY, inHeight, inDivisor,
+                                         rowLattice, rowOffset, latticeY );
+    
+    int numLattice = numLatticeX * numLatticeY;
+    
+    double *latticeHash = 
+        (double*)getScratch( SCRATCH_LATTICE_HASH, 
+                             numLattice * sizeof( double ) );
+    
+    if( inMask == NULL ) {
+        // every lattice point is a corner of some cell
+        for( int ly=0; ly<numLatticeY; ly++ ) {
+            double *hashRow = &( latticeHash[ ly * numLatticeX ] );
+            
+            for( int lx=0; lx<numLatticeX; lx++ ) {
+                hashRow[lx] = xxTweakedHash2D( latticeX[lx], latticeY[ly] );
+                }
+            }
+        }
+    else {
+        // only hash corners of masked cells
+        char *needed = 
+            (char*)getScratch( SCRATCH_LATTICE_NEEDED, numLattice );
+        
+        for( int i=0; i<numLattice; i++ ) {
+            needed[i] = false;
+            }
+        
+        for( int y=0; y<inHeight; y++ ) {
+            char *neededA = &( needed[ rowLattice[y] * numLatticeX ] );
+            char *neededB = neededA + numLatticeX;
+            
+            const char *rowMask = &( inMask[ y * inWidth ] );
+            
+            for( int x=0; x<inWidth; x++ ) {
+                if( rowMask[x] ) {
+                    int l = colLattice[x];
+                    neededA[l] = true;
+                    neededA[l + 1] = true;
+                    neededB[l] = true;
+                    neededB[l + 1] = true;
+                    }
+                }
+            }
+        
+        for( int ly=0; ly<numLatticeY; ly++ ) {
+            double *hashRow = &( latticeHash[ ly * numLatticeX ] );
+            char *neededRow = &( needed[ ly * numLatticeX ] );
+            
+            for( int lx=0; lx<numLatticeX; lx++ ) {
+                if( neededRow[lx] ) {
+                    hashRow[lx] = 
+                        xxTweakedHash2D( latticeX[lx], latticeY[ly] );
+                    }
+                }
+            }
+        }
+    
+
+    // same blending steps as getXYRandomBN
+    for( int y=0; y<inHeight; y++ ) {
+        double *hashA = &( latticeHash[ rowLattice[y] * numLatticeX ] );
+        double *hashB = hashA + numLatticeX;
+
+        double yOffset = rowOffset[y];
+        
+        double *rowValues = &( outValues[ y * inWidth ] );
+        
+        if( inMask == NULL ) {
+            for( int x=0; x<inWidth; x++ ) {
+                int l = colLattice[x];
+                double xOffset = colOffset[x];
+                
+                double topBlend = 
+                    hashA[l + 1] * xOffset + (1-xOffset) * hashA[l];
+                double bottomBlend = 
+                    hashB[l + 1] * xOffset + (1-xOffset) * hashB[l];
+                
+                rowValues[x] = bottomBlend * yOffset + (1-yOffset) * topBlend;
+                }
+            }
+        else {
+            const char *rowMask = &( inMask[ y * inWidth ] );
+            
+            for( int x=0; x<inWidth; x++ ) {
+                if( rowMask[x] ) {
+                    int l = colLattice[x];
+                    double xOffset = colOffset[x];
+                    
+                    double topBlend = 
+                        hashA[l + 1] * xOffset + (1-xOffset) * hashA[l];
+                    double bottomBlend = 
+                        hashB[l + 1] * xOffset + (1-xOffset) * hashB[l];
+                    
+                    rowValues[x] = 
+                        bottomBlend * yOffset + (1-yOffset) * topBlend;
+                    }
+                }
+            }
+        }
+    }
+
+
+
+void getXYFractalRect( int inX, int inY, int inWidth, int inHeight,
+                       double inRoughness, double inScale,
+                       double *outValues, const char *inMask ) {
+    
+    int numCells = inWidth * inHeight;
+    
+    if( numCells <= 0 ) {
+        return;
+        }
+    
+    double *octaves = 
+        (double*)getScratch( SCRATCH_OCTAVES, 
+                             6 * numCells * sizeof( double ) );
+
+    double divisors[6] = { 32 * inScale,
+                           16 * inScale,
+                           8 * inScale,
+                           4 * inScale,
+                           2 * inScale,
+                           inScale };
+    
+    for( int o=0; o<6; o++ ) {
+        getXYRandomBNRect( inX, inY, inWidth, inHeight, divisors[o],
+                           &( octaves[ o * numCells ] ), inMask );
+        }
+    
+    double *o32 = &( octaves[ 0 ] );
+    double *o16 = &( octaves[ numCells ] );
+    double *o8 = &( octaves[ 2 * numCells ] );
+    double *o4 = &( octaves[ 3 * numCells ] );
+    double *o2 = &( octaves[ 4 * numCells ] );
+    double *o1 = &( octaves[ 5 * numCells ] );
+    
+    double b = inRoughness;
+    double a = 1 - b;
+
+    // same nesting as getXYFractal, so rounding is the same
+    for( int i=0; i<numCells; i++ ) {
+        if( inMask != NULL && ! inMask[i] ) {
+            continue;
+            }
+        
+        double sum =
+            a * o32[i]
+            +
+            b * (
+                a * o16[i]
+                +
+                b * (
+                    a * o8[i]
+                    +
+                    b * (
+                        a * o4[i]
+                        +
+                        b * (
+                            a * o2[i]
+                            +
+                            b * (
+                                o1[i]
+                                ) ) ) ) );
+        
+        outValues[i] = sum * oneOverIntMax;
+        }
+    }
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stddef.h>
 
 
 // sets seed for all subsequent calls
@@ -18,3 +19,24 @@ double getXYRandom( int inX, int inY );
 // BUT can be larger than 1 sometimes
 double getXYFractal( int inX, int inY, double inRoughness, double inScale );
 
+
+
+
+// Rectangle versions of the above, for filling a whole block of cells
+// at once.
+// Results are bit-identical to calling the per-cell versions for each cell.
+//
+// outValues[ y * inWidth + x ] gets the value for cell ( inX + x, inY + y )
+//
+// if inMask is not NULL, only cells with non-zero inMask entries (same
+// layout as outValues) are computed, and other entries are left alone
+
+void getXYRandomRect( int inX, int inY, int inWidth, int inHeight,
+                      double *outValues, const char *inMask = NULL );
+
+
+// lattice hashes shared by neighboring cells are only computed once,
+// which saves most of the hashing for the coarse octaves
+void getXYFractalRect( int inX, int inY, int inWidth, int inHeight,
+                       double inRoughness, double inScale,
+                       double *outValues, const char *inMask = NULL );
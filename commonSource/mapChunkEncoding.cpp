@@ -0,0 +1,44 @@
+#include "mapChunkEncoding.h"
+
+#include <stdint.h>
+
+
+
+int writeChunkVarInt( unsigned char *outBuffer, int inValue ) {
+    // zig-zag so that small negative values stay short too
+    uint32_t v = 
+        ( (uint32_t)inValue << 1 ) ^ (uint32_t)( inValue >> 31 );
+    
+    int numWritten = 0;
+    
+    while( v >= 0x80 ) {
+        outBuffer[ numWritten ] = (unsigned char)( v | 0x80 );
+        v >>= 7;
+        numWritten++;
+        }
+    outBuffer[ numWritten ] = (unsigned char)v;
+    numWritten++;
+    
+    return numWritten;
+    }
+
+
+
+int readChunkVarInt( const unsigned char *inBuffer, int inBufferLength,
+                     int *outValue ) {
+    uint32_t v = 0;
+    int shift = 0;
+    
+    for( int i=0; i<inBufferLength && i<CHUNK_VAR_INT_MAX_BYTES; i++ ) {
+        v |= (uint32_t)( inBuffer[i] & 0x7F ) << shift;
+        
+        if( ( inBuffer[i] & 0x80 ) == 0 ) {
+            *outValue = (int)( ( v >> 1 ) ^ ( ~( v & 1 ) + 1 ) );
+            return i + 1;
+            }
+        shift += 7;
+        }
+    
+    // ran off end of buffer
+    return 0;
+    }
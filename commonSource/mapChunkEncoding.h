@@ -0,0 +1,21 @@
+
+
+// compact binary encoding used for the body of MB (binary map chunk) messages
+// see MB in server/protocol.txt for the layout
+
+
+// most bytes that one encoded int can take
+#define CHUNK_VAR_INT_MAX_BYTES 5
+
+
+// writes inValue into outBuffer as a zig-zag, 7-bits-per-byte varint
+// outBuffer must have room for CHUNK_VAR_INT_MAX_BYTES
+// returns number of bytes written
+int writeChunkVarInt( unsigned char *outBuffer, int inValue );
+
+
+// reads a varint written by writeChunkVarInt from inBuffer
+// returns number of bytes consumed, or 0 if inBuffer ends before the
+// value is complete (or the value is malformed)
+int readChunkVarInt( const unsigned char *inBuffer, int inBufferLength,
+                     int *outValue );
@@ -0,0 +1,153 @@
+#include "messageBuffer.h"
+
+#include <string.h>
+#include <stddef.h>
+
+
+
+MessageBuffer::MessageBuffer()
+        : mBuffer( NULL ),
+          mCapacity( 0 ),
+          mStart( 0 ),
+          mEnd( 0 ),
+          mScanned( 0 ) {
+    }
+
+
+
+MessageBuffer::~MessageBuffer() {
+    if( mBuffer != NULL ) {
+        delete [] mBuffer;
+        }
+    }
+
+
+
+void MessageBuffer::append( const unsigned char *inBytes, int inLength ) {
+    if( inLength <= 0 ) {
+        return;
+        }
+
+    if( mEnd + inLength > mCapacity ) {
+        int numUnread = mEnd - mStart;
+
+        if( mStart > 0 && numUnread + inLength <= mCapacity / 2 ) {
+            // plenty of room once unread bytes move to front
+            memmove( mBuffer, &( mBuffer[ mStart ] ), numUnread );
+            }
+        else {
+            int newCapacity = mCapacity;
+
+            if( newCapacity == 0 ) {
+                newCapacity = 4096;
+                }
+            while( newCapacity < numUnread + inLength ) {
+                newCapacity *= 2;
+                }
+
+            unsigned char *newBuffer = new unsigned char[ newCapacity ];
+
+            if( mBuffer != NULL ) {
+                memcpy( newBuffer, &( mBuffer[ mStart ] ), numUnread );
+                delete [] mBuffer;
+                }
+            mBuffer = newBuffer;
+            mCapacity = newCapacity;
+            }
+
+        mScanned -= mStart;
+        mStart = 0;
+        mEnd = numUnread;
+        }
+
+    memcpy( &( mBuffer[ mEnd ] ), inBytes, inLength );
+    mEnd += inLength;
+    }
+
+
+
+char MessageBuffer::findMessage( MessageView *outView, char inTerminator ) {
+    if( mScanned < mStart ) {
+        mScanned = mStart;
+        }
+
+    if( mScanned >= mEnd ) {
+        return false;
+        }
+
+    unsigned char *found =
+        (unsigned char*)memchr( &( mBuffer[ mScanned ] ), inTerminator,
+                                mEnd - mScanned );
+
+    if( found == NULL ) {
+        mScanned = mEnd;
+        return false;
+        }
+
+    // terminator itself not scanned yet, so it's found again
+    // until consumed
+    mScanned = found - mBuffer;
+
+    outView->start = (const char*)&( mBuffer[ mStart ] );
+    outView->length = mScanned - mStart;
+
+    return true;
+    }
+
+
+
+char *MessageBuffer::takeMessage( MessageView *inView ) {
+    char *message = new char[ inView->length + 1 ];
+
+    memcpy( message, inView->start, inView->length );
+    message[ inView->length ] = '\0';
+
+    consume( inView->length + 1 );
+
+    return message;
+    }
+
+
+
+void MessageBuffer::consume( int inLength ) {
+    if( inLength > mEnd - mStart ) {
+        inLength = mEnd - mStart;
+        }
+
+    mStart += inLength;
+
+    if( mStart == mEnd ) {
+        // empty, start over at front
+        mStart = 0;
+        mEnd = 0;
+        mScanned = 0;
+        }
+    else if( mScanned < mStart ) {
+        mScanned = mStart;
+        }
+    }
+
+
+
+void MessageBuffer::clear() {
+    mStart = 0;
+    mEnd = 0;
+    mScanned = 0;
+    }
+
+
+
+int getTwoLetterTagIndex( const char *inTag, int inLength ) {
+    if( inLength != 2 ) {
+        return -1;
+        }
+
+    unsigned int a = (unsigned char)inTag[0] - 'A';
+    unsigned int b = (unsigned char)inTag[1] - 'A';
+
+    if( a >= 26 || b >= 26 ) {
+        return -1;
+        }
+
+    return a * 26 + b;
+    }
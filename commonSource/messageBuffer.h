@@ -0,0 +1,87 @@
+// receive buffer for '#'-terminated protocol messages
+//
+// Bytes live in one contiguous block between a read offset and a write
+// offset.  Consuming a message only moves the read offset, so taking
+// messages off the front costs nothing per byte left behind.  Unread bytes
+// are moved to the front only when an append doesn't fit after the write
+// offset:  in place if unread plus new bytes fit in half the buffer,
+// otherwise into a bigger buffer.  An in-place move copies fewer bytes
+// than were consumed since the last one, so moves cost a constant amount
+// per received byte.
+//
+// Framing uses memchr, and remembers how far it has already searched, so
+// each received byte is searched for a terminator once, no matter how many
+// times a partial message is polled.
+
+
+
+// a message inside a MessageBuffer, not terminated and not owned
+// valid until the buffer is next changed
+typedef struct MessageView {
+        const char *start;
+        int length;
+    } MessageView;
+
+
+
+class MessageBuffer {
+    public:
+
+        MessageBuffer();
+        ~MessageBuffer();
+
+
+        // number of unread bytes
+        int size() {
+            return mEnd - mStart;
+            }
+
+        // first unread byte
+        const unsigned char *getBytes() {
+            return &( mBuffer[ mStart ] );
+            }
+
+
+        void append( const unsigned char *inBytes, int inLength );
+
+
+        // finds next message ending with inTerminator
+        // returns true and fills outView (excluding terminator) if a whole
+        // message has arrived
+        // message and terminator stay in buffer until consumed
+        char findMessage( MessageView *outView, char inTerminator = '#' );
+
+
+        // consumes next message found by findMessage, plus its terminator
+        // returns it as a new, \0-terminated string
+        char *takeMessage( MessageView *inView );
+
+
+        // drops inLength unread bytes from front
+        void consume( int inLength );
+
+
+        void clear();
+
+
+    private:
+
+        unsigned char *mBuffer;
+        int mCapacity;
+
+        int mStart;
+        int mEnd;
+
+        // bytes before this offset are known to hold no terminator
+        int mScanned;
+    };
+
+
+
+// index in [0, 676) for a message tag of exactly two capital letters,
+// or -1 for any other tag
+//
+// inLength is length of tag
+int getTwoLetterTagIndex( const char *inTag, int inLength );
+
+#define NUM_TWO_LETTER_TAGS 676
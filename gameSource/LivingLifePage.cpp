@@ -26,6 +26,8 @@
 
 #include "../commonSource/fractalNoise.h"
 #include "../commonSource/sayLimit.h"
+#include "../commonSource/mapChunkEncoding.h"
+#include "../commonSource/messageBuffer.h"
 
 
 #include "minorGems/util/SimpleVector.h"
@@ -1074,7 +1076,7 @@ static void replaceLastMessageSent( char *inNewMessage ) {
 
 
 
-SimpleVector<unsigned char> serverSocketBuffer;
+MessageBuffer serverSocketBuffer;
 
 static char serverSocketConnected = false;
 static char serverSocketHardFail = false;
@@ -1094,9 +1096,9 @@ static char readServerSocketFull( int inServerSocket ) {
         }
     
 
-    unsigned char buffer[512];
+    unsigned char buffer[16384];
     
-    int numRead = readFromSocket( inServerSocket, buffer, 512 );
+    int numRead = readFromSocket( inServerSocket, buffer, 16384 );
     
     
     while( numRead > 0 ) {
@@ -1105,11 +1107,11 @@ static char readServerSocketFull( int inServerSocket ) {
             connectedTime = game_getCurrentTime();
             }
         
-        serverSocketBuffer.appendArray( buffer, numRead );
+        serverSocketBuffer.append( buffer, numRead );
         numServerBytesRead += numRead;
         bytesInCount += numRead;
         
-        numRead = readFromSocket( inServerSocket, buffer, 512 );
+        numRead = readFromSocket( inServerSocket, buffer, 16384 );
         }    
 
     if( numRead == -1 ) {
@@ -1451,173 +1453,134 @@ typedef enum messageType {
 
 
 
-messageType getMessageType( char *inMessage ) {
-    char *copy = stringDuplicate( inMessage );
+typedef struct MessageTag {
+        const char *tag;
+        messageType type;
+    } MessageTag;
+
+
+static MessageTag messageTags[] = {
+    { "CM", COMPRESSED_MESSAGE },
+    { "MC", MAP_CHUNK },
+    // MB is binary version of MC, same header
+    { "MB", MAP_CHUNK },
+    { "MX", MAP_CHANGE },
+    { "PU", PLAYER_UPDATE },
+    { "PM", PLAYER_MOVES_START },
+    { "PO", PLAYER_OUT_OF_RANGE },
+    { "BW", BABY_WIGGLE },
+    { "PS", PLAYER_SAYS },
+    { "LS", LOCATION_SAYS },
+    { "PE", PLAYER_EMOT },
+    { "FX", FOOD_CHANGE },
+    { "HX", HEAT_CHANGE },
+    { "LN", LINEAGE },
+    { "CU", CURSED },
+    { "CX", CURSE_TOKEN_CHANGE },
+    { "CS", CURSE_SCORE },
+    { "NM", NAMES },
+    { "AP", APOCALYPSE },
+    { "AD", APOCALYPSE_DONE },
+    { "DY", DYING },
+    { "HE", HEALED },
+    { "PJ", POSSE_JOIN },
+    { "MN", MONUMENT_CALL },
+    { "GV", GRAVE },
+    { "GM", GRAVE_MOVE },
+    { "GO", GRAVE_OLD },
+    { "OW", OWNER },
+    { "FW", FOLLOWING },
+    { "EX", EXILED },
+    { "VS", VALLEY_SPACING },
+    { "FD", FLIGHT_DEST },
+    { "BB", BAD_BIOMES },
+    { "VU", VOG_UPDATE },
+    { "PH", PHOTO_SIGNATURE },
+    { "PONG", PONG },
+    { "SHUTDOWN", SHUTDOWN },
+    { "SERVER_FULL", SERVER_FULL },
+    { "SN", SEQUENCE_NUMBER },
+    { "ACCEPTED", ACCEPTED },
+    { "REJECTED", REJECTED },
+    { "NO_LIFE_TOKENS", NO_LIFE_TOKENS },
+    { "SD", FORCED_SHUTDOWN },
+    { "MS", GLOBAL_MESSAGE },
+    { "WR", WAR_REPORT },
+    { "LR", LEARNED_TOOL_REPORT },
+    { "TE", TOOL_EXPERTS },
+    { "TS", TOOL_SLOTS },
+    { "HL", HOMELAND },
+    { "FL", FLIP },
+    { "CR", CRAVING }
+    };
+
+#define NUM_MESSAGE_TAGS ( sizeof( messageTags ) / sizeof( MessageTag ) )
+
+
+// direct lookup for two-letter tags (almost all messages), by 
+// getTwoLetterTagIndex
+static messageType twoLetterTagTypes[ NUM_TWO_LETTER_TAGS ];
+static char twoLetterTagTypesBuilt = false;
+
+
+static messageType getMessageTypeFromTag( const char *inTag, 
+                                          int inTagLength ) {
+    if( ! twoLetterTagTypesBuilt ) {
+        for( int i=0; i<NUM_TWO_LETTER_TAGS; i++ ) {
+            twoLetterTagTypes[i] = UNKNOWN;
+            }
+        for( unsigned int i=0; i<NUM_MESSAGE_TAGS; i++ ) {
+            int index = getTwoLetterTagIndex( messageTags[i].tag,
+                                              strlen( messageTags[i].tag ) );
+            if( index != -1 ) {
+                twoLetterTagTypes[ index ] = messageTags[i].type;
+                }
+            }
+        twoLetterTagTypesBuilt = true;
+        }
+    
+    int index = getTwoLetterTagIndex( inTag, inTagLength );
     
-    char *firstBreak = strstr( copy, "\n" );
+    if( index != -1 ) {
+        return twoLetterTagTypes[ index ];
+        }
+    
+    // longer tags, from login and shutdown, are rare
+    for( unsigned int i=0; i<NUM_MESSAGE_TAGS; i++ ) {
+        const char *tag = messageTags[i].tag;
+        
+        if( (int)strlen( tag ) == inTagLength &&
+            memcmp( tag, inTag, inTagLength ) == 0 ) {
+            return messageTags[i].type;
+            }
+        }
+    return UNKNOWN;
+    }
+
+
+
+// type from first line of message, without copying it
+messageType getMessageType( const char *inMessage, int inLength ) {
+    const char *firstBreak = 
+        (const char*)memchr( inMessage, '\n', inLength );
     
     if( firstBreak == NULL ) {
-        delete [] copy;
         return UNKNOWN;
         }
     
-    firstBreak[0] = '\0';
-    
-    messageType returnValue = UNKNOWN;
+    return getMessageTypeFromTag( inMessage, firstBreak - inMessage );
+    }
 
-    if( strcmp( copy, "CM" ) == 0 ) {
-        returnValue = COMPRESSED_MESSAGE;
-        }
-    else if( strcmp( copy, "MC" ) == 0 ) {
-        returnValue = MAP_CHUNK;
-        }
-    else if( strcmp( copy, "MX" ) == 0 ) {
-        returnValue = MAP_CHANGE;
-        }
-    else if( strcmp( copy, "PU" ) == 0 ) {
-        returnValue = PLAYER_UPDATE;
-        }
-    else if( strcmp( copy, "PM" ) == 0 ) {
-        returnValue = PLAYER_MOVES_START;
-        }
-    else if( strcmp( copy, "PO" ) == 0 ) {
-        returnValue = PLAYER_OUT_OF_RANGE;
-        }
-    else if( strcmp( copy, "BW" ) == 0 ) {
-        returnValue = BABY_WIGGLE;
-        }
-    else if( strcmp( copy, "PS" ) == 0 ) {
-        returnValue = PLAYER_SAYS;
-        }
-    else if( strcmp( copy, "LS" ) == 0 ) {
-        returnValue = LOCATION_SAYS;
-        }
-    else if( strcmp( copy, "PE" ) == 0 ) {
-        returnValue = PLAYER_EMOT;
-        }
-    else if( strcmp( copy, "FX" ) == 0 ) {
-        returnValue = FOOD_CHANGE;
-        }
-    else if( strcmp( copy, "HX" ) == 0 ) {
-        returnValue = HEAT_CHANGE;
-        }
-    else if( strcmp( copy, "LN" ) == 0 ) {
-        returnValue = LINEAGE;
-        }
-    else if( strcmp( copy, "CU" ) == 0 ) {
-        returnValue = CURSED;
-        }
-    else if( strcmp( copy, "CX" ) == 0 ) {
-        returnValue = CURSE_TOKEN_CHANGE;
-        }
-    else if( strcmp( copy, "CS" ) == 0 ) {
-        returnValue = CURSE_SCORE;
-        }
-    else if( strcmp( copy, "NM" ) == 0 ) {
-        returnValue = NAMES;
-        }
-    else if( strcmp( copy, "AP" ) == 0 ) {
-        returnValue = APOCALYPSE;
-        }
-    else if( strcmp( copy, "AD" ) == 0 ) {
-        returnValue = APOCALYPSE_DONE;
-        }
-    else if( strcmp( copy, "DY" ) == 0 ) {
-        returnValue = DYING;
-        }
-    else if( strcmp( copy, "HE" ) == 0 ) {
-        returnValue = HEALED;
-        }
-    else if( strcmp( copy, "PJ" ) == 0 ) {
-        returnValue = POSSE_JOIN;
-        }
-    else if( strcmp( copy, "MN" ) == 0 ) {
-        returnValue = MONUMENT_CALL;
-        }
-    else if( strcmp( copy, "GV" ) == 0 ) {
-        returnValue = GRAVE;
-        }
-    else if( strcmp( copy, "GM" ) == 0 ) {
-        returnValue = GRAVE_MOVE;
-        }
-    else if( strcmp( copy, "GO" ) == 0 ) {
-        returnValue = GRAVE_OLD;
-        }
-    else if( strcmp( copy, "OW" ) == 0 ) {
-        returnValue = OWNER;
-        }
-    else if( strcmp( copy, "FW" ) == 0 ) {
-        returnValue = FOLLOWING;
-        }
-    else if( strcmp( copy, "EX" ) == 0 ) {
-        returnValue = EXILED;
-        }
-    else if( strcmp( copy, "VS" ) == 0 ) {
-        returnValue = VALLEY_SPACING;
-        }
-    else if( strcmp( copy, "FD" ) == 0 ) {
-        returnValue = FLIGHT_DEST;
-        }
-    else if( strcmp( copy, "BB" ) == 0 ) {
-        returnValue = BAD_BIOMES;
-        }
-    else if( strcmp( copy, "VU" ) == 0 ) {
-        returnValue = VOG_UPDATE;
-        }
-    else if( strcmp( copy, "PH" ) == 0 ) {
-        returnValue = PHOTO_SIGNATURE;
-        }
-    else if( strcmp( copy, "PONG" ) == 0 ) {
-        returnValue = PONG;
-        }
-    else if( strcmp( copy, "SHUTDOWN" ) == 0 ) {
-        returnValue = SHUTDOWN;
-        }
-    else if( strcmp( copy, "SERVER_FULL" ) == 0 ) {
-        returnValue = SERVER_FULL;
-        }
-    else if( strcmp( copy, "SN" ) == 0 ) {
-        returnValue = SEQUENCE_NUMBER;
-        }
-    else if( strcmp( copy, "ACCEPTED" ) == 0 ) {
-        returnValue = ACCEPTED;
-        }
-    else if( strcmp( copy, "REJECTED" ) == 0 ) {
-        returnValue = REJECTED;
-        }
-    else if( strcmp( copy, "NO_LIFE_TOKENS" ) == 0 ) {
-        returnValue = NO_LIFE_TOKENS;
-        }
-    else if( strcmp( copy, "SD" ) == 0 ) {
-        returnValue = FORCED_SHUTDOWN;
-        }
-    else if( strcmp( copy, "MS" ) == 0 ) {
-        returnValue = GLOBAL_MESSAGE;
-        }
-    else if( strcmp( copy, "WR" ) == 0 ) {
-        returnValue = WAR_REPORT;
-        }
-    else if( strcmp( copy, "LR" ) == 0 ) {
-        returnValue = LEARNED_TOOL_REPORT;
-        }
-    else if( strcmp( copy, "TE" ) == 0 ) {
-        returnValue = TOOL_EXPERTS;
-        }
-    else if( strcmp( copy, "TS" ) == 0 ) {
-        returnValue = TOOL_SLOTS;
-        }
-    else if( strcmp( copy, "HL" ) == 0 ) {
-        returnValue = HOMELAND;
-        }
-    else if( strcmp( copy, "FL" ) == 0 ) {
-        returnValue = FLIP;
-        }
-    else if( strcmp( copy, "CR" ) == 0 ) {
-        returnValue = CRAVING;
+
+
+messageType getMessageType( char *inMessage ) {
+    const char *firstBreak = strchr( inMessage, '\n' );
+    
+    if( firstBreak == NULL ) {
+        return UNKNOWN;
         }
     
-    delete [] copy;
-    return returnValue;
+    return getMessageTypeFromTag( inMessage, firstBreak - inMessage );
     }
 
 
@@ -1679,20 +1642,14 @@ char *getNextServerMessageRaw() {
         if( serverSocketBuffer.size() >= pendingCMCompressedSize ) {
             pendingCMData = false;
             
-            unsigned char *compressedData = 
-                new unsigned char[ pendingCMCompressedSize ];
-            
-            for( int i=0; i<pendingCMCompressedSize; i++ ) {
-                compressedData[i] = serverSocketBuffer.getElementDirect( i );
-                }
-            serverSocketBuffer.deleteStartElements( pendingCMCompressedSize );
-            
+            // decompress straight out of receive buffer
             unsigned char *decompressedMessage =
-                zipDecompress( compressedData, 
-                               pendingCMCompressedSize,
-                               pendingCMDecompressedSize );
+                zipDecompress( 
+                    (unsigned char*)serverSocketBuffer.getBytes(), 
+                    pendingCMCompressedSize,
+                    pendingCMDecompressedSize );
 
-            delete [] compressedData;
+            serverSocketBuffer.consume( pendingCMCompressedSize );
 
             if( decompressedMessage == NULL ) {
                 printf( "Decompressing CM message failed\n" );
@@ -1720,9 +1677,9 @@ char *getNextServerMessageRaw() {
 
     // find first terminal character #
 
-    int index = serverSocketBuffer.getElementIndex( '#' );
-        
-    if( index == -1 ) {
+    MessageView view;
+    
+    if( ! serverSocketBuffer.findMessage( &view ) ) {
         return NULL;
         }
 
@@ -1740,28 +1697,24 @@ char *getNextServerMessageRaw() {
 
 
     
-    char *message = new char[ index + 1 ];
+    messageType type = getMessageType( view.start, view.length );
     
-    for( int i=0; i<index; i++ ) {
-        message[i] = (char)( serverSocketBuffer.getElementDirect( i ) );
-        }
     // delete message and terminal character
-    serverSocketBuffer.deleteStartElements( index + 1 );
-    
-    message[ index ] = '\0';
+    char *message = serverSocketBuffer.takeMessage( &view );
 
-    if( getMessageType( message ) == MAP_CHUNK ) {
+    if( type == MAP_CHUNK ) {
         pendingMapChunkMessage = message;
         
         int sizeX, sizeY, x, y, binarySize;
-        sscanf( message, "MC\n%d %d %d %d\n%d %d\n", 
+        // header same for MC and MB
+        sscanf( message, "M%*c\n%d %d %d %d\n%d %d\n", 
                 &sizeX, &sizeY,
                 &x, &y, &binarySize, &pendingCompressedChunkSize );
 
 
         return getNextServerMessageRaw();
         }
-    else if( getMessageType( message ) == COMPRESSED_MESSAGE ) {
+    else if( type == COMPRESSED_MESSAGE ) {
         pendingCMData = true;
         
         printf( "Got compressed message header:\n%s\n\n", message );
@@ -12028,6 +11981,132 @@ void LivingLifePage::applyReceiveOffset( int *inX, int *inY ) {
 
 
 
+// reads next varint of an MB chunk body into outValues
+// returns false if body ends before it, or it is malformed
+static char readChunkValue( unsigned char *inData, int inLength, int *ioPos,
+                            SimpleVector<int> *outValues, 
+                            int *outValue ) {
+    int numRead = readChunkVarInt( &( inData[ *ioPos ] ), 
+                                   inLength - *ioPos, outValue );
+    if( numRead == 0 ) {
+        return false;
+        }
+    *ioPos += numRead;
+    
+    outValues->push_back( *outValue );
+    return true;
+    }
+
+
+
+void LivingLifePage::readBinaryMapChunk( unsigned char *inData, 
+                                         int inLength,
+                                         int inSizeX, int inSizeY, 
+                                         int inX, int inY ) {
+    int numCells = inSizeX * inSizeY;
+    
+    // decode whole body first, and apply none of it if it is truncated
+    // or malformed, like an MC chunk with the wrong number of cells
+    SimpleVector<int> values;
+    
+    int pos = 0;
+    
+    for( int i=0; i<numCells; i++ ) {
+        int v;
+        
+        // biome, floor, object
+        for( int f=0; f<3; f++ ) {
+            if( ! readChunkValue( inData, inLength, &pos, &values, &v ) ) {
+                return;
+                }
+            }
+        
+        int numContained;
+        if( ! readChunkValue( inData, inLength, &pos, &values, 
+                              &numContained ) ||
+            numContained < 0 ) {
+            return;
+            }
+        
+        for( int c=0; c<numContained; c++ ) {
+            int numSubCont;
+            
+            if( ! readChunkValue( inData, inLength, &pos, &values, &v ) ||
+                ! readChunkValue( inData, inLength, &pos, &values, 
+                                  &numSubCont ) ||
+                numSubCont < 0 ) {
+                return;
+                }
+            
+            for( int s=0; s<numSubCont; s++ ) {
+                if( ! readChunkValue( inData, inLength, &pos, &values, 
+                                      &v ) ) {
+                    return;
+                    }
+                }
+            }
+        }
+    
+    if( pos != inLength ) {
+        // extra data after last cell
+        return;
+        }
+    
+    
+    int next = 0;
+    
+    for( int i=0; i<numCells; i++ ) {
+        int biome = values.getElementDirect( next++ );
+        int floorID = values.getElementDirect( next++ );
+        int id = values.getElementDirect( next++ );
+        int numContained = values.getElementDirect( next++ );
+        
+        int cX = i % inSizeX;
+        int cY = i / inSizeX;
+        
+        int mapX = cX + inX - mMapOffsetX + mMapD / 2;
+        int mapY = cY + inY - mMapOffsetY + mMapD / 2;
+        
+        char inMap = 
+            mapX >= 0 && mapX < mMapD &&
+            mapY >= 0 && mapY < mMapD;
+        
+        int mapI = mapY * mMapD + mapX;
+        
+        if( inMap ) {
+            mMapBiomes[mapI] = biome;
+            mMapFloors[mapI] = floorID;
+            
+            if( mMap[mapI] != id ) {
+                // our placement status cleared
+                mMapPlayerPlacedFlags[mapI] = false;
+                }
+            mMap[mapI] = id;
+
+            mMapContainedStacks[mapI].deleteAll();
+            mMapSubContainedStacks[mapI].deleteAll();
+            }
+        
+        for( int c=0; c<numContained; c++ ) {
+            int contained = values.getElementDirect( next++ );
+            int numSubCont = values.getElementDirect( next++ );
+            
+            SimpleVector<int> newSubStack;
+            
+            for( int s=0; s<numSubCont; s++ ) {
+                newSubStack.push_back( values.getElementDirect( next++ ) );
+                }
+            
+            if( inMap ) {
+                mMapContainedStacks[mapI].push_back( contained );
+                mMapSubContainedStacks[mapI].push_back( newSubStack );
+                }
+            }
+        }
+    }
+
+
+
 int LivingLifePage::sendX( int inX ) {
     if( mMapGlobalOffsetSet ) {
         return inX + mMapGlobalOffset.x;
@@ -15138,6 +15217,12 @@ void LivingLifePage::step() {
 
             SettingsManager::setSetting( "loginSuccess", 1 );
 
+            if( outputMapMode != 1 ) {
+                // map output works on MC text tokens, so only
+                // ask for MB if it's off
+                sendToServerSocket( (char*)"CFMT 0 0 1#" );
+                }
+
             delete [] message;
             return;
             }
@@ -15778,9 +15863,12 @@ void LivingLifePage::step() {
             int binarySize = 0;
             int compressedSize = 0;
             
-            sscanf( message, "MC\n%d %d %d %d\n%d %d\n", 
+            // header same for MC and MB
+            sscanf( message, "M%*c\n%d %d %d %d\n%d %d\n", 
                     &sizeX, &sizeY, &x, &y, &binarySize, &compressedSize );
             
+            char binaryFormat = ( message[1] == 'B' );
+            
             printf( "Got map chunk with bin size %d, compressed size %d\n", 
                     binarySize, compressedSize );
             
@@ -16045,11 +16133,9 @@ void LivingLifePage::step() {
             unsigned char *compressedChunk = 
                 new unsigned char[ compressedSize ];
     
-            
-            for( int i=0; i<compressedSize; i++ ) {
-                compressedChunk[i] = serverSocketBuffer.getElementDirect( i );
-                }
-            serverSocketBuffer.deleteStartElements( compressedSize );
+            memcpy( compressedChunk, serverSocketBuffer.getBytes(),
+                    compressedSize );
+            serverSocketBuffer.consume( compressedSize );
 
             
             unsigned char *decompressedChunk =
@@ -16059,9 +16145,17 @@ void LivingLifePage::step() {
             
             delete [] compressedChunk;
             
+            char chunkDecompressed = ( decompressedChunk != NULL );
+            
             if( decompressedChunk == NULL ) {
                 printf( "Decompressing chunk failed\n" );
                 }
+            else if( binaryFormat ) {
+                readBinaryMapChunk( decompressedChunk, binarySize,
+                                    sizeX, sizeY, x, y );
+                
+                delete [] decompressedChunk;
+                }
             else {
                 
                 unsigned char *binaryChunk = 
@@ -16176,6 +16270,9 @@ void LivingLifePage::step() {
                 
                 tokens->deallocateStringElements();
                 delete tokens;
+                }
+            
+            if( chunkDecompressed ) {
                 
                 if( !( mFirstServerMessagesReceived & 1 ) ) {
                     // first map chunk just recieved
@@ -23428,7 +23525,7 @@ void LivingLifePage::makeActive( char inFresh ) {
     lastPongReceived = 0;
     
 
-    serverSocketBuffer.deleteAll();
+    serverSocketBuffer.clear();
 
     if( nextActionMessageToSend != NULL ) {    
         delete [] nextActionMessageToSend;
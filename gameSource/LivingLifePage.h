@@ -630,6 +630,13 @@ class LivingLifePage : public GamePage, public ActionListener {
 
         // conversion function for received coordinates into local coords
         void applyReceiveOffset( int *inX, int *inY );
+
+        // fills in map cells from a decompressed MB chunk body
+        // changes nothing if body is truncated or malformed
+        // inX, inY already converted to local coords
+        void readBinaryMapChunk( unsigned char *inData, int inLength,
+                                 int inSizeX, int inSizeY, 
+                                 int inX, int inY );
 		public: // hetuw mod
 		bool hetuwUsesGlobalOffset();
         // converts local coors for sending back to server
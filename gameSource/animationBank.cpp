@@ -20,6 +20,7 @@
 #include "hetuwmod.h"
 
 #include "folderCache.h"
+#include "bankSnapshot.h"
 
 #include "spriteDrawColorOverride.h"
 
@@ -91,6 +92,134 @@ static char shouldFileBeCached( char *inFileName ) {
 
 
 
+// all records came from animations/cache.snap
+static char loadedFromSnapshot = false;
+
+
+// bump when AnimationRecord or its parts change
+#define ANIMATION_SNAPSHOT_VERSION 1
+
+
+
+static void addAnimationToRecords( AnimationRecord *r ) {
+    records.push_back( r );
+    
+    if( r->objectID > maxID ) {
+        maxID = r->objectID;
+        }
+    }
+
+
+
+// animation as parsed from its file, before initAnimationBankFinish
+static void writeAnimationSnapshot( BankSnapshotWriter *inWriter,
+                                    AnimationRecord *r ) {
+    // plain fields, pointers are replaced on read
+    inWriter->writeBytes( r, sizeof( AnimationRecord ) );
+    
+    inWriter->writeArray( r->soundAnim, r->numSounds );
+    
+    for( int i=0; i<r->numSounds; i++ ) {
+        SoundUsage u = r->soundAnim[i].sound;
+        
+        inWriter->writeArray( u.ids, u.numSubSounds );
+        inWriter->writeArray( u.volumes, u.numSubSounds );
+        }
+    
+    inWriter->writeArray( r->spriteAnim, r->numSprites );
+    inWriter->writeArray( r->slotAnim, r->numSlots );
+    
+    inWriter->endRecord();
+    }
+
+
+
+static AnimationRecord *readAnimationSnapshot( BankSnapshotReader *inReader ) {
+    AnimationRecord *r = new AnimationRecord;
+    
+    inReader->readBytes( r, sizeof( AnimationRecord ) );
+    
+    r->soundAnim = inReader->readArray<SoundAnimationRecord>( r->numSounds );
+    
+    if( r->soundAnim == NULL ) {
+        // bad snapshot, don't trust the counts below
+        r->numSounds = 0;
+        }
+    
+    for( int i=0; i<r->numSounds; i++ ) {
+        SoundUsage *u = &( r->soundAnim[i].sound );
+        
+        u->ids = inReader->readArray<int>( u->numSubSounds );
+        u->volumes = inReader->readArray<double>( u->numSubSounds );
+        }
+    
+    r->spriteAnim = 
+        inReader->readArray<SpriteAnimationRecord>( r->numSprites );
+    r->slotAnim = 
+        inReader->readArray<SpriteAnimationRecord>( r->numSlots );
+    
+    return r;
+    }
+
+
+
+static char loadAnimationSnapshot() {
+    BankSnapshotReader *reader = 
+        openBankSnapshot( cache, "animations", 
+                          ANIMATION_SNAPSHOT_VERSION, 
+                          sizeof( AnimationRecord ) );
+
+    if( reader == NULL ) {
+        return false;
+        }
+    
+    SimpleVector<AnimationRecord*> loaded;
+
+    int numRecords = reader->getNumRecords();
+    
+    for( int i=0; i<numRecords && reader->isGood(); i++ ) {
+        loaded.push_back( readAnimationSnapshot( reader ) );
+        }
+
+    if( ! reader->isGood() ) {
+        // only happens if snapshot was damaged after its header was
+        // checked, partial records are leaked
+        discardBankSnapshot( reader, "animations" );
+        return false;
+        }
+
+    delete reader;
+
+    for( int i=0; i<loaded.size(); i++ ) {
+        addAnimationToRecords( loaded.getElementDirect( i ) );
+        }
+    
+    printf( "Loaded %d animations from snapshot\n", loaded.size() );
+
+    return true;
+    }
+
+
+
+static void saveAnimationSnapshot() {
+    BankSnapshotWriter *writer = 
+        startBankSnapshot( cache, 
+                           ANIMATION_SNAPSHOT_VERSION, 
+                           sizeof( AnimationRecord ) );
+    
+    if( writer == NULL ) {
+        return;
+        }
+
+    for( int i=0; i<records.size(); i++ ) {
+        writeAnimationSnapshot( writer, records.getElementDirect( i ) );
+        }
+    
+    finishBankSnapshot( writer, "animations" );
+    }
+
+
+
 
 int initAnimationBankStart( char *outRebuildingCache ) {
 
@@ -182,6 +311,13 @@ int initAnimationBankStart( char *outRebuildingCache ) {
     cache = initFolderCache( "animations", outRebuildingCache,
                              shouldFileBeCached );
 
+    loadedFromSnapshot = loadAnimationSnapshot();
+    
+    if( loadedFromSnapshot ) {
+        // all loaded, one step to finish
+        return 1;
+        }
+
     return cache.numFiles;
     }
 
@@ -189,7 +325,7 @@ int initAnimationBankStart( char *outRebuildingCache ) {
 
 float initAnimationBankStep() {
         
-    if( currentFile == cache.numFiles ) {
+    if( loadedFromSnapshot || currentFile == cache.numFiles ) {
         return 1.0;
         }
     
@@ -219,10 +355,6 @@ float initAnimationBankStep() {
                 sscanf( lines[next], "id=%d", 
                         &( r->objectID ) );
                             
-                if( r->objectID > maxID ) {
-                    maxID = r->objectID;
-                    }
-                            
                 next++;
 
                             
@@ -268,6 +400,11 @@ float initAnimationBankStep() {
                     }
                 r->soundAnim = new SoundAnimationRecord[ r->numSounds ];
 
+                for( int j=0; j< r->numSounds; j++ ) {
+                    // in case file ends early
+                    r->soundAnim[j].sound = blankSoundUsage;
+                    }
+
                 if( r->numSounds > 0 ) {
                     
                     for( int j=0; j< r->numSounds && next < numLines; j++ ) {
@@ -454,7 +591,7 @@ float initAnimationBankStep() {
                     }
                             
 
-                records.push_back( r );
+                addAnimationToRecords( r );
                 }
             for( int j=0; j<numLines; j++ ) {
                 delete [] lines[j];
@@ -473,6 +610,10 @@ float initAnimationBankStep() {
 
 void initAnimationBankFinish() {
     
+    if( ! loadedFromSnapshot ) {
+        saveAnimationSnapshot();
+        }
+
     freeFolderCache( cache );
     
     mapSize = maxID + 1;
@@ -0,0 +1,431 @@
+#include "bankSnapshot.h"
+
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/SettingsManager.h"
+#include "minorGems/io/file/File.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+#if defined(__linux__) || defined(__APPLE__)
+#define USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+
+// bump when header or encoding of fields changes
+#define SNAPSHOT_FORMAT_VERSION 1
+
+#define SOURCE_HASH_LENGTH 64
+
+
+static const char *snapshotMagic = "OLBS";
+
+
+typedef struct SnapshotHeader {
+        char magic[4];
+        int formatVersion;
+        int bankVersion;
+
+        // catch snapshots made by a build with a different layout
+        int recordSize;
+        int pointerSize;
+        int byteOrderCheck;
+
+        char sourceHash[ SOURCE_HASH_LENGTH ];
+
+        int numRecords;
+        int dataLength;
+        int stringsLength;
+    } SnapshotHeader;
+
+
+
+static void fillHeader( SnapshotHeader *outHeader,
+                        int inBankVersion, int inRecordSize,
+                        const char *inSourceHash ) {
+    memset( outHeader, 0, sizeof( SnapshotHeader ) );
+
+    memcpy( outHeader->magic, snapshotMagic, 4 );
+    outHeader->formatVersion = SNAPSHOT_FORMAT_VERSION;
+    outHeader->bankVersion = inBankVersion;
+    outHeader->recordSize = inRecordSize;
+    outHeader->pointerSize = sizeof( void* );
+    outHeader->byteOrderCheck = 0x01020304;
+
+    strncpy( outHeader->sourceHash, inSourceHash, SOURCE_HASH_LENGTH - 1 );
+    }
+
+
+
+BankSnapshotWriter::BankSnapshotWriter( int inBankVersion, int inRecordSize,
+                                        const char *inSourceHash )
+        : mBankVersion( inBankVersion ),
+          mRecordSize( inRecordSize ),
+          mSourceHash( stringDuplicate( inSourceHash ) ),
+          mNumRecords( 0 ) {
+    }
+
+
+
+BankSnapshotWriter::~BankSnapshotWriter() {
+    delete [] mSourceHash;
+    }
+
+
+
+void BankSnapshotWriter::writeInt( int inValue ) {
+    writeBytes( &inValue, sizeof( int ) );
+    }
+
+
+
+void BankSnapshotWriter::writeBytes( const void *inBytes, int inLength ) {
+    mData.appendArray( (unsigned char*)inBytes, inLength );
+    }
+
+
+
+void BankSnapshotWriter::writeString( const char *inString ) {
+    if( inString == NULL ) {
+        writeInt( -1 );
+        return;
+        }
+
+    writeInt( mStrings.size() );
+
+    mStrings.appendArray( (char*)inString, strlen( inString ) + 1 );
+    }
+
+
+
+void BankSnapshotWriter::endRecord() {
+    mNumRecords++;
+    }
+
+
+
+char BankSnapshotWriter::writeToFile( const char *inPath ) {
+    SnapshotHeader header;
+    fillHeader( &header, mBankVersion, mRecordSize, mSourceHash );
+
+    header.numRecords = mNumRecords;
+    header.dataLength = mData.size();
+    header.stringsLength = mStrings.size();
+
+    char *tempPath = autoSprintf( "%s.tmp", inPath );
+
+    FILE *f = fopen( tempPath, "wb" );
+
+    if( f == NULL ) {
+        delete [] tempPath;
+        return false;
+        }
+
+    char good = true;
+
+    if( fwrite( &header, sizeof( header ), 1, f ) != 1 ) {
+        good = false;
+        }
+
+    if( good && mData.size() > 0 ) {
+        unsigned char *data = mData.getElementArray();
+
+        if( fwrite( data, mData.size(), 1, f ) != 1 ) {
+            good = false;
+            }
+        delete [] data;
+        }
+
+    if( good && mStrings.size() > 0 ) {
+        char *strings = mStrings.getElementArray();
+
+        if( fwrite( strings, mStrings.size(), 1, f ) != 1 ) {
+            good = false;
+            }
+        delete [] strings;
+        }
+
+    if( fclose( f ) != 0 ) {
+        good = false;
+        }
+
+    if( good ) {
+        // rename won't replace an existing file everywhere
+        remove( inPath );
+
+        if( rename( tempPath, inPath ) != 0 ) {
+            good = false;
+            }
+        }
+
+    if( ! good ) {
+        remove( tempPath );
+        }
+
+    delete [] tempPath;
+
+    return good;
+    }
+
+
+
+BankSnapshotReader::BankSnapshotReader( const char *inPath,
+                                        int inBankVersion, int inRecordSize,
+                                        const char *inSourceHash )
+        : mGood( false ),
+          mNumRecords( 0 ),
+          mFileBytes( NULL ),
+          mFileLength( 0 ),
+          mData( NULL ),
+          mDataLength( 0 ),
+          mNextByte( 0 ),
+          mStrings( NULL ),
+          mStringsLength( 0 ) {
+
+#ifdef USE_MMAP
+    int fd = open( inPath, O_RDONLY );
+
+    if( fd == -1 ) {
+        return;
+        }
+
+    struct stat fileStat;
+
+    if( fstat( fd, &fileStat ) == 0 &&
+        fileStat.st_size >= (off_t)sizeof( SnapshotHeader ) ) {
+
+        void *mapped = mmap( NULL, fileStat.st_size, PROT_READ,
+                             MAP_PRIVATE, fd, 0 );
+
+        if( mapped != MAP_FAILED ) {
+            mFileBytes = (unsigned char*)mapped;
+            mFileLength = fileStat.st_size;
+            }
+        }
+    close( fd );
+#else
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        return;
+        }
+
+    fseek( f, 0, SEEK_END );
+    long length = ftell( f );
+    fseek( f, 0, SEEK_SET );
+
+    if( length >= (long)sizeof( SnapshotHeader ) ) {
+        mFileBytes = new unsigned char[ length ];
+
+        if( fread( mFileBytes, length, 1, f ) == 1 ) {
+            mFileLength = length;
+            }
+        else {
+            delete [] mFileBytes;
+            mFileBytes = NULL;
+            }
+        }
+    fclose( f );
+#endif
+
+    if( mFileBytes == NULL ) {
+        return;
+        }
+
+
+    SnapshotHeader expected;
+    fillHeader( &expected, inBankVersion, inRecordSize, inSourceHash );
+
+    SnapshotHeader header;
+    memcpy( &header, mFileBytes, sizeof( header ) );
+
+    if( memcmp( header.magic, expected.magic, 4 ) != 0 ||
+        header.formatVersion != expected.formatVersion ||
+        header.bankVersion != expected.bankVersion ||
+        header.recordSize != expected.recordSize ||
+        header.pointerSize != expected.pointerSize ||
+        header.byteOrderCheck != expected.byteOrderCheck ||
+        memcmp( header.sourceHash, expected.sourceHash,
+                SOURCE_HASH_LENGTH ) != 0 ) {
+        return;
+        }
+
+    if( header.numRecords < 0 ||
+        header.dataLength < 0 || header.stringsLength < 0 ||
+        (long)sizeof( header ) + header.dataLength + header.stringsLength
+        != mFileLength ) {
+        return;
+        }
+
+    mNumRecords = header.numRecords;
+
+    mData = &( mFileBytes[ sizeof( header ) ] );
+    mDataLength = header.dataLength;
+
+    mStrings = (const char*)&( mData[ mDataLength ] );
+    mStringsLength = header.stringsLength;
+
+    if( mStringsLength > 0 && mStrings[ mStringsLength - 1 ] != '\0' ) {
+        return;
+        }
+
+    mGood = true;
+    }
+
+
+
+BankSnapshotReader::~BankSnapshotReader() {
+    if( mFileBytes != NULL ) {
+#ifdef USE_MMAP
+        munmap( mFileBytes, mFileLength );
+#else
+        delete [] mFileBytes;
+#endif
+        }
+    }
+
+
+
+int BankSnapshotReader::readInt() {
+    int value = 0;
+    readBytes( &value, sizeof( int ) );
+    return value;
+    }
+
+
+
+void BankSnapshotReader::readBytes( void *outBytes, int inLength ) {
+    if( ! mGood || inLength > mDataLength - mNextByte ) {
+        mGood = false;
+        memset( outBytes, 0, inLength );
+        return;
+        }
+
+    memcpy( outBytes, &( mData[ mNextByte ] ), inLength );
+    mNextByte += inLength;
+    }
+
+
+
+char *BankSnapshotReader::readString() {
+    int offset = readInt();
+
+    if( offset == -1 ) {
+        return NULL;
+        }
+
+    if( offset < 0 || offset >= mStringsLength ) {
+        mGood = false;
+        return stringDuplicate( "" );
+        }
+
+    return stringDuplicate( &( mStrings[ offset ] ) );
+    }
+
+
+
+static char *getSnapshotPath( const char *inFolderName ) {
+    File folder( NULL, inFolderName );
+
+    File *snapshotFile = folder.getChildFile( "cache.snap" );
+
+    char *path = snapshotFile->getFullFileName();
+
+    delete snapshotFile;
+
+    return path;
+    }
+
+
+
+static char snapshotsEnabled() {
+    return SettingsManager::getIntSetting( "useBankSnapshots", 1 );
+    }
+
+
+
+BankSnapshotReader *openBankSnapshot( FolderCache inCache,
+                                      const char *inFolderName,
+                                      int inBankVersion, int inRecordSize ) {
+    if( inCache.dataBlock == NULL || ! snapshotsEnabled() ) {
+        return NULL;
+        }
+
+    char *hash = getFolderCacheHash( inCache );
+
+    if( hash == NULL ) {
+        return NULL;
+        }
+
+    char *path = getSnapshotPath( inFolderName );
+
+    BankSnapshotReader *reader =
+        new BankSnapshotReader( path, inBankVersion, inRecordSize, hash );
+
+    delete [] path;
+    delete [] hash;
+
+    if( ! reader->isGood() ) {
+        delete reader;
+        return NULL;
+        }
+
+    return reader;
+    }
+
+
+
+BankSnapshotWriter *startBankSnapshot( FolderCache inCache,
+                                       int inBankVersion, int inRecordSize ) {
+    if( ! snapshotsEnabled() ) {
+        return NULL;
+        }
+
+    char *hash = getFolderCacheHash( inCache );
+
+    if( hash == NULL ) {
+        return NULL;
+        }
+
+    BankSnapshotWriter *writer =
+        new BankSnapshotWriter( inBankVersion, inRecordSize, hash );
+
+    delete [] hash;
+
+    return writer;
+    }
+
+
+
+void finishBankSnapshot( BankSnapshotWriter *inWriter,
+                         const char *inFolderName ) {
+    char *path = getSnapshotPath( inFolderName );
+
+    if( ! inWriter->writeToFile( path ) ) {
+        printf( "Failed to write bank snapshot %s\n", path );
+        }
+
+    delete [] path;
+    delete inWriter;
+    }
+
+
+
+void discardBankSnapshot( BankSnapshotReader *inReader,
+                          const char *inFolderName ) {
+    delete inReader;
+
+    char *path = getSnapshotPath( inFolderName );
+
+    printf( "Bank snapshot %s is bad, removing it\n", path );
+
+    remove( path );
+
+    delete [] path;
+    }
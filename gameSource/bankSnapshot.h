@@ -0,0 +1,176 @@
+#ifndef BANK_SNAPSHOT_INCLUDED
+#define BANK_SNAPSHOT_INCLUDED
+
+
+#include "minorGems/util/SimpleVector.h"
+
+#include "folderCache.h"
+
+
+// binary snapshot of the records a bank parsed from its text files
+//
+// Loading a bank from a snapshot skips splitting and scanning each text
+// record.  A snapshot is only used if it was made from exactly the same
+// folder cache contents (see getFolderCacheHash), by a build with the same
+// record layout.
+//
+// File layout:
+//   header (magic, format version, layout checks, source hash,
+//           record count, data length, string table length)
+//   data:  records, each as flat fields and arrays
+//   string table:  \0-terminated strings, referenced by offset from data
+//
+// Snapshots are native-endian and layout-specific, so they're never
+// shipped, only made locally after a successful text load.
+
+
+
+class BankSnapshotWriter {
+    public:
+
+        // inBankVersion changes whenever a bank's record format changes
+        // inSourceHash is copied
+        BankSnapshotWriter( int inBankVersion, int inRecordSize,
+                            const char *inSourceHash );
+
+        ~BankSnapshotWriter();
+
+
+        void writeInt( int inValue );
+
+        void writeBytes( const void *inBytes, int inLength );
+
+        // NULL allowed
+        void writeString( const char *inString );
+
+        // NULL allowed
+        template <class T>
+        void writeArray( const T *inArray, int inNumElements ) {
+            writeInt( inArray != NULL );
+
+            if( inArray != NULL && inNumElements > 0 ) {
+                writeBytes( inArray, inNumElements * sizeof( T ) );
+                }
+            }
+
+
+        // call after writing each record
+        void endRecord();
+
+
+        // writes to a temp file, then moves it into place
+        // returns true on success
+        char writeToFile( const char *inPath );
+
+    private:
+
+        int mBankVersion;
+        int mRecordSize;
+        char *mSourceHash;
+
+        int mNumRecords;
+
+        SimpleVector<unsigned char> mData;
+        SimpleVector<char> mStrings;
+    };
+
+
+
+class BankSnapshotReader {
+    public:
+
+        // opens and checks header, mapping file into memory where possible
+        // check isGood before reading
+        BankSnapshotReader( const char *inPath,
+                            int inBankVersion, int inRecordSize,
+                            const char *inSourceHash );
+
+        ~BankSnapshotReader();
+
+
+        // true if file exists and matches version, layout, and hash
+        // false once any read runs past end of data
+        char isGood() {
+            return mGood;
+            }
+
+
+        int getNumRecords() {
+            return mNumRecords;
+            }
+
+
+        int readInt();
+
+        void readBytes( void *outBytes, int inLength );
+
+        // NULL if written as NULL
+        // destroyed by caller
+        char *readString();
+
+        // NULL if written as NULL
+        // destroyed by caller
+        template <class T>
+        T *readArray( int inNumElements ) {
+            if( ! readInt() ) {
+                return NULL;
+                }
+            T *array = new T[ inNumElements ];
+
+            if( inNumElements > 0 ) {
+                readBytes( array, inNumElements * sizeof( T ) );
+                }
+            return array;
+            }
+
+
+    private:
+
+        char mGood;
+
+        int mNumRecords;
+
+        unsigned char *mFileBytes;
+        int mFileLength;
+
+        const unsigned char *mData;
+        int mDataLength;
+        int mNextByte;
+
+        const char *mStrings;
+        int mStringsLength;
+    };
+
+
+
+// Helpers for banks loaded through a FolderCache, snapshot kept in
+// inFolderName/cache.snap
+// Snapshots can be turned off with the useBankSnapshots setting.
+
+
+// returns a reader for a good snapshot of inCache's contents, or NULL
+// inCache must have been loaded from cache.fcz (not rebuilding)
+// result destroyed by caller
+BankSnapshotReader *openBankSnapshot( FolderCache inCache,
+                                      const char *inFolderName,
+                                      int inBankVersion, int inRecordSize );
+
+
+// returns a writer for a snapshot of inCache's contents, or NULL
+// call after all records read, before freeFolderCache
+BankSnapshotWriter *startBankSnapshot( FolderCache inCache,
+                                       int inBankVersion, int inRecordSize );
+
+
+// writes snapshot and destroys inWriter
+void finishBankSnapshot( BankSnapshotWriter *inWriter,
+                         const char *inFolderName );
+
+
+// destroys inReader and removes its snapshot, for when records in it
+// turn out to be bad part-way through loading
+void discardBankSnapshot( BankSnapshotReader *inReader,
+                          const char *inFolderName );
+
+
+#endif
@@ -1,6 +1,7 @@
 #include "folderCache.h"
 
 #include "minorGems/formats/encodingUtils.h"
+#include "minorGems/crypto/hashes/sha1.h"
 
 
 #include "minorGems/system/Time.h"
@@ -346,6 +347,52 @@ char *getFileContents( FolderCache inCache, int inFileNumber ) {
 
 
 
+char *getFolderCacheHash( FolderCache inCache ) {
+    if( inCache.fileRecords == NULL ) {
+        return NULL;
+        }
+    
+    SimpleVector<char> hashData;
+    
+    for( int i=0; i<inCache.numFiles; i++ ) {
+        CacheFileRecord *r = &( inCache.fileRecords[i] );
+        
+        if( inCache.dataBlock == NULL &&
+            ( r->fileName == NULL || r->dataBlockOffset == -1 ) ) {
+            // not read, so won't be in new cache.fcz
+            continue;
+            }
+        
+        char *line = autoSprintf( "%s %d %d\n", 
+                                  r->fileName, r->dataBlockOffset, 
+                                  r->length );
+        hashData.appendElementString( line );
+        delete [] line;
+        }
+    
+    hashData.push_back( '#' );
+    
+    if( inCache.dataBlock != NULL ) {
+        hashData.appendElementString( inCache.dataBlock );
+        }
+    else {
+        char *newData = inCache.newDataBlock->getElementString();
+        hashData.appendElementString( newData );
+        delete [] newData;
+        }
+    
+    int hashDataLength = hashData.size();
+    char *hashBytes = hashData.getElementArray();
+    
+    char *hash = computeSHA1Digest( (unsigned char*)hashBytes, 
+                                    hashDataLength );
+    delete [] hashBytes;
+    
+    return hash;
+    }
+
+
+
 // writes new cache to disk, based on read contents, as needed
 void freeFolderCache( FolderCache inCache ) {
     if( inCache.dataBlock == NULL && 
@@ -1,3 +1,5 @@
+#ifndef FOLDER_CACHE_INCLUDED
+#define FOLDER_CACHE_INCLUDED
 
 #include "minorGems/io/file/File.h"
 #include "minorGems/util/SimpleVector.h"
@@ -47,3 +49,15 @@ char *getFileContents( FolderCache inCache, int inFileNumber );
 // writes new cache to disk, based on read contents, as needed
 void freeFolderCache( FolderCache inCache );
 
+
+
+// SHA1 hex digest of file names and contents, as they will be stored
+// in cache.fcz
+// call after all file contents have been read, before freeFolderCache
+// (same result whether cache was loaded or rebuilt)
+// returns NULL if folder missing
+// destroyed by caller
+char *getFolderCacheHash( FolderCache inCache );
+
+
+#endif
@@ -111,6 +111,7 @@ CustomRandomSource randSource( 34957197 );
 #include "whiteSprites.h"
 
 #include "hetuwmod.h"
+#include "minitech.h"
 #include "message.h"
 
 #ifdef USE_DISCORD
@@ -824,6 +825,10 @@ void freeFrameDrawer() {
     freeObjectBank();
     freeSpriteBank();
 
+    minitech::freeTransIndex();
+    minitech::freeSearchIndex();
+    HetuwMod::freeSearchIndex();
+    
     freeTransBank();
     
     freeCategoryBank();
@@ -2016,6 +2021,23 @@ void drawFrame( char inUpdate ) {
                         
                         loadingPhaseStartTime = Time::getCurrentTime();
 
+                        minitech::initTransIndex();
+                        printf( "Finished building minitech transition "
+                                "index in %f sec\n",
+                                Time::getCurrentTime() - 
+                                loadingPhaseStartTime );
+                        
+                        loadingPhaseStartTime = Time::getCurrentTime();
+
+                        minitech::initSearchIndex();
+                        HetuwMod::initSearchIndex();
+                        printf( "Finished building object search "
+                                "indexes in %f sec\n",
+                                Time::getCurrentTime() - 
+                                loadingPhaseStartTime );
+                        
+                        loadingPhaseStartTime = Time::getCurrentTime();
+
                         loadingPage->setCurrentPhase( 
                             translate( "groundTextures" ) );
 
@@ -1,5 +1,6 @@
 #include "hetuwmod.h"
 #include "minitech.h"
+#include "objectSearchIndex.h"
 
 #include <iostream>
 #include <vector>
@@ -1301,41 +1302,62 @@ bool HetuwMod::charArrEqualsCharArr(const char *a, const char *b) {
 	return false;
 }
 
-void HetuwMod::setSearchArray() {
+// search descriptions of all objects, as getObjSearchDescr returns them
+static ObjectSearchIndex searchIndex;
+static bool searchIndexBuilt = false;
+static bool searchIndexIncludesHashText = false;
+
+void HetuwMod::initSearchIndex() {
+	freeSearchIndex();
+	searchIndexIncludesHashText = searchIncludeHashText;
+
 	int descrSize = 32;
-	char descr[descrSize];
-	char exactSearchArr[64];
-	for (int i=0; i<maxObjects; i++) {
-		objIsBeingSearched[i] = false;
+	// objGetDescrWithoutHashtag can write one past descrSize
+	char descr[descrSize+1];
+	int maxID = getMaxObjectID();
+	for (int i=0; i<=maxID; i++) {
 		ObjectRecord *o = getObject( i );
 		if (!o) continue;
-		bool exactSearch = false;
-		for (unsigned k=0; k<searchWordList.size(); k++) {
-			exactSearch = false;
-			for (int m=0; m < 64; m++) {
-				if (searchWordList[k][m] == 0) {
-					if (m > 0 && searchWordList[k][m-1] == '.') {
-						exactSearch = true;
-						strcpy(exactSearchArr, searchWordList[k]);
-						exactSearchArr[m-1] = 0;
-					}
-					break;
-				}
-			}
+		getObjSearchDescr(o->description, descr, descrSize);
+		searchIndex.addObject(i, descr);
+	}
+	searchIndexBuilt = true;
+}
 
-			getObjSearchDescr(o->description, descr, descrSize);
+void HetuwMod::freeSearchIndex() {
+	searchIndex.clear();
+	searchIndexBuilt = false;
+}
 
-			if (exactSearch) {
-				if (charArrEqualsCharArr(descr, exactSearchArr)) {
-					objIsBeingSearched[i] = true;
-					break;
+void HetuwMod::setSearchArray() {
+	if (!searchIndexBuilt || searchIndexIncludesHashText != searchIncludeHashText) {
+		initSearchIndex();
+	}
+
+	for (int i=0; i<maxObjects; i++) objIsBeingSearched[i] = false;
+
+	char exactSearchArr[64];
+	vector<int> hits;
+	for (unsigned k=0; k<searchWordList.size(); k++) {
+		bool exactSearch = false;
+		for (int m=0; m < 64; m++) {
+			if (searchWordList[k][m] == 0) {
+				if (m > 0 && searchWordList[k][m-1] == '.') {
+					exactSearch = true;
+					strcpy(exactSearchArr, searchWordList[k]);
+					exactSearchArr[m-1] = 0;
 				}
-			} else if (charArrContainsCharArr(descr, searchWordList[k])) {
-				//printf("hetuw search for id: %i, desc: %s\n", i, o->description);
-				objIsBeingSearched[i] = true;
 				break;
 			}
 		}
+
+		hits.clear();
+		if (exactSearch) searchIndex.findEqual(exactSearchArr, &hits);
+		else searchIndex.findContaining(searchWordList[k], &hits);
+
+		for (unsigned i=0; i<hits.size(); i++) {
+			if (hits[i] < maxObjects) objIsBeingSearched[hits[i]] = true;
+		}
 	}
 }
 
@@ -598,6 +598,9 @@ public:
 	static bool searchIncludeHashText;
 	static bool *objIsBeingSearched;
 	static void setSearchArray();
+	// word index that setSearchArray queries, call after the object bank is loaded
+	static void initSearchIndex();
+	static void freeSearchIndex();
 
 	static bool cameraIsFixed;
 	static void SetFixCamera(bool b);
@@ -0,0 +1,245 @@
+#include "loadingWorkers.h"
+
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/SettingsManager.h"
+
+#include <stdio.h>
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+
+// more than this many workers doesn't help, because the main thread
+// can't feed them or upload results any faster
+#define MAX_LOADING_WORKERS 16
+
+
+// every job added and not yet collected, oldest first
+static SimpleVector<LoadingJob*> jobs;
+
+// index in jobs of next job for a worker to pick up
+static int nextJobToStart = 0;
+
+static char stopSignal = false;
+
+
+static MutexLock jobLock;
+
+// Binary semaphores can drop signals that arrive together,
+// so waiting workers wake each other in a chain while jobs remain.
+static BinarySemaphore jobAddedSemaphore;
+static BinarySemaphore jobDoneSemaphore;
+
+
+
+class LoadingWorkerThread : public Thread {
+
+        virtual void run() {
+
+            while( true ) {
+
+                jobLock.lock();
+
+                if( stopSignal ) {
+                    jobLock.unlock();
+
+                    // pass stop on to next worker
+                    jobAddedSemaphore.signal();
+                    break;
+                    }
+
+                LoadingJob *job = NULL;
+
+                if( nextJobToStart < jobs.size() ) {
+                    job = jobs.getElementDirect( nextJobToStart );
+                    nextJobToStart++;
+                    }
+
+                char moreJobs = ( nextJobToStart < jobs.size() );
+
+                jobLock.unlock();
+
+
+                if( job == NULL ) {
+                    jobAddedSemaphore.wait();
+                    continue;
+                    }
+
+                if( moreJobs ) {
+                    jobAddedSemaphore.signal();
+                    }
+
+                job->run();
+
+                jobLock.lock();
+                job->mDone = true;
+                jobLock.unlock();
+
+                jobDoneSemaphore.signal();
+                }
+            }
+
+    };
+
+
+
+static SimpleVector<LoadingWorkerThread*> workers;
+
+
+
+static int getNumCores() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+
+    return (int)info.dwNumberOfProcessors;
+#else
+    long numCores = sysconf( _SC_NPROCESSORS_ONLN );
+
+    if( numCores < 1 ) {
+        return 1;
+        }
+    return (int)numCores;
+#endif
+    }
+
+
+
+void startLoadingWorkers() {
+    if( workers.size() > 0 ) {
+        return;
+        }
+
+    int numWorkers = SettingsManager::getIntSetting( "loadingThreads", -1 );
+
+    if( numWorkers < 0 ) {
+        // leave the first core for the main thread
+        numWorkers = getNumCores() - 1;
+        }
+    if( numWorkers > MAX_LOADING_WORKERS ) {
+        numWorkers = MAX_LOADING_WORKERS;
+        }
+
+    stopSignal = false;
+
+    for( int i=0; i<numWorkers; i++ ) {
+        LoadingWorkerThread *t = new LoadingWorkerThread;
+
+        t->start();
+
+        workers.push_back( t );
+        }
+
+    if( numWorkers > 0 ) {
+        printf( "Started %d loading worker threads\n", numWorkers );
+        }
+    }
+
+
+
+void stopLoadingWorkers() {
+    jobLock.lock();
+    stopSignal = true;
+    jobLock.unlock();
+
+    jobAddedSemaphore.signal();
+
+    for( int i=0; i<workers.size(); i++ ) {
+        LoadingWorkerThread *t = workers.getElementDirect( i );
+
+        t->join();
+        delete t;
+        }
+    workers.deleteAll();
+
+
+    for( int i=0; i<jobs.size(); i++ ) {
+        delete jobs.getElementDirect( i );
+        }
+    jobs.deleteAll();
+
+    nextJobToStart = 0;
+
+    // last stop signal is still set, and a dropped done signal might be
+    // too, so clear them before next start
+    jobAddedSemaphore.wait( 0 );
+    jobDoneSemaphore.wait( 0 );
+    }
+
+
+
+int getNumLoadingWorkers() {
+    return workers.size();
+    }
+
+
+
+void addLoadingJob( LoadingJob *inJob ) {
+    if( workers.size() == 0 ) {
+        inJob->run();
+        inJob->mDone = true;
+
+        jobs.push_back( inJob );
+        nextJobToStart = jobs.size();
+        return;
+        }
+
+    jobLock.lock();
+    jobs.push_back( inJob );
+    jobLock.unlock();
+
+    jobAddedSemaphore.signal();
+    }
+
+
+
+int getNumLoadingJobs() {
+    jobLock.lock();
+    int num = jobs.size();
+    jobLock.unlock();
+
+    return num;
+    }
+
+
+
+LoadingJob *getDoneLoadingJob( char inWait ) {
+    jobLock.lock();
+
+    if( jobs.size() == 0 ) {
+        jobLock.unlock();
+        return NULL;
+        }
+
+    LoadingJob *job = jobs.getElementDirect( 0 );
+
+    while( inWait && ! job->mDone ) {
+        jobLock.unlock();
+
+        jobDoneSemaphore.wait();
+
+        jobLock.lock();
+        }
+
+    if( ! job->mDone ) {
+        jobLock.unlock();
+        return NULL;
+        }
+
+    jobs.deleteElement( 0 );
+    nextJobToStart--;
+
+    jobLock.unlock();
+
+    return job;
+    }
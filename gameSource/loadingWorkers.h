@@ -0,0 +1,67 @@
+#ifndef LOADING_WORKERS_INCLUDED
+#define LOADING_WORKERS_INCLUDED
+
+
+// pool of worker threads for the CPU-heavy parts of bank loading
+//
+// Banks hand decode and convolve jobs to the pool during their init Step
+// calls, then collect finished jobs on the main thread, where any GPU
+// or sound uploads happen.
+//
+// Workers only live between startLoadingWorkers and stopLoadingWorkers,
+// and only one bank uses them at a time.
+//
+// The loadingThreads setting picks the number of workers, with -1 meaning
+// one per core beyond the first.  With 0 workers, jobs run right
+// away inside addLoadingJob.
+
+
+
+class LoadingJob {
+    public:
+
+        LoadingJob()
+                : mDone( false ) {
+            }
+
+        virtual ~LoadingJob() {
+            }
+
+
+        // called on a worker thread
+        // must not touch GPU, sound, or shared bank state
+        virtual void run() = 0;
+
+
+        // set by pool, under its lock
+        char mDone;
+    };
+
+
+
+void startLoadingWorkers();
+
+
+// destroys any jobs that have not been collected
+void stopLoadingWorkers();
+
+
+int getNumLoadingWorkers();
+
+
+// inJob collected later with getDoneLoadingJob
+void addLoadingJob( LoadingJob *inJob );
+
+
+// jobs added but not yet collected
+int getNumLoadingJobs();
+
+
+// returns jobs in the order they were added, destroyed by caller
+//
+// returns NULL if no jobs added, or if oldest job isn't done and inWait
+// is false
+LoadingJob *getDoneLoadingJob( char inWait );
+
+
+#endif
@@ -21,6 +21,7 @@
 
 
 #include "minitech.h"
+#include "objectSearchIndex.h"
 
 using namespace std;
 
@@ -66,6 +67,23 @@ vector<minitech::mouseListener*> minitech::twotechMouseListeners;
 minitech::mouseListener* minitech::prevListener = NULL;
 minitech::mouseListener* minitech::nextListener = NULL;
 
+//transition index, CSR layout:
+//entries for objId are flat[ start[objId] ] up to flat[ start[objId+1] ]
+static int indexMaxObjects = 0;
+static bool indexShowUncraftables = false;
+static vector<int> usesIndexStart;
+static vector<TransRecord*> usesIndexFlat;
+static vector<int> prodIndexStart;
+static vector<TransRecord*> prodIndexFlat;
+static vector<int> dummyParentIndex;
+//copies made for probabilitySet transitions, owned by the index
+static vector<TransRecord*> indexOwnedTrans;
+
+//word index over the descriptions that hint search ranks by
+static ObjectSearchIndex hintSearchIndex;
+static bool hintSearchIndexBuilt = false;
+static bool hintSearchIndexShowComments = true;
+
 const char *biomeNames[] = {"GRASSLANDS",
 							"SWAMP",
 							"YELLOW PRAIRIES",
@@ -103,6 +121,11 @@ void minitech::setLivingLifePage(
 	delete [] minimizeKeyFromSetting;
     
     showUncraftables = SettingsManager::getIntSetting( "minitechShowUncraftables", 0 );
+    
+    //index filters on showUncraftables
+    if( indexMaxObjects > 0 && showUncraftables != indexShowUncraftables ) {
+        initTransIndex();
+    }
 }
 
 void minitech::initOnBirth() { 
@@ -152,6 +175,7 @@ bool minitech::posEqual(doublePair pos1, doublePair pos2) {
 }
 
 int minitech::getDummyParent(int objId) {
+	if (objId > 0 && objId < indexMaxObjects) return dummyParentIndex[objId];
 	if (objId <= 0 || objId >= maxObjects) return objId;
 	ObjectRecord* o = getObject(objId);
 	if (o != NULL) {
@@ -690,8 +714,143 @@ void minitech::drawBox(doublePair posCen, float height, float width, float lineW
 
 
 
+void minitech::dedupeAndPresortTrans(vector<TransRecord*> &trans) {
+	
+	//There could be duplicated transitions...
+	sort( trans.begin(), trans.end() );
+	trans.erase( unique( trans.begin(), trans.end() ), trans.end() );
+	
+	//presort by depth of ingredients, the order that sortUsesTrans and 
+	//sortProdTrans fall back on for ingredients that are not nearby
+	vector<int> depthScores(trans.size(), 0);
+	for ( int i=0; i<trans.size(); i++ ) {
+		if (trans[i]->actor > 0) depthScores[i] += getObjectDepth(trans[i]->actor) + 1;
+		if (trans[i]->target > 0) depthScores[i] += getObjectDepth(trans[i]->target) + 1;
+	}
+	
+	vector<std::size_t> index(trans.size());
+	iota(index.begin(), index.end(), 0);
+	stable_sort(index.begin(), index.end(), [&](size_t a, size_t b) { return depthScores[a] < depthScores[b]; });
+	
+	vector<TransRecord*> temp(trans.size());
+	for ( int i=0; i<trans.size(); i++ ) {
+		temp[i] = trans[index[i]];
+	}
+	trans = temp;
+}
+
+void minitech::initTransIndex() {
+	
+	freeTransIndex();
+	
+	//setLivingLifePage reads this again, but only after loading is done
+	showUncraftables = SettingsManager::getIntSetting( "minitechShowUncraftables", 0 );
+	
+	indexMaxObjects = getMaxObjectID() + 1;
+	indexShowUncraftables = showUncraftables;
+	
+	dummyParentIndex.resize(indexMaxObjects);
+	for (int id=0; id<indexMaxObjects; id++) {
+		int parent = id;
+		ObjectRecord* o = getObject(id);
+		if (o != NULL && o->isUseDummy) parent = o->useDummyParent;
+		dummyParentIndex[id] = parent;
+	}
+	
+	usesIndexStart.resize(indexMaxObjects + 1);
+	prodIndexStart.resize(indexMaxObjects + 1);
+	
+	for (int id=0; id<indexMaxObjects; id++) {
+		usesIndexStart[id] = usesIndexFlat.size();
+		prodIndexStart[id] = prodIndexFlat.size();
+		
+		if (id == 0 || getObject(id) == NULL) continue;
+		
+		vector<TransRecord*> uses = scanUsesTrans(id, &indexOwnedTrans);
+		dedupeAndPresortTrans(uses);
+		usesIndexFlat.insert(usesIndexFlat.end(), uses.begin(), uses.end());
+		
+		vector<TransRecord*> prods = scanProdTrans(id, &indexOwnedTrans);
+		dedupeAndPresortTrans(prods);
+		prodIndexFlat.insert(prodIndexFlat.end(), prods.begin(), prods.end());
+	}
+	usesIndexStart[indexMaxObjects] = usesIndexFlat.size();
+	prodIndexStart[indexMaxObjects] = prodIndexFlat.size();
+	
+	usesIndexFlat.shrink_to_fit();
+	prodIndexFlat.shrink_to_fit();
+}
+
+void minitech::freeTransIndex() {
+	
+	for (auto t: indexOwnedTrans) {
+		delete t;
+	}
+	indexOwnedTrans.clear();
+	
+	usesIndexStart.clear();
+	usesIndexFlat.clear();
+	prodIndexStart.clear();
+	prodIndexFlat.clear();
+	dummyParentIndex.clear();
+	
+	indexMaxObjects = 0;
+}
+
+void minitech::initSearchIndex() {
+	
+	freeSearchIndex();
+	
+	hintSearchIndexShowComments = showCommentsAndTagsInObjectDescription;
+	
+	int maxID = getMaxObjectID();
+	for (int id=0; id<=maxID; id++) {
+		ObjectRecord* o = getObject(id);
+		if (o == NULL) continue;
+		
+		char *desc = stringToUpperCase(o->description);
+		if (!hintSearchIndexShowComments) stripDescriptionComment(desc);
+		hintSearchIndex.addObject(id, desc);
+		delete [] desc;
+	}
+	
+	hintSearchIndexBuilt = true;
+}
+
+void minitech::freeSearchIndex() {
+	hintSearchIndex.clear();
+	hintSearchIndexBuilt = false;
+}
+
 vector<TransRecord*> minitech::getUsesTrans(int objId) {
 	
+	if (objId > 0 && objId < indexMaxObjects) {
+		return vector<TransRecord*>(
+			usesIndexFlat.begin() + usesIndexStart[objId],
+			usesIndexFlat.begin() + usesIndexStart[objId + 1] );
+	}
+	
+	vector<TransRecord*> results = scanUsesTrans(objId, NULL);
+	dedupeAndPresortTrans(results);
+	return results;
+}
+
+vector<TransRecord*> minitech::getProdTrans(int objId) {
+	
+	if (objId > 0 && objId < indexMaxObjects) {
+		return vector<TransRecord*>(
+			prodIndexFlat.begin() + prodIndexStart[objId],
+			prodIndexFlat.begin() + prodIndexStart[objId + 1] );
+	}
+	
+	vector<TransRecord*> results = scanProdTrans(objId, NULL);
+	dedupeAndPresortTrans(results);
+	return results;
+}
+
+//copies of probabilitySet transitions are added to outCopies, if not NULL
+vector<TransRecord*> minitech::scanUsesTrans(int objId, vector<TransRecord*> *outCopies) {
+	
 	SimpleVector<TransRecord*> *usesTrans = getAllUses( objId );
 	vector<TransRecord*> results;
 	
@@ -728,6 +887,7 @@ vector<TransRecord*> minitech::getUsesTrans(int objId) {
 				if (cOrD == 0) staticTrans->newActor = newId;
 				if (cOrD == 1) staticTrans->newTarget = newId;
 				results.push_back(staticTrans);
+				if (outCopies != NULL) outCopies->push_back(staticTrans);
 			}
 			continue;
 		}
@@ -760,7 +920,7 @@ vector<TransRecord*> minitech::getUsesTrans(int objId) {
 	return results;
 }
 
-vector<TransRecord*> minitech::getProdTrans(int objId) {
+vector<TransRecord*> minitech::scanProdTrans(int objId, vector<TransRecord*> *outCopies) {
 	
 	SimpleVector<TransRecord*> *prodTrans = getAllProduces( objId );
 	vector<TransRecord*> results;
@@ -830,6 +990,7 @@ vector<TransRecord*> minitech::getProdTrans(int objId) {
 				if (staticTrans->newTarget == cId) staticTrans->newTarget = objId;
 				
 				results.push_back(staticTrans);
+				if (outCopies != NULL) outCopies->push_back(staticTrans);
 			}
 		}
 	}
@@ -891,7 +1052,8 @@ vector<TransRecord*> minitech::sortUsesTrans(vector<TransRecord*> unsortedTrans)
 	
 	vector<std::size_t> index(unsortedTrans.size());
 	iota(index.begin(), index.end(), 0);
-	sort(index.begin(), index.end(), [&](size_t a, size_t b) { return rankScores[a] < rankScores[b]; });
+	//stable, so presorted order breaks ties
+	stable_sort(index.begin(), index.end(), [&](size_t a, size_t b) { return rankScores[a] < rankScores[b]; });
 	
 	vector<TransRecord*> temp(unsortedTrans.size());
 	for ( int i=0; i<unsortedTrans.size(); i++ ) {
@@ -964,7 +1126,8 @@ vector<TransRecord*> minitech::sortProdTrans(vector<TransRecord*> unsortedTrans)
 	
 	vector<std::size_t> index(unsortedTrans.size());
 	iota(index.begin(), index.end(), 0);
-	sort(index.begin(), index.end(), [&](size_t a, size_t b) { return rankScores[a] < rankScores[b]; });
+	//stable, so presorted order breaks ties
+	stable_sort(index.begin(), index.end(), [&](size_t a, size_t b) { return rankScores[a] < rankScores[b]; });
 	
 	vector<TransRecord*> temp(unsortedTrans.size());
 	for ( int i=0; i<unsortedTrans.size(); i++ ) {
@@ -1624,81 +1787,34 @@ void minitech::inputHintStrToSearch(string hintStr) {
 											 &numHits, &numRemain );
 		
 		if (numHits > 0) {
-			vector<ObjectRecord*> unsortedHits;
+            //index words are stripped of comments or not to match the setting
+            if( !hintSearchIndexBuilt || 
+                hintSearchIndexShowComments != showCommentsAndTagsInObjectDescription ) {
+                initSearchIndex();
+            }
+            
+			vector<int> sortedHits;
 			for (int i=0; i<numHits; i++) {
                 if( !showCommentsAndTagsInObjectDescription ) {
-                    string strippedName = livingLifePage->minitechGetDisplayObjectDescription(hitsSimpleVector[i]->id);
-                    if( strippedName.find(hintStr) != std::string::npos )
-                        unsortedHits.push_back(hitsSimpleVector[i]);
+                    const char *strippedName = hintSearchIndex.getText(hitsSimpleVector[i]->id);
+                    if( strippedName != NULL && strstr(strippedName, hintStr.c_str()) != NULL )
+                        sortedHits.push_back(hitsSimpleVector[i]->id);
                 } else {
-                    unsortedHits.push_back(hitsSimpleVector[i]);
+                    sortedHits.push_back(hitsSimpleVector[i]->id);
                 }
 			}
             
-            if( unsortedHits.size() > 0 ) {
+            if( sortedHits.size() > 0 ) {
             
-                std::vector<std::string> hintWords = Tokenize( hintStr, "[\\s]+" );
-                std::vector<std::vector<std::string>> descWords(unsortedHits.size());
-                
-                vector<std::size_t> index(unsortedHits.size());
-                iota(index.begin(), index.end(), 0);
-                sort(index.begin(), index.end(), [&](size_t a, size_t b) { 
-                    // string aDesc(stringToUpperCase(unsortedHits[a]->description));
-                    // string bDesc(stringToUpperCase(unsortedHits[b]->description));
-                    // int aLDist = LevenshteinDistance(hintStr, aDesc); 
-                    // int bLDist = LevenshteinDistance(hintStr, bDesc);
-                    // return aLDist < bLDist;
-                    
-                    string aDesc;
-                    string bDesc;
-                    if( !showCommentsAndTagsInObjectDescription ) {
-                        aDesc = livingLifePage->minitechGetDisplayObjectDescription(unsortedHits[a]->id);
-                        bDesc = livingLifePage->minitechGetDisplayObjectDescription(unsortedHits[b]->id);
-                    } else {
-                        aDesc = stringToUpperCase(unsortedHits[a]->description);
-                        bDesc = stringToUpperCase(unsortedHits[b]->description);
-                    }
-
-                    if( descWords[a].size() == 0 ) descWords[a] = Tokenize( aDesc, "[\\s]+" );
-                    if( descWords[b].size() == 0 ) descWords[b] = Tokenize( bDesc, "[\\s]+" );                
-                    std::vector<std::string> aDescWords = descWords[a];
-                    std::vector<std::string> bDescWords = descWords[b];
-                    
-                    int aScore = 0;
-                    int bScore = 0;
-                    
-                    for ( int i=0; i<(int)hintWords.size(); i++ ) {
-                        string hintWord = hintWords[i];
-                        for ( int j=0; j<(int)aDescWords.size(); j++ ) {
-                            if( hintWord.compare( aDescWords[j] ) == 0 ) aScore++;
-                        }
-                        for ( int k=0; k<(int)bDescWords.size(); k++ ) {
-                            if( hintWord.compare( bDescWords[k] ) == 0 ) bScore++;
-                        }
-                    }
-                    
-                    float aScoreF = (float)aScore / (float)aDescWords.size();
-                    float bScoreF = (float)bScore / (float)bDescWords.size();
-                    
-                    if( aScoreF == bScoreF ) {
-                        return unsortedHits[a]->id < unsortedHits[b]->id;
-                    } else {
-                        return aScoreF > bScoreF;
-                    }
-                });
-                
-                vector<ObjectRecord*> sortedHits(unsortedHits.size());
-                for ( int i=0; i<(int)unsortedHits.size(); i++ ) {
-                    sortedHits[i] = unsortedHits[index[i]];
-                }
+                hintSearchIndex.rankByWordMatches( hintStr.c_str(), &sortedHits );
                 
                 if (showUncraftables) {
-                    currentHintObjId = sortedHits[0]->id;
+                    currentHintObjId = sortedHits[0];
                     return;
                 } else {
                     for ( int i=0; i<(int)sortedHits.size(); i++ ) {
-                        if ( !isUncraftable(sortedHits[i]->id) ) {
-                            currentHintObjId = sortedHits[i]->id;
+                        if ( !isUncraftable(sortedHits[i]) ) {
+                            currentHintObjId = sortedHits[i];
                             return;
                         }
                     }
@@ -1765,6 +1881,7 @@ void minitech::livingLifeDraw(float mX, float mY) {
 		twotechMouseListeners.shrink_to_fit();
 		
 
+		//already deduplicated and presorted by ingredient depth
 		vector<TransRecord*> unsortedTrans;
 		
 		if (useOrMake == 0) {
@@ -1772,13 +1889,6 @@ void minitech::livingLifeDraw(float mX, float mY) {
 		} else if (useOrMake == 1) {
 			unsortedTrans = getProdTrans(currentHintObjId);
 		}
-		
-		// There could be duplicated transitions...
-		sort( unsortedTrans.begin(), unsortedTrans.end() );
-		unsortedTrans.erase( 
-			unique( unsortedTrans.begin(), unsortedTrans.end() ), 
-			unsortedTrans.end() 
-			);
 			
 		if (useOrMake == 0) {
 			currentHintTrans = sortUsesTrans(unsortedTrans);
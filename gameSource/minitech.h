@@ -83,6 +83,19 @@ public:
 	static std::vector<TransRecord*> getUsesTrans(int objId);
 	static std::vector<TransRecord*> getProdTrans(int objId);
 	
+	//one-time index of getUsesTrans/getProdTrans results for every object ID,
+	//call after initTransBankFinish
+	static void initTransIndex();
+	static void freeTransIndex();
+	static std::vector<TransRecord*> scanUsesTrans(int objId, std::vector<TransRecord*> *outCopies);
+	static std::vector<TransRecord*> scanProdTrans(int objId, std::vector<TransRecord*> *outCopies);
+	static void dedupeAndPresortTrans(std::vector<TransRecord*> &trans);
+	
+	//one-time word index of object descriptions for hint search ranking,
+	//call after the object bank is loaded
+	static void initSearchIndex();
+	static void freeSearchIndex();
+	
 	static void drawPoint(doublePair posCen, std::string color);
 	static void drawObj(
 		doublePair posCen, 
@@ -19,6 +19,8 @@
 
 #include "folderCache.h"
 
+#include "bankSnapshot.h"
+
 #include "soundBank.h"
 
 #include "animationBank.h"
@@ -352,6 +354,11 @@ static char shouldFileBeCached( char *inFileName ) {
 static char autoGenerateUsedObjects = false;
 static char autoGenerateVariableObjects = false;
 
+// all records came from objects/cache.snap
+static char loadedFromSnapshot = false;
+
+static char loadObjectSnapshot();
+
 
 int initObjectBankStart( char *outRebuildingCache, 
                          char inAutoGenerateUsedObjects,
@@ -367,6 +374,13 @@ int initObjectBankStart( char *outRebuildingCache,
     autoGenerateUsedObjects = inAutoGenerateUsedObjects;
     autoGenerateVariableObjects = inAutoGenerateVariableObjects;
 
+    loadedFromSnapshot = loadObjectSnapshot();
+    
+    if( loadedFromSnapshot ) {
+        // all loaded, one step to finish
+        return 1;
+        }
+
     return cache.numFiles;
     }
 
@@ -584,10 +598,6 @@ static void setupObjectSpeechPipe( ObjectRecord *inR ) {
             sscanf( indexLoc, "%d", &( inR->speechPipeIndex ) );
             }
         }
-
-    if( inR->speechPipeIndex > maxSpeechPipeIndex ) {
-        maxSpeechPipeIndex = inR->speechPipeIndex;
-        }
     }
 
 
@@ -981,9 +991,249 @@ int getMaxSpeechPipeIndex() {
 
 
 
+// records a newly loaded object, and the lists and maxima
+// that depend on it
+static void addObjectToLists( ObjectRecord *r ) {
+    records.push_back( r );
+
+    if( r->id > maxID ) {
+        maxID = r->id;
+        }
+
+    if( r->speechPipeIndex > maxSpeechPipeIndex ) {
+        maxSpeechPipeIndex = r->speechPipeIndex;
+        }
+    
+    if( r->wide ) {
+        if( r->leftBlockingRadius > maxWideRadius ) {
+            maxWideRadius = r->leftBlockingRadius;
+            }
+        if( r->rightBlockingRadius > maxWideRadius ) {
+            maxWideRadius = r->rightBlockingRadius;
+            }
+        }
+    
+    if( r->deathMarker ) {
+        deathMarkerObjectIDs.push_back( r->id );
+        }
+
+    if( strstr( r->description, "fromDeath" ) != NULL ) {
+        allPossibleDeathMarkerIDs.push_back( r->id );
+        }
+
+    if( r->foodValue > maxFoodValue ) {
+        maxFoodValue = r->foodValue;
+        }
+    
+    if( r->foodValue > 0 || r->bonusValue > 0 ) {
+        allPossibleFoodIDs.push_back( r->id );
+        }
+
+    if( r->monumentCall ) {
+        monumentCallObjectIDs.push_back( r->id );
+        }
+    
+    if( r->person && ! r->personNoSpawn ) {
+        personObjectIDs.push_back( r->id );
+        
+        if( ! r->male ) {
+            femalePersonObjectIDs.push_back( r->id );
+            }
+        
+        if( r->race <= MAX_RACE ) {
+            racePersonObjectIDs[ r->race ].push_back( r->id );
+            }
+        else {
+            racePersonObjectIDs[ MAX_RACE ].push_back( r->id );
+            }
+        }
+    }
+
+
+
+// bump when ObjectRecord fields or what's saved for them changes
+#define OBJECT_SNAPSHOT_VERSION 1
+
+
+static void writeSoundUsage( BankSnapshotWriter *inWriter, SoundUsage inU ) {
+    inWriter->writeArray( inU.ids, inU.numSubSounds );
+    inWriter->writeArray( inU.volumes, inU.numSubSounds );
+    }
+
+
+
+static void readSoundUsage( BankSnapshotReader *inReader, SoundUsage *inU ) {
+    inU->ids = inReader->readArray<int>( inU->numSubSounds );
+    inU->volumes = inReader->readArray<double>( inU->numSubSounds );
+    }
+
+
+
+// object as parsed from its text file, before initObjectBankFinish
+static void writeObjectSnapshot( BankSnapshotWriter *inWriter,
+                                 ObjectRecord *r ) {
+    BankSnapshotWriter *w = inWriter;
+    int n = r->numSprites;
+
+    // plain fields, pointers are replaced on read
+    w->writeBytes( r, sizeof( ObjectRecord ) );
+
+    w->writeString( r->description );
+
+    w->writeArray( r->spriteBehindPlayer, n );
+    w->writeArray( r->spriteAdditiveBlend, n );
+    w->writeArray( r->biomes, r->numBiomes );
+
+    writeSoundUsage( w, r->creationSound );
+    writeSoundUsage( w, r->usingSound );
+    writeSoundUsage( w, r->eatingSound );
+    writeSoundUsage( w, r->decaySound );
+
+    w->writeArray( r->slotPos, r->numSlots );
+    w->writeArray( r->slotVert, r->numSlots );
+    w->writeArray( r->slotParent, r->numSlots );
+
+    w->writeArray( r->sprites, n );
+    w->writeArray( r->spritePos, n );
+    w->writeArray( r->spriteRot, n );
+    w->writeArray( r->spriteHFlip, n );
+    w->writeArray( r->spriteColor, n );
+    w->writeArray( r->spriteAgeStart, n );
+    w->writeArray( r->spriteAgeEnd, n );
+    w->writeArray( r->spriteParent, n );
+    w->writeArray( r->spriteInvisibleWhenHolding, n );
+    w->writeArray( r->spriteInvisibleWhenWorn, n );
+    w->writeArray( r->spriteBehindSlots, n );
+    w->writeArray( r->spriteInvisibleWhenContained, n );
+    w->writeArray( r->spriteIsHead, n );
+    w->writeArray( r->spriteIsBody, n );
+    w->writeArray( r->spriteIsBackFoot, n );
+    w->writeArray( r->spriteIsFrontFoot, n );
+    w->writeArray( r->spriteUseVanish, n );
+    w->writeArray( r->spriteUseAppear, n );
+    w->writeArray( r->spriteSkipDrawing, n );
+
+    w->endRecord();
+    }
+
+
+
+static ObjectRecord *readObjectSnapshot( BankSnapshotReader *inReader ) {
+    BankSnapshotReader *s = inReader;
+    
+    ObjectRecord *r = new ObjectRecord;
+    
+    s->readBytes( r, sizeof( ObjectRecord ) );
+
+    int n = r->numSprites;
+    
+    r->description = s->readString();
+
+    r->spriteBehindPlayer = s->readArray<char>( n );
+    r->spriteAdditiveBlend = s->readArray<char>( n );
+    r->biomes = s->readArray<int>( r->numBiomes );
+
+    readSoundUsage( s, &( r->creationSound ) );
+    readSoundUsage( s, &( r->usingSound ) );
+    readSoundUsage( s, &( r->eatingSound ) );
+    readSoundUsage( s, &( r->decaySound ) );
+
+    r->slotPos = s->readArray<doublePair>( r->numSlots );
+    r->slotVert = s->readArray<char>( r->numSlots );
+    r->slotParent = s->readArray<int>( r->numSlots );
+
+    r->sprites = s->readArray<int>( n );
+    r->spritePos = s->readArray<doublePair>( n );
+    r->spriteRot = s->readArray<double>( n );
+    r->spriteHFlip = s->readArray<char>( n );
+    r->spriteColor = s->readArray<FloatRGB>( n );
+    r->spriteAgeStart = s->readArray<double>( n );
+    r->spriteAgeEnd = s->readArray<double>( n );
+    r->spriteParent = s->readArray<int>( n );
+    r->spriteInvisibleWhenHolding = s->readArray<char>( n );
+    r->spriteInvisibleWhenWorn = s->readArray<int>( n );
+    r->spriteBehindSlots = s->readArray<char>( n );
+    r->spriteInvisibleWhenContained = s->readArray<char>( n );
+    r->spriteIsHead = s->readArray<char>( n );
+    r->spriteIsBody = s->readArray<char>( n );
+    r->spriteIsBackFoot = s->readArray<char>( n );
+    r->spriteIsFrontFoot = s->readArray<char>( n );
+    r->spriteUseVanish = s->readArray<char>( n );
+    r->spriteUseAppear = s->readArray<char>( n );
+    r->spriteSkipDrawing = s->readArray<char>( n );
+
+    // set up in initObjectBankFinish
+    r->useDummyIDs = NULL;
+    r->variableDummyIDs = NULL;
+    r->permittedBiomeMap = NULL;
+    r->spriteNoFlipXPos = NULL;
+
+    // depends on sprite bank, which may differ from when snapshot was made
+    setupEyesAndMouth( r );
+
+    return r;
+    }
+
+
+
+static char loadObjectSnapshot() {
+    BankSnapshotReader *reader = 
+        openBankSnapshot( cache, "objects", 
+                          OBJECT_SNAPSHOT_VERSION, sizeof( ObjectRecord ) );
+
+    if( reader == NULL ) {
+        return false;
+        }
+    
+    SimpleVector<ObjectRecord*> loaded;
+
+    int numRecords = reader->getNumRecords();
+    
+    for( int i=0; i<numRecords && reader->isGood(); i++ ) {
+        loaded.push_back( readObjectSnapshot( reader ) );
+        }
+
+    if( ! reader->isGood() ) {
+        // only happens if snapshot was damaged after its header was
+        // checked, partial records are leaked
+        discardBankSnapshot( reader, "objects" );
+        return false;
+        }
+
+    delete reader;
+
+    for( int i=0; i<loaded.size(); i++ ) {
+        addObjectToLists( loaded.getElementDirect( i ) );
+        }
+    
+    printf( "Loaded %d objects from snapshot\n", loaded.size() );
+
+    return true;
+    }
+
+
+
+static void saveObjectSnapshot() {
+    BankSnapshotWriter *writer = 
+        startBankSnapshot( cache, 
+                           OBJECT_SNAPSHOT_VERSION, sizeof( ObjectRecord ) );
+    
+    if( writer == NULL ) {
+        return;
+        }
+
+    for( int i=0; i<records.size(); i++ ) {
+        writeObjectSnapshot( writer, records.getElementDirect( i ) );
+        }
+    
+    finishBankSnapshot( writer, "objects" );
+    }
+
+
+
 float initObjectBankStep() {
         
-    if( currentFile == cache.numFiles ) {
+    if( loadedFromSnapshot || currentFile == cache.numFiles ) {
         return 1.0;
         }
     
@@ -1014,10 +1264,6 @@ float initObjectBankStep() {
                 sscanf2( &next, lines, "id=%d", 
                         &( r->id ) );
                 
-                if( r->id > maxID ) {
-                    maxID = r->id;
-                    }
-                
                 next++;
                             
                 r->description = stringDuplicate( lines[next] );
@@ -1189,17 +1435,6 @@ float initObjectBankStep() {
                 
                 r->wide = ( r->leftBlockingRadius > 0 || 
                             r->rightBlockingRadius > 0 );
-
-                if( r->wide ) {
-                    // r->drawBehindPlayer = true;
-                    
-                    if( r->leftBlockingRadius > maxWideRadius ) {
-                        maxWideRadius = r->leftBlockingRadius;
-                        }
-                    if( r->rightBlockingRadius > maxWideRadius ) {
-                        maxWideRadius = r->rightBlockingRadius;
-                        }
-                    }
                     
 
                 next++;
@@ -1281,17 +1516,8 @@ float initObjectBankStep() {
                     
                 r->deathMarker = deathMarkerRead;
                 
-                if( r->deathMarker ) {
-                    deathMarkerObjectIDs.push_back( r->id );
-                    }
-
                 next++;
 
-                
-                if( strstr( r->description, "fromDeath" ) != NULL ) {
-                    allPossibleDeathMarkerIDs.push_back( r->id );
-                    }
-                
 
                 r->homeMarker = false;
                 
@@ -1385,14 +1611,6 @@ float initObjectBankStep() {
                 sscanf( lines[next], "foodValue=%d,%d", 
                         &( r->foodValue ), &( r->bonusValue ) );
                 
-                if( r->foodValue > maxFoodValue ) {
-                    maxFoodValue = r->foodValue;
-                    }
-                
-                if( r->foodValue > 0 || r->bonusValue > 0 ) {
-                    allPossibleFoodIDs.push_back( r->id );
-                    }
-
                 next++;
                             
                             
@@ -1680,7 +1898,6 @@ float initObjectBankStep() {
                     else if( strstr( r->description, 
                                      "monumentCall" ) != NULL ) {
                         r->monumentCall = true;
-                        monumentCallObjectIDs.push_back( r->id );
                         }
                     }
                 
@@ -1861,23 +2078,7 @@ float initObjectBankStep() {
                 r->isBiomeLimited = false;
                 r->permittedBiomeMap = NULL;
                     
-                records.push_back( r );
-
-                            
-                if( r->person && ! r->personNoSpawn ) {
-                    personObjectIDs.push_back( r->id );
-                    
-                    if( ! r->male ) {
-                        femalePersonObjectIDs.push_back( r->id );
-                        }
-
-                    if( r->race <= MAX_RACE ) {
-                        racePersonObjectIDs[ r->race ].push_back( r->id );
-                        }
-                    else {
-                        racePersonObjectIDs[ MAX_RACE ].push_back( r->id );
-                        }
-                    }
+                addObjectToLists( r );
                 }
                             
             for( int i=0; i<numLines; i++ ) {
@@ -2182,6 +2383,10 @@ void setupNumericSprites( ObjectRecord *inO, int inNumber, int inMax,
 
 void initObjectBankFinish() {
   
+    if( ! loadedFromSnapshot ) {
+        saveObjectSnapshot();
+        }
+    
     freeFolderCache( cache );
     
     mapSize = maxID + 1;
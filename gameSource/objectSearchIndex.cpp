@@ -0,0 +1,298 @@
+#include "objectSearchIndex.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+
+#include "minorGems/util/stringUtils.h"
+
+
+
+void splitSearchWords( const char *inText,
+                       std::vector<std::string> *outWords ) {
+    std::string word;
+
+    for( const char *c = inText; *c != '\0'; c++ ) {
+        if( isspace( (unsigned char)*c ) ) {
+            if( word.size() > 0 ) {
+                outWords->push_back( word );
+                word.clear();
+                }
+            }
+        else {
+            word.push_back( (char)toupper( (unsigned char)*c ) );
+            }
+        }
+
+    if( word.size() > 0 ) {
+        outWords->push_back( word );
+        }
+    }
+
+
+
+ObjectSearchIndex::ObjectSearchIndex() {
+    }
+
+
+
+ObjectSearchIndex::~ObjectSearchIndex() {
+    clear();
+    }
+
+
+
+void ObjectSearchIndex::clear() {
+    for( unsigned int i=0; i<mTexts.size(); i++ ) {
+        if( mTexts[i] != NULL ) {
+            delete [] mTexts[i];
+            }
+        }
+    mTexts.clear();
+    mNumWords.clear();
+    mWordLookup.clear();
+    mWords.clear();
+    mPostings.clear();
+    mScratch.clear();
+    }
+
+
+
+void ObjectSearchIndex::addObject( int inID, const char *inText ) {
+    if( inID < 0 ) {
+        return;
+        }
+
+    if( (int)mTexts.size() <= inID ) {
+        mTexts.resize( inID + 1, NULL );
+        mNumWords.resize( inID + 1, 0 );
+        mScratch.resize( inID + 1, 0 );
+        }
+
+    if( mTexts[inID] != NULL ) {
+        delete [] mTexts[inID];
+        }
+    mTexts[inID] = stringToUpperCase( inText );
+
+
+    std::vector<std::string> words;
+    splitSearchWords( inText, &words );
+
+    mNumWords[inID] = words.size();
+
+    for( unsigned int i=0; i<words.size(); i++ ) {
+        int wordNumber = getWordNumber( words[i] );
+
+        if( wordNumber == -1 ) {
+            wordNumber = mWords.size();
+            mWordLookup[ words[i] ] = wordNumber;
+            mWords.push_back( words[i] );
+            mPostings.push_back( std::vector<Posting>() );
+            }
+
+        std::vector<Posting> *postings = &( mPostings[wordNumber] );
+
+        // IDs come in increasing order, so repeats of a word in this
+        // text can only be at the end
+        if( postings->size() > 0 && postings->back().id == inID ) {
+            postings->back().count ++;
+            }
+        else {
+            Posting p = { inID, 1 };
+            postings->push_back( p );
+            }
+        }
+    }
+
+
+
+const char *ObjectSearchIndex::getText( int inID ) {
+    if( inID < 0 || inID >= (int)mTexts.size() ) {
+        return NULL;
+        }
+    return mTexts[inID];
+    }
+
+
+
+int ObjectSearchIndex::getWordNumber( const std::string &inWord ) {
+    std::unordered_map<std::string, int>::iterator it =
+        mWordLookup.find( inWord );
+
+    if( it == mWordLookup.end() ) {
+        return -1;
+        }
+    return it->second;
+    }
+
+
+
+void ObjectSearchIndex::findContainingSlow( const char *inUpperSubstring,
+                                            std::vector<int> *outIDs ) {
+    for( unsigned int i=0; i<mTexts.size(); i++ ) {
+        if( mTexts[i] != NULL &&
+            strstr( mTexts[i], inUpperSubstring ) != NULL ) {
+            outIDs->push_back( i );
+            }
+        }
+    }
+
+
+
+void ObjectSearchIndex::findContaining( const char *inSubstring,
+                                        std::vector<int> *outIDs ) {
+    if( inSubstring[0] == '\0' ) {
+        return;
+        }
+
+    char *upper = stringToUpperCase( inSubstring );
+
+    char hasSpace = false;
+    for( char *c = upper; *c != '\0'; c++ ) {
+        if( isspace( (unsigned char)*c ) ) {
+            hasSpace = true;
+            break;
+            }
+        }
+
+    if( hasSpace ) {
+        // can match across word boundaries, word dictionary doesn't help
+        findContainingSlow( upper, outIDs );
+        delete [] upper;
+        return;
+        }
+
+
+    // without whitespace, a match must lie inside a single word
+    // so only objects in the postings of words containing it can match
+    std::vector<int> hits;
+
+    for( unsigned int w=0; w<mWords.size(); w++ ) {
+        if( mWords[w].find( upper ) == std::string::npos ) {
+            continue;
+            }
+
+        std::vector<Posting> *postings = &( mPostings[w] );
+
+        for( unsigned int p=0; p<postings->size(); p++ ) {
+            int id = (*postings)[p].id;
+
+            if( mScratch[id] == 0 ) {
+                mScratch[id] = 1;
+                hits.push_back( id );
+                }
+            }
+        }
+
+    delete [] upper;
+
+    std::sort( hits.begin(), hits.end() );
+
+    for( unsigned int i=0; i<hits.size(); i++ ) {
+        mScratch[ hits[i] ] = 0;
+        outIDs->push_back( hits[i] );
+        }
+    }
+
+
+
+void ObjectSearchIndex::findEqual( const char *inText,
+                                   std::vector<int> *outIDs ) {
+    char *upper = stringToUpperCase( inText );
+
+    std::vector<std::string> words;
+    splitSearchWords( upper, &words );
+
+    if( words.size() == 0 ) {
+        // texts that are empty or all whitespace aren't in any posting
+        for( unsigned int i=0; i<mTexts.size(); i++ ) {
+            if( mTexts[i] != NULL && strcmp( mTexts[i], upper ) == 0 ) {
+                outIDs->push_back( i );
+                }
+            }
+        delete [] upper;
+        return;
+        }
+
+
+    int wordNumber = getWordNumber( words[0] );
+
+    if( wordNumber != -1 ) {
+        std::vector<Posting> *postings = &( mPostings[wordNumber] );
+
+        for( unsigned int p=0; p<postings->size(); p++ ) {
+            int id = (*postings)[p].id;
+
+            if( strcmp( mTexts[id], upper ) == 0 ) {
+                outIDs->push_back( id );
+                }
+            }
+        }
+
+    delete [] upper;
+    }
+
+
+
+void ObjectSearchIndex::rankByWordMatches( const char *inQuery,
+                                           std::vector<int> *inOutIDs ) {
+    std::vector<std::string> queryWords;
+    splitSearchWords( inQuery, &queryWords );
+
+    std::vector<int> queryWordNumbers;
+
+    for( unsigned int i=0; i<queryWords.size(); i++ ) {
+        int wordNumber = getWordNumber( queryWords[i] );
+
+        if( wordNumber != -1 ) {
+            queryWordNumbers.push_back( wordNumber );
+
+            std::vector<Posting> *postings = &( mPostings[wordNumber] );
+
+            for( unsigned int p=0; p<postings->size(); p++ ) {
+                mScratch[ (*postings)[p].id ] += (*postings)[p].count;
+                }
+            }
+        }
+
+
+    std::vector<float> scores( inOutIDs->size(), 0 );
+
+    for( unsigned int i=0; i<inOutIDs->size(); i++ ) {
+        int id = (*inOutIDs)[i];
+
+        if( id >= 0 && id < (int)mTexts.size() && mNumWords[id] > 0 ) {
+            scores[i] = (float)mScratch[id] / (float)mNumWords[id];
+            }
+        }
+
+    for( unsigned int i=0; i<queryWordNumbers.size(); i++ ) {
+        std::vector<Posting> *postings =
+            &( mPostings[ queryWordNumbers[i] ] );
+
+        for( unsigned int p=0; p<postings->size(); p++ ) {
+            mScratch[ (*postings)[p].id ] = 0;
+            }
+        }
+
+
+    std::vector<unsigned int> order( inOutIDs->size() );
+    for( unsigned int i=0; i<order.size(); i++ ) {
+        order[i] = i;
+        }
+
+    std::sort( order.begin(), order.end(),
+               [&]( unsigned int a, unsigned int b ) {
+                   if( scores[a] != scores[b] ) {
+                       return scores[a] > scores[b];
+                       }
+                   return (*inOutIDs)[a] < (*inOutIDs)[b];
+                   } );
+
+    std::vector<int> sorted( order.size() );
+    for( unsigned int i=0; i<order.size(); i++ ) {
+        sorted[i] = (*inOutIDs)[ order[i] ];
+        }
+
+    *inOutIDs = sorted;
+    }
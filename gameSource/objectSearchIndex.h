@@ -0,0 +1,103 @@
+#ifndef OBJECT_SEARCH_INDEX_INCLUDED
+#define OBJECT_SEARCH_INDEX_INCLUDED
+
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+
+// inverted word index over object descriptions
+//
+// Texts are upper-cased and split into words on whitespace once, when
+// they are added.  After that, searches only walk the word dictionary and
+// the posting lists of matching words, instead of re-reading and
+// re-tokenizing every object description.
+//
+// The caller decides what text to index for each object (full description,
+// stripped of comments, truncated, etc.)
+class ObjectSearchIndex {
+
+    public:
+
+        ObjectSearchIndex();
+        ~ObjectSearchIndex();
+
+
+        // drops all indexed objects
+        void clear();
+
+
+        // IDs must be added in increasing order
+        // inText copied internally
+        void addObject( int inID, const char *inText );
+
+
+        // upper-cased text for inID, or NULL if inID was not added
+        const char *getText( int inID );
+
+
+        // appends IDs of objects whose text contains inSubstring,
+        // ignoring case, to outIDs, in increasing ID order
+        //
+        // empty substring matches nothing
+        void findContaining( const char *inSubstring,
+                             std::vector<int> *outIDs );
+
+
+        // appends IDs of objects whose whole text equals inText,
+        // ignoring case, to outIDs, in increasing ID order
+        void findEqual( const char *inText, std::vector<int> *outIDs );
+
+
+        // sorts inOutIDs so that objects with the most whole-word matches
+        // for the words in inQuery, relative to how many words are in their
+        // text, come first.
+        // Each occurrence of a query word in a text counts once,
+        // and a query word repeated in inQuery counts again.
+        // Ties, and IDs that were not added, are sorted by increasing ID.
+        void rankByWordMatches( const char *inQuery,
+                                std::vector<int> *inOutIDs );
+
+
+    protected:
+
+        typedef struct Posting {
+                int id;
+                // times the word appears in this object's text
+                int count;
+            } Posting;
+
+
+        // indexed by object ID, NULL for objects not added
+        std::vector<char*> mTexts;
+        std::vector<int> mNumWords;
+
+        std::unordered_map<std::string, int> mWordLookup;
+        std::vector<std::string> mWords;
+
+        // indexed by word number, sorted by object ID
+        std::vector< std::vector<Posting> > mPostings;
+
+
+        // per-object scratch space for searches, all zero between calls
+        std::vector<int> mScratch;
+
+
+        // -1 if not found
+        int getWordNumber( const std::string &inWord );
+
+        void findContainingSlow( const char *inUpperSubstring,
+                                 std::vector<int> *outIDs );
+    };
+
+
+
+// splits inText into upper-cased words on whitespace
+void splitSearchWords( const char *inText,
+                       std::vector<std::string> *outWords );
+
+
+
+#endif
@@ -20,6 +20,7 @@
 #include "minorGems/system/Time.h"
 
 #include "binFolderCache.h"
+#include "loadingWorkers.h"
 
 
 
@@ -351,8 +352,27 @@ static SoundRecord *getSoundRecord( int inID ) {
 
 
 
+// regenerates one reverb cache file on a loading worker
+class ReverbJob : public LoadingJob {
+    public:
+
+        ReverbJob( SoundRecord *inRecord, File *inReverbFolder )
+                : mRecord( inRecord ), mReverbFolder( inReverbFolder ) {
+            }
+
+        virtual void run() {
+            generateReverb( mRecord, mReverbFolder );
+            }
+
+        SoundRecord *mRecord;
+        File *mReverbFolder;
+    };
+
+
+
 static SimpleVector<int> reverbsToRegenerate;
 static int nextReverbToRegenerate = 0;
+static char reverbJobsAdded = false;
 static File *reverbFolder;
 
 static int currentSoundFile = 0;
@@ -386,7 +406,10 @@ int initSoundBankStart( char *outRebuildingCache ) {
 
     currentSoundFile = 0;
     currentReverbFile = 0;
+    reverbJobsAdded = false;
     
+    startLoadingWorkers();
+
     char rebuildingSounds, rebuildingReverbs;
     
     
@@ -586,11 +609,27 @@ float initSoundBankStep() {
         }
     else if( nextReverbToRegenerate < reverbsToRegenerate.size() ) {
 
-        int id = reverbsToRegenerate.getElementDirect( nextReverbToRegenerate );
-    
-        generateReverb( getSoundRecord( id ), reverbFolder );
-
-        nextReverbToRegenerate++;
+        if( ! reverbJobsAdded ) {
+            // each convolution is independent, hand them all out at once
+            for( int i=0; i<reverbsToRegenerate.size(); i++ ) {
+                int id = reverbsToRegenerate.getElementDirect( i );
+                
+                addLoadingJob( 
+                    new ReverbJob( getSoundRecord( id ), reverbFolder ) );
+                }
+            reverbJobsAdded = true;
+            }
+        
+        // wait for at least one per step, then take any others that
+        // are done
+        LoadingJob *job = getDoneLoadingJob( true );
+        
+        while( job != NULL ) {
+            delete job;
+            nextReverbToRegenerate++;
+            
+            job = getDoneLoadingJob( false );
+            }
         
         if( nextReverbToRegenerate == reverbsToRegenerate.size() ) {
             // done regenning reverbs, and there were some
@@ -663,6 +702,8 @@ float initSoundBankStep() {
 
 
 void initSoundBankFinish() {
+    stopLoadingWorkers();
+
     endMultiConvolution( &reverbConvolution );
     
     freeBinFolderCache( soundCache );
@@ -17,6 +17,7 @@
 
 #include "folderCache.h"
 #include "binFolderCache.h"
+#include "loadingWorkers.h"
 
 
 
@@ -64,6 +65,10 @@ static SimpleVector<int> loadedSprites;
 static char *loadingFailureFileName = NULL;
 
 
+// bin_cache files read ahead of decoding, per loading worker
+#define MAX_SPRITE_JOBS_PER_WORKER 8
+
+
 
 
 int getMaxSpriteID() {
@@ -121,6 +126,8 @@ int initSpriteBankStart( char *outRebuildingCache ) {
 
     blankSprite = fillSprite( onePixel, 1, 1 );
     
+    startLoadingWorkers();
+
     return cache.numFiles + binCache.numFiles;
     }
 
@@ -166,8 +173,26 @@ static void setLoadingFailureFileName( char *inNewFileName ) {
 
 
 
-static void loadSpriteFromRawTGAData( int inSpriteID, unsigned char *inTGAData,
-                                      int inDataLength ) {
+// what we learn about a sprite from its pixels, computed off
+// the main thread during bank loading
+typedef struct SpriteShape {
+        int w, h;
+        int maxD;
+        char *hitMap;
+        int centerXOffset, centerYOffset;
+        int visibleW, visibleH;
+    } SpriteShape;
+
+
+
+// safe to call on a loading worker thread
+// returns NULL on failure, and sets outWrongFormat if the image was
+// readable but not a 4-channel image
+static RawRGBAImage *decodeSpriteImage( int inSpriteID, 
+                                        unsigned char *inTGAData,
+                                        int inDataLength,
+                                        char *outWrongFormat ) {
+    *outWrongFormat = false;
     
     RawRGBAImage *spriteImage = readTGAFileRawFromBuffer( inTGAData, 
                                                           inDataLength);
@@ -179,96 +204,140 @@ static void loadSpriteFromRawTGAData( int inSpriteID, unsigned char *inTGAData,
         delete spriteImage;
         spriteImage = NULL;
         
-        setLoadingFailureFileName(
-            autoSprintf( "sprites/%d.tga", inSpriteID ) );
+        *outWrongFormat = true;
         }
-                            
-    if( spriteImage != NULL ) {
-        SpriteRecord *r = getSpriteRecord( inSpriteID );
-                        
-        r->sprite =
-            fillSprite( spriteImage->mRGBABytes, 
-                        spriteImage->mWidth,
-                        spriteImage->mHeight );
-        
-        r->w = spriteImage->mWidth;
-        r->h = spriteImage->mHeight;                
-        
-        doublePair offset = { (double)( r->centerAnchorXOffset ),
-                              (double)( r->centerAnchorYOffset ) };
-        
-        setSpriteCenterOffset( r->sprite, offset );
-        
-        
+
+    return spriteImage;
+    }
+
+
+
+// safe to call on a loading worker thread
+static void measureSpriteImage( RawRGBAImage *inImage, 
+                                SpriteShape *outShape ) {
+    
+    outShape->w = inImage->mWidth;
+    outShape->h = inImage->mHeight;                
         
-        r->maxD = r->w;
-        if( r->h > r->maxD ) {
-            r->maxD = r->h;
-            }        
+    outShape->maxD = outShape->w;
+    if( outShape->h > outShape->maxD ) {
+        outShape->maxD = outShape->h;
+        }        
         
-        int numPixels = r->w * r->h;
-        r->hitMap = new char[ numPixels ];
+    int numPixels = outShape->w * outShape->h;
+    outShape->hitMap = new char[ numPixels ];
         
-        memset( r->hitMap, 1, numPixels );
+    memset( outShape->hitMap, 1, numPixels );
         
                     
-        int numBytes = numPixels * 4;
+    int numBytes = numPixels * 4;
                     
-        unsigned char *bytes = spriteImage->mRGBABytes;
+    unsigned char *bytes = inImage->mRGBABytes;
                     
-        // track max/min x and y to compute average for center
+    // track max/min x and y to compute average for center
 
-        int minX = r->w;
-        int maxX = 0;
+    int minX = outShape->w;
+    int maxX = 0;
                     
-        int minY = r->h;
-        int maxY = 0;
+    int minY = outShape->h;
+    int maxY = 0;
                     
-        int w = r->w;
+    int w = outShape->w;
                     
 
-        // alpha is 4th byte
-        int p=0;
-        for( int b=3; b<numBytes; b+=4 ) {
-            if( bytes[b] < 64 ) {
-                r->hitMap[p] = 0;
-                }
-            else {
-                int y = p / w;
-                int x = p % w;
+    // alpha is 4th byte
+    int p=0;
+    for( int b=3; b<numBytes; b+=4 ) {
+        if( bytes[b] < 64 ) {
+            outShape->hitMap[p] = 0;
+            }
+        else {
+            int y = p / w;
+            int x = p % w;
 
-                if( y < minY ) {
-                    minY = y;
-                    }
-                if( y > maxY ) {
-                    maxY = y;
-                    }
+            if( y < minY ) {
+                minY = y;
+                }
+            if( y > maxY ) {
+                maxY = y;
+                }
 
-                if( x < minX ) {
-                    minX = x;
-                    }
-                if( x > maxX ) {
-                    maxX = x;
-                    }
+            if( x < minX ) {
+                minX = x;
+                }
+            if( x > maxX ) {
+                maxX = x;
                 }
-                        
-            p++;
             }
+                        
+        p++;
+        }
                     
-        for( int e=0; e<3; e++ ) {    
-            expandMap( r->hitMap, r->w, r->h );
-            }
+    for( int e=0; e<3; e++ ) {    
+        expandMap( outShape->hitMap, outShape->w, outShape->h );
+        }
 
-        r->centerXOffset = 
-            ( maxX + minX ) / 2 - 
-            r->w / 2;
+    outShape->centerXOffset = 
+        ( maxX + minX ) / 2 - 
+        outShape->w / 2;
 
-        r->centerYOffset = 
-            ( maxY + minY ) / 2 - 
-            r->h / 2;
+    outShape->centerYOffset = 
+        ( maxY + minY ) / 2 - 
+        outShape->h / 2;
                     
-        r->visibleW = maxX - minX;
-        r->visibleH = maxY - minY;
+    outShape->visibleW = maxX - minX;
+    outShape->visibleH = maxY - minY;
+    }
+
+
+
+// main thread only, uploads image to GPU
+// takes ownership of inShape's hit map
+static void applySpriteImage( int inSpriteID, RawRGBAImage *inImage,
+                              SpriteShape *inShape ) {
+    SpriteRecord *r = getSpriteRecord( inSpriteID );
+                        
+    r->sprite =
+        fillSprite( inImage->mRGBABytes, 
+                    inImage->mWidth,
+                    inImage->mHeight );
+    
+    doublePair offset = { (double)( r->centerAnchorXOffset ),
+                          (double)( r->centerAnchorYOffset ) };
+        
+    setSpriteCenterOffset( r->sprite, offset );
+
+    r->w = inShape->w;
+    r->h = inShape->h;
+    r->maxD = inShape->maxD;
+    r->hitMap = inShape->hitMap;
+    r->centerXOffset = inShape->centerXOffset;
+    r->centerYOffset = inShape->centerYOffset;
+    r->visibleW = inShape->visibleW;
+    r->visibleH = inShape->visibleH;
+    }
+
+
+
+static void loadSpriteFromRawTGAData( int inSpriteID, unsigned char *inTGAData,
+                                      int inDataLength ) {
+    
+    char wrongFormat;
+    
+    RawRGBAImage *spriteImage = decodeSpriteImage( inSpriteID, 
+                                                   inTGAData, inDataLength,
+                                                   &wrongFormat );
+
+    if( wrongFormat ) {
+        setLoadingFailureFileName(
+            autoSprintf( "sprites/%d.tga", inSpriteID ) );
+        }
+                            
+    if( spriteImage != NULL ) {
+        SpriteShape shape;
+        measureSpriteImage( spriteImage, &shape );
+        
+        applySpriteImage( inSpriteID, spriteImage, &shape );
 
         delete spriteImage;
         }
@@ -276,6 +345,92 @@ static void loadSpriteFromRawTGAData( int inSpriteID, unsigned char *inTGAData,
 
 
 
+// decodes one bin_cache TGA on a loading worker
+class SpriteDecodeJob : public LoadingJob {
+    public:
+
+        // takes ownership of inTGAData
+        SpriteDecodeJob( int inSpriteID, unsigned char *inTGAData,
+                         int inDataLength )
+                : mSpriteID( inSpriteID ),
+                  mTGAData( inTGAData ), mDataLength( inDataLength ),
+                  mImage( NULL ), mWrongFormat( false ) {
+            mShape.hitMap = NULL;
+            }
+
+        virtual ~SpriteDecodeJob() {
+            if( mTGAData != NULL ) {
+                delete [] mTGAData;
+                }
+            if( mImage != NULL ) {
+                delete mImage;
+                }
+            if( mShape.hitMap != NULL ) {
+                delete [] mShape.hitMap;
+                }
+            }
+
+        virtual void run() {
+            mImage = decodeSpriteImage( mSpriteID, mTGAData, mDataLength,
+                                        &mWrongFormat );
+            
+            delete [] mTGAData;
+            mTGAData = NULL;
+
+            if( mImage != NULL ) {
+                measureSpriteImage( mImage, &mShape );
+                }
+            }
+
+        int mSpriteID;
+
+        unsigned char *mTGAData;
+        int mDataLength;
+
+        RawRGBAImage *mImage;
+        char mWrongFormat;
+
+        SpriteShape mShape;
+    };
+
+
+
+// uploads a decoded sprite on the main thread
+static void finishSpriteDecodeJob( SpriteDecodeJob *inJob ) {
+    if( inJob->mWrongFormat ) {
+        setLoadingFailureFileName(
+            autoSprintf( "sprites/%d.tga", inJob->mSpriteID ) );
+        }
+
+    if( inJob->mImage != NULL ) {
+        applySpriteImage( inJob->mSpriteID, inJob->mImage, &( inJob->mShape ) );
+        
+        // record owns hit map now
+        inJob->mShape.hitMap = NULL;
+        }
+
+    SpriteRecord *r = getSpriteRecord( inJob->mSpriteID );
+    
+    r->numStepsUnused = 0;
+    loadedSprites.push_back( inJob->mSpriteID );
+    
+    delete inJob;
+    }
+
+
+
+// collects finished decode jobs, waiting for all of them if inWaitForAll
+static void collectSpriteDecodeJobs( char inWaitForAll ) {
+    LoadingJob *job = getDoneLoadingJob( inWaitForAll );
+    
+    while( job != NULL ) {
+        finishSpriteDecodeJob( (SpriteDecodeJob*)job );
+        
+        job = getDoneLoadingJob( inWaitForAll );
+        }
+    }
+
+
 
 
 typedef struct LoadedSpritePlaceholder {
@@ -485,24 +640,41 @@ float initSpriteBankStep() {
                     SpriteRecord *r = getSpriteRecord( spriteID );
                     
                     if( r != NULL ) {
-                        loadSpriteFromRawTGAData( 
-                            spriteID, contents, contSize );
-                    
-                        r->numStepsUnused = 0;
-                        loadedSprites.push_back( spriteID );
+                        // decode and measure on a worker, upload once
+                        // it comes back
+                        addLoadingJob( 
+                            new SpriteDecodeJob( spriteID, 
+                                                 contents, contSize ) );
+                        }
+                    else {
+                        delete [] contents;
                         }
-                    
-                    delete [] contents;
                     }
                 }
             }
         delete [] fileName;
         currentBinFile++;
+
+
+        if( currentBinFile == binCache.numFiles ) {
+            // all read, wait for the rest to be decoded
+            collectSpriteDecodeJobs( true );
+            }
+        else {
+            if( getNumLoadingJobs() > 
+                MAX_SPRITE_JOBS_PER_WORKER * getNumLoadingWorkers() ) {
+                
+                // don't let reading get too far ahead of decoding
+                finishSpriteDecodeJob( 
+                    (SpriteDecodeJob*)getDoneLoadingJob( true ) );
+                }
+            collectSpriteDecodeJobs( false );
+            }
         }
     
     
-
-    return (float)( currentFile + currentBinFile ) / 
+    // files still being decoded don't count as done
+    return (float)( currentFile + currentBinFile - getNumLoadingJobs() ) / 
         (float)( cache.numFiles + binCache.numFiles );
     }
 
@@ -513,6 +685,8 @@ static char spriteBankLoaded = false;
 
 void initSpriteBankFinish() {    
 
+    stopLoadingWorkers();
+
     freeFolderCache( cache );
     freeBinFolderCache( binCache );
     
@@ -0,0 +1,350 @@
+
+#include "spriteBank.h"
+#include "objectBank.h"
+#include "animationBank.h"
+#include "transitionBank.h"
+#include "categoryBank.h"
+
+#include "soundBank.h"
+
+
+#include "minorGems/io/file/File.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/game/game.h"
+
+
+#include <stdlib.h>
+#include <math.h>
+
+
+// make binFolderCache happy
+int versionNumber = 60;
+
+
+static int targetNumSteps = 78;
+
+
+void runSteps( const char *inBankName,
+                 int inNumExpectedSteps,
+                 float (*inStepFunction)() ) {
+    printf( "Loading bank of %d %s\n", inNumExpectedSteps, inBankName );
+        
+    int batchSize = inNumExpectedSteps / targetNumSteps;
+        
+    if( batchSize < 1 ) {
+        batchSize = 1;
+        }
+
+    float progress = 0;
+    int lastStepsPrinted = 0;
+        
+    printf( "[" );
+    
+    for( int i=0; i<targetNumSteps; i++ ) {
+        printf( "-" );
+        }
+    printf( "]" );
+
+    while( progress < 1 ) {
+        for( int i=0; i<batchSize && progress < 1; i++ ) {
+            progress = (*inStepFunction)();
+            }
+            
+        // erase old progress steps
+        for( int p=0; p<targetNumSteps; p++ ) {
+            printf( "\b" );
+            }
+        printf( "\b" );
+
+        lastStepsPrinted = lrint( floor( progress * targetNumSteps ) );
+        
+        for( int p=0; p<lastStepsPrinted; p++ ) {
+            printf( "#" );
+            }
+        for( int p=0; p<targetNumSteps - lastStepsPrinted; p++ ) {
+            printf( "-" );
+            }
+        printf( "]" );
+        
+        fflush( stdout );
+        }
+    
+    printf( "\n" );
+    }
+
+
+
+static void usage() {
+    printf( "\nUsage:\n\n transLookupBenchmark [transLookups.txt] [passes]\n\n"
+            "Replays getTrans lookups recorded by the server "
+            "(recordTransLookups setting)\n"
+            "against both the hash index and the old linear scan.\n"
+            "Without a lookup file, replays a synthetic workload "
+            "built from the\n"
+            "transitions in this directory.\n\n" );
+    exit( 0 );
+    }
+
+
+
+typedef struct TransLookup {
+        int actor;
+        int target;
+        char lastUseActor;
+        char lastUseTarget;
+        int contTransFlag;
+    } TransLookup;
+
+
+
+static void addLookup( SimpleVector<TransLookup> *inList,
+                       int inActor, int inTarget,
+                       char inLastUseActor = false, 
+                       char inLastUseTarget = false,
+                       int inContTransFlag = 0 ) {
+    TransLookup l = { inActor, inTarget, inLastUseActor, inLastUseTarget,
+                      inContTransFlag };
+    inList->push_back( l );
+    }
+
+
+
+static void readLookups( FILE *inFile, SimpleVector<TransLookup> *inList ) {
+    int a, t, lua, lut, flag;
+    
+    while( fscanf( inFile, "%d %d %d %d %d", &a, &t, &lua, &lut, &flag ) 
+           == 5 ) {
+        addLookup( inList, a, t, lua, lut, flag );
+        }
+    }
+
+
+
+// what the server asks about each object: using it bare-handed,
+// decaying it, and every defined use, plus near-misses of those uses
+static void makeSyntheticLookups( SimpleVector<TransLookup> *inList ) {
+    int maxID = getMaxObjectID();
+    
+    for( int id=0; id<=maxID; id++ ) {
+        if( getObject( id ) == NULL ) {
+            continue;
+            }
+        
+        addLookup( inList, 0, id );
+        addLookup( inList, -1, id );
+        addLookup( inList, id, -1 );
+        addLookup( inList, id, 0 );
+        addLookup( inList, -1, id, false, false, 1 );
+        addLookup( inList, -1, id, false, false, 2 );
+
+        SimpleVector<TransRecord*> *uses = getAllUses( id );
+        
+        for( int i=0; i<uses->size(); i++ ) {
+            TransRecord *r = uses->getElementDirect( i );
+            
+            if( r->target != id ) {
+                // each record once, under its target
+                continue;
+                }
+
+            addLookup( inList, r->actor, r->target, r->lastUseActor,
+                       r->lastUseTarget, r->contTransFlag );
+            addLookup( inList, r->actor, r->target, ! r->lastUseActor,
+                       r->lastUseTarget, r->contTransFlag );
+            addLookup( inList, r->actor, r->target, r->lastUseActor,
+                       ! r->lastUseTarget, r->contTransFlag );
+            }
+        }
+    }
+
+
+
+typedef TransRecord *(*TransLookupFunction)( int, int, char, char, int );
+
+
+// returns seconds taken
+static double timeLookups( TransLookup *inLookups, int inNumLookups,
+                           int inNumPasses, 
+                           TransLookupFunction inFunction,
+                           int *outNumFound ) {
+    int numFound = 0;
+    
+    double startTime = Time::getCurrentTime();
+    
+    for( int p=0; p<inNumPasses; p++ ) {
+        for( int i=0; i<inNumLookups; i++ ) {
+            TransLookup *l = &( inLookups[i] );
+            
+            if( inFunction( l->actor, l->target, 
+                            l->lastUseActor, l->lastUseTarget,
+                            l->contTransFlag ) != NULL ) {
+                numFound++;
+                }
+            }
+        }
+    
+    *outNumFound = numFound;
+    
+    return Time::getCurrentTime() - startTime;
+    }
+
+
+
+static TransRecord *getTransHashed( int inActor, int inTarget, 
+                                    char inLastUseActor,
+                                    char inLastUseTarget, 
+                                    int inContTransFlag ) {
+    return getTrans( inActor, inTarget, inLastUseActor, inLastUseTarget,
+                     inContTransFlag );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+    
+    if( inNumArgs > 3 ) {
+        usage();
+        }
+    
+    int numPasses = 0;
+    
+    if( inNumArgs == 3 ) {
+        numPasses = atoi( inArgs[2] );
+        
+        if( numPasses < 1 ) {
+            usage();
+            }
+        }
+    
+    
+    char rebuilding;
+
+    int num = initObjectBankStart( &rebuilding, true, true );
+    
+    runSteps( "objects", num, &initObjectBankStep );
+    
+    initObjectBankFinish();
+
+    printf( "\n" );
+
+
+    num = initCategoryBankStart( &rebuilding );
+    
+    runSteps( "categories", num, &initCategoryBankStep );
+    
+    initCategoryBankFinish();
+
+    printf( "\n" );
+
+
+    // same auto-generated transitions as server
+    num = initTransBankStart( &rebuilding, true, true, true, true );
+
+    runSteps( "transitions", num, &initTransBankStep );
+    
+    initTransBankFinish();
+
+    printf( "\n" );
+
+    
+    SimpleVector<TransLookup> lookups;
+    
+    if( inNumArgs >= 2 ) {
+        FILE *f = fopen( inArgs[1], "r" );
+        
+        if( f == NULL ) {
+            printf( "Failed to open %s\n", inArgs[1] );
+            usage();
+            }
+        readLookups( f, &lookups );
+        fclose( f );
+
+        printf( "Read %d recorded lookups from %s\n", 
+                lookups.size(), inArgs[1] );
+        }
+    else {
+        makeSyntheticLookups( &lookups );
+        
+        printf( "Made %d synthetic lookups\n", lookups.size() );
+        }
+    
+    if( lookups.size() == 0 ) {
+        printf( "No lookups to replay\n" );
+        return 0;
+        }
+    
+    TransLookup *lookupArray = lookups.getElementArray();
+    int numLookups = lookups.size();
+    
+
+    // check first, so a wrong index doesn't go unnoticed
+    int numMismatches = 0;
+    
+    for( int i=0; i<numLookups; i++ ) {
+        TransLookup *l = &( lookupArray[i] );
+        
+        TransRecord *hashed = getTrans( l->actor, l->target, 
+                                        l->lastUseActor, l->lastUseTarget,
+                                        l->contTransFlag );
+        TransRecord *scanned = getTransByScan( l->actor, l->target, 
+                                               l->lastUseActor, 
+                                               l->lastUseTarget,
+                                               l->contTransFlag );
+        if( hashed != scanned ) {
+            if( numMismatches < 10 ) {
+                printf( "Mismatch for %d %d %d %d %d\n",
+                        l->actor, l->target, 
+                        l->lastUseActor, l->lastUseTarget,
+                        l->contTransFlag );
+                }
+            numMismatches++;
+            }
+        }
+
+    if( numMismatches > 0 ) {
+        printf( "%d of %d lookups differ between hash and scan\n",
+                numMismatches, numLookups );
+        }
+    else {
+        printf( "All %d lookups match between hash and scan\n", numLookups );
+        }
+    
+
+    if( numPasses == 0 ) {
+        // about ten million lookups
+        numPasses = 10000000 / numLookups + 1;
+        }
+    
+    int numFoundScan, numFoundHash;
+    
+    double scanTime = timeLookups( lookupArray, numLookups, numPasses,
+                                   &getTransByScan, &numFoundScan );
+    double hashTime = timeLookups( lookupArray, numLookups, numPasses,
+                                   &getTransHashed, &numFoundHash );
+    
+    double total = (double)numLookups * numPasses;
+    
+    printf( "\n%d passes over %d lookups (%d found per pass)\n\n",
+            numPasses, numLookups, numFoundHash / numPasses );
+    
+    printf( "scan: %.3f s  (%.1f ns per lookup)\n", 
+            scanTime, 1e9 * scanTime / total );
+    printf( "hash: %.3f s  (%.1f ns per lookup)\n", 
+            hashTime, 1e9 * hashTime / total );
+    
+    if( hashTime > 0 ) {
+        printf( "speedup: %.2fx\n", scanTime / hashTime );
+        }
+    
+    delete [] lookupArray;
+
+    freeTransBank();
+    freeCategoryBank();
+    freeObjectBank();
+    
+    if( numMismatches > 0 ) {
+        return 1;
+        }
+    return 0;
+    }
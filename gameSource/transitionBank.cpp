@@ -6,9 +6,12 @@
 
 #include "minorGems/io/file/File.h"
 
+#include <string.h>
+
 
 
 #include "folderCache.h"
+#include "bankSnapshot.h"
 #include "objectBank.h"
 #include "categoryBank.h"
 
@@ -37,6 +40,18 @@ static SimpleVector<TransRecord *> *usesMap;
 static SimpleVector<TransRecord *> *producesMap;
 
 
+// open-addressing hash of records by their full getTrans key
+// size is a power of two, kept at most half full
+// only records that getTrans could find in usesMap are present
+static TransRecord **transHash = NULL;
+static int transHashSize = 0;
+static int transHashCount = 0;
+
+
+// if set, each getTrans lookup is written here
+static FILE *transLookupRecordFile = NULL;
+
+
 static int depthMapSize = 0;
 static int *depthMap = NULL;
 
@@ -57,6 +72,93 @@ static char autoGenerateUsedObjectTransitions = false;
 static char autoGenerateGenericUseTransitions = false;
 static char autoGenerateVariableTransitions = false;
 
+// all records came from transitions/cache.snap
+static char loadedFromSnapshot = false;
+
+
+// bump when TransRecord changes
+#define TRANS_SNAPSHOT_VERSION 1
+
+
+
+static void addTransToRecords( TransRecord *r ) {
+    records.push_back( r );
+    
+    if( r->actor > maxID ) {
+        maxID = r->actor;
+        }
+    if( r->target > maxID ) {
+        maxID = r->target;
+        }
+    if( r->newActor > maxID ) {
+        maxID = r->newActor;
+        }
+    if( r->newTarget > maxID ) {
+        maxID = r->newTarget;
+        }
+    }
+
+
+
+// transitions as read from files, before initTransBankFinish
+// TransRecord has no pointers, so each is saved whole
+static char loadTransSnapshot() {
+    BankSnapshotReader *reader = 
+        openBankSnapshot( cache, "transitions",
+                          TRANS_SNAPSHOT_VERSION, sizeof( TransRecord ) );
+    
+    if( reader == NULL ) {
+        return false;
+        }
+    
+    int numRecords = reader->getNumRecords();
+    
+    TransRecord *loaded = new TransRecord[ numRecords ];
+    
+    reader->readBytes( loaded, numRecords * sizeof( TransRecord ) );
+    
+    if( ! reader->isGood() ) {
+        delete [] loaded;
+        discardBankSnapshot( reader, "transitions" );
+        return false;
+        }
+    
+    delete reader;
+
+    for( int i=0; i<numRecords; i++ ) {
+        TransRecord *r = new TransRecord;
+        *r = loaded[i];
+        addTransToRecords( r );
+        }
+    
+    delete [] loaded;
+
+    printf( "Loaded %d transitions from snapshot\n", numRecords );
+    
+    return true;
+    }
+
+
+
+static void saveTransSnapshot() {
+    BankSnapshotWriter *writer = 
+        startBankSnapshot( cache, 
+                           TRANS_SNAPSHOT_VERSION, sizeof( TransRecord ) );
+    
+    if( writer == NULL ) {
+        return;
+        }
+    
+    for( int i=0; i<records.size(); i++ ) {
+        writer->writeBytes( records.getElementDirect( i ), 
+                            sizeof( TransRecord ) );
+        writer->endRecord();
+        }
+    
+    finishBankSnapshot( writer, "transitions" );
+    }
+
+
 
 static char shouldFileBeCached( char *inFileName ) {
     if( strstr( inFileName, ".txt" ) != NULL ) {
@@ -86,6 +188,13 @@ int initTransBankStart( char *outRebuildingCache,
     cache = initFolderCache( "transitions", outRebuildingCache,
                              shouldFileBeCached );
 
+    loadedFromSnapshot = loadTransSnapshot();
+    
+    if( loadedFromSnapshot ) {
+        // all loaded, one step to finish
+        return 1;
+        }
+
     return cache.numFiles;
     }
 
@@ -94,7 +203,7 @@ int initTransBankStart( char *outRebuildingCache,
 
 float initTransBankStep() {
         
-    if( currentFile == cache.numFiles ) {
+    if( loadedFromSnapshot || currentFile == cache.numFiles ) {
         return 1.0;
         }
     
@@ -219,20 +328,7 @@ float initTransBankStep() {
                 r->targetMinUseFraction = targetMinUseFraction;
                 
                 
-                records.push_back( r );
-                            
-                if( actor > maxID ) {
-                    maxID = actor;
-                    }
-                if( target > maxID ) {
-                    maxID = target;
-                    }
-                if( newActor > maxID ) {
-                    maxID = newActor;
-                    }
-                if( newTarget > maxID ) {
-                    maxID = newTarget;
-                    }
+                addTransToRecords( r );
 
                 delete [] contents;
                 }
@@ -274,12 +370,173 @@ static void handleWhatProbSetProduces( int inPossibleSetID,
 
 
 
+static unsigned int getTransHashSlot( int inActor, int inTarget,
+                                      char inLastUseActor,
+                                      char inLastUseTarget,
+                                      int inContTransFlag ) {
+    unsigned int h = (unsigned int)inActor * 0x9E3779B1U;
+    
+    h ^= (unsigned int)inTarget * 0x85EBCA77U;
+    h ^= (unsigned int)( ( inLastUseActor ? 1 : 0 ) | 
+                         ( inLastUseTarget ? 2 : 0 ) |
+                         ( inContTransFlag << 2 ) ) * 0xC2B2AE3DU;
+    
+    h ^= h >> 15;
+    h *= 0x27D4EB2FU;
+    h ^= h >> 13;
+    
+    return h & ( transHashSize - 1 );
+    }
+
+
+
+static char transKeyMatches( TransRecord *inR,
+                             int inActor, int inTarget,
+                             char inLastUseActor,
+                             char inLastUseTarget,
+                             int inContTransFlag ) {
+    return 
+        inR->actor == inActor && inR->target == inTarget &&
+        inR->lastUseActor == inLastUseActor &&
+        inR->lastUseTarget == inLastUseTarget &&
+        inR->contTransFlag == inContTransFlag;
+    }
+
+
+
+static unsigned int getTransHashSlot( TransRecord *inR ) {
+    return getTransHashSlot( inR->actor, inR->target,
+                             inR->lastUseActor, inR->lastUseTarget,
+                             inR->contTransFlag );
+    }
+
+
+
+// records not in usesMap can't be found by getTrans
+static char isTransInUsesMap( TransRecord *inR ) {
+    return 
+        inR->actor > 0 || 
+        ( inR->target >= 0 && inR->target != inR->actor );
+    }
+
+
+
+static void clearTransHash() {
+    if( transHash != NULL ) {
+        delete [] transHash;
+        transHash = NULL;
+        }
+    transHashSize = 0;
+    transHashCount = 0;
+    }
+
+
+
+static void insertIntoTransHash( TransRecord *inR );
+
+
+static void resizeTransHash( int inNewSize ) {
+    TransRecord **oldHash = transHash;
+    int oldSize = transHashSize;
+    
+    transHash = new TransRecord*[ inNewSize ];
+    transHashSize = inNewSize;
+    transHashCount = 0;
+    
+    memset( transHash, 0, sizeof( TransRecord* ) * inNewSize );
+    
+    if( oldHash != NULL ) {
+        for( int i=0; i<oldSize; i++ ) {
+            if( oldHash[i] != NULL ) {
+                insertIntoTransHash( oldHash[i] );
+                }
+            }
+        delete [] oldHash;
+        }
+    }
+
+
+
+// if a record with the same key is already present, it stays
+// (getTrans returns the first one in usesMap order)
+static void insertIntoTransHash( TransRecord *inR ) {
+    if( ! isTransInUsesMap( inR ) ) {
+        return;
+        }
+    
+    if( ( transHashCount + 1 ) * 2 > transHashSize ) {
+        int newSize = 1024;
+        while( ( transHashCount + 1 ) * 2 > newSize ) {
+            newSize *= 2;
+            }
+        resizeTransHash( newSize );
+        }
+
+    unsigned int mask = transHashSize - 1;
+    unsigned int slot = getTransHashSlot( inR );
+    
+    while( transHash[slot] != NULL ) {
+        TransRecord *other = transHash[slot];
+        
+        if( transKeyMatches( other, inR->actor, inR->target,
+                             inR->lastUseActor, inR->lastUseTarget,
+                             inR->contTransFlag ) ) {
+            return;
+            }
+        slot = ( slot + 1 ) & mask;
+        }
+    
+    transHash[slot] = inR;
+    transHashCount++;
+    }
+
+
+
+static void removeFromTransHash( TransRecord *inR ) {
+    if( transHashSize == 0 ) {
+        return;
+        }
+    
+    unsigned int mask = transHashSize - 1;
+    unsigned int slot = getTransHashSlot( inR );
+    
+    while( transHash[slot] != NULL && transHash[slot] != inR ) {
+        slot = ( slot + 1 ) & mask;
+        }
+
+    if( transHash[slot] == NULL ) {
+        return;
+        }
+    
+    // backward-shift later entries of the probe run into the gap
+    unsigned int gap = slot;
+    unsigned int next = ( gap + 1 ) & mask;
+    
+    while( transHash[next] != NULL ) {
+        unsigned int home = getTransHashSlot( transHash[next] );
+        
+        // distance from home to next, and from gap to next, along the run
+        if( ( ( next - home ) & mask ) >= ( ( next - gap ) & mask ) ) {
+            transHash[gap] = transHash[next];
+            gap = next;
+            }
+        next = ( next + 1 ) & mask;
+        }
+    
+    transHash[gap] = NULL;
+    transHashCount--;
+    }
+
+
+
 static void regenUsesAndProducesMaps() {
     for( int i=0; i<mapSize; i++ ) {
         usesMap[i].deleteAll();
         producesMap[i].deleteAll();
         }
 
+    clearTransHash();
+
 
     int numRecords = records.size();
     
@@ -295,6 +552,8 @@ static void regenUsesAndProducesMaps() {
         if( t->target >= 0 && t->target != t->actor ) {    
             usesMap[t->target].push_back( t );
             }
+
+        insertIntoTransHash( t );
         
         if( t->newActor != 0 ) {
             producesMap[t->newActor].push_back( t );
@@ -329,6 +588,10 @@ static void regenUsesAndProducesMaps() {
 
 void initTransBankFinish() {
     
+    if( ! loadedFromSnapshot ) {
+        saveTransSnapshot();
+        }
+
     freeFolderCache( cache );
 
 
@@ -1639,6 +1902,8 @@ void freeTransBank() {
     delete [] usesMap;
     delete [] producesMap;
     
+    clearTransHash();
+    
     if( depthMap != NULL ) {
         delete [] depthMap;
         depthMap = NULL;
@@ -1959,8 +2224,53 @@ void regenerateHumanMadeMap() {
 
 
 
+void setTransLookupRecordFile( FILE *inFile ) {
+    transLookupRecordFile = inFile;
+    }
+
+
+
 TransRecord *getTrans( int inActor, int inTarget, char inLastUseActor,
                        char inLastUseTarget, int inContTransFlag ) {
+    
+    if( transLookupRecordFile != NULL ) {
+        fprintf( transLookupRecordFile, "%d %d %d %d %d\n",
+                 inActor, inTarget, 
+                 inLastUseActor ? 1 : 0, inLastUseTarget ? 1 : 0,
+                 inContTransFlag );
+        }
+    
+    if( inTarget < 0 && inActor < 0 ) {
+        return NULL;
+        }
+    
+    if( transHashSize == 0 ) {
+        return NULL;
+        }
+    
+    unsigned int mask = transHashSize - 1;
+    unsigned int slot = getTransHashSlot( inActor, inTarget,
+                                          inLastUseActor, inLastUseTarget,
+                                          inContTransFlag );
+
+    while( transHash[slot] != NULL ) {
+        TransRecord *r = transHash[slot];
+        
+        if( transKeyMatches( r, inActor, inTarget,
+                             inLastUseActor, inLastUseTarget,
+                             inContTransFlag ) ) {
+            return r;
+            }
+        slot = ( slot + 1 ) & mask;
+        }
+    
+    return NULL;
+    }
+
+
+
+TransRecord *getTransByScan( int inActor, int inTarget, char inLastUseActor,
+                             char inLastUseTarget, int inContTransFlag ) {
     int mapIndex = inTarget;
     
     if( mapIndex < 0 ) {
@@ -2638,6 +2948,8 @@ void addTrans( int inActor, int inTarget,
             usesMap[inTarget].push_back( t );
             }
         
+        insertIntoTransHash( t );
+
         if( inNewActor != 0 ) {
             producesMap[inNewActor].push_back( t );
             }
@@ -2882,6 +3194,15 @@ void deleteTransFromBank( int inActor, int inTarget,
             usesMap[inTarget].deleteElementEqualTo( t );
             }
         
+        removeFromTransHash( t );
+        
+        // a record loaded twice under the same key may be left behind
+        TransRecord *dup = getTransByScan( inActor, inTarget, 
+                                           inLastUseActor, inLastUseTarget,
+                                           inContTransFlag );
+        if( dup != NULL ) {
+            insertIntoTransHash( dup );
+            }
 
         records.deleteElementEqualTo( t );
 
@@ -4,6 +4,8 @@
 
 #include "minorGems/util/SimpleVector.h"
 
+#include <stdio.h>
+
 
 
 typedef struct TransRecord {
@@ -122,6 +124,21 @@ TransRecord *getTrans( int inActor, int inTarget,
                        int inContTransFlag = false );
 
 
+// same result as getTrans, found by scanning the uses of inTarget
+// (or inActor) instead of through the hash index
+// slower, kept for benchmarking and checking the index
+TransRecord *getTransByScan( int inActor, int inTarget, 
+                             char inLastUseActor = false,
+                             char inLastUseTarget = false,
+                             int inContTransFlag = false );
+
+
+// if not NULL, each getTrans call writes a line
+// "actor target lastUseActor lastUseTarget contTransFlag" to inFile
+// pass NULL to stop
+void setTransLookupRecordFile( FILE *inFile );
+
+
 // same as getTrans, with actorChangeChance and targetChangeChance applied
 // returned pointer managed internally
 // limit of 100 results that can be used by caller simultanously
@@ -289,12 +289,15 @@ rm reverbImpulseResponse.aiff
 # cache.fcz files are full of compressed text files, so they're much smaller
 # and fine to included when they change
 rm */bin_*cache.fcz
+# bank snapshots are specific to the build that made them
+rm -f */cache.snap
 
 cd ~/checkout/diffWorking/dataLatest
 cp ~/checkout/OneLifeWorking/gameSource/reverbImpulseResponse.aiff .
 ~/checkout/OneLifeWorking/gameSource/regenerateCaches
 rm reverbImpulseResponse.aiff
 rm */bin_*cache.fcz
+rm -f */cache.snap
 
 
 echo "" 
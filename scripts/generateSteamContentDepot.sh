@@ -123,6 +123,8 @@ cp ~/checkout/OneLifeWorking/gameSource/reverbImpulseResponse.aiff .
 ~/checkout/OneLifeWorking/gameSource/regenerateCaches
 rm reverbImpulseResponse.aiff
 rm */bin_*cache.fcz
+# bank snapshots are specific to the build that made them
+rm -f */cache.snap
 
 
 
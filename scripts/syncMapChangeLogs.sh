@@ -2,6 +2,11 @@
 
 # delete old files from game server
 ssh bigserver2.onehouronelife.com 'find checkout/OneLife/server/mapChangeLogs/*mapLog.txt -mtime +14 -delete'
+ssh bigserver2.onehouronelife.com 'find checkout/OneLife/server/mapChangeLogs/*mapLog.bin* -mtime +14 -delete'
+
+
+# server logs are binary now, convert any that changed since last sync
+ssh bigserver2.onehouronelife.com 'cd checkout/OneLife/server/mapChangeLogs; for f in *mapLog.bin; do t=${f%.bin}.txt; if [ ! -e $t -o $f -nt $t ]; then ../mapChangeLogTool text $f; fi; done'
 
 
 # copy from game server to here
@@ -1,133 +1,194 @@
 #include "CoordinateTimeTracking.h"
 
+#include <math.h>
+
+
+
+#define INITIAL_NUM_SLOTS 1024
+
 
 
 CoordinateTimeTracking::CoordinateTimeTracking()
-        :mNextIndex( 0 ) {
+        : mSlots( NULL ),
+          mNumSlots( 0 ),
+          mNumUsed( 0 ),
+          mExpiryHead( 0 ),
+          mAnyCleaned( false ),
+          mLastStaleTime( 0 ) {
+
+    resize( INITIAL_NUM_SLOTS );
     }
 
 
 
+CoordinateTimeTracking::~CoordinateTimeTracking() {
+    delete [] mSlots;
+    }
 
-char CoordinateTimeTracking::checkExists( int inX, int inY, 
-                                          timeSec_t inCurTime ) {
-    
-    int dir = 1;
-    
-    int numRecords = mRecords.size();
-    
-
-    if( numRecords > 0 ) {
-        
-        CoordinateXYRecord *testR = mRecords.getElement( mNextIndex );
-
-        if( testR->y == inY &&
-            testR->x == inX ) {
-            
-            testR->t = inCurTime;
-            
-            return true;
-            }
 
 
-        if( testR->y > inY ||
-            ( testR->y == inY 
-              && 
-              testR->x > inX ) ) {
-            dir = -1;
-            }
+static unsigned int hashCoordinates( int inX, int inY ) {
+    unsigned int h = (unsigned int)inX * 0x9E3779B1U;
 
+    h ^= (unsigned int)inY * 0x85EBCA77U;
 
-        if( dir == 1 ) {
-            for( mNextIndex = mNextIndex; 
-                 mNextIndex < numRecords; mNextIndex ++ ) {
-                
-                CoordinateXYRecord *r = mRecords.getElement( mNextIndex );
-                if( r->y == inY &&
-                    r->x == inX ) {
-                    
-                    r->t = inCurTime;
-                    
-                    return true;
-                    }
-                
-                if( r->y > inY ||
-                    ( r->y == inY &&
-                      r->x > inX ) ) {
-                    // walked past spot and not found
-                    // keep mNextIndex as insert point
-                    break;
-                    }
-                }
-            }
-        else if( dir == -1 ) {
-            for( mNextIndex = mNextIndex; mNextIndex > -1; mNextIndex -- ) {
-                CoordinateXYRecord *r = mRecords.getElement( mNextIndex );
-                if( r->y == inY &&
-                    r->x == inX ) {
-                    
-                    r->t = inCurTime;
-                    
-                    return true;
-                    }
-                
-                if( r->y < inY ||
-                    ( r->y == inY &&
-                      r->x < inX ) ) {
-                    // walked past spot and not found
-                    // keep mNextIndex as insert point
-                    break;
-                    }
-                }
+    h ^= h >> 15;
+    h *= 0x27D4EB2FU;
+    h ^= h >> 13;
+
+    return h;
+    }
+
+
+
+// returns slot holding inX,inY, or empty slot where it would go
+int CoordinateTimeTracking::findSlot( int inX, int inY ) {
+    unsigned int mask = mNumSlots - 1;
+    unsigned int slot = hashCoordinates( inX, inY ) & mask;
+
+    while( mSlots[slot].used &&
+           ( mSlots[slot].x != inX || mSlots[slot].y != inY ) ) {
+        slot = ( slot + 1 ) & mask;
+        }
+
+    return slot;
+    }
+
+
+
+void CoordinateTimeTracking::removeSlot( int inSlot ) {
+    unsigned int mask = mNumSlots - 1;
+
+    // backward-shift later slots of the probe run into the gap
+    unsigned int gap = inSlot;
+    unsigned int next = ( gap + 1 ) & mask;
+
+    while( mSlots[next].used ) {
+        unsigned int home =
+            hashCoordinates( mSlots[next].x, mSlots[next].y ) & mask;
+
+        // distance from home to next, and from gap to next, along the run
+        if( ( ( next - home ) & mask ) >= ( ( next - gap ) & mask ) ) {
+            mSlots[gap] = mSlots[next];
+            gap = next;
             }
+        next = ( next + 1 ) & mask;
         }
-    else {
-        // no records, use this as insertion point
-        mNextIndex = 0;
+
+    mSlots[gap].used = false;
+    mNumUsed--;
+    }
+
+
+
+void CoordinateTimeTracking::resize( int inNumSlots ) {
+    CoordinateTimeSlot *oldSlots = mSlots;
+    int oldNumSlots = mNumSlots;
+
+    mNumSlots = inNumSlots;
+    mSlots = new CoordinateTimeSlot[ mNumSlots ];
+
+    for( int i=0; i<mNumSlots; i++ ) {
+        mSlots[i].used = false;
+        }
+
+    for( int i=0; i<oldNumSlots; i++ ) {
+        if( oldSlots[i].used ) {
+            mSlots[ findSlot( oldSlots[i].x, oldSlots[i].y ) ] = oldSlots[i];
+            }
         }
-    
-
-    // not found
-    
-    // insert new
-    CoordinateXYRecord r = { inX, inY, inCurTime };
-    
-    if( mNextIndex == numRecords ) {
-        // stick on end
-        mRecords.push_back( r );
+
+    if( oldSlots != NULL ) {
+        delete [] oldSlots;
         }
-    else if( mNextIndex == -1 ) {
-        // stick on front
-        mRecords.push_front( r );
-        mNextIndex = 0;
+    }
+
+
+
+
+char CoordinateTimeTracking::checkExists( int inX, int inY,
+                                          timeSec_t inCurTime ) {
+
+    timeSec_t second = floor( inCurTime );
+
+    int slot = findSlot( inX, inY );
+
+    CoordinateTimeSlot *s = &( mSlots[slot] );
+
+    char exists = false;
+    char needsListing = true;
+
+    if( s->used ) {
+        // cleaned, but not removed yet
+        exists = ! ( mAnyCleaned && s->t <= mLastStaleTime );
+
+        needsListing = ( s->listedSecond != second );
         }
     else {
-        mRecords.push_middle( r, mNextIndex );
+        if( ( mNumUsed + 1 ) * 2 > mNumSlots ) {
+            resize( mNumSlots * 2 );
+
+            slot = findSlot( inX, inY );
+            s = &( mSlots[slot] );
+            }
+
+        s->used = true;
+        s->x = inX;
+        s->y = inY;
+        mNumUsed++;
         }
-    return false;
+
+    s->t = inCurTime;
+
+    if( needsListing ) {
+        s->listedSecond = second;
+
+        CoordinateXYRecord r = { inX, inY, second };
+        mExpiryList.push_back( r );
+        }
+
+    return exists;
     }
 
 
 
 void CoordinateTimeTracking::cleanStale( timeSec_t inStaleTime ) {
-    int beforeCleanSize = mRecords.size();
-    
-    // pre-allocate space
-    SimpleVector<CoordinateXYRecord> temp( beforeCleanSize );
-    
-    
-    for( int i=0; i<mRecords.size(); i++ ) {
-        CoordinateXYRecord *r = mRecords.getElement( i );
-        
-        if( r->t > inStaleTime ) {
-            temp.push_back( *r );
+    if( ! mAnyCleaned || inStaleTime > mLastStaleTime ) {
+        mLastStaleTime = inStaleTime;
+        mAnyCleaned = true;
+        }
+
+    // Entries come off the front in the order their seconds ended.
+    // Anything last touched in a second that ended by the stale time is
+    // stale.  Records in the current partial second are left for
+    // later, and checkExists treats them as gone until then.
+    int numEntries = mExpiryList.size();
+
+    while( mExpiryHead < numEntries ) {
+        CoordinateXYRecord *r = mExpiryList.getElement( mExpiryHead );
+
+        if( r->t + 1 > mLastStaleTime ) {
+            break;
             }
+
+        int slot = findSlot( r->x, r->y );
+
+        // skip entries for coordinates touched again in a later second
+        if( mSlots[slot].used && mSlots[slot].listedSecond == r->t ) {
+            removeSlot( slot );
+            }
+
+        mExpiryHead++;
         }
-    mRecords.deleteAll();
-    mRecords.push_back_other( &temp );
-    
 
-    // start index over after cleaning
-    mNextIndex = 0;
+    if( mExpiryHead > 0 && mExpiryHead * 2 >= numEntries ) {
+        mExpiryList.deleteStartElements( mExpiryHead );
+        mExpiryHead = 0;
+        }
     }
 
+
+
+int CoordinateTimeTracking::getNumRecords() {
+    return mNumUsed;
+    }
@@ -11,11 +11,25 @@ typedef struct CoordinateXYRecord {
 
 
 
+typedef struct CoordinateTimeSlot {
+        int x, y;
+        timeSec_t t;
+
+        // whole second this coordinate was last added to expiry list for
+        timeSec_t listedSecond;
+
+        char used;
+    } CoordinateTimeSlot;
+
+
+
 class CoordinateTimeTracking {
     public:
 
         CoordinateTimeTracking();
 
+        ~CoordinateTimeTracking();
+
 
         // returns true if exists, or false if not (and new record created if
         // not).  If exists, time of record will be updated to inCurTime
@@ -26,15 +40,42 @@ class CoordinateTimeTracking {
         void cleanStale( timeSec_t inStaleTime );
 
 
+        // number of records held, including stale ones not yet cleared
+        // from the table
+        int getNumRecords();
+
+
     private:
 
-        SimpleVector<CoordinateXYRecord> mRecords;
-        
-        // track index across searches as starting point for next
-        // search, because usually coordinates are checked in
-        // row-major order (a rectangular look region)
-        int mNextIndex;
-        
+        // open-addressing table with linear probing, size a power of 2
+        // and kept at most half full
+        CoordinateTimeSlot *mSlots;
+        int mNumSlots;
+        int mNumUsed;
+
+
+        // coordinates in the order they were touched, with t set to
+        // the whole second they were touched in
+        // A coordinate is added again only when touched in a new second,
+        // and older entries for it are skipped during cleaning.
+        SimpleVector<CoordinateXYRecord> mExpiryList;
+
+        // entries before this in mExpiryList have been cleaned
+        int mExpiryHead;
+
+
+        // records at or older than this count as gone, even if
+        // cleaning hasn't reached them yet
+        char mAnyCleaned;
+        timeSec_t mLastStaleTime;
+
+
+        int findSlot( int inX, int inY );
+
+        void removeSlot( int inSlot );
+
+        void resize( int inNumSlots );
+
     };
 
-    
+
@@ -0,0 +1,315 @@
+#include "PlayerOutputQueue.h"
+
+#include "HashTable.h"
+
+#include <string.h>
+
+
+
+PlayerOutputQueue::PlayerOutputQueue()
+        : mBuffer( NULL ),
+          mCapacity( 0 ),
+          mStart( 0 ),
+          mNumBytes( 0 ),
+          mFirstMessage( 0 ),
+          mFirstMessageSent( 0 ) {
+    }
+
+
+
+PlayerOutputQueue::~PlayerOutputQueue() {
+    if( mBuffer != NULL ) {
+        delete [] mBuffer;
+        }
+    }
+
+
+
+void PlayerOutputQueue::copyOut( int inOffset, int inNumBytes,
+                                 unsigned char *outBytes ) {
+    int start = ( mStart + inOffset ) % mCapacity;
+
+    int firstPart = mCapacity - start;
+
+    if( firstPart > inNumBytes ) {
+        firstPart = inNumBytes;
+        }
+
+    memcpy( outBytes, &( mBuffer[ start ] ), firstPart );
+    memcpy( &( outBytes[ firstPart ] ), mBuffer, inNumBytes - firstPart );
+    }
+
+
+
+void PlayerOutputQueue::makeRoom( int inNumBytes ) {
+    if( mNumBytes + inNumBytes <= mCapacity ) {
+        return;
+        }
+
+    int newCapacity = mCapacity;
+
+    if( newCapacity == 0 ) {
+        newCapacity = 4096;
+        }
+    while( newCapacity < mNumBytes + inNumBytes ) {
+        newCapacity *= 2;
+        }
+
+    unsigned char *newBuffer = new unsigned char[ newCapacity ];
+
+    if( mNumBytes > 0 ) {
+        copyOut( 0, mNumBytes, newBuffer );
+        }
+
+    if( mBuffer != NULL ) {
+        delete [] mBuffer;
+        }
+
+    mBuffer = newBuffer;
+    mCapacity = newCapacity;
+    mStart = 0;
+    }
+
+
+
+void PlayerOutputQueue::add( unsigned char *inMessage, int inLength,
+                             QueuedUpdateKind inKind,
+                             SimpleVector<int> *inUpdatedIDs ) {
+    if( inLength <= 0 ) {
+        return;
+        }
+
+    makeRoom( inLength );
+
+    int end = ( mStart + mNumBytes ) % mCapacity;
+
+    int firstPart = mCapacity - end;
+
+    if( firstPart > inLength ) {
+        firstPart = inLength;
+        }
+
+    memcpy( &( mBuffer[ end ] ), inMessage, firstPart );
+    memcpy( mBuffer, &( inMessage[ firstPart ] ), inLength - firstPart );
+
+    mNumBytes += inLength;
+
+
+    QueuedMessage m = { inLength, inKind, mUpdatedIDs.size(), 0 };
+
+    if( inKind != QUEUED_OTHER && inUpdatedIDs != NULL ) {
+        mUpdatedIDs.push_back_other( inUpdatedIDs );
+        m.numIDs = inUpdatedIDs->size();
+        }
+    else {
+        m.kind = QUEUED_OTHER;
+        }
+
+    mMessages.push_back( m );
+    }
+
+
+
+void PlayerOutputQueue::removeSent( int inNumBytes ) {
+    mStart = ( mStart + inNumBytes ) % mCapacity;
+    mNumBytes -= inNumBytes;
+
+    mFirstMessageSent += inNumBytes;
+
+    while( mFirstMessage < mMessages.size() ) {
+        int length = mMessages.getElementDirect( mFirstMessage ).length;
+
+        if( mFirstMessageSent < length ) {
+            break;
+            }
+        mFirstMessageSent -= length;
+        mFirstMessage ++;
+        }
+
+
+    if( mFirstMessage == mMessages.size() ) {
+        mMessages.deleteAll();
+        mUpdatedIDs.deleteAll();
+        mFirstMessage = 0;
+        mStart = 0;
+        }
+    else if( mFirstMessage > 64 && mFirstMessage > mMessages.size() / 2 ) {
+        // drop records of sent messages
+        int firstID = mMessages.getElementDirect( mFirstMessage ).firstID;
+
+        mMessages.deleteStartElements( mFirstMessage );
+        mUpdatedIDs.deleteStartElements( firstID );
+
+        for( int i=0; i<mMessages.size(); i++ ) {
+            mMessages.getElement( i )->firstID -= firstID;
+            }
+        mFirstMessage = 0;
+        }
+    }
+
+
+
+char PlayerOutputQueue::flush( Socket *inSock ) {
+    while( mNumBytes > 0 ) {
+
+        // all bytes up to end of ring in one write
+        int length = mCapacity - mStart;
+
+        if( length > mNumBytes ) {
+            length = mNumBytes;
+            }
+
+        int numSent = inSock->send( &( mBuffer[ mStart ] ), length,
+                                    false, false );
+
+        if( numSent == -1 ) {
+            return false;
+            }
+
+        if( numSent <= 0 ) {
+            // would block
+            break;
+            }
+
+        removeSent( numSent );
+
+        if( numSent < length ) {
+            // socket buffer full
+            break;
+            }
+        }
+
+    return true;
+    }
+
+
+
+int PlayerOutputQueue::dropStaleUpdates() {
+    int numMessages = mMessages.size() - mFirstMessage;
+
+    if( numMessages < 2 ) {
+        return 0;
+        }
+
+    // players updated by newer messages, by any PU, or by any PU or PM
+    HashTable<char> puUpdated( 256, false );
+    HashTable<char> anyUpdated( 256, false );
+
+    char *keep = new char[ numMessages ];
+
+    int numDroppedBytes = 0;
+
+    for( int m = numMessages - 1; m >= 0; m-- ) {
+        QueuedMessage *msg = mMessages.getElement( mFirstMessage + m );
+
+        keep[m] = true;
+
+        if( msg->kind == QUEUED_OTHER ) {
+            continue;
+            }
+
+        HashTable<char> *replacedBy = &anyUpdated;
+
+        if( msg->kind == QUEUED_PU ) {
+            replacedBy = &puUpdated;
+            }
+
+        // a partly-sent message must finish
+        char allReplaced = ( m > 0 || mFirstMessageSent == 0 );
+
+        for( int i=0; i<msg->numIDs; i++ ) {
+            int id = mUpdatedIDs.getElementDirect( msg->firstID + i );
+
+            if( allReplaced ) {
+                char found;
+                replacedBy->lookup( id, 0, 0, 0, &found );
+
+                if( ! found ) {
+                    allReplaced = false;
+                    }
+                }
+
+            if( msg->kind == QUEUED_PU ) {
+                puUpdated.insert( id, 0, 0, 0, true );
+                }
+            anyUpdated.insert( id, 0, 0, 0, true );
+            }
+
+        if( allReplaced && msg->numIDs > 0 ) {
+            keep[m] = false;
+            numDroppedBytes += msg->length;
+            }
+        }
+
+
+    if( numDroppedBytes > 0 ) {
+        // rebuild ring with only kept messages
+        unsigned char *newBuffer = new unsigned char[ mCapacity ];
+
+        SimpleVector<QueuedMessage> newMessages;
+        SimpleVector<int> newIDs;
+
+        int offset = 0;
+        int newNumBytes = 0;
+
+        for( int m = 0; m < numMessages; m++ ) {
+            QueuedMessage msg =
+                mMessages.getElementDirect( mFirstMessage + m );
+
+            int length = msg.length;
+
+            if( m == 0 ) {
+                // part of first message may be sent already
+                length -= mFirstMessageSent;
+                }
+
+            if( keep[m] ) {
+                copyOut( offset, length, &( newBuffer[ newNumBytes ] ) );
+                newNumBytes += length;
+
+                int oldFirstID = msg.firstID;
+                msg.firstID = newIDs.size();
+
+                for( int i=0; i<msg.numIDs; i++ ) {
+                    newIDs.push_back(
+                        mUpdatedIDs.getElementDirect( oldFirstID + i ) );
+                    }
+                newMessages.push_back( msg );
+                }
+
+            offset += length;
+            }
+
+        if( ! keep[0] ) {
+            mFirstMessageSent = 0;
+            }
+
+        delete [] mBuffer;
+        mBuffer = newBuffer;
+        mStart = 0;
+        mNumBytes = newNumBytes;
+
+        mMessages.deleteAll();
+        mMessages.push_back_other( &newMessages );
+
+        mUpdatedIDs.deleteAll();
+        mUpdatedIDs.push_back_other( &newIDs );
+
+        mFirstMessage = 0;
+        }
+
+    delete [] keep;
+
+    return numDroppedBytes;
+    }
+
+
+
+void PlayerOutputQueue::clear() {
+    mStart = 0;
+    mNumBytes = 0;
+    mMessages.deleteAll();
+    mUpdatedIDs.deleteAll();
+    mFirstMessage = 0;
+    mFirstMessageSent = 0;
+    }
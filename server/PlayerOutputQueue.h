@@ -0,0 +1,96 @@
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/network/Socket.h"
+
+
+
+// kinds of player update messages that a queue may drop once they are
+// stale
+enum QueuedUpdateKind {
+    QUEUED_OTHER = 0,
+    // full player state, only replaced by a later PU about the same player
+    QUEUED_PU,
+    // player move, replaced by a later PU or PM about the same player
+    QUEUED_PM
+    };
+
+
+
+typedef struct QueuedMessage {
+        int length;
+        QueuedUpdateKind kind;
+        // range in mUpdatedIDs of players this update is about
+        int firstID;
+        int numIDs;
+    } QueuedMessage;
+
+
+
+// bytes waiting to be sent to one player's socket
+//
+// Messages are added whole, and sent later without blocking, back to back,
+// so many small messages go out in a few large socket writes.
+// When a client falls behind, PU/PM messages that are already replaced
+// by newer queued ones can be dropped before they are sent.
+class PlayerOutputQueue {
+    public:
+
+        PlayerOutputQueue();
+
+        ~PlayerOutputQueue();
+
+
+        // inMessage copied internally
+        //
+        // inUpdatedIDs are the players a PU or PM message is about
+        // (ignored for QUEUED_OTHER)
+        void add( unsigned char *inMessage, int inLength,
+                  QueuedUpdateKind inKind = QUEUED_OTHER,
+                  SimpleVector<int> *inUpdatedIDs = NULL );
+
+
+        // sends as much as inSock will take without blocking
+        // returns false on socket error
+        char flush( Socket *inSock );
+
+
+        int getNumBytes() {
+            return mNumBytes;
+            }
+
+
+        // drops PU and PM messages that haven't started sending, if later
+        // messages in the queue update all of the same players
+        //
+        // returns number of bytes dropped
+        int dropStaleUpdates();
+
+
+        // drops everything, including a partly-sent message
+        void clear();
+
+
+    private:
+
+        // ring buffer of message bytes
+        unsigned char *mBuffer;
+        int mCapacity;
+        int mStart;
+        int mNumBytes;
+
+        // messages in mBuffer, oldest first, starting at mFirstMessage
+        SimpleVector<QueuedMessage> mMessages;
+        int mFirstMessage;
+
+        // bytes of oldest message already sent
+        int mFirstMessageSent;
+
+        SimpleVector<int> mUpdatedIDs;
+
+
+        void makeRoom( int inNumBytes );
+
+        // copies inNumBytes out of ring starting at inOffset past mStart
+        void copyOut( int inOffset, int inNumBytes, unsigned char *outBytes );
+
+        void removeSent( int inNumBytes );
+    };
@@ -0,0 +1,146 @@
+#include "PositionBucketIndex.h"
+
+#include <stdlib.h>
+
+
+
+PositionBucketIndex::PositionBucketIndex( int inBucketSize )
+        : mBucketSize( inBucketSize ) {
+    
+    if( mBucketSize < 1 ) {
+        mBucketSize = 1;
+        }
+    }
+
+
+
+int PositionBucketIndex::bucketOf( int inCoord ) {
+    // round toward negative infinity, so -1 and 0 end up in 
+    // different buckets
+    if( inCoord >= 0 ) {
+        return inCoord / mBucketSize;
+        }
+    return - ( ( - inCoord - 1 ) / mBucketSize ) - 1;
+    }
+
+
+
+void PositionBucketIndex::add( int inX, int inY, int inIndex ) {
+    PositionBucketRecord r = { bucketOf( inX ), bucketOf( inY ), inIndex };
+    mRecords.push_back( r );
+    }
+
+
+
+static int comparePositionBucketRecords( const void *inA, const void *inB ) {
+    const PositionBucketRecord *a = (const PositionBucketRecord*)inA;
+    const PositionBucketRecord *b = (const PositionBucketRecord*)inB;
+    
+    if( a->bucketY != b->bucketY ) {
+        return ( a->bucketY < b->bucketY ) ? -1 : 1;
+        }
+    if( a->bucketX != b->bucketX ) {
+        return ( a->bucketX < b->bucketX ) ? -1 : 1;
+        }
+    if( a->index != b->index ) {
+        return ( a->index < b->index ) ? -1 : 1;
+        }
+    return 0;
+    }
+
+
+
+void PositionBucketIndex::finishAdding() {
+    if( mRecords.size() > 1 ) {
+        qsort( mRecords.getElement( 0 ), mRecords.size(), 
+               sizeof( PositionBucketRecord ), 
+               comparePositionBucketRecords );
+        }
+    }
+
+
+
+int PositionBucketIndex::findBucketStart( int inBucketX, int inBucketY ) {
+    // binary search for first record at or after this bucket
+    int lo = 0;
+    int hi = mRecords.size();
+    
+    while( lo < hi ) {
+        int mid = ( lo + hi ) / 2;
+        
+        PositionBucketRecord *r = mRecords.getElement( mid );
+        
+        if( r->bucketY < inBucketY ||
+            ( r->bucketY == inBucketY && r->bucketX < inBucketX ) ) {
+            lo = mid + 1;
+            }
+        else {
+            hi = mid;
+            }
+        }
+    
+    if( lo < mRecords.size() ) {
+        PositionBucketRecord *r = mRecords.getElement( lo );
+        
+        if( r->bucketX == inBucketX && r->bucketY == inBucketY ) {
+            return lo;
+            }
+        }
+    return -1;
+    }
+
+
+
+static int compareInts( const void *inA, const void *inB ) {
+    int a = *( (const int*)inA );
+    int b = *( (const int*)inB );
+    
+    if( a < b ) {
+        return -1;
+        }
+    if( a > b ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+void PositionBucketIndex::getNear( int inX, int inY, int inRadius, 
+                                   SimpleVector<int> *outIndices ) {
+    
+    int numRecords = mRecords.size();
+    
+    if( numRecords > 0 ) {
+        
+        int startBX = bucketOf( inX - inRadius );
+        int endBX = bucketOf( inX + inRadius );
+        int startBY = bucketOf( inY - inRadius );
+        int endBY = bucketOf( inY + inRadius );
+        
+        for( int by = startBY; by <= endBY; by++ ) {
+            for( int bx = startBX; bx <= endBX; bx++ ) {
+                
+                int i = findBucketStart( bx, by );
+                
+                if( i == -1 ) {
+                    continue;
+                    }
+                
+                for( ; i < numRecords; i++ ) {
+                    PositionBucketRecord *r = mRecords.getElement( i );
+                    
+                    if( r->bucketX != bx || r->bucketY != by ) {
+                        break;
+                        }
+                    outIndices->push_back( r->index );
+                    }
+                }
+            }
+        }
+    
+    if( outIndices->size() > 1 ) {
+        qsort( outIndices->getElement( 0 ), outIndices->size(), 
+               sizeof( int ), compareInts );
+        }
+    }
@@ -0,0 +1,53 @@
+#include "minorGems/util/SimpleVector.h"
+
+
+
+typedef struct PositionBucketRecord {
+        int bucketX, bucketY;
+        int index;
+    } PositionBucketRecord;
+
+
+
+// index of positions bucketed into square cells, rebuilt each step
+// for things like pending PU and PM updates, so that each player only
+// visits the entries near them instead of every entry
+class PositionBucketIndex {
+    public:
+        
+        // inBucketSize is width of a bucket in map cells
+        PositionBucketIndex( int inBucketSize );
+        
+
+        // inIndex is the caller's index for this position (for example,
+        // an index into their own vector of update records)
+        void add( int inX, int inY, int inIndex );
+        
+        // must be called after the last add, before any getNear
+        void finishAdding();
+        
+
+        // appends indices of entries that may be within inRadius of
+        // inX,inY to outIndices
+        // some entries may be further than inRadius (caller must still
+        // check exact distance)
+        //
+        // all of outIndices (including anything already in it)
+        // is left sorted in ascending order, so entries come out in the
+        // same order that a scan of the caller's own vector would give
+        void getNear( int inX, int inY, int inRadius, 
+                      SimpleVector<int> *outIndices );
+        
+
+    private:
+        
+        int mBucketSize;
+        
+        SimpleVector<PositionBucketRecord> mRecords;
+        
+        int bucketOf( int inCoord );
+
+        // index of first record in inBucketX,inBucketY, or -1 if empty
+        int findBucketStart( int inBucketX, int inBucketY );
+        
+    };
@@ -0,0 +1,337 @@
+#include <stddef.h>
+
+#include "minorGems/util/log/AppLog.h"
+
+
+
+// number of entries in each set
+// a key can only be cached in the entries of the set it hashes to
+#define SET_ASSOCIATIVE_CACHE_WAYS 4
+
+
+
+// Fixed-size cache keyed by up to four ints, like HashTable, but never
+// grows.  When a set is full, CLOCK picks an entry in it to evict:  entries
+// that have been used since the hand last passed them get another chance.
+//
+// Counts hits, misses and evictions for logStats.
+template <class Type>
+class SetAssociativeCache {
+
+    public:
+
+        // inName is used in log lines
+        SetAssociativeCache( const char *inName );
+
+        ~SetAssociativeCache();
+
+
+        // (re)allocates with room for at least inNumEntries, rounded up
+        // to a power of 2, dropping anything cached and zeroing stats
+        void init( int inNumEntries );
+
+
+        // NULL on miss
+        // pointer is good until the next insert
+        Type *lookup( int inKeyA, int inKeyB, int inKeyC = 0, int inKeyD = 0 );
+
+        // like lookup, but not counted in stats, and doesn't keep entry
+        // from being evicted
+        // for checking what's already cached before a batch fill
+        Type *peek( int inKeyA, int inKeyB, int inKeyC = 0, int inKeyD = 0 );
+
+
+        void insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                     Type inValue );
+
+        void insert( int inKeyA, int inKeyB, Type inValue ) {
+            insert( inKeyA, inKeyB, 0, 0, inValue );
+            }
+
+
+        void remove( int inKeyA, int inKeyB, int inKeyC = 0, int inKeyD = 0 );
+
+
+        void clear();
+
+
+        // logs counts since last logStats call, then zeros them
+        void logStats();
+
+
+    private:
+
+        typedef struct CacheEntry {
+                int keyA, keyB, keyC, keyD;
+                Type value;
+            } CacheEntry;
+
+        const char *mName;
+
+        int mNumEntries;
+        unsigned int mSetMask;
+
+        CacheEntry *mEntries;
+
+        // see flag bits below
+        unsigned char *mFlags;
+
+        // CLOCK hand for each set, which way to look at next
+        unsigned char *mHands;
+
+        int mNumUsed;
+
+        unsigned int mHits;
+        unsigned int mMisses;
+        unsigned int mEvictions;
+
+        unsigned int computeSet( int inKeyA, int inKeyB,
+                                 int inKeyC, int inKeyD );
+
+        // index of entry holding key, or -1
+        int findEntry( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
+
+    };
+
+
+
+#define CACHE_ENTRY_USED 1
+#define CACHE_ENTRY_REFERENCED 2
+
+
+
+template <class Type>
+SetAssociativeCache<Type>::SetAssociativeCache( const char *inName )
+        : mName( inName ),
+          mNumEntries( 0 ),
+          mSetMask( 0 ),
+          mEntries( NULL ),
+          mFlags( NULL ),
+          mHands( NULL ),
+          mNumUsed( 0 ),
+          mHits( 0 ),
+          mMisses( 0 ),
+          mEvictions( 0 ) {
+    }
+
+
+
+template <class Type>
+SetAssociativeCache<Type>::~SetAssociativeCache() {
+    if( mEntries != NULL ) {
+        delete [] mEntries;
+        delete [] mFlags;
+        delete [] mHands;
+        }
+    }
+
+
+
+template <class Type>
+void SetAssociativeCache<Type>::init( int inNumEntries ) {
+    if( mEntries != NULL ) {
+        delete [] mEntries;
+        delete [] mFlags;
+        delete [] mHands;
+        }
+
+    int numSets = 1;
+
+    while( numSets * SET_ASSOCIATIVE_CACHE_WAYS < inNumEntries ) {
+        numSets *= 2;
+        }
+
+    mNumEntries = numSets * SET_ASSOCIATIVE_CACHE_WAYS;
+    mSetMask = numSets - 1;
+
+    mEntries = new CacheEntry[ mNumEntries ];
+    mFlags = new unsigned char[ mNumEntries ];
+    mHands = new unsigned char[ numSets ];
+
+    clear();
+
+    mHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
+    }
+
+
+
+template <class Type>
+void SetAssociativeCache<Type>::clear() {
+    for( int i=0; i<mNumEntries; i++ ) {
+        mFlags[i] = 0;
+        }
+    for( unsigned int s=0; s<=mSetMask; s++ ) {
+        mHands[s] = 0;
+        }
+    mNumUsed = 0;
+    }
+
+
+
+template <class Type>
+inline unsigned int SetAssociativeCache<Type>::computeSet( int inKeyA,
+                                                           int inKeyB,
+                                                           int inKeyC,
+                                                           int inKeyD ) {
+    unsigned int h = (unsigned int)inKeyA * 0x9E3779B1U;
+
+    h ^= (unsigned int)inKeyB * 0x85EBCA77U;
+    h ^= (unsigned int)inKeyC * 0xC2B2AE3DU;
+    h ^= (unsigned int)inKeyD * 0x27D4EB2FU;
+
+    h ^= h >> 15;
+    h *= 0x2C1B3C6DU;
+    h ^= h >> 12;
+
+    return h & mSetMask;
+    }
+
+
+
+template <class Type>
+inline int SetAssociativeCache<Type>::findEntry( int inKeyA, int inKeyB,
+                                                 int inKeyC, int inKeyD ) {
+    int start =
+        computeSet( inKeyA, inKeyB, inKeyC, inKeyD ) *
+        SET_ASSOCIATIVE_CACHE_WAYS;
+
+    for( int i=start; i<start + SET_ASSOCIATIVE_CACHE_WAYS; i++ ) {
+        if( mFlags[i] & CACHE_ENTRY_USED ) {
+            CacheEntry *e = &( mEntries[i] );
+
+            if( e->keyA == inKeyA && e->keyB == inKeyB &&
+                e->keyC == inKeyC && e->keyD == inKeyD ) {
+                return i;
+                }
+            }
+        }
+    return -1;
+    }
+
+
+
+template <class Type>
+Type *SetAssociativeCache<Type>::lookup( int inKeyA, int inKeyB,
+                                         int inKeyC, int inKeyD ) {
+    int i = findEntry( inKeyA, inKeyB, inKeyC, inKeyD );
+
+    if( i == -1 ) {
+        mMisses++;
+        return NULL;
+        }
+
+    mHits++;
+    mFlags[i] |= CACHE_ENTRY_REFERENCED;
+
+    return &( mEntries[i].value );
+    }
+
+
+
+template <class Type>
+Type *SetAssociativeCache<Type>::peek( int inKeyA, int inKeyB,
+                                       int inKeyC, int inKeyD ) {
+    int i = findEntry( inKeyA, inKeyB, inKeyC, inKeyD );
+
+    if( i == -1 ) {
+        return NULL;
+        }
+    return &( mEntries[i].value );
+    }
+
+
+
+template <class Type>
+void SetAssociativeCache<Type>::insert( int inKeyA, int inKeyB,
+                                        int inKeyC, int inKeyD,
+                                        Type inValue ) {
+    unsigned int set = computeSet( inKeyA, inKeyB, inKeyC, inKeyD );
+
+    int start = set * SET_ASSOCIATIVE_CACHE_WAYS;
+
+    int dest = -1;
+    int firstFree = -1;
+
+    for( int i=start; i<start + SET_ASSOCIATIVE_CACHE_WAYS; i++ ) {
+        if( mFlags[i] & CACHE_ENTRY_USED ) {
+            CacheEntry *e = &( mEntries[i] );
+
+            if( e->keyA == inKeyA && e->keyB == inKeyB &&
+                e->keyC == inKeyC && e->keyD == inKeyD ) {
+                dest = i;
+                break;
+                }
+            }
+        else if( firstFree == -1 ) {
+            firstFree = i;
+            }
+        }
+
+    if( dest == -1 ) {
+        if( firstFree != -1 ) {
+            dest = firstFree;
+            mNumUsed++;
+            }
+        else {
+            // sweep, clearing referenced bits, until we find one clear
+            // ends within two passes
+            int hand = mHands[ set ];
+
+            while( mFlags[ start + hand ] & CACHE_ENTRY_REFERENCED ) {
+                mFlags[ start + hand ] &= ~CACHE_ENTRY_REFERENCED;
+                hand = ( hand + 1 ) % SET_ASSOCIATIVE_CACHE_WAYS;
+                }
+
+            dest = start + hand;
+            mHands[ set ] = ( hand + 1 ) % SET_ASSOCIATIVE_CACHE_WAYS;
+
+            mEvictions++;
+            }
+
+        CacheEntry *e = &( mEntries[ dest ] );
+        e->keyA = inKeyA;
+        e->keyB = inKeyB;
+        e->keyC = inKeyC;
+        e->keyD = inKeyD;
+        }
+
+    mEntries[ dest ].value = inValue;
+    mFlags[ dest ] = CACHE_ENTRY_USED | CACHE_ENTRY_REFERENCED;
+    }
+
+
+
+template <class Type>
+void SetAssociativeCache<Type>::remove( int inKeyA, int inKeyB,
+                                        int inKeyC, int inKeyD ) {
+    int i = findEntry( inKeyA, inKeyB, inKeyC, inKeyD );
+
+    if( i != -1 ) {
+        mFlags[i] = 0;
+        mNumUsed--;
+        }
+    }
+
+
+
+template <class Type>
+void SetAssociativeCache<Type>::logStats() {
+    unsigned int total = mHits + mMisses;
+
+    double hitPercent = 0;
+
+    if( total > 0 ) {
+        hitPercent = 100.0 * mHits / total;
+        }
+
+    AppLog::infoF( "%s cache:  %u hits, %u misses (%.1f%% hit), "
+                   "%u evictions, %d of %d entries used",
+                   mName, mHits, mMisses, hitPercent, mEvictions,
+                   mNumUsed, mNumEntries );
+
+    mHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
+    }
@@ -1,11 +1,18 @@
 #include "backup.h"
+#include "backupSnapshot.h"
+#include "dbWriteBehind.h"
 
 
 
 #include "minorGems/util/SettingsManager.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
 #include "minorGems/io/file/File.h"
 #include "minorGems/io/file/Directory.h"
 #include "minorGems/system/Time.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
 
 #include "minorGems/util/log/AppLog.h"
 
@@ -40,28 +47,664 @@ void initBackup() {
     }
 
 
-// call with "map" or "eve" for example
-void backupDBFile( const char *inFileNamePrefix, char *inTimeFileNamePart,
-                   File *inBackupFolder ) {
-    char *fileName = autoSprintf( "%s.db", inFileNamePrefix );
+// written through the write-behind layer in map.cpp
+// while write-behind flushes are held, these files don't change, so the
+// backup thread copies them to staging folder, and flushes are released
+// before the copies are compressed
+static const char *heldDBNames[] = { "lookTime", "map", "mapTime",
+                                     "contents", "floor", "floorTime" };
+
+// written directly, small, copied to staging folder first
+static const char *copiedDBNames[] = { "biome", "eve", "playerStats" };
+
+#define NUM_HELD_DBS ( sizeof( heldDBNames ) / sizeof( char* ) )
+#define NUM_COPIED_DBS ( sizeof( copiedDBNames ) / sizeof( char* ) )
+
+
+
+typedef struct BackupJob {
+        char *timeFileNamePart;
+        timeSec_t startTime;
+        int fullInterval;
+        int keepSeconds;
+
+        // database name, like "map", and file to read it from
+        SimpleVector<char*> dbNames;
+        SimpleVector<char*> sourcePaths;
+        // remove source after snapshot
+        SimpleVector<char> sourceStaged;
+        // source is a live database file, copied to staging folder by
+        // backup thread before flushes are released
+        // source path set to NULL if it can't be copied
+        SimpleVector<char> sourceHeld;
+        int numHeld;
+
+        // filled by backup thread, logged by main thread when done
+        SimpleVector<char*> infoLines;
+        SimpleVector<char*> errorLines;
+        int numRemoved;
+    } BackupJob;
+
+
+
+static BackupJob *currentJob = NULL;
+
+static char flushesHeld = false;
+
+static double jobStartTime = 0;
+
+
+static MutexLock jobDoneLock;
+static char jobDone = false;
+
+// guarded by jobDoneLock
+// held files copied, or copying stopped because captureAborted
+static char captureDone = false;
+// set by main thread if files changed during copy
+static char captureAborted = false;
+
+// main thread signals once it has released flushes and set captureAborted
+static BinarySemaphore captureCheckedSemaphore;
+
+
+
+static char isCaptureAborted() {
+    jobDoneLock.lock();
+    char aborted = captureAborted;
+    jobDoneLock.unlock();
     
-    File dbFile( NULL, fileName );
+    return aborted;
+    }
 
-    delete [] fileName;
 
+
+// returns false if file can't be copied, or copying was aborted
+static char copyHeldFile( const char *inSourcePath, const char *inDestPath ) {
+    FILE *source = fopen( inSourcePath, "rb" );
+    
+    if( source == NULL ) {
+        return false;
+        }
+    
+    FILE *dest = fopen( inDestPath, "wb" );
+    
+    if( dest == NULL ) {
+        fclose( source );
+        return false;
+        }
+
+    int bufferSize = 1048576;
+    unsigned char *buffer = new unsigned char[ bufferSize ];
+    
+    char ok = true;
+    
+    while( ok ) {
+        int numRead = fread( buffer, 1, bufferSize, source );
+        
+        if( numRead > 0 &&
+            (int)fwrite( buffer, 1, numRead, dest ) != numRead ) {
+            ok = false;
+            }
+        else if( numRead < bufferSize ) {
+            ok = ! ferror( source );
+            break;
+            }
+        else if( isCaptureAborted() ) {
+            ok = false;
+            }
+        }
+    
+    delete [] buffer;
+    
+    fclose( source );
+    
+    if( fclose( dest ) != 0 ) {
+        ok = false;
+        }
+    
+    if( ! ok ) {
+        remove( inDestPath );
+        }
+    return ok;
+    }
+
+
+
+static void dropHeldSource( BackupJob *inJob, int inIndex ) {
+    char *path = inJob->sourcePaths.getElementDirect( inIndex );
+    
+    if( path != NULL ) {
+        if( inJob->sourceStaged.getElementDirect( inIndex ) ) {
+            remove( path );
+            }
+        delete [] path;
+        }
+    
+    *( inJob->sourcePaths.getElement( inIndex ) ) = NULL;
+    *( inJob->sourceStaged.getElement( inIndex ) ) = false;
+    }
+
+
+
+// copies held database files into staging folder, then waits for main
+// thread to release flushes and say whether files stayed unchanged
+static void captureHeldDBs( BackupJob *inJob ) {
+    for( int i=0; i<inJob->dbNames.size(); i++ ) {
+        if( ! inJob->sourceHeld.getElementDirect( i ) ) {
+            continue;
+            }
+        
+        char *dbName = inJob->dbNames.getElementDirect( i );
+        char *sourcePath = inJob->sourcePaths.getElementDirect( i );
+        
+        char *stagedPath = autoSprintf( "backups/staging/%s.db", dbName );
+        
+        if( ! isCaptureAborted() && 
+            copyHeldFile( sourcePath, stagedPath ) ) {
+            delete [] sourcePath;
+            *( inJob->sourcePaths.getElement( i ) ) = stagedPath;
+            *( inJob->sourceStaged.getElement( i ) ) = true;
+            }
+        else {
+            delete [] stagedPath;
+            
+            if( ! isCaptureAborted() ) {
+                inJob->errorLines.push_back(
+                    autoSprintf( "Failed to copy %s.db into staging folder",
+                                 dbName ) );
+                }
+            dropHeldSource( inJob, i );
+            }
+        }
+    
+    jobDoneLock.lock();
+    captureDone = true;
+    jobDoneLock.unlock();
+    
+    captureCheckedSemaphore.wait();
+    
+    if( isCaptureAborted() ) {
+        for( int i=0; i<inJob->dbNames.size(); i++ ) {
+            if( inJob->sourceHeld.getElementDirect( i ) ) {
+                dropHeldSource( inJob, i );
+                }
+            }
+        inJob->errorLines.push_back(
+            stringDuplicate( "Write-behind hold was broken while copying "
+                             "map databases, so they were not backed up" ) );
+        }
+    }
+
+
+
+static void snapshotDBs( BackupJob *inJob ) {
+    for( int i=0; i<inJob->dbNames.size(); i++ ) {
+        char *dbName = inJob->dbNames.getElementDirect( i );
+        char *sourcePath = inJob->sourcePaths.getElementDirect( i );
+
+        if( sourcePath == NULL ) {
+            continue;
+            }
+
+        char *snapshotPath = autoSprintf( "backups/%s_%s.snap", dbName,
+                                          inJob->timeFileNamePart );
+        char *hashPath = autoSprintf( "backups/%s.snapHashes", dbName );
+
+        SnapshotStats stats;
+
+        if( writeDBSnapshot( sourcePath, snapshotPath, hashPath,
+                             inJob->fullInterval, &stats ) ) {
+            inJob->infoLines.push_back(
+                autoSprintf( "Backed up %s.db, %s snapshot, "
+                             "%d of %d blocks, %.3f MB written",
+                             dbName, stats.full ? "full" : "diff",
+                             stats.numBlocksWritten, stats.numBlocks,
+                             stats.numBytesWritten / ( 1024 * 1024 ) ) );
+            }
+        else {
+            inJob->errorLines.push_back(
+                autoSprintf( "Failed to back up %s.db into %s",
+                             dbName, snapshotPath ) );
+            }
+
+        if( inJob->sourceStaged.getElementDirect( i ) ) {
+            remove( sourcePath );
+            }
+
+        delete [] snapshotPath;
+        delete [] hashPath;
+        }
+    }
+
+
+
+static char isStale( BackupJob *inJob, File *inFile ) {
+    return inJob->startTime - inFile->getModificationTime() 
+        > (timeSec_t)inJob->keepSeconds;
+    }
+
+
+
+static char endsWith( const char *inString, const char *inEnd ) {
+    int length = strlen( inString );
+    int endLength = strlen( inEnd );
+
+    return length >= endLength &&
+        strcmp( &( inString[ length - endLength ] ), inEnd ) == 0;
+    }
+
+
+
+static int compareFileNames( const void *inA, const void *inB ) {
+    return strcmp( *(char**)inA, *(char**)inB );
+    }
+
+
+
+// snapshots come in chains, a full snapshot followed by diffs that
+// depend on it
+// A whole chain is removed once all of it is stale, and only if a newer
+// chain exists.
+static void removeStaleSnapshots( BackupJob *inJob, const char *inDBName,
+                                  SimpleVector<char*> *inSnapshotNames ) {
+    
+    char *prefix = autoSprintf( "%s_", inDBName );
+
+    SimpleVector<char*> names;
+    
+    for( int i=0; i<inSnapshotNames->size(); i++ ) {
+        char *name = inSnapshotNames->getElementDirect( i );
+        
+        if( strstr( name, prefix ) == name ) {
+            names.push_back( name );
+            }
+        }
+    delete [] prefix;
+
+    int numNames = names.size();
+    
+    if( numNames == 0 ) {
+        return;
+        }
+    
+    char **sorted = names.getElementArray();
+    
+    // time part of name sorts oldest first
+    qsort( sorted, numNames, sizeof( char* ), compareFileNames );
+    
+    
+    char *chainStale = new char[ numNames ];
+    int *chainIDs = new int[ numNames ];
+    
+    int chainID = 0;
+    
+    for( int i=0; i<numNames; i++ ) {
+        char *path = autoSprintf( "backups/%s", sorted[i] );
+        
+        char *baseName;
+        if( readDBSnapshotBase( path, &baseName ) ) {
+            if( baseName == NULL ) {
+                // full, new chain starts
+                chainID ++;
+                }
+            else {
+                delete [] baseName;
+                }
+            }
+        
+        chainIDs[i] = chainID;
+        
+        File f( NULL, path );
+        chainStale[i] = isStale( inJob, &f );
+
+        delete [] path;
+        }
+    
+    int lastChainID = chainID;
+    
+    for( int i=0; i<numNames; i++ ) {
+        if( chainIDs[i] == lastChainID ) {
+            break;
+            }
+        
+        char wholeChainStale = true;
+        
+        for( int j=i; j<numNames && chainIDs[j] == chainIDs[i]; j++ ) {
+            if( ! chainStale[j] ) {
+                wholeChainStale = false;
+                break;
+                }
+            }
+
+        if( wholeChainStale ) {
+            char *path = autoSprintf( "backups/%s", sorted[i] );
+            
+            if( remove( path ) == 0 ) {
+                inJob->numRemoved ++;
+                }
+            else {
+                inJob->errorLines.push_back(
+                    autoSprintf( "Failed to remove %s", path ) );
+                }
+            delete [] path;
+            }
+        }
+    
+    delete [] chainStale;
+    delete [] chainIDs;
+    delete [] sorted;
+    }
+
+
+
+static void removeStaleBackups( BackupJob *inJob ) {
+    File backupFolder( NULL, "backups" );
+
+    int numChildren;
+    File **childFiles = backupFolder.getChildFiles( &numChildren );
+    
+    SimpleVector<char*> snapshotNames;
+    
+    for( int i=0; i<numChildren; i++ ) {
+        char *fileName = childFiles[i]->getFileName();
+        
+        if( childFiles[i]->isDirectory() ||
+            endsWith( fileName, ".snapHashes" ) ) {
+            // staging folder and hashes of newest snapshots stay
+            delete [] fileName;
+            }
+        else if( endsWith( fileName, ".snap" ) ) {
+            snapshotNames.push_back( fileName );
+            }
+        else {
+            // whole-file copies from older versions
+            if( isStale( inJob, childFiles[i] ) ) {
+                if( childFiles[i]->remove() ) {
+                    inJob->numRemoved ++;
+                    }
+                else {
+                    inJob->errorLines.push_back(
+                        autoSprintf( "Failed to remove %s", fileName ) );
+                    }
+                }
+            delete [] fileName;
+            }
+        delete childFiles[i];
+        }
+    delete [] childFiles;
+    
+    for( unsigned int i=0; i<NUM_HELD_DBS; i++ ) {
+        removeStaleSnapshots( inJob, heldDBNames[i], &snapshotNames );
+        }
+    for( unsigned int i=0; i<NUM_COPIED_DBS; i++ ) {
+        removeStaleSnapshots( inJob, copiedDBNames[i], &snapshotNames );
+        }
+    
+    snapshotNames.deallocateStringElements();
+    }
+
+
+
+class BackupThread : public Thread {
+
+    public:
+
+        BackupThread( BackupJob *inJob )
+                : mJob( inJob ) {
+            }
+
+
+        virtual void run() {
+            if( mJob->numHeld > 0 ) {
+                captureHeldDBs( mJob );
+                }
+            snapshotDBs( mJob );
+            removeStaleBackups( mJob );
+
+            jobDoneLock.lock();
+            jobDone = true;
+            jobDoneLock.unlock();
+            }
+
+    protected:
+        BackupJob *mJob;
+    };
+
+
+static BackupThread *backupThread = NULL;
+
+
+
+static char isJobDone() {
+    jobDoneLock.lock();
+    char done = jobDone;
+    jobDoneLock.unlock();
+    
+    return done;
+    }
+
+
+
+static char isCaptureDone() {
+    jobDoneLock.lock();
+    char done = captureDone;
+    jobDoneLock.unlock();
+    
+    return done;
+    }
+
+
+
+// releases write-behind flushes once backup thread has copied held files
+// if inWait, waits for copying to finish
+// if the hold was broken, copying is aborted right away
+static void checkCapture( char inWait ) {
+    if( ! flushesHeld ) {
+        return;
+        }
+
+    char aborted = false;
+    
+    if( ! writeBehindFlushesHeld() ) {
+        // files may have changed under the copies
+        jobDoneLock.lock();
+        captureAborted = true;
+        jobDoneLock.unlock();
+        
+        aborted = true;
+        }
+    else if( inWait ) {
+        while( ! isCaptureDone() ) {
+            Thread::staticSleep( 100 );
+            }
+        }
+    else if( ! isCaptureDone() ) {
+        return;
+        }
+
+    writeBehindReleaseFlushes();
+    flushesHeld = false;
+
+    if( aborted ) {
+        AppLog::warning( "Backup thread copying of map databases aborted" );
+        }
+    else {
+        AppLog::infoF( "Backup thread done copying map databases "
+                       "after %f sec",
+                       Time::getCurrentTime() - jobStartTime );
+        }
+
+    captureCheckedSemaphore.signal();
+    }
+
+
+
+// copies a database file into staging folder
+// returns path of copy, or NULL if database file doesn't exist
+static char *stageDBFile( const char *inDBName, File *inStagingFolder ) {
+    char *fileName = autoSprintf( "%s.db", inDBName );
+    
+    File dbFile( NULL, fileName );
+
+    char *stagedPath = NULL;
+    
     if( dbFile.exists() ) {
+        File *stagedFile = inStagingFolder->getChildFile( fileName );
+        
+        dbFile.copy( stagedFile );
         
+        stagedPath = autoSprintf( "backups/staging/%s", fileName );
+        
+        delete stagedFile;
+        }
+    
+    delete [] fileName;
+    
+    return stagedPath;
+    }
+
+
+
+static void addJobDB( BackupJob *inJob, const char *inDBName, 
+                      char *inSourcePath, char inStaged, char inHeld ) {
+    inJob->dbNames.push_back( stringDuplicate( inDBName ) );
+    inJob->sourcePaths.push_back( inSourcePath );
+    inJob->sourceStaged.push_back( inStaged );
+    inJob->sourceHeld.push_back( inHeld );
+    
+    if( inHeld ) {
+        inJob->numHeld ++;
+        }
+    }
+
+
 
-        char *backFileName =
-            autoSprintf( "%s_%s.db", inFileNamePrefix, inTimeFileNamePart );
+// backups folder must exist
+static void startBackupJob( char *inTimeFileNamePart, timeSec_t inCurTime ) {
+    
+    jobStartTime = Time::getCurrentTime();
+
+    BackupJob *job = new BackupJob;
+    
+    job->timeFileNamePart = stringDuplicate( inTimeFileNamePart );
+    job->startTime = inCurTime;
+    job->fullInterval = 
+        SettingsManager::getIntSetting( "backupFullInterval", 6 );
+    job->keepSeconds = 
+        SettingsManager::getIntSetting( "keepBackupsDays", 14 ) * 24 * 3600;
+    job->numRemoved = 0;
+    job->numHeld = 0;
+
+    
+    File stagingFolder( NULL, "backups/staging" );
+    
+    if( ! stagingFolder.exists() ) {
+        Directory::makeDirectory( &stagingFolder );
+        }
+    
+    // from here until the backup thread has copied them, map database
+    // files stay as they are
+    flushesHeld = writeBehindHoldFlushes();
+    
+    if( ! flushesHeld ) {
+        AppLog::warning( "Write-behind is off, so map databases must be "
+                         "copied before backup thread can start" );
+        }
+    
+    for( unsigned int i=0; i<NUM_HELD_DBS; i++ ) {
+        const char *dbName = heldDBNames[i];
         
-        File *backFile = 
-            inBackupFolder->getChildFile( backFileName );
+        if( flushesHeld ) {
+            char *path = autoSprintf( "%s.db", dbName );
+            
+            File dbFile( NULL, path );
+            
+            if( dbFile.exists() ) {
+                addJobDB( job, dbName, path, false, true );
+                }
+            else {
+                delete [] path;
+                }
+            }
+        else {
+            char *stagedPath = stageDBFile( dbName, &stagingFolder );
+            
+            if( stagedPath != NULL ) {
+                addJobDB( job, dbName, stagedPath, true, false );
+                }
+            }
+        }
+    
+    for( unsigned int i=0; i<NUM_COPIED_DBS; i++ ) {
+        const char *dbName = copiedDBNames[i];
         
-        dbFile.copy( backFile );
+        char *stagedPath = stageDBFile( dbName, &stagingFolder );
         
-        delete [] backFileName;
-        delete backFile;
+        if( stagedPath != NULL ) {
+            addJobDB( job, dbName, stagedPath, true, false );
+            }
+        }
+    
+    if( flushesHeld && job->numHeld == 0 ) {
+        // nothing for backup thread to copy
+        writeBehindReleaseFlushes();
+        flushesHeld = false;
+        }
+    
+    AppLog::infoF( "Backup staging done in %f sec, "
+                   "backup thread starting",
+                   Time::getCurrentTime() - jobStartTime );
+    
+    currentJob = job;
+    
+    jobDone = false;
+    captureDone = false;
+    captureAborted = false;
+    
+    backupThread = new BackupThread( job );
+    backupThread->start();
+    }
+
+
+
+static void finishBackupJob() {
+    backupThread->join();
+    delete backupThread;
+    backupThread = NULL;
+    
+    for( int i=0; i<currentJob->infoLines.size(); i++ ) {
+        AppLog::info( currentJob->infoLines.getElementDirect( i ) );
+        }
+    for( int i=0; i<currentJob->errorLines.size(); i++ ) {
+        AppLog::error( currentJob->errorLines.getElementDirect( i ) );
+        }
+
+    if( currentJob->errorLines.size() > 0 ) {
+        AppLog::error( "...Failed to save some backups" );
+        }
+    
+    AppLog::infoF( "...Done saving backups in %f sec, "
+                   "removed %d stale backup files",
+                   Time::getCurrentTime() - jobStartTime,
+                   currentJob->numRemoved );
+    
+    delete [] currentJob->timeFileNamePart;
+    currentJob->dbNames.deallocateStringElements();
+    currentJob->sourcePaths.deallocateStringElements();
+    currentJob->infoLines.deallocateStringElements();
+    currentJob->errorLines.deallocateStringElements();
+    
+    delete currentJob;
+    currentJob = NULL;
+    }
+
+
+
+void freeBackup() {
+    if( backupThread != NULL ) {
+        AppLog::info( "Waiting for backup thread to finish" );
+        checkCapture( true );
+        finishBackupJob();
         }
     }
 
@@ -71,6 +714,17 @@ void backupDBFile( const char *inFileNamePrefix, char *inTimeFileNamePart,
 // makes a new backup if needed
 // also handles deleting old backups
 void checkBackup() {
+    
+    if( backupThread != NULL ) {
+        checkCapture( false );
+        
+        if( isJobDone() ) {
+            finishBackupJob();
+            }
+        // never start a new one while one is running
+        return;
+        }
+    
     timeSec_t curTime = Time::timeSec();
     
     if( curTime - lastBackupTime > 12 * 3600 
@@ -96,10 +750,9 @@ void checkBackup() {
             if( SettingsManager::getIntSetting( "saveBackups", 0 ) ) {
                 
                 AppLog::info( 
-                    "Saving a backup of map.db, mapTime.db, and biome.db "
-                    "floor.db, floorTime.db, playerStats.db, and eve.db ..." );
-                
-                char backupsSaved = false;
+                    "Saving a backup of map.db, mapTime.db, contents.db, "
+                    "biome.db, floor.db, floorTime.db, lookTime.db, playerStats.db, "
+                    "and eve.db ..." );
                 
                 // save a backup now
 
@@ -119,75 +772,9 @@ void checkBackup() {
                     }
                 
                 if( backupFolder.isDirectory() ) {
-                    
-                    backupDBFile( "lookTime", timeFileNamePart, &backupFolder );
-
-                    backupDBFile( "map", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "mapTime", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "biome", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "eve", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "floor", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "floorTime", timeFileNamePart, 
-                                  &backupFolder );
-                    
-                    backupDBFile( "playerStats", 
-                                  timeFileNamePart, &backupFolder );
-
-
-                    AppLog::info( "...Done saving backups" );
-                    backupsSaved = true;
-
-                    
-                    int keepDays = 
-                        SettingsManager::getIntSetting( "keepBackupsDays",
-                                                        14 );
-
-
-                    AppLog::infoF( "Checking for stale backup files "
-                                   "(older than %d days)", keepDays );
-                    
-                    int keepSeconds = keepDays * 24 * 3600;
-
-                    int numChildren;
-                    File **childFiles = 
-                        backupFolder.getChildFiles( &numChildren );
-                    
-                    int numRemoved = 0;
-                    
-                    for( int i=0; i<numChildren; i++ ) {
-                        if( curTime - 
-                            childFiles[i]->getModificationTime()
-                            > keepSeconds ) {
-                            
-                            char removed = childFiles[i]->remove();
-
-                            char *fileName = childFiles[i]->getFileName();
-                            
-                            if( removed ) {
-                                AppLog::infoF( "Removed %s", fileName );
-                                numRemoved++;
-                                }
-                            else {
-                                AppLog::errorF( "Failed to remove %s",
-                                                fileName );
-                                }
-                            delete [] fileName;
-                            }
-                        delete childFiles[i];
-                        }
-                    
-                    delete [] childFiles;
-                    
-                    AppLog::infoF( "Done checking, removed %d stale backups", 
-                                   numRemoved );
+                    startBackupJob( timeFileNamePart, curTime );
                     }
-                
-                if( !backupsSaved ) {
+                else {
                     AppLog::error( "...Failed to save backups" );
                     }
                 
@@ -214,4 +801,3 @@ void checkBackup() {
         }
     
     }
-
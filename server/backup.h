@@ -5,4 +5,15 @@ void initBackup();
 
 // makes a new backup if needed
 // also handles deleting old backups
+//
+// Backups are written by a background thread, as incremental snapshots
+// (see backupSnapshot.h) in the backups folder.  Map databases are copied
+// into backups/staging by that thread while write-behind flushes are held,
+// and flushes are released as soon as the copies are done, before any
+// compression.  Staging needs free disk space as big as the map databases.
 void checkBackup();
+
+
+// waits for a backup in progress to finish
+// call before map databases are closed
+void freeBackup();
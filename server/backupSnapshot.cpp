@@ -0,0 +1,649 @@
+#include "backupSnapshot.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/formats/encodingUtils.h"
+#include "minorGems/crypto/hashes/sha1.h"
+
+
+#ifdef _WIN32
+#define fseeko fseeko64
+#define ftello ftello64
+#endif
+
+
+// small enough that scattered record writes don't drag much unchanged
+// data into a diff
+#define SNAPSHOT_BLOCK_SIZE 65536
+
+// marks end of block list in a snapshot
+#define SNAPSHOT_END_BLOCK 0xFFFFFFFF
+
+// limit on chain length when following bases, in case of a loop
+#define SNAPSHOT_MAX_CHAIN 100000
+
+// SHA-1 digest of each block
+// a block is left out of a diff when its digest is unchanged, so the hash
+// must be strong enough that a changed block never matches
+#define SNAPSHOT_HASH_LENGTH 20
+
+
+static const char *snapshotMagic = "OLSNAP1";
+static const char *hashFileMagic = "OLSNPH2";
+
+// magic strings written with their terminating \0
+#define MAGIC_LENGTH 8
+
+
+
+typedef struct SnapshotHeader {
+        char full;
+        uint32_t blockSize;
+        uint64_t fileSize;
+        uint32_t numBlocks;
+        // NULL for full snapshots
+        char *baseName;
+    } SnapshotHeader;
+
+
+
+typedef struct HashFile {
+        uint32_t blockSize;
+        uint64_t fileSize;
+        uint32_t numBlocks;
+        uint32_t diffsSinceFull;
+        char *snapshotName;
+        // SNAPSHOT_HASH_LENGTH bytes per block
+        unsigned char *hashes;
+    } HashFile;
+
+
+
+static char writeUInt32( FILE *inFile, uint32_t inValue ) {
+    return fwrite( &inValue, sizeof( inValue ), 1, inFile ) == 1;
+    }
+
+static char writeUInt64( FILE *inFile, uint64_t inValue ) {
+    return fwrite( &inValue, sizeof( inValue ), 1, inFile ) == 1;
+    }
+
+static char readUInt32( FILE *inFile, uint32_t *outValue ) {
+    return fread( outValue, sizeof( *outValue ), 1, inFile ) == 1;
+    }
+
+static char readUInt64( FILE *inFile, uint64_t *outValue ) {
+    return fread( outValue, sizeof( *outValue ), 1, inFile ) == 1;
+    }
+
+
+
+// length-prefixed, NULL written as empty
+static char writeName( FILE *inFile, const char *inName ) {
+    uint32_t length = 0;
+    if( inName != NULL ) {
+        length = strlen( inName );
+        }
+
+    if( ! writeUInt32( inFile, length ) ) {
+        return false;
+        }
+    if( length == 0 ) {
+        return true;
+        }
+    return fwrite( inName, 1, length, inFile ) == length;
+    }
+
+
+
+// returns NULL for empty name
+// sets outOK to false on read error
+static char *readName( FILE *inFile, char *outOK ) {
+    uint32_t length;
+
+    // file names only
+    if( ! readUInt32( inFile, &length ) || length > 4096 ) {
+        *outOK = false;
+        return NULL;
+        }
+
+    *outOK = true;
+
+    if( length == 0 ) {
+        return NULL;
+        }
+
+    char *name = new char[ length + 1 ];
+
+    if( fread( name, 1, length, inFile ) != length ) {
+        delete [] name;
+        *outOK = false;
+        return NULL;
+        }
+    name[ length ] = '\0';
+
+    return name;
+    }
+
+
+
+static char readMagic( FILE *inFile, const char *inMagic ) {
+    char magic[ MAGIC_LENGTH ];
+
+    if( fread( magic, 1, MAGIC_LENGTH, inFile ) != MAGIC_LENGTH ) {
+        return false;
+        }
+    return memcmp( magic, inMagic, MAGIC_LENGTH ) == 0;
+    }
+
+
+
+static const char *getFileNamePart( const char *inPath ) {
+    const char *name = inPath;
+
+    for( const char *c = inPath; *c != '\0'; c++ ) {
+        if( *c == '/' || *c == '\\' ) {
+            name = c + 1;
+            }
+        }
+    return name;
+    }
+
+
+
+// inName replaces file name part of inPath
+static char *getSiblingPath( const char *inPath, const char *inName ) {
+    int dirLength = getFileNamePart( inPath ) - inPath;
+
+    char *dir = stringDuplicate( inPath );
+    dir[ dirLength ] = '\0';
+
+    char *path = autoSprintf( "%s%s", dir, inName );
+    delete [] dir;
+
+    return path;
+    }
+
+
+
+static void freeHashFile( HashFile *inHashFile ) {
+    if( inHashFile->snapshotName != NULL ) {
+        delete [] inHashFile->snapshotName;
+        inHashFile->snapshotName = NULL;
+        }
+    if( inHashFile->hashes != NULL ) {
+        delete [] inHashFile->hashes;
+        inHashFile->hashes = NULL;
+        }
+    }
+
+
+
+static char readHashFile( const char *inPath, HashFile *outHashFile ) {
+    outHashFile->snapshotName = NULL;
+    outHashFile->hashes = NULL;
+
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    char ok =
+        readMagic( f, hashFileMagic ) &&
+        readUInt32( f, &( outHashFile->blockSize ) ) &&
+        readUInt64( f, &( outHashFile->fileSize ) ) &&
+        readUInt32( f, &( outHashFile->numBlocks ) ) &&
+        readUInt32( f, &( outHashFile->diffsSinceFull ) );
+
+    if( ok ) {
+        outHashFile->snapshotName = readName( f, &ok );
+        }
+
+    if( ok ) {
+        outHashFile->hashes = 
+            new unsigned char[ outHashFile->numBlocks * 
+                               SNAPSHOT_HASH_LENGTH ];
+
+        ok = fread( outHashFile->hashes, SNAPSHOT_HASH_LENGTH,
+                    outHashFile->numBlocks, f ) == outHashFile->numBlocks;
+        }
+
+    fclose( f );
+
+    if( ! ok ) {
+        freeHashFile( outHashFile );
+        }
+    return ok;
+    }
+
+
+
+// replaces inPath in one step, so a crash leaves old or new file
+static char writeHashFile( const char *inPath, HashFile *inHashFile ) {
+    char *tempPath = autoSprintf( "%s.temp", inPath );
+
+    FILE *f = fopen( tempPath, "wb" );
+
+    if( f == NULL ) {
+        delete [] tempPath;
+        return false;
+        }
+
+    char ok =
+        fwrite( hashFileMagic, 1, MAGIC_LENGTH, f ) == MAGIC_LENGTH &&
+        writeUInt32( f, inHashFile->blockSize ) &&
+        writeUInt64( f, inHashFile->fileSize ) &&
+        writeUInt32( f, inHashFile->numBlocks ) &&
+        writeUInt32( f, inHashFile->diffsSinceFull ) &&
+        writeName( f, inHashFile->snapshotName ) &&
+        fwrite( inHashFile->hashes, SNAPSHOT_HASH_LENGTH,
+                inHashFile->numBlocks, f ) == inHashFile->numBlocks;
+
+    if( fclose( f ) != 0 ) {
+        ok = false;
+        }
+
+    if( ok ) {
+        remove( inPath );
+        ok = ( rename( tempPath, inPath ) == 0 );
+        }
+
+    if( ! ok ) {
+        remove( tempPath );
+        }
+
+    delete [] tempPath;
+    return ok;
+    }
+
+
+
+char writeDBSnapshot( const char *inDBPath, const char *inSnapshotPath,
+                      const char *inHashPath, int inFullInterval,
+                      SnapshotStats *outStats ) {
+
+    outStats->full = false;
+    outStats->numBlocks = 0;
+    outStats->numBlocksWritten = 0;
+    outStats->numBytesWritten = 0;
+
+    FILE *dbFile = fopen( inDBPath, "rb" );
+
+    if( dbFile == NULL ) {
+        return false;
+        }
+
+    if( fseeko( dbFile, 0, SEEK_END ) ) {
+        fclose( dbFile );
+        return false;
+        }
+
+    uint64_t fileSize = ftello( dbFile );
+
+    if( fseeko( dbFile, 0, SEEK_SET ) ) {
+        fclose( dbFile );
+        return false;
+        }
+
+    uint32_t numBlocks =
+        ( fileSize + SNAPSHOT_BLOCK_SIZE - 1 ) / SNAPSHOT_BLOCK_SIZE;
+
+
+    HashFile oldHashes;
+
+    char full = true;
+
+    if( readHashFile( inHashPath, &oldHashes ) &&
+        oldHashes.snapshotName != NULL ) {
+
+        char *oldSnapshotPath =
+            getSiblingPath( inSnapshotPath, oldHashes.snapshotName );
+
+        FILE *oldSnapshot = fopen( oldSnapshotPath, "rb" );
+
+        // base must still be there for diff to be restorable
+        if( oldSnapshot != NULL &&
+            oldHashes.blockSize == SNAPSHOT_BLOCK_SIZE &&
+            ( inFullInterval <= 0 ||
+              (int)oldHashes.diffsSinceFull < inFullInterval ) ) {
+            full = false;
+            }
+
+        if( oldSnapshot != NULL ) {
+            fclose( oldSnapshot );
+            }
+        delete [] oldSnapshotPath;
+        }
+    else {
+        freeHashFile( &oldHashes );
+        oldHashes.numBlocks = 0;
+        oldHashes.diffsSinceFull = 0;
+        }
+
+
+    char *tempPath = autoSprintf( "%s.temp", inSnapshotPath );
+
+    FILE *snapshot = fopen( tempPath, "wb" );
+
+    if( snapshot == NULL ) {
+        fclose( dbFile );
+        freeHashFile( &oldHashes );
+        delete [] tempPath;
+        return false;
+        }
+
+    char ok =
+        fwrite( snapshotMagic, 1, MAGIC_LENGTH, snapshot ) == MAGIC_LENGTH &&
+        writeUInt32( snapshot, full ) &&
+        writeUInt32( snapshot, SNAPSHOT_BLOCK_SIZE ) &&
+        writeUInt64( snapshot, fileSize ) &&
+        writeUInt32( snapshot, numBlocks ) &&
+        writeName( snapshot, full ? NULL : oldHashes.snapshotName );
+
+
+    HashFile newHashes;
+    newHashes.blockSize = SNAPSHOT_BLOCK_SIZE;
+    newHashes.fileSize = fileSize;
+    newHashes.numBlocks = numBlocks;
+    newHashes.diffsSinceFull = full ? 0 : oldHashes.diffsSinceFull + 1;
+    newHashes.snapshotName =
+        stringDuplicate( getFileNamePart( inSnapshotPath ) );
+    newHashes.hashes = new unsigned char[ numBlocks * SNAPSHOT_HASH_LENGTH ];
+
+    unsigned char *block = new unsigned char[ SNAPSHOT_BLOCK_SIZE ];
+
+    for( uint32_t b=0; b<numBlocks && ok; b++ ) {
+
+        int blockLength = SNAPSHOT_BLOCK_SIZE;
+
+        if( b == numBlocks - 1 ) {
+            blockLength = fileSize - (uint64_t)b * SNAPSHOT_BLOCK_SIZE;
+            }
+
+        if( fread( block, 1, blockLength, dbFile ) !=
+            (unsigned)blockLength ) {
+            ok = false;
+            break;
+            }
+
+        unsigned char *h = computeRawSHA1Digest( block, blockLength );
+        memcpy( &( newHashes.hashes[ b * SNAPSHOT_HASH_LENGTH ] ), h,
+                SNAPSHOT_HASH_LENGTH );
+        delete [] h;
+
+        if( ! full && b < oldHashes.numBlocks &&
+            memcmp( &( oldHashes.hashes[ b * SNAPSHOT_HASH_LENGTH ] ),
+                    &( newHashes.hashes[ b * SNAPSHOT_HASH_LENGTH ] ),
+                    SNAPSHOT_HASH_LENGTH ) == 0 ) {
+            // unchanged
+            continue;
+            }
+
+        int compressedLength;
+        unsigned char *compressed =
+            zipCompress( block, blockLength, &compressedLength );
+
+        if( compressed == NULL ) {
+            ok = false;
+            break;
+            }
+
+        ok =
+            writeUInt32( snapshot, b ) &&
+            writeUInt32( snapshot, compressedLength ) &&
+            fwrite( compressed, 1, compressedLength, snapshot ) ==
+            (unsigned)compressedLength;
+
+        delete [] compressed;
+
+        outStats->numBlocksWritten ++;
+        outStats->numBytesWritten += compressedLength;
+        }
+
+    delete [] block;
+    fclose( dbFile );
+
+    if( ok ) {
+        ok = writeUInt32( snapshot, SNAPSHOT_END_BLOCK );
+        }
+
+    if( fclose( snapshot ) != 0 ) {
+        ok = false;
+        }
+
+    if( ok ) {
+        ok = ( rename( tempPath, inSnapshotPath ) == 0 );
+        }
+
+    if( ok ) {
+        // if this fails, next snapshot is full
+        if( ! writeHashFile( inHashPath, &newHashes ) ) {
+            remove( inHashPath );
+            }
+        }
+    else {
+        remove( tempPath );
+        }
+
+    outStats->full = full;
+    outStats->numBlocks = numBlocks;
+
+    freeHashFile( &oldHashes );
+    freeHashFile( &newHashes );
+    delete [] tempPath;
+
+    return ok;
+    }
+
+
+
+static char readSnapshotHeader( FILE *inFile, SnapshotHeader *outHeader ) {
+    outHeader->baseName = NULL;
+
+    uint32_t full;
+
+    char ok =
+        readMagic( inFile, snapshotMagic ) &&
+        readUInt32( inFile, &full ) &&
+        readUInt32( inFile, &( outHeader->blockSize ) ) &&
+        readUInt64( inFile, &( outHeader->fileSize ) ) &&
+        readUInt32( inFile, &( outHeader->numBlocks ) );
+
+    if( ok ) {
+        outHeader->baseName = readName( inFile, &ok );
+        }
+
+    outHeader->full = ( full != 0 );
+
+    if( ok && outHeader->full != ( outHeader->baseName == NULL ) ) {
+        ok = false;
+        }
+
+    if( ! ok && outHeader->baseName != NULL ) {
+        delete [] outHeader->baseName;
+        outHeader->baseName = NULL;
+        }
+    return ok;
+    }
+
+
+
+char readDBSnapshotBase( const char *inSnapshotPath, char **outBaseName ) {
+    *outBaseName = NULL;
+
+    FILE *f = fopen( inSnapshotPath, "rb" );
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    SnapshotHeader header;
+    char ok = readSnapshotHeader( f, &header );
+
+    fclose( f );
+
+    if( ok ) {
+        *outBaseName = header.baseName;
+        }
+    return ok;
+    }
+
+
+
+// writes blocks of inSnapshotPath into inOutput, skipping any part
+// past inFinalSize
+static char applySnapshot( const char *inSnapshotPath, FILE *inOutput,
+                           uint64_t inFinalSize ) {
+    FILE *f = fopen( inSnapshotPath, "rb" );
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    SnapshotHeader header;
+
+    if( ! readSnapshotHeader( f, &header ) ) {
+        fclose( f );
+        return false;
+        }
+
+    if( header.baseName != NULL ) {
+        delete [] header.baseName;
+        }
+
+
+    SimpleVector<unsigned char> compressed;
+
+    char ok = true;
+
+    while( ok ) {
+        uint32_t b;
+        uint32_t compressedLength;
+
+        if( ! readUInt32( f, &b ) ) {
+            ok = false;
+            break;
+            }
+
+        if( b == SNAPSHOT_END_BLOCK ) {
+            break;
+            }
+
+        if( b >= header.numBlocks || ! readUInt32( f, &compressedLength ) ) {
+            ok = false;
+            break;
+            }
+
+        uint64_t start = (uint64_t)b * header.blockSize;
+
+        int blockLength = header.blockSize;
+
+        if( b == header.numBlocks - 1 ) {
+            blockLength = header.fileSize - start;
+            }
+
+        unsigned char *data = new unsigned char[ compressedLength ];
+
+        if( fread( data, 1, compressedLength, f ) != compressedLength ) {
+            delete [] data;
+            ok = false;
+            break;
+            }
+
+        unsigned char *block =
+            zipDecompress( data, compressedLength, blockLength );
+        delete [] data;
+
+        if( block == NULL ) {
+            ok = false;
+            break;
+            }
+
+        if( start < inFinalSize ) {
+            if( start + blockLength > inFinalSize ) {
+                blockLength = inFinalSize - start;
+                }
+
+            ok =
+                fseeko( inOutput, start, SEEK_SET ) == 0 &&
+                fwrite( block, 1, blockLength, inOutput ) ==
+                (unsigned)blockLength;
+            }
+
+        delete [] block;
+        }
+
+    fclose( f );
+
+    return ok;
+    }
+
+
+
+char restoreDBSnapshot( const char *inSnapshotPath,
+                        const char *inOutputDBPath ) {
+
+    FILE *f = fopen( inSnapshotPath, "rb" );
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    SnapshotHeader target;
+    char ok = readSnapshotHeader( f, &target );
+    fclose( f );
+
+    if( ! ok ) {
+        return false;
+        }
+
+    // newest first
+    SimpleVector<char*> chain;
+
+    chain.push_back( stringDuplicate( inSnapshotPath ) );
+
+    char *baseName = target.baseName;
+
+    while( ok && baseName != NULL ) {
+        if( chain.size() > SNAPSHOT_MAX_CHAIN ) {
+            delete [] baseName;
+            ok = false;
+            break;
+            }
+
+        char *basePath = getSiblingPath( inSnapshotPath, baseName );
+        delete [] baseName;
+
+        chain.push_back( basePath );
+
+        ok = readDBSnapshotBase( basePath, &baseName );
+        }
+
+
+    if( ok ) {
+        FILE *output = fopen( inOutputDBPath, "wb" );
+
+        if( output == NULL ) {
+            ok = false;
+            }
+        else {
+            // oldest (full) first
+            for( int i=chain.size() - 1; i>=0 && ok; i-- ) {
+                ok = applySnapshot( chain.getElementDirect( i ), output,
+                                    target.fileSize );
+                }
+
+            if( fclose( output ) != 0 ) {
+                ok = false;
+                }
+            }
+        }
+
+    chain.deallocateStringElements();
+
+    return ok;
+    }
@@ -0,0 +1,53 @@
+// incremental, compressed snapshots of database files
+//
+// A snapshot stores a database file as fixed-size blocks, each one
+// zip-compressed.  A full snapshot has every block.  A diff snapshot only
+// has the blocks that changed since an earlier snapshot of the same file,
+// and names that earlier snapshot as its base.
+//
+// SHA-1 digests of the blocks in the newest snapshot are kept in a
+// separate hash file, so making a diff only reads the current database
+// file, never old snapshots.
+
+
+
+typedef struct SnapshotStats {
+        char full;
+        int numBlocks;
+        int numBlocksWritten;
+        double numBytesWritten;
+    } SnapshotStats;
+
+
+
+// writes a snapshot of inDBPath to inSnapshotPath
+//
+// Makes a diff against the snapshot recorded in inHashPath when possible.
+// Makes a full snapshot if inHashPath is missing or doesn't match,
+// or if there have been inFullInterval diffs in a row.
+//
+// inHashPath is updated to describe the new snapshot.
+//
+// Only the file name part of inSnapshotPath is recorded as the base of the
+// next diff, so all snapshots of a file must live in the same directory.
+//
+// returns true on success
+char writeDBSnapshot( const char *inDBPath, const char *inSnapshotPath,
+                      const char *inHashPath, int inFullInterval,
+                      SnapshotStats *outStats );
+
+
+
+// returns true if inSnapshotPath is a readable snapshot
+// outBaseName set to a new string with the file name of its base, or NULL
+// for a full snapshot
+char readDBSnapshotBase( const char *inSnapshotPath, char **outBaseName );
+
+
+
+// rebuilds the database file as of inSnapshotPath, following its chain
+// of bases (in the same directory) back to a full snapshot
+//
+// returns true on success
+char restoreDBSnapshot( const char *inSnapshotPath,
+                        const char *inOutputDBPath );
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Measures main loop tail latency during a login storm:  100 logins over
+# 10 seconds into a server that already has 200 players.
+#
+# Needs OneLifeServer and stressTestClient (makeStressTestClient) built
+# in this directory, and requireClientPassword / requireTicketServerCheck
+# turned off so that the dummy clients can log in.
+#
+# Usage:
+# ./benchmarkLoginStorm.sh [settle_seconds]
+
+
+settleSeconds=${1:-30}
+
+oldTimingSetting=`cat settings/logMainLoopTiming.ini`
+
+echo -n "1" > settings/logMainLoopTiming.ini
+
+
+./OneLifeServer > benchmarkServerOut.txt 2>&1 &
+serverPID=$!
+
+sleep 5
+
+./stressTestClient localhost 8005 base 200 > /dev/null 2>&1 &
+basePID=$!
+
+sleep $settleSeconds
+
+echo "Before storm:"
+grep "Main loop timing" benchmarkServerOut.txt | tail -n 1
+echo ""
+
+
+stormStartLine=`wc -l < benchmarkServerOut.txt`
+
+stormPIDs=""
+
+for i in `seq 1 10`
+do
+	./stressTestClient localhost 8005 storm$i 10 > /dev/null 2>&1 &
+	stormPIDs="$stormPIDs $!"
+	sleep 1
+done
+
+# let timing log cover the whole storm
+sleep 15
+
+
+kill $stormPIDs $basePID
+wait $stormPIDs $basePID 2> /dev/null
+
+kill $serverPID
+wait $serverPID 2> /dev/null
+
+
+echo "During storm:"
+tail -n +$stormStartLine benchmarkServerOut.txt | grep "Main loop timing"
+
+rm -f benchmarkServerOut.txt
+
+echo -n "$oldTimingSetting" > settings/logMainLoopTiming.ini
@@ -0,0 +1,48 @@
+#!/bin/bash
+
+# Measures main loop step time with and without the player id index table
+# at several simulated player counts.
+#
+# Needs OneLifeServer and stressTestClient (makeStressTestClient) built
+# in this directory, and requireClientPassword / requireTicketServerCheck
+# turned off so that the dummy clients can log in.
+#
+# Usage:
+# ./benchmarkPlayerLookup.sh [seconds_per_run]
+
+
+runSeconds=${1:-60}
+
+oldIndexSetting=`cat settings/playerIndexTableOn.ini`
+oldTimingSetting=`cat settings/logMainLoopTiming.ini`
+
+echo -n "1" > settings/logMainLoopTiming.ini
+
+
+for numPlayers in 50 150 300
+do
+	for indexOn in 1 0
+	do
+		echo -n "$indexOn" > settings/playerIndexTableOn.ini
+
+		./OneLifeServer > benchmarkServerOut.txt 2>&1 &
+		serverPID=$!
+
+		sleep 5
+
+		timeout $runSeconds ./stressTestClient localhost 8005 \
+			bench$numPlayers $numPlayers > /dev/null 2>&1
+
+		kill $serverPID
+		wait $serverPID 2> /dev/null
+
+		echo "$numPlayers players, playerIndexTableOn=$indexOn:"
+		grep "Main loop timing" benchmarkServerOut.txt | tail -n 3
+		echo ""
+	done
+done
+
+rm -f benchmarkServerOut.txt
+
+echo -n "$oldIndexSetting" > settings/playerIndexTableOn.ini
+echo -n "$oldTimingSetting" > settings/logMainLoopTiming.ini
@@ -6,8 +6,11 @@
 #include "lineardb3.h"
 #include "dbCommon.h"
 
+#include "PositionBucketIndex.h"
+
 
 #include "minorGems/util/SettingsManager.h"
+#include "minorGems/util/stringUtils.h"
 #include "minorGems/util/log/AppLog.h"
 #include "minorGems/io/file/File.h"
 
@@ -294,7 +297,12 @@ void initCurseDB() {
 
 
 
+static void clearTargetCurseSets();
+
+
 void freeCurseDB() {
+    clearTargetCurseSets();
+    
     if( dbOpen ) {
         LINEARDB3_close( &db );
         dbOpen = false;
@@ -665,6 +673,66 @@ typedef struct PersonRecord {
 
 SimpleVector<PersonRecord> blockingRecords;
 
+
+
+// people in blockingRecords who have cursed one target, with their
+// positions indexed, built once per spawn decision
+typedef struct TargetCurseSet {
+        // NULL for main target
+        char *targetEmail;
+        
+        // indices into blockingRecords
+        SimpleVector<int> blockers;
+        
+        int radius;
+        
+        // built on first check
+        PositionBucketIndex *index;
+    } TargetCurseSet;
+
+
+// for twins, whose curse sets aren't built up by 
+// addPersonToPersonalCurseTest
+static SimpleVector<TargetCurseSet*> otherTargetSets;
+
+static TargetCurseSet mainTargetSet;
+
+
+// radius beyond any map distance, where an index can't help, and where
+// bucket math could overflow
+#define MAX_INDEXED_CURSE_RADIUS 1048576
+
+
+
+static void clearTargetCurseSet( TargetCurseSet *inSet ) {
+    if( inSet->targetEmail != NULL ) {
+        delete [] inSet->targetEmail;
+        inSet->targetEmail = NULL;
+        }
+    inSet->blockers.deleteAll();
+    inSet->radius = 0;
+    
+    if( inSet->index != NULL ) {
+        delete inSet->index;
+        inSet->index = NULL;
+        }
+    }
+
+
+
+static void clearTargetCurseSets() {
+    clearTargetCurseSet( &mainTargetSet );
+    
+    for( int i=0; i<otherTargetSets.size(); i++ ) {
+        TargetCurseSet *set = otherTargetSets.getElementDirect( i );
+        clearTargetCurseSet( set );
+        delete set;
+        }
+    otherTargetSets.deleteAll();
+    }
+
+
+
 int personalLiveCurseCount = 0;
 
 int personalTotalCurseCount = 0;
@@ -676,6 +744,8 @@ void initPersonalCurseTest( const char *inTargetEmail ) {
 
     blockingRecords.deleteAll();
 
+    clearTargetCurseSets();
+    
     personalLiveCurseCount = 0;
 
     personalTotalCurseCount = getCurseCount( inTargetEmail );
@@ -694,6 +764,14 @@ void addPersonToPersonalCurseTest( const char *inEmail,
 
     if( blocking ) {
         personalLiveCurseCount ++;
+        
+        mainTargetSet.blockers.push_back( blockingRecords.size() - 1 );
+        
+        if( mainTargetSet.index != NULL ) {
+            // person added after checks started, rebuild on next check
+            delete mainTargetSet.index;
+            mainTargetSet.index = NULL;
+            }
         }
     }
 
@@ -709,18 +787,53 @@ static int getCurseRadius( int inLiveCurseCount, int inTotalCurseCount ) {
 
 
 
-
-char isBirthLocationCurseBlocked( const char *inTargetEmail, GridPos inPos ) {
+static char isBlockedBySet( TargetCurseSet *inSet, GridPos inPos ) {
     
-    int radius = getCurseRadius( personalLiveCurseCount, 
-                                 personalTotalCurseCount );
+    int numBlockers = inSet->blockers.size();
+    
+    if( numBlockers == 0 ) {
+        return false;
+        }
     
-    for( int i=0; i<blockingRecords.size(); i++ ) {
-        PersonRecord *r = blockingRecords.getElement( i );
+    int radius = inSet->radius;
+    
+    if( radius < 0 || radius > MAX_INDEXED_CURSE_RADIUS ) {
+        for( int i=0; i<numBlockers; i++ ) {
+            PersonRecord *r = blockingRecords.getElement( 
+                inSet->blockers.getElementDirect( i ) );
+            
+            if( distance( inPos, r->pos ) <= radius ) {
+                return true;
+                }
+            }
+        return false;
+        }
+    
+
+    if( inSet->index == NULL ) {
+        // buckets as wide as radius, so a check looks at 3x3 buckets
+        // at most
+        inSet->index = new PositionBucketIndex( radius );
         
-        if( r->blocking == 1 && 
-            distance( inPos, r->pos ) <= radius ) {
+        for( int i=0; i<numBlockers; i++ ) {
+            int b = inSet->blockers.getElementDirect( i );
+            
+            GridPos pos = blockingRecords.getElement( b )->pos;
             
+            inSet->index->add( pos.x, pos.y, b );
+            }
+        inSet->index->finishAdding();
+        }
+    
+    SimpleVector<int> near;
+    
+    inSet->index->getNear( inPos.x, inPos.y, radius, &near );
+    
+    for( int i=0; i<near.size(); i++ ) {
+        PersonRecord *r = blockingRecords.getElement( 
+            near.getElementDirect( i ) );
+        
+        if( distance( inPos, r->pos ) <= radius ) {
             // in radius, and blocking
             return true;
             }
@@ -730,45 +843,61 @@ char isBirthLocationCurseBlocked( const char *inTargetEmail, GridPos inPos ) {
 
 
 
-char isBirthLocationCurseBlockedNoCache( const char *inTargetEmail, 
-                                         GridPos inPos ) {
-
-    int liveCurseCount = 0;
 
-    SimpleVector<char> curseCache;
+char isBirthLocationCurseBlocked( const char *inTargetEmail, GridPos inPos ) {
     
-    for( int i=0; i<blockingRecords.size(); i++ ) {
-        PersonRecord *r = blockingRecords.getElement( i );
+    int radius = getCurseRadius( personalLiveCurseCount, 
+                                 personalTotalCurseCount );
+    
+    if( radius != mainTargetSet.radius ) {
+        // index buckets are sized by radius
+        mainTargetSet.radius = radius;
         
-        if( isCursed( r->email, inTargetEmail ) ) {
-            liveCurseCount ++;
-            curseCache.push_back( true );
-            }
-        else {
-            curseCache.push_back( false );
+        if( mainTargetSet.index != NULL ) {
+            delete mainTargetSet.index;
+            mainTargetSet.index = NULL;
             }
         }
     
+    return isBlockedBySet( &mainTargetSet, inPos );
+    }
+
+
+
+char isBirthLocationCurseBlockedNoCache( const char *inTargetEmail, 
+                                         GridPos inPos ) {
+
+    TargetCurseSet *set = NULL;
     
+    for( int i=0; i<otherTargetSets.size(); i++ ) {
+        TargetCurseSet *s = otherTargetSets.getElementDirect( i );
+        
+        if( strcmp( s->targetEmail, inTargetEmail ) == 0 ) {
+            set = s;
+            break;
+            }
+        }
     
-    int radius = getCurseRadius( liveCurseCount,
-                                 getCurseCount( inTargetEmail ) );
-    
-    for( int i=0; i<blockingRecords.size(); i++ ) {
-        PersonRecord *r = blockingRecords.getElement( i );
+    if( set == NULL ) {
+        // first check for this target in this spawn decision
+        // hit the curse database for everyone once
+        set = new TargetCurseSet;
+        set->targetEmail = stringDuplicate( inTargetEmail );
+        set->index = NULL;
         
-        if( curseCache.getElementDirect( i ) ) {
-            // cursed
-            
-            if( distance( inPos, r->pos ) <= radius ) {
-                // in radius
-                return true;
+        for( int i=0; i<blockingRecords.size(); i++ ) {
+            PersonRecord *r = blockingRecords.getElement( i );
+        
+            if( isCursed( r->email, inTargetEmail ) ) {
+                set->blockers.push_back( i );
                 }
             }
+        
+        set->radius = getCurseRadius( set->blockers.size(),
+                                      getCurseCount( inTargetEmail ) );
+        
+        otherTargetSets.push_back( set );
         }
-    return false;
+    
+    return isBlockedBySet( set, inPos );
     }
-
-
-
-
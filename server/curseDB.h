@@ -24,12 +24,10 @@ void addPersonToPersonalCurseTest( const char *inEmail,
 char isBirthLocationCurseBlocked( const char *inTargetEmail, GridPos inPos );
 
 
-// checks personal curse blocking without relying on or storing
-// results in cache
-// This results in potentially hitting the curse database for all players in 
-// range
-// (the cached version, above, avoids this for subsequent calls) 
-// However, in some cases, like when checking twins for curses, 
-// this extra work cannot be avoided.
+// checks personal curse blocking for a target other than the one passed
+// to initPersonalCurseTest, like a twin
+// The first call for a target hits the curse database for everyone added
+// to the test, and the result is kept for that target until the next
+// initPersonalCurseTest.
 char isBirthLocationCurseBlockedNoCache( const char *inTargetEmail, 
                                          GridPos inPos );
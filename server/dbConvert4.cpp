@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "minorGems/util/SimpleVector.h"
+
+#include "lineardb3.h"
+#include "dbCommon.h"
+#include "tileContents.h"
+#include "oldContainers.h"
+
+
+// old map.db and mapTime.db slot layout, from before contents.db
+#define DECAY_SLOT 1
+
+
+void usage() {
+    printf( "Usage:\n" );
+    printf( "dbConvert4\n\n" );
+
+    printf( "Run in the server folder, with the server stopped cleanly.\n" );
+    printf( "Moves contained objects and their decay times out of map.db "
+            "and mapTime.db,\n"
+            "into one record per tile in contents.db, then removes them "
+            "from map.db\n"
+            "and mapTime.db.\n"
+            "The server moves them on startup too, but leaves the old "
+            "records in place.\n\n" );
+
+    exit( 1 );
+    }
+
+
+
+static char fileExists( const char *inFileName ) {
+    FILE *f = fopen( inFileName, "rb" );
+
+    if( f == NULL ) {
+        return false;
+        }
+    fclose( f );
+    return true;
+    }
+
+
+
+// copies records with slots 0 and DECAY_SLOT into a new file,
+// and replaces old file with it
+static void dropContainerSlots( const char *inFileName, LINEARDB3 *inDB,
+                                int inValueSize ) {
+    unsigned char key[16];
+    unsigned char *value = new unsigned char[ inValueSize ];
+
+    LINEARDB3_Iterator dbi;
+
+    LINEARDB3_Iterator_init( inDB, &dbi );
+
+    int count = 0;
+    while( LINEARDB3_Iterator_next( &dbi, key, value ) > 0 ) {
+        int s = valueToInt( &( key[8] ) );
+
+        if( s == 0 || s == DECAY_SLOT ) {
+            count++;
+            }
+        }
+
+    char tempFileName[1000];
+
+    sprintf( tempFileName, "%s.temp", inFileName );
+
+    LINEARDB3 dbNew;
+
+    int error = LINEARDB3_open( &dbNew,
+                                tempFileName,
+                                0,
+                                LINEARDB3_getPerfectTableSize( 0.5, count ),
+                                16,
+                                inValueSize );
+    if( error ) {
+        printf( "dbConvert4: Failed to open %s\n", tempFileName );
+        exit( 1 );
+        }
+
+    LINEARDB3_Iterator_init( inDB, &dbi );
+
+    int numDropped = 0;
+
+    while( LINEARDB3_Iterator_next( &dbi, key, value ) > 0 ) {
+        int s = valueToInt( &( key[8] ) );
+
+        if( s == 0 || s == DECAY_SLOT ) {
+            LINEARDB3_put( &dbNew, key, value );
+            }
+        else {
+            numDropped++;
+            }
+        }
+
+    delete [] value;
+
+    LINEARDB3_close( &dbNew );
+    LINEARDB3_close( inDB );
+
+    if( rename( tempFileName, inFileName ) != 0 ) {
+        printf( "dbConvert4: Failed to move temp file %s to "
+                "overwrite %s\n",
+                tempFileName, inFileName );
+        exit( 1 );
+        }
+
+    printf( "...kept %d records in %s, dropped %d container records\n",
+            count, inFileName, numDropped );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs != 1 ) {
+        usage();
+        }
+
+    const char *journals[6] = { "map.db.journal", "map.db.journal.flushing",
+                                "mapTime.db.journal",
+                                "mapTime.db.journal.flushing",
+                                "contents.db.journal",
+                                "contents.db.journal.flushing" };
+
+    for( int i=0; i<6; i++ ) {
+        if( fileExists( journals[i] ) ) {
+            printf( "dbConvert4: %s present, server didn't shut down "
+                    "cleanly.\n"
+                    "Start and stop the server once before converting.\n",
+                    journals[i] );
+            exit( 1 );
+            }
+        }
+
+
+    LINEARDB3 db;
+    LINEARDB3 timeDB;
+    LINEARDB3 contDB;
+
+    int error = LINEARDB3_open( &db, "map.db", 0, 80000, 16, 4 );
+
+    if( error ) {
+        printf( "dbConvert4: Failed to open map.db\n" );
+        exit( 1 );
+        }
+
+    error = LINEARDB3_open( &timeDB, "mapTime.db", 0, 80000, 16, 8 );
+
+    if( error ) {
+        printf( "dbConvert4: Failed to open mapTime.db\n" );
+        LINEARDB3_close( &db );
+        exit( 1 );
+        }
+
+    error = LINEARDB3_open( &contDB, "contents.db", 0, 80000,
+                            CONTENTS_KEY_SIZE, CONTENTS_CHUNK_SIZE );
+
+    if( error ) {
+        printf( "dbConvert4: Failed to open contents.db\n" );
+        LINEARDB3_close( &db );
+        LINEARDB3_close( &timeDB );
+        exit( 1 );
+        }
+
+
+    printf( "Moving containers from map.db into contents.db...\n" );
+
+    int numSkipped;
+    int numMoved = convertOldContainers( &db, &timeDB, &contDB,
+                                         &numSkipped );
+
+    printf( "...moved %d tiles, %d tiles already had contents records\n",
+            numMoved, numSkipped );
+
+    LINEARDB3_close( &contDB );
+
+
+    printf( "Removing container records from map.db and mapTime.db...\n" );
+
+    dropContainerSlots( "map.db", &db, 4 );
+    dropContainerSlots( "mapTime.db", &timeDB, 8 );
+
+    printf( "...done\n\n" );
+
+    return 0;
+    }
@@ -0,0 +1,794 @@
+#include "dbWriteBehind.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/system/Time.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/log/AppLog.h"
+
+
+
+// dirty records, coalesced by key
+// open addressing with linear probing, never deletes single records
+typedef struct DirtyTable {
+        unsigned int keySize;
+        unsigned int valueSize;
+
+        // power of 2
+        unsigned int numSlots;
+
+        unsigned char *keys;
+        unsigned char *values;
+        char *used;
+
+        // in order of first put, so a table can be walked or cleared
+        // without touching every slot
+        SimpleVector<unsigned int> *usedSlots;
+    } DirtyTable;
+
+
+#define DIRTY_TABLE_START_SLOTS 1024
+
+
+
+static void initDirtyTable( DirtyTable *inTable, unsigned int inKeySize,
+                            unsigned int inValueSize,
+                            unsigned int inNumSlots ) {
+    inTable->keySize = inKeySize;
+    inTable->valueSize = inValueSize;
+    inTable->numSlots = inNumSlots;
+
+    inTable->keys = new unsigned char[ inNumSlots * inKeySize ];
+    inTable->values = new unsigned char[ inNumSlots * inValueSize ];
+    inTable->used = new char[ inNumSlots ];
+
+    memset( inTable->used, false, inNumSlots );
+
+    inTable->usedSlots = new SimpleVector<unsigned int>();
+    }
+
+
+
+static void freeDirtyTable( DirtyTable *inTable ) {
+    delete [] inTable->keys;
+    delete [] inTable->values;
+    delete [] inTable->used;
+    delete inTable->usedSlots;
+    }
+
+
+
+static void clearDirtyTable( DirtyTable *inTable ) {
+    int numUsed = inTable->usedSlots->size();
+
+    for( int i=0; i<numUsed; i++ ) {
+        inTable->used[ inTable->usedSlots->getElementDirect( i ) ] = false;
+        }
+    inTable->usedSlots->deleteAll();
+    }
+
+
+
+static int getNumDirty( DirtyTable *inTable ) {
+    return inTable->usedSlots->size();
+    }
+
+
+
+// FNV-1a
+static unsigned int hashKey( const unsigned char *inKey,
+                             unsigned int inKeySize ) {
+    unsigned int h = 2166136261U;
+
+    for( unsigned int i=0; i<inKeySize; i++ ) {
+        h ^= inKey[i];
+        h *= 16777619U;
+        }
+    return h;
+    }
+
+
+
+// returns slot where key is, or where it should go if not present
+static unsigned int findSlot( DirtyTable *inTable,
+                              const unsigned char *inKey ) {
+    unsigned int mask = inTable->numSlots - 1;
+
+    unsigned int s = hashKey( inKey, inTable->keySize ) & mask;
+
+    while( inTable->used[s] &&
+           memcmp( &( inTable->keys[ s * inTable->keySize ] ),
+                   inKey, inTable->keySize ) != 0 ) {
+        s = ( s + 1 ) & mask;
+        }
+
+    return s;
+    }
+
+
+
+static unsigned char *lookupDirty( DirtyTable *inTable,
+                                   const unsigned char *inKey ) {
+    unsigned int s = findSlot( inTable, inKey );
+
+    if( inTable->used[s] ) {
+        return &( inTable->values[ s * inTable->valueSize ] );
+        }
+    return NULL;
+    }
+
+
+
+static void insertDirty( DirtyTable *inTable, const unsigned char *inKey,
+                         const unsigned char *inValue );
+
+
+static void growDirtyTable( DirtyTable *inTable ) {
+    DirtyTable old = *inTable;
+
+    initDirtyTable( inTable, old.keySize, old.valueSize, old.numSlots * 2 );
+
+    int numUsed = old.usedSlots->size();
+
+    for( int i=0; i<numUsed; i++ ) {
+        unsigned int s = old.usedSlots->getElementDirect( i );
+
+        insertDirty( inTable,
+                     &( old.keys[ s * old.keySize ] ),
+                     &( old.values[ s * old.valueSize ] ) );
+        }
+
+    freeDirtyTable( &old );
+    }
+
+
+
+static void insertDirty( DirtyTable *inTable, const unsigned char *inKey,
+                         const unsigned char *inValue ) {
+
+    unsigned int s = findSlot( inTable, inKey );
+
+    if( ! inTable->used[s] ) {
+        // keep load at or below 1/2
+        if( 2 * ( getNumDirty( inTable ) + 1 ) > (int)inTable->numSlots ) {
+            growDirtyTable( inTable );
+            s = findSlot( inTable, inKey );
+            }
+
+        inTable->used[s] = true;
+        inTable->usedSlots->push_back( s );
+        memcpy( &( inTable->keys[ s * inTable->keySize ] ),
+                inKey, inTable->keySize );
+        }
+
+    memcpy( &( inTable->values[ s * inTable->valueSize ] ),
+            inValue, inTable->valueSize );
+    }
+
+
+
+
+struct WriteBehindDB {
+        void *db;
+        unsigned int keySize;
+        unsigned int valueSize;
+
+        WriteBehindGetFunction get;
+        WriteBehindPutFunction put;
+        WriteBehindSyncFunction sync;
+
+        // held by background thread while it writes to db
+        MutexLock *engineLock;
+
+        // main thread puts new records here
+        DirtyTable *pending;
+
+        // batch being written by background thread
+        // read-only while a batch is in progress
+        DirtyTable *flushing;
+
+
+        char *journalPath;
+        char *flushingJournalPath;
+
+        FILE *journal;
+
+        // records appended since journal was last rotated
+        int journalRecords;
+
+        // appended since last fflush
+        char journalDirty;
+
+        // background thread removes this after batch is written
+        char flushingJournalPresent;
+    };
+
+
+
+static SimpleVector<WriteBehindDB*> wrappedDBs;
+
+
+static char writeBehindRunning = false;
+
+static double flushInterval = 1.0;
+static int maxPendingRecords = 200000;
+
+static double lastHandOffTime = 0;
+
+// no hand-offs while true
+static char flushesHeld = false;
+
+static double holdStartTime = 0;
+static int maxPendingWhileHeld = 0;
+
+
+// guards batchInProgress and stopSignal
+static MutexLock stateLock;
+static char batchInProgress = false;
+static char stopSignal = false;
+
+static BinarySemaphore batchReadySemaphore;
+static BinarySemaphore batchDoneSemaphore;
+
+
+static int numPuts = 0;
+static int numRecordsHandedOff = 0;
+static int numBatches = 0;
+static int numStalls = 0;
+
+
+// how many records background thread writes per engine lock
+#define FLUSH_GROUP_SIZE 64
+
+
+
+static char *getFlushingJournalPath( const char *inJournalPath ) {
+    return autoSprintf( "%s.flushing", inJournalPath );
+    }
+
+
+
+static int replayJournalFile( void *inDB,
+                              unsigned int inKeySize,
+                              unsigned int inValueSize,
+                              WriteBehindPutFunction inPut,
+                              const char *inPath ) {
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        return 0;
+        }
+
+    unsigned int recordSize = inKeySize + inValueSize;
+
+    unsigned char *record = new unsigned char[ recordSize ];
+
+    int numReplayed = 0;
+
+    // a partial record at the end was cut off by a crash, ignore it
+    while( fread( record, 1, recordSize, f ) == recordSize ) {
+        inPut( inDB, record, &( record[ inKeySize ] ) );
+        numReplayed++;
+        }
+
+    delete [] record;
+
+    fclose( f );
+
+    return numReplayed;
+    }
+
+
+
+int writeBehindReplayJournal( void *inDB,
+                              unsigned int inKeySize,
+                              unsigned int inValueSize,
+                              WriteBehindPutFunction inPut,
+                              WriteBehindSyncFunction inSync,
+                              const char *inJournalPath ) {
+
+    char *flushingPath = getFlushingJournalPath( inJournalPath );
+
+    // batch that was being written when we stopped is older than
+    // anything in the main journal
+    int numReplayed =
+        replayJournalFile( inDB, inKeySize, inValueSize, inPut,
+                           flushingPath );
+
+    numReplayed +=
+        replayJournalFile( inDB, inKeySize, inValueSize, inPut,
+                           inJournalPath );
+
+    if( numReplayed > 0 ) {
+        inSync( inDB );
+
+        AppLog::infoF( "Replayed %d write-behind journal records from %s",
+                       numReplayed, inJournalPath );
+        }
+
+    remove( flushingPath );
+    remove( inJournalPath );
+
+    delete [] flushingPath;
+
+    return numReplayed;
+    }
+
+
+
+static void writeBatch() {
+    for( int i=0; i<wrappedDBs.size(); i++ ) {
+        WriteBehindDB *w = wrappedDBs.getElementDirect( i );
+
+        DirtyTable *t = w->flushing;
+
+        int numDirty = getNumDirty( t );
+
+        // short lock holds, so main thread gets aren't stuck behind
+        // a whole batch
+        for( int g=0; g<numDirty; g += FLUSH_GROUP_SIZE ) {
+
+            int groupEnd = g + FLUSH_GROUP_SIZE;
+            if( groupEnd > numDirty ) {
+                groupEnd = numDirty;
+                }
+
+            w->engineLock->lock();
+
+            for( int r=g; r<groupEnd; r++ ) {
+                unsigned int s = t->usedSlots->getElementDirect( r );
+
+                w->put( w->db,
+                        &( t->keys[ s * t->keySize ] ),
+                        &( t->values[ s * t->valueSize ] ) );
+                }
+
+            w->engineLock->unlock();
+            }
+
+        if( numDirty > 0 ) {
+            w->engineLock->lock();
+            w->sync( w->db );
+            w->engineLock->unlock();
+            }
+
+        if( w->flushingJournalPresent ) {
+            // batch is safely in db now
+            remove( w->flushingJournalPath );
+            }
+        }
+    }
+
+
+
+class WriteBehindThread : public Thread {
+
+        virtual void run() {
+
+            char stop = false;
+
+            while( ! stop ) {
+                batchReadySemaphore.wait();
+
+                stateLock.lock();
+                char work = batchInProgress;
+                stop = stopSignal;
+                stateLock.unlock();
+
+                if( work ) {
+                    writeBatch();
+
+                    stateLock.lock();
+                    batchInProgress = false;
+                    stateLock.unlock();
+
+                    batchDoneSemaphore.signal();
+                    }
+                }
+            }
+
+    };
+
+
+static WriteBehindThread *writeBehindThread = NULL;
+
+
+
+static char isBatchInProgress() {
+    stateLock.lock();
+    char inProgress = batchInProgress;
+    stateLock.unlock();
+
+    return inProgress;
+    }
+
+
+
+static void waitForBatch() {
+    while( isBatchInProgress() ) {
+        batchDoneSemaphore.wait();
+        }
+    }
+
+
+
+static void openJournal( WriteBehindDB *inDB ) {
+    inDB->journal = fopen( inDB->journalPath, "wb" );
+
+    if( inDB->journal == NULL ) {
+        AppLog::errorF( "Failed to open write-behind journal %s, "
+                        "unflushed records will be lost on a crash",
+                        inDB->journalPath );
+        }
+    inDB->journalRecords = 0;
+    inDB->journalDirty = false;
+    }
+
+
+
+static void flushJournal( WriteBehindDB *inDB ) {
+    if( inDB->journal != NULL && inDB->journalDirty ) {
+        fflush( inDB->journal );
+        }
+    inDB->journalDirty = false;
+    }
+
+
+
+// batch must not be in progress
+static void handOffBatch() {
+
+    lastHandOffTime = Time::getCurrentTime();
+
+    int numRecords = 0;
+
+    for( int i=0; i<wrappedDBs.size(); i++ ) {
+        WriteBehindDB *w = wrappedDBs.getElementDirect( i );
+
+        // last batch is in db already
+        clearDirtyTable( w->flushing );
+
+        DirtyTable *temp = w->flushing;
+        w->flushing = w->pending;
+        w->pending = temp;
+
+        numRecords += getNumDirty( w->flushing );
+
+        w->flushingJournalPresent = false;
+
+        if( w->journal != NULL && w->journalRecords > 0 ) {
+            // journal covers exactly the records in this batch
+            fclose( w->journal );
+            w->journal = NULL;
+
+            if( rename( w->journalPath, w->flushingJournalPath ) == 0 ) {
+                w->flushingJournalPresent = true;
+                }
+
+            openJournal( w );
+            }
+        }
+
+    if( numRecords == 0 ) {
+        return;
+        }
+
+    numRecordsHandedOff += numRecords;
+    numBatches++;
+
+    stateLock.lock();
+    batchInProgress = true;
+    stateLock.unlock();
+
+    batchReadySemaphore.signal();
+    }
+
+
+
+static int getNumPending() {
+    int num = 0;
+
+    for( int i=0; i<wrappedDBs.size(); i++ ) {
+        num += getNumDirty( wrappedDBs.getElementDirect( i )->pending );
+        }
+    return num;
+    }
+
+
+
+void initWriteBehind( double inFlushIntervalSeconds,
+                      int inMaxPendingRecords ) {
+    flushInterval = inFlushIntervalSeconds;
+    maxPendingRecords = inMaxPendingRecords;
+
+    numPuts = 0;
+    numRecordsHandedOff = 0;
+    numBatches = 0;
+    numStalls = 0;
+
+    batchInProgress = false;
+    stopSignal = false;
+    flushesHeld = false;
+
+    lastHandOffTime = Time::getCurrentTime();
+
+    writeBehindThread = new WriteBehindThread();
+    writeBehindThread->start();
+
+    writeBehindRunning = true;
+    }
+
+
+
+void freeWriteBehind() {
+    if( ! writeBehindRunning ) {
+        return;
+        }
+
+    writeBehindFlushAll();
+
+    stateLock.lock();
+    stopSignal = true;
+    stateLock.unlock();
+
+    batchReadySemaphore.signal();
+
+    writeBehindThread->join();
+    delete writeBehindThread;
+    writeBehindThread = NULL;
+
+    writeBehindRunning = false;
+
+
+    for( int i=0; i<wrappedDBs.size(); i++ ) {
+        WriteBehindDB *w = wrappedDBs.getElementDirect( i );
+
+        if( w->journal != NULL ) {
+            fclose( w->journal );
+            }
+        // everything is in db, nothing left to replay
+        remove( w->journalPath );
+        remove( w->flushingJournalPath );
+
+        delete [] w->journalPath;
+        delete [] w->flushingJournalPath;
+
+        freeDirtyTable( w->pending );
+        freeDirtyTable( w->flushing );
+        delete w->pending;
+        delete w->flushing;
+
+        delete w->engineLock;
+
+        delete w;
+        }
+    wrappedDBs.deleteAll();
+
+    AppLog::infoF( "Write-behind:  %d puts coalesced into %d records, "
+                   "written in %d batches, %d main-thread stalls",
+                   numPuts, numRecordsHandedOff, numBatches, numStalls );
+    }
+
+
+
+WriteBehindDB *writeBehindWrap( void *inDB,
+                                unsigned int inKeySize,
+                                unsigned int inValueSize,
+                                WriteBehindGetFunction inGet,
+                                WriteBehindPutFunction inPut,
+                                WriteBehindSyncFunction inSync,
+                                const char *inJournalPath ) {
+
+    WriteBehindDB *w = new WriteBehindDB;
+
+    w->db = inDB;
+    w->keySize = inKeySize;
+    w->valueSize = inValueSize;
+    w->get = inGet;
+    w->put = inPut;
+    w->sync = inSync;
+
+    w->engineLock = new MutexLock();
+
+    w->pending = new DirtyTable;
+    w->flushing = new DirtyTable;
+
+    initDirtyTable( w->pending, inKeySize, inValueSize,
+                    DIRTY_TABLE_START_SLOTS );
+    initDirtyTable( w->flushing, inKeySize, inValueSize,
+                    DIRTY_TABLE_START_SLOTS );
+
+    w->journalPath = stringDuplicate( inJournalPath );
+    w->flushingJournalPath = getFlushingJournalPath( inJournalPath );
+    w->flushingJournalPresent = false;
+
+    openJournal( w );
+
+    // not touched by background thread outside of a batch
+    wrappedDBs.push_back( w );
+
+    return w;
+    }
+
+
+
+char writeBehindGetDirty( WriteBehindDB *inDB, const void *inKey,
+                          void *outValue ) {
+
+    const unsigned char *key = (const unsigned char*)inKey;
+
+    unsigned char *value = lookupDirty( inDB->pending, key );
+
+    if( value == NULL ) {
+        // if batch is done, these are already in db, but they are
+        // still the newest values
+        value = lookupDirty( inDB->flushing, key );
+        }
+
+    if( value != NULL ) {
+        memcpy( outValue, value, inDB->valueSize );
+        return true;
+        }
+    return false;
+    }
+
+
+
+int writeBehindGet( WriteBehindDB *inDB, const void *inKey, void *outValue ) {
+
+    if( writeBehindGetDirty( inDB, inKey, outValue ) ) {
+        return 0;
+        }
+
+    inDB->engineLock->lock();
+    int result = inDB->get( inDB->db, inKey, outValue );
+    inDB->engineLock->unlock();
+
+    return result;
+    }
+
+
+
+void writeBehindPut( WriteBehindDB *inDB, const void *inKey,
+                     const void *inValue ) {
+
+    insertDirty( inDB->pending,
+                 (const unsigned char*)inKey,
+                 (const unsigned char*)inValue );
+
+    if( inDB->journal != NULL ) {
+        fwrite( inKey, 1, inDB->keySize, inDB->journal );
+        fwrite( inValue, 1, inDB->valueSize, inDB->journal );
+
+        inDB->journalRecords++;
+        inDB->journalDirty = true;
+        }
+
+    numPuts++;
+    }
+
+
+
+void writeBehindLockEngine( WriteBehindDB *inDB ) {
+    inDB->engineLock->lock();
+    }
+
+
+
+void writeBehindUnlockEngine( WriteBehindDB *inDB ) {
+    inDB->engineLock->unlock();
+    }
+
+
+
+void stepWriteBehind() {
+    if( ! writeBehindRunning ) {
+        return;
+        }
+
+    for( int i=0; i<wrappedDBs.size(); i++ ) {
+        flushJournal( wrappedDBs.getElementDirect( i ) );
+        }
+
+    int numPending = getNumPending();
+
+    if( flushesHeld ) {
+        if( numPending > maxPendingWhileHeld ) {
+            maxPendingWhileHeld = numPending;
+            }
+
+        if( numPending < maxPendingRecords ) {
+            return;
+            }
+
+        // whoever holds flushes is taking too long, don't let pending
+        // grow forever
+        AppLog::warningF( "%d write-behind records pending while flushes "
+                          "held, breaking hold", numPending );
+        writeBehindReleaseFlushes();
+        }
+
+    if( numPending == 0 ) {
+        return;
+        }
+
+    char overMax = ( numPending >= maxPendingRecords );
+
+    if( ! overMax &&
+        Time::getCurrentTime() - lastHandOffTime < flushInterval ) {
+        return;
+        }
+
+    if( isBatchInProgress() ) {
+        if( ! overMax ) {
+            // keep coalescing until background thread is ready
+            return;
+            }
+
+        // background thread can't keep up, don't let pending grow forever
+        numStalls++;
+        waitForBatch();
+        }
+
+    handOffBatch();
+    }
+
+
+
+void writeBehindFlushAll() {
+    if( ! writeBehindRunning ) {
+        return;
+        }
+
+    for( int i=0; i<wrappedDBs.size(); i++ ) {
+        flushJournal( wrappedDBs.getElementDirect( i ) );
+        }
+
+    waitForBatch();
+    handOffBatch();
+    waitForBatch();
+    }
+
+
+
+char writeBehindHoldFlushes() {
+    if( ! writeBehindRunning ) {
+        return false;
+        }
+
+    writeBehindFlushAll();
+
+    flushesHeld = true;
+
+    holdStartTime = Time::getCurrentTime();
+    maxPendingWhileHeld = 0;
+
+    return true;
+    }
+
+
+
+char writeBehindFlushesHeld() {
+    return flushesHeld;
+    }
+
+
+
+void writeBehindReleaseFlushes() {
+    if( ! flushesHeld ) {
+        return;
+        }
+
+    flushesHeld = false;
+
+    AppLog::infoF( "Write-behind flushes held for %f sec, "
+                   "at most %d records pending",
+                   Time::getCurrentTime() - holdStartTime,
+                   maxPendingWhileHeld );
+    }
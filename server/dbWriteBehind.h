@@ -0,0 +1,134 @@
+// write-behind layer that sits in front of whichever map database engine
+// is selected in map.cpp
+//
+// Puts go into an in-memory table of dirty records, where repeated puts to
+// the same key are coalesced, and are appended to a per-database journal
+// file.  A background thread writes dirty records to the underlying
+// database in batches.  Gets check dirty records first, so they always see
+// the newest value.
+//
+// The journal is replayed at startup, so records that were accepted but
+// never reached the database (server crash) are not lost.
+//
+// Except where noted, calls must all come from the main thread.
+
+
+
+// same return values as the engine's get and put calls
+typedef int (*WriteBehindGetFunction)( void *inDB, const void *inKey,
+                                       void *outValue );
+
+typedef int (*WriteBehindPutFunction)( void *inDB, const void *inKey,
+                                       const void *inValue );
+
+// makes all engine writes so far durable on disk
+// journal records covering them are removed once this returns
+typedef void (*WriteBehindSyncFunction)( void *inDB );
+
+
+
+typedef struct WriteBehindDB WriteBehindDB;
+
+
+
+// Replays any journal left behind for a database by an earlier run
+// straight into the database, then removes the journal.
+//
+// Call right after opening the database, before anything reads from it,
+// whether or not write-behind will be used in this run.
+//
+// returns number of records replayed
+int writeBehindReplayJournal( void *inDB,
+                              unsigned int inKeySize,
+                              unsigned int inValueSize,
+                              WriteBehindPutFunction inPut,
+                              WriteBehindSyncFunction inSync,
+                              const char *inJournalPath );
+
+
+
+// starts the background flush thread
+//
+// dirty records are handed to the background thread at least every
+// inFlushIntervalSeconds.
+// If more than inMaxPendingRecords pile up while the background thread is
+// still busy with the previous batch, the main thread waits for it.
+void initWriteBehind( double inFlushIntervalSeconds,
+                      int inMaxPendingRecords );
+
+
+// writes all dirty records, stops the background thread, and destroys
+// all WriteBehindDBs
+//
+// underlying databases are left open
+void freeWriteBehind();
+
+
+
+// inDB must stay open until freeWriteBehind is called
+//
+// inJournalPath copied internally
+WriteBehindDB *writeBehindWrap( void *inDB,
+                                unsigned int inKeySize,
+                                unsigned int inValueSize,
+                                WriteBehindGetFunction inGet,
+                                WriteBehindPutFunction inPut,
+                                WriteBehindSyncFunction inSync,
+                                const char *inJournalPath );
+
+
+
+int writeBehindGet( WriteBehindDB *inDB, const void *inKey, void *outValue );
+
+void writeBehindPut( WriteBehindDB *inDB, const void *inKey,
+                     const void *inValue );
+
+
+// if key has a value that has not reached the underlying database yet,
+// copies that value into outValue and returns true
+char writeBehindGetDirty( WriteBehindDB *inDB, const void *inKey,
+                          void *outValue );
+
+
+
+// for touching the underlying database directly (like with iterators)
+// while the background thread may be writing to it
+void writeBehindLockEngine( WriteBehindDB *inDB );
+
+void writeBehindUnlockEngine( WriteBehindDB *inDB );
+
+
+
+// call once per server step
+// flushes journals and hands dirty records to the background thread
+// when due
+void stepWriteBehind();
+
+
+// blocks until every dirty record has been written to its database
+// (even while flushes are held)
+void writeBehindFlushAll();
+
+
+
+// for taking a consistent copy of database files while the server runs
+//
+// Writes all dirty records, then stops handing new ones to the background
+// thread until released, so that underlying database files stop changing.
+// Gets and puts keep working in the meantime; dirty records pile up in
+// RAM and in the journals.
+//
+// If inMaxPendingRecords pile up, stepWriteBehind breaks the hold and
+// files start changing again, so keep holds short.
+//
+// returns false if write-behind isn't running, in which case database
+// files can still change at any time
+char writeBehindHoldFlushes();
+
+
+// false once released, or once the hold has been broken
+char writeBehindFlushesHeld();
+
+
+// logs how long flushes were held and the most records pending meanwhile
+void writeBehindReleaseFlushes();
@@ -126,6 +126,7 @@
 #define DB_Iterator_init  LINEARDB3_Iterator_init
 #define DB_Iterator_next  LINEARDB3_Iterator_next
 #define DB_maxStack db.maxOverflowDepth
+#define DB_getBatch LINEARDB3_getBatch
 
 #endif
 
@@ -398,6 +399,62 @@ int main() {
 
 
 
+#ifdef DB_getBatch
+    // same lookups, one batch call per run
+    startTime = Time::getCurrentTime();
+    
+    unsigned int batchChecksum = 0;
+    numHits = 0;
+
+    unsigned char *batchKeys = new unsigned char[ lookupCount * 16 ];
+    unsigned char *batchValues = new unsigned char[ lookupCount * 4 ];
+    int *batchResults = new int[ lookupCount ];
+    
+    for( int r=0; r<numRuns; r++ ) {
+        CustomRandomSource runSource( 44493 );
+
+        for( int i=0; i<lookupCount; i++ ) {
+            int x = runSource.getRandomBoundedInt( 0, num-1 );
+            int y = runSource.getRandomBoundedInt( 0, num-1 );
+            int s = runSource.getRandomBoundedInt( 0, num-1 );
+            int b = runSource.getRandomBoundedInt( 0, num-1 );
+            intQuadToKey( x, y, s, b, &( batchKeys[ i * 16 ] ) );
+            }
+        
+        if( DB_getBatch( &db, lookupCount, batchKeys, batchValues, 
+                         batchResults ) == -1 ) {
+            printf( "DB_getBatch failed\n" );
+            return 1;
+            }
+        
+        for( int i=0; i<lookupCount; i++ ) {
+            if( batchResults[i] == 0 ) {
+                batchChecksum += valueToInt( &( batchValues[ i * 4 ] ) );
+                numHits++;
+                }
+            }
+        }
+    
+    delete [] batchKeys;
+    delete [] batchValues;
+    delete [] batchResults;
+
+    printf( "Batch random lookup for %d batchs of %d (%d hits)\n", 
+            numRuns, lookupCount, numHits );
+
+    printf( "Batch random look used %d bytes, took %f sec\n", 
+            getMallocDelta(),
+            Time::getCurrentTime() - startTime );
+
+    printf( "Checksum = %u (%s)\n", batchChecksum,
+            batchChecksum == checksum ? "matches" : "MISMATCH" );
+
+    
+    maybeFlush();
+#endif
+
+
+
     startTime = Time::getCurrentTime();
     
 
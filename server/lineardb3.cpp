@@ -9,6 +9,11 @@
 #ifdef _WIN32
 #define fseeko fseeko64
 #define ftello ftello64
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LINEARDB3_MMAP_AVAILABLE
 #endif
 
 
@@ -32,6 +37,20 @@ void LINEARDB3_setMaxLoad( double inMaxLoad ) {
 
 
 
+static char mmapModeForOpenCalls = false;
+
+
+void LINEARDB3_setMmapMode( char inUseMmap ) {
+    mmapModeForOpenCalls = inUseMmap;
+    }
+
+
+// mapping grows by at least this much at a time, or by half its
+// current size, whichever is bigger
+#define LINEARDB3_MMAP_EXTENT ( (uint64_t)64 * 1024 * 1024 )
+
+
+
 
 #include "murmurhash2_64.cpp"
 
@@ -359,6 +378,108 @@ static int writeHeader( LINEARDB3 *inDB ) {
 
 
 
+static void unmapFile( LINEARDB3 *inDB ) {
+    #ifdef LINEARDB3_MMAP_AVAILABLE
+    if( inDB->mapData != NULL ) {
+        munmap( inDB->mapData, inDB->mapSize );
+        }
+    #endif
+    
+    inDB->mapData = NULL;
+    inDB->mapSize = 0;
+    inDB->mapFileSize = 0;
+    }
+
+
+
+// makes sure that first inNeededSize bytes of file can be accessed 
+// through mapping
+// returns 0 on success, -1 on error
+static int ensureMapped( LINEARDB3 *inDB, uint64_t inNeededSize ) {
+    if( inNeededSize <= inDB->mapFileSize ) {
+        return 0;
+        }
+
+    #ifdef LINEARDB3_MMAP_AVAILABLE
+    
+    // newly appended records may still be in stdio buffer
+    if( fflush( inDB->file ) ) {
+        return -1;
+        }
+
+    struct stat fileInfo;
+    
+    if( fstat( fileno( inDB->file ), &fileInfo ) ) {
+        return -1;
+        }
+    
+    inDB->mapFileSize = fileInfo.st_size;
+
+    if( inNeededSize > inDB->mapFileSize ) {
+        // past end of file
+        return -1;
+        }
+    
+    if( inDB->mapFileSize > inDB->mapSize ||
+        inDB->mapData == NULL ) {
+        
+        uint64_t newSize = inDB->mapSize;
+        
+        uint64_t extent = newSize / 2;
+        if( extent < LINEARDB3_MMAP_EXTENT ) {
+            extent = LINEARDB3_MMAP_EXTENT;
+            }
+        
+        while( newSize < inDB->mapFileSize || newSize == 0 ) {
+            newSize += extent;
+            }
+        
+        if( inDB->mapData != NULL ) {
+            munmap( inDB->mapData, inDB->mapSize );
+            inDB->mapData = NULL;
+            }
+
+        // mapping past end of file is fine, as long as we never touch
+        // those pages
+        void *newMap = mmap( NULL, newSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fileno( inDB->file ), 0 );
+        
+        if( newMap == MAP_FAILED ) {
+            inDB->mapSize = 0;
+            inDB->mapFileSize = 0;
+            return -1;
+            }
+        
+        inDB->mapData = (uint8_t*)newMap;
+        inDB->mapSize = newSize;
+        }
+    
+    return 0;
+
+    #else
+
+    return -1;
+
+    #endif
+    }
+
+
+
+// returns NULL on error
+static uint8_t *getMappedRecord( LINEARDB3 *inDB, uint32_t inFileIndex ) {
+    uint64_t filePosRec = 
+        LINEARDB3_HEADER_SIZE + 
+        (uint64_t)inFileIndex * inDB->recordSizeBytes;
+
+    if( ensureMapped( inDB, filePosRec + inDB->recordSizeBytes ) ) {
+        return NULL;
+        }
+    
+    return &( inDB->mapData[ filePosRec ] );
+    }
+
+
+
 static int getRecordSizeBytes( int inKeySize, int inValueSize ) {
     return inKeySize + inValueSize;
     }
@@ -422,6 +543,10 @@ int LINEARDB3_open(
     inDB->recordBuffer = NULL;
     inDB->maxOverflowDepth = 0;
 
+    inDB->mapData = NULL;
+    inDB->mapSize = 0;
+    inDB->mapFileSize = 0;
+
     inDB->numRecords = 0;
     
     inDB->maxLoad = maxLoadForOpenCalls;
@@ -696,7 +821,13 @@ int LINEARDB3_open(
         }
     
 
-    
+    if( mmapModeForOpenCalls ) {
+        if( ensureMapped( inDB, LINEARDB3_HEADER_SIZE ) ) {
+            printf( "Failed to mmap lineardb3 file %s, "
+                    "falling back to stdio\n", inPath );
+            unmapFile( inDB );
+            }
+        }
 
 
     return 0;
@@ -718,6 +849,7 @@ void LINEARDB3_close( LINEARDB3 *inDB ) {
     delete inDB->hashTable;
     delete inDB->overflowBuckets;
     
+    unmapFile( inDB );
 
     if( inDB->file != NULL ) {
         fclose( inDB->file );
@@ -1022,6 +1154,30 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
             LINEARDB3_HEADER_SIZE +
             inBucket->fileIndex[ i ] * 
             inDB->recordSizeBytes;
+        
+        if( !emptyRec && inDB->mapData != NULL ) {
+            // mmap mode, no stdio needed
+            
+            uint8_t *rec = getMappedRecord( inDB, inBucket->fileIndex[ i ] );
+            
+            if( rec == NULL ) {
+                return -1;
+                }
+            if( ! keyComp( inDB->keySize, rec, inKey ) ) {
+                // fingerprint collision
+                return 2;
+                }
+            
+            if( inPut ) {
+                memcpy( &( rec[ inDB->keySize ] ), inOutValue, 
+                        inDB->valueSize );
+                }
+            else {
+                memcpy( inOutValue, &( rec[ inDB->keySize ] ), 
+                        inDB->valueSize );
+                }
+            return 0;
+            }
             
         if( !emptyRec ) {
             
@@ -1089,7 +1245,10 @@ static int LINEARDB3_considerFingerprintBucket( LINEARDB3 *inDB,
 
             // still need to seek here after reading before writing
             // according to fopen docs
-            fseeko( inDB->file, 0, SEEK_CUR );
+            // (in mmap mode, file is only used for appends, never read)
+            if( inDB->mapData == NULL ) {
+                fseeko( inDB->file, 0, SEEK_CUR );
+                }
             
             int numWritten = fwrite( inOutValue, inDB->valueSize, 1, 
                                      inDB->file );
@@ -1276,6 +1435,238 @@ int LINEARDB3_get( LINEARDB3 *inDB, const void *inKey, void *outValue ) {
 
 
 
+// records closer together than this are read together in getBatch
+#define LINEARDB3_BATCH_MAX_GAP 4096
+
+// but no more than this many bytes in one read
+#define LINEARDB3_BATCH_MAX_SPAN 65536
+
+
+typedef struct {
+        uint32_t fileIndex;
+        // which key this record might belong to
+        unsigned int keyIndex;
+    } BatchCandidate;
+
+
+
+static int compareBatchCandidates( const void *inA, const void *inB ) {
+    const BatchCandidate *a = (const BatchCandidate*)inA;
+    const BatchCandidate *b = (const BatchCandidate*)inB;
+
+    if( a->fileIndex < b->fileIndex ) {
+        return -1;
+        }
+    if( a->fileIndex > b->fileIndex ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+// reads inNumRecords records starting at inFirstIndex into outBuffer
+// returns 0 on success, -1 on error
+static int readRecordSpan( LINEARDB3 *inDB, uint32_t inFirstIndex, 
+                           uint32_t inNumRecords, uint8_t *outBuffer ) {
+    
+    uint64_t numBytes = (uint64_t)inNumRecords * inDB->recordSizeBytes;
+
+    if( inDB->mapData != NULL ) {
+        // make sure whole span is mapped
+        if( getMappedRecord( inDB, 
+                             inFirstIndex + inNumRecords - 1 ) == NULL ) {
+            return -1;
+            }
+        memcpy( outBuffer, getMappedRecord( inDB, inFirstIndex ), numBytes );
+        return 0;
+        }
+    
+    uint64_t filePos = 
+        LINEARDB3_HEADER_SIZE + 
+        (uint64_t)inFirstIndex * inDB->recordSizeBytes;
+
+    #ifdef _WIN32
+    
+    if( fseeko( inDB->file, filePos, SEEK_SET ) ) {
+        return -1;
+        }
+    inDB->lastOp = opRead;
+    
+    if( fread( outBuffer, numBytes, 1, inDB->file ) != 1 ) {
+        return -1;
+        }
+    
+    #else
+
+    // pread doesn't touch FILE* position, and FILE* read buffer stays
+    // valid, because we don't write
+    // but make sure buffered writes have reached the file first
+    if( inDB->lastOp == opWrite ) {
+        if( fflush( inDB->file ) ) {
+            return -1;
+            }
+        }
+    
+    uint64_t numDone = 0;
+    
+    while( numDone < numBytes ) {
+        ssize_t numRead = pread( fileno( inDB->file ), 
+                                 &( outBuffer[ numDone ] ),
+                                 numBytes - numDone, 
+                                 filePos + numDone );
+        if( numRead <= 0 ) {
+            return -1;
+            }
+        numDone += numRead;
+        }
+    
+    #endif
+
+    return 0;
+    }
+
+
+
+int LINEARDB3_getBatch( LINEARDB3 *inDB, unsigned int inNumKeys, 
+                        const void *inKeys, void *outValues, 
+                        int *outResults ) {
+    
+    const uint8_t *keys = (const uint8_t*)inKeys;
+    uint8_t *values = (uint8_t*)outValues;
+    
+    // usually one candidate per key, more for fingerprint collisions
+    unsigned int maxCandidates = inNumKeys + 16;
+    unsigned int numCandidates = 0;
+    BatchCandidate *candidates = new BatchCandidate[ maxCandidates ];
+    
+    
+    // probe hash table in RAM for all keys first
+    for( unsigned int k=0; k<inNumKeys; k++ ) {
+        outResults[k] = 1;
+        
+        const uint8_t *key = &( keys[ k * inDB->keySize ] );
+        
+        uint32_t fingerprint;
+        uint64_t binNumber = getBinNumber( inDB, key, &fingerprint );
+        
+        FingerprintBucket *thisBucket = 
+            getBucket( inDB->hashTable, binNumber );
+        
+        char hitEmpty = false;
+
+        while( ! hitEmpty ) {
+            
+            for( int i=0; i<RECORDS_PER_BUCKET; i++ ) {
+                uint32_t binFP = thisBucket->fingerprints[ i ];
+                
+                if( binFP == 0 ) {
+                    // guaranteed not found past here
+                    hitEmpty = true;
+                    break;
+                    }
+                if( binFP == fingerprint ) {
+                    if( numCandidates == maxCandidates ) {
+                        maxCandidates *= 2;
+                        BatchCandidate *newCandidates = 
+                            new BatchCandidate[ maxCandidates ];
+                        memcpy( newCandidates, candidates,
+                                numCandidates * sizeof( BatchCandidate ) );
+                        delete [] candidates;
+                        candidates = newCandidates;
+                        }
+                    candidates[ numCandidates ].fileIndex = 
+                        thisBucket->fileIndex[ i ];
+                    candidates[ numCandidates ].keyIndex = k;
+                    numCandidates++;
+                    }
+                }
+            
+            if( thisBucket->overflowIndex == 0 ) {
+                break;
+                }
+            thisBucket = getBucket( inDB->overflowBuckets, 
+                                    thisBucket->overflowIndex );
+            }
+        }
+    
+    
+    // then read records in file order
+    qsort( candidates, numCandidates, sizeof( BatchCandidate ),
+           compareBatchCandidates );
+    
+    uint32_t maxSpanRecords = 
+        LINEARDB3_BATCH_MAX_SPAN / inDB->recordSizeBytes;
+    uint32_t maxGapRecords = 
+        LINEARDB3_BATCH_MAX_GAP / inDB->recordSizeBytes;
+    
+    if( maxSpanRecords < 1 ) {
+        maxSpanRecords = 1;
+        }
+    
+    if( inDB->mapData != NULL ) {
+        // no syscalls to save by reading gaps between records
+        maxSpanRecords = 1;
+        }
+    
+    uint8_t *spanBuffer = 
+        new uint8_t[ maxSpanRecords * inDB->recordSizeBytes ];
+    
+    int returnVal = 0;
+
+    unsigned int c = 0;
+    
+    while( c < numCandidates ) {
+        uint32_t spanStart = candidates[c].fileIndex;
+        
+        unsigned int spanEndC = c + 1;
+        
+        while( spanEndC < numCandidates ) {
+            uint32_t nextIndex = candidates[ spanEndC ].fileIndex;
+            uint32_t lastIndex = candidates[ spanEndC - 1 ].fileIndex;
+            
+            if( nextIndex - lastIndex > maxGapRecords + 1 ||
+                nextIndex - spanStart >= maxSpanRecords ) {
+                break;
+                }
+            spanEndC++;
+            }
+        
+        uint32_t spanRecords = 
+            candidates[ spanEndC - 1 ].fileIndex - spanStart + 1;
+        
+        if( readRecordSpan( inDB, spanStart, spanRecords, spanBuffer ) ) {
+            returnVal = -1;
+            break;
+            }
+        
+        for( unsigned int i=c; i<spanEndC; i++ ) {
+            uint8_t *rec = 
+                &( spanBuffer[ ( candidates[i].fileIndex - spanStart ) * 
+                               inDB->recordSizeBytes ] );
+            
+            unsigned int k = candidates[i].keyIndex;
+            
+            if( keyComp( inDB->keySize, rec, 
+                         &( keys[ k * inDB->keySize ] ) ) ) {
+                memcpy( &( values[ k * inDB->valueSize ] ),
+                        &( rec[ inDB->keySize ] ), inDB->valueSize );
+                outResults[k] = 0;
+                }
+            // else fingerprint collision
+            }
+        
+        c = spanEndC;
+        }
+
+    delete [] spanBuffer;
+    delete [] candidates;
+    
+    return returnVal;
+    }
+
+
+
 int LINEARDB3_put( LINEARDB3 *inDB, const void *inKey, const void *inValue ) {
     int result = LINEARDB3_getOrPut( inDB, inKey, (void *)inValue, 
                                      true, false );
@@ -1294,6 +1685,46 @@ int LINEARDB3_put( LINEARDB3 *inDB, const void *inKey, const void *inValue ) {
 
 
 
+int LINEARDB3_sync( LINEARDB3 *inDB ) {
+    if( fflush( inDB->file ) ) {
+        return -1;
+        }
+    
+    #ifdef LINEARDB3_MMAP_AVAILABLE
+    if( inDB->mapData != NULL && inDB->mapFileSize > 0 ) {
+        if( msync( inDB->mapData, inDB->mapFileSize, MS_ASYNC ) ) {
+            return -1;
+            }
+        }
+    #endif
+
+    return 0;
+    }
+
+
+
+int LINEARDB3_syncToDisk( LINEARDB3 *inDB ) {
+    if( fflush( inDB->file ) ) {
+        return -1;
+        }
+    
+    #ifdef LINEARDB3_MMAP_AVAILABLE
+    if( inDB->mapData != NULL && inDB->mapFileSize > 0 ) {
+        if( msync( inDB->mapData, inDB->mapFileSize, MS_SYNC ) ) {
+            return -1;
+            }
+        }
+
+    if( fsync( fileno( inDB->file ) ) ) {
+        return -1;
+        }
+    #endif
+
+    return 0;
+    }
+
+
+
 void LINEARDB3_Iterator_init( LINEARDB3 *inDB, LINEARDB3_Iterator *inDBi ) {
     inDBi->db = inDB;
     inDBi->nextRecordIndex = 0;
@@ -1313,6 +1744,20 @@ int LINEARDB3_Iterator_next( LINEARDB3_Iterator *inDBi,
             return 0;
             }
 
+        if( db->mapData != NULL ) {
+            uint8_t *rec = getMappedRecord( db, inDBi->nextRecordIndex );
+            
+            if( rec == NULL ) {
+                return -1;
+                }
+            
+            memcpy( outKey, rec, db->keySize );
+            memcpy( outValue, &( rec[ db->keySize ] ), db->valueSize );
+
+            inDBi->nextRecordIndex++;
+            return 1;
+            }
+
 
         // fseek is needed here to make iterator safe to interleave
         // with other calls
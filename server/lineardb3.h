@@ -86,6 +86,19 @@ typedef struct {
         // for deciding when fseek is needed between reads and writes
         LastFileOp lastOp;
 
+        // non-NULL in mmap mode
+        // whole data file mapped from byte 0 (including header)
+        // new records are still appended through file, and mapping
+        // is grown in large extents as file grows
+        uint8_t *mapData;
+
+        // bytes mapped, can extend past end of file
+        uint64_t mapSize;
+
+        // bytes of file that are safe to touch through mapping
+        // (past this, records may still be sitting in file's stdio buffer)
+        uint64_t mapFileSize;
+
         // equal to the largest possible 32-bit table size, given
         // our current table size
         // used as mod for computing 32-bit hash fingerprints
@@ -139,6 +152,24 @@ void LINEARDB3_setMaxLoad( double inMaxLoad );
 
 
 
+/**
+ * Set whether subsequent calls to LINEARDB3_open memory-map the data file.
+ *
+ * Defaults to false.
+ *
+ * In mmap mode, gets, iteration, and puts that replace an existing value 
+ * are memcpys to and from the mapping, with no stdio calls.  Puts of new
+ * keys are still appended through the FILE*.
+ *
+ * File format is the same in both modes.
+ *
+ * Ignored on platforms without mmap, or if mapping a file fails (that
+ * DB falls back to stdio mode).
+ */
+void LINEARDB3_setMmapMode( char inUseMmap );
+
+
+
 
 /**
  * Open database
@@ -191,6 +222,28 @@ int LINEARDB3_get( LINEARDB3 *inDB, const void *inKey, void *outValue );
 
 
 
+/**
+ * Get many entries at once
+ *
+ * Hash table is probed for all keys first, then the matching records are
+ * read in file order, with records that are close together in the file
+ * read together.  Much cheaper than the same number of LINEARDB3_get calls
+ * when looking up a whole map region.
+ *
+ * @param db Database struct
+ * @param numKeys Number of keys
+ * @param keys numKeys keys, packed back to back (key_size bytes each)
+ * @param vbufs Value buffers, packed back to back (value_size bytes each)
+ *   Value buffers of keys that are not found are left untouched.
+ * @param results Filled with numKeys results, 0 for found, 1 for not found
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_getBatch( LINEARDB3 *inDB, unsigned int inNumKeys, 
+                        const void *inKeys, void *outValues, 
+                        int *outResults );
+
+
+
 /**
  * Put an entry (overwriting it if it already exists)
  *
@@ -206,6 +259,33 @@ int LINEARDB3_put( LINEARDB3 *inDB, const void *inKey, const void *inValue );
 
 
 
+/**
+ * Hand all puts so far to the operating system, so they survive a crash
+ * of this process.
+ *
+ * In stdio mode, flushes the FILE* buffer.
+ * In mmap mode, also schedules write-back of changed mapped pages.
+ *
+ * Does not wait for the disk itself (no fsync).
+ *
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_sync( LINEARDB3 *inDB );
+
+
+
+/**
+ * Like LINEARDB3_sync, but waits until all puts so far are on disk, so
+ * they survive a power loss or OS crash.
+ *
+ * Much slower.  Not available on Windows, where this only flushes.
+ *
+ * @return -1 on I/O error, 0 on success
+ */
+int LINEARDB3_syncToDisk( LINEARDB3 *inDB );
+
+
+
 /**
  * Cursor used for iterating over all entries in database
  */
@@ -0,0 +1,337 @@
+// Replays look regions against CoordinateTimeTracking and the sorted-vector
+// version it replaced, checks that they agree, and times both.
+//
+// Usage:
+//   lookTimeTrackingTest                   (synthetic players walking around)
+//   lookTimeTrackingTest lookRegions.txt   (recorded by a server with
+//                                           recordLookRegions set to 1)
+
+
+#include "CoordinateTimeTracking.h"
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/random/CustomRandomSource.h"
+
+#include <stdio.h>
+
+
+#define NUM_PLAYERS 40
+#define NUM_STEPS 20000
+#define STEP_SECONDS 0.02
+
+// matches noLookCountAsStaleSeconds in map.cpp
+#define STALE_SECONDS 10
+
+// region around each player, like the map chunks they're sent
+#define LOOK_RADIUS_X 16
+#define LOOK_RADIUS_Y 14
+
+
+
+// old implementation, kept here for comparison
+// records sorted in row-major order, searched linearly from last hit
+//
+// The old version inserted before the record where a backward search
+// stopped, which put that record out of order, so later checks could
+// miss it.  That's fixed here so the results are exact.
+class SortedCoordinateTimeTracking {
+    public:
+
+        SortedCoordinateTimeTracking()
+                :mNextIndex( 0 ) {
+            }
+
+
+        char checkExists( int inX, int inY, timeSec_t inCurTime ) {
+            int dir = 1;
+
+            int numRecords = mRecords.size();
+
+            if( numRecords > 0 ) {
+
+                CoordinateXYRecord *testR = mRecords.getElement( mNextIndex );
+
+                if( testR->y == inY &&
+                    testR->x == inX ) {
+                    testR->t = inCurTime;
+                    return true;
+                    }
+
+                if( testR->y > inY ||
+                    ( testR->y == inY
+                      &&
+                      testR->x > inX ) ) {
+                    dir = -1;
+                    }
+
+                if( dir == 1 ) {
+                    for( ; mNextIndex < numRecords; mNextIndex ++ ) {
+                        CoordinateXYRecord *r =
+                            mRecords.getElement( mNextIndex );
+
+                        if( r->y == inY &&
+                            r->x == inX ) {
+                            r->t = inCurTime;
+                            return true;
+                            }
+
+                        if( r->y > inY ||
+                            ( r->y == inY &&
+                              r->x > inX ) ) {
+                            break;
+                            }
+                        }
+                    }
+                else {
+                    for( ; mNextIndex > -1; mNextIndex -- ) {
+                        CoordinateXYRecord *r =
+                            mRecords.getElement( mNextIndex );
+
+                        if( r->y == inY &&
+                            r->x == inX ) {
+                            r->t = inCurTime;
+                            return true;
+                            }
+
+                        if( r->y < inY ||
+                            ( r->y == inY &&
+                              r->x < inX ) ) {
+                            break;
+                            }
+                        }
+                    // insert after record we stopped at
+                    mNextIndex ++;
+                    }
+                }
+            else {
+                mNextIndex = 0;
+                }
+
+            CoordinateXYRecord r = { inX, inY, inCurTime };
+
+            if( mNextIndex == numRecords ) {
+                mRecords.push_back( r );
+                }
+            else {
+                mRecords.push_middle( r, mNextIndex );
+                }
+            return false;
+            }
+
+
+        void cleanStale( timeSec_t inStaleTime ) {
+            SimpleVector<CoordinateXYRecord> temp( mRecords.size() );
+
+            for( int i=0; i<mRecords.size(); i++ ) {
+                CoordinateXYRecord *r = mRecords.getElement( i );
+
+                if( r->t > inStaleTime ) {
+                    temp.push_back( *r );
+                    }
+                }
+            mRecords.deleteAll();
+            mRecords.push_back_other( &temp );
+
+            mNextIndex = 0;
+            }
+
+
+        int getNumRecords() {
+            return mRecords.size();
+            }
+
+
+    private:
+
+        SimpleVector<CoordinateXYRecord> mRecords;
+        int mNextIndex;
+    };
+
+
+
+typedef struct LookOp {
+        // 'l' for look region, 'c' for clean stale
+        char type;
+        timeSec_t t;
+        int xStart, yStart, xEnd, yEnd;
+    } LookOp;
+
+
+
+static void readOps( FILE *inFile, SimpleVector<LookOp> *outOps ) {
+    char type;
+
+    while( fscanf( inFile, " %c", &type ) == 1 ) {
+        LookOp op;
+        op.type = type;
+        op.xStart = op.yStart = op.xEnd = op.yEnd = 0;
+
+        int numRead;
+
+        if( type == 'l' ) {
+            numRead = fscanf( inFile, "%lf %d %d %d %d", &( op.t ),
+                              &( op.xStart ), &( op.yStart ),
+                              &( op.xEnd ), &( op.yEnd ) );
+            if( numRead != 5 ) {
+                break;
+                }
+            }
+        else if( type == 'c' ) {
+            numRead = fscanf( inFile, "%lf", &( op.t ) );
+            if( numRead != 1 ) {
+                break;
+                }
+            }
+        else {
+            printf( "Unknown op type '%c', stopping read\n", type );
+            break;
+            }
+
+        outOps->push_back( op );
+        }
+    }
+
+
+
+// players wander around a few camps, looking at the region around
+// them whenever they step, with a clean every server step
+static void makeSyntheticOps( SimpleVector<LookOp> *outOps ) {
+    CustomRandomSource randSource( 0 );
+
+    int x[ NUM_PLAYERS ];
+    int y[ NUM_PLAYERS ];
+
+    for( int p=0; p<NUM_PLAYERS; p++ ) {
+        int camp = p % 5;
+
+        x[p] = camp * 200 + randSource.getRandomBoundedInt( -20, 20 );
+        y[p] = camp * -150 + randSource.getRandomBoundedInt( -20, 20 );
+        }
+
+    timeSec_t t = 1000000;
+
+    for( int s=0; s<NUM_STEPS; s++ ) {
+        t += STEP_SECONDS;
+
+        for( int p=0; p<NUM_PLAYERS; p++ ) {
+            // a step about every 0.2 seconds
+            if( randSource.getRandomBoundedInt( 0, 9 ) != 0 ) {
+                continue;
+                }
+
+            x[p] += randSource.getRandomBoundedInt( -1, 1 );
+            y[p] += randSource.getRandomBoundedInt( -1, 1 );
+
+            LookOp op = { 'l', t,
+                          x[p] - LOOK_RADIUS_X, y[p] - LOOK_RADIUS_Y,
+                          x[p] + LOOK_RADIUS_X, y[p] + LOOK_RADIUS_Y };
+            outOps->push_back( op );
+            }
+
+        LookOp op = { 'c', t - STALE_SECONDS, 0, 0, 0, 0 };
+        outOps->push_back( op );
+        }
+    }
+
+
+
+// returns seconds taken
+// checkExists results added to outResults
+template <class T>
+static double replayOps( T *inTracking, SimpleVector<LookOp> *inOps,
+                         SimpleVector<char> *outResults,
+                         int *outMaxRecords ) {
+    *outMaxRecords = 0;
+
+    double startTime = Time::getCurrentTime();
+
+    for( int i=0; i<inOps->size(); i++ ) {
+        LookOp *op = inOps->getElement( i );
+
+        if( op->type == 'c' ) {
+            inTracking->cleanStale( op->t );
+            continue;
+            }
+
+        for( int y=op->yStart; y<=op->yEnd; y++ ) {
+            for( int x=op->xStart; x<=op->xEnd; x++ ) {
+                outResults->push_back(
+                    inTracking->checkExists( x, y, op->t ) );
+                }
+            }
+
+        if( inTracking->getNumRecords() > *outMaxRecords ) {
+            *outMaxRecords = inTracking->getNumRecords();
+            }
+        }
+
+    return Time::getCurrentTime() - startTime;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+    SimpleVector<LookOp> ops;
+
+    if( inNumArgs > 1 ) {
+        FILE *f = fopen( inArgs[1], "r" );
+
+        if( f == NULL ) {
+            printf( "Failed to open %s\n", inArgs[1] );
+            return 1;
+            }
+        readOps( f, &ops );
+        fclose( f );
+
+        printf( "Read %d ops from %s\n", ops.size(), inArgs[1] );
+        }
+    else {
+        makeSyntheticOps( &ops );
+
+        printf( "Made %d synthetic ops for %d players\n",
+                ops.size(), NUM_PLAYERS );
+        }
+
+
+    SimpleVector<char> sortedResults;
+    SimpleVector<char> hashedResults;
+
+    int sortedMax, hashedMax;
+
+    SortedCoordinateTimeTracking sorted;
+    double sortedTime = replayOps( &sorted, &ops, &sortedResults,
+                                   &sortedMax );
+
+    CoordinateTimeTracking hashed;
+    double hashedTime = replayOps( &hashed, &ops, &hashedResults,
+                                   &hashedMax );
+
+
+    int mismatches = 0;
+    int numExisting = 0;
+
+    for( int i=0; i<sortedResults.size(); i++ ) {
+        char s = sortedResults.getElementDirect( i );
+
+        if( s != hashedResults.getElementDirect( i ) ) {
+            mismatches++;
+            }
+        if( s ) {
+            numExisting++;
+            }
+        }
+
+    printf( "%d checks, %d existing\n", sortedResults.size(), numExisting );
+
+    printf( "Sorted:  %.3f sec, max %d records\n", sortedTime, sortedMax );
+    printf( "Hashed:  %.3f sec, max %d records (including stale)\n",
+            hashedTime, hashedMax );
+
+    printf( "%d mismatches\n", mismatches );
+
+    if( mismatches > 0 ) {
+        return 1;
+        }
+    return 0;
+    }
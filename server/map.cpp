@@ -7,6 +7,14 @@
 
 #include "eveMovingGrid.h"
 
+#include "settingsCache.h"
+
+#include "dbWriteBehind.h"
+
+#include "SetAssociativeCache.h"
+
+#include "mapChangeLog.h"
+
 
 // cell pixel dimension on client
 #define CELL_D 128
@@ -31,6 +39,8 @@
 
 #include "minorGems/util/crc32.h"
 
+#include "../commonSource/mapChunkEncoding.h"
+
 
 /*
 #define DB KISSDB
@@ -49,6 +59,9 @@
 #define DB_getCurrentSize( dbP )  dbP->hashTableSize
 // no support for counting records
 #define DB_getNumRecords( dbP ) 0
+#define DB_sync( dbP ) fflush( (dbP)->f )
+// no durable sync
+#define DB_syncToDisk( dbP ) fflush( (dbP)->f )
 */
 
 
@@ -69,6 +82,9 @@
 #define DB_getCurrentSize( dbP )  dbP->hashTableSize
 // no support for counting records
 #define DB_getNumRecords( dbP ) 0
+#define DB_sync( dbP ) fflush( (dbP)->file )
+// no durable sync
+#define DB_syncToDisk( dbP ) fflush( (dbP)->file )
 */
 
 /*
@@ -86,6 +102,9 @@
 #define DB_getShrinkSize  LINEARDB_getShrinkSize
 #define DB_getCurrentSize  LINEARDB_getCurrentSize
 #define DB_getNumRecords LINEARDB_getNumRecords
+#define DB_sync( dbP ) fflush( (dbP)->file )
+// no durable sync
+#define DB_syncToDisk( dbP ) fflush( (dbP)->file )
 */
 
 
@@ -103,6 +122,9 @@
 #define DB_getShrinkSize  LINEARDB3_getShrinkSize
 #define DB_getCurrentSize  LINEARDB3_getCurrentSize
 #define DB_getNumRecords LINEARDB3_getNumRecords
+#define DB_sync( dbP ) LINEARDB3_sync( dbP )
+#define DB_syncToDisk( dbP ) LINEARDB3_syncToDisk( dbP )
+#define DB_getBatch LINEARDB3_getBatch
 
 
 
@@ -113,6 +135,8 @@
 
     
 #include "dbCommon.h"
+#include "tileContents.h"
+#include "oldContainers.h"
 
 
 #include <stdarg.h>
@@ -249,8 +273,6 @@ static unsigned int biomeRandSeedB = 941;
 static SimpleVector<int> barrierItemList;
 
 
-static FILE *mapChangeLogFile = NULL;
-
 static double mapChangeLogTimeStart = -1;
 
 
@@ -361,6 +383,11 @@ static DB timeDB;
 static char timeDBOpen = false;
 
 
+// everything contained at each tile, see tileContents.h
+static DB contDB;
+static char contDBOpen = false;
+
+
 static DB biomeDB;
 static char biomeDBOpen = false;
 
@@ -386,6 +413,209 @@ static char metaDBOpen = false;
 
 
 
+// write-behind layers in front of the DBs that are written during play
+// NULL when write-behind is off, or before initMap finishes, in which case
+// gets and puts go straight to the DB
+static WriteBehindDB *dbWB = NULL;
+static WriteBehindDB *timeDBWB = NULL;
+static WriteBehindDB *contDBWB = NULL;
+static WriteBehindDB *floorDBWB = NULL;
+static WriteBehindDB *floorTimeDBWB = NULL;
+static WriteBehindDB *lookTimeDBWB = NULL;
+
+
+
+static int writeBehindEngineGet( void *inDB, const void *inKey, 
+                                 void *outValue ) {
+    return DB_get( (DB*)inDB, inKey, outValue );
+    }
+
+
+static int writeBehindEnginePut( void *inDB, const void *inKey, 
+                                 const void *inValue ) {
+    return DB_put( (DB*)inDB, inKey, inValue );
+    }
+
+
+// journal is removed after this, so writes must be on disk
+static void writeBehindEngineSync( void *inDB ) {
+    DB_syncToDisk( (DB*)inDB );
+    }
+
+
+
+static char *getJournalPath( const char *inDBFileName ) {
+    return autoSprintf( "%s.journal", inDBFileName );
+    }
+
+
+
+// call right after DB is opened
+static void replayMapDBJournal( DB *inDB, const char *inDBFileName,
+                                unsigned int inKeySize,
+                                unsigned int inValueSize ) {
+    char *journalPath = getJournalPath( inDBFileName );
+    
+    writeBehindReplayJournal( inDB, inKeySize, inValueSize,
+                              writeBehindEnginePut, writeBehindEngineSync,
+                              journalPath );
+    delete [] journalPath;
+    }
+
+
+
+static WriteBehindDB *wrapMapDB( DB *inDB, const char *inDBFileName,
+                                 unsigned int inKeySize,
+                                 unsigned int inValueSize ) {
+    char *journalPath = getJournalPath( inDBFileName );
+    
+    WriteBehindDB *w = 
+        writeBehindWrap( inDB, inKeySize, inValueSize,
+                         writeBehindEngineGet, writeBehindEnginePut,
+                         writeBehindEngineSync,
+                         journalPath );
+    delete [] journalPath;
+    
+    return w;
+    }
+
+
+
+static int mapDBGet( DB *inDB, WriteBehindDB *inWB, 
+                     const void *inKey, void *outValue ) {
+    if( inWB != NULL ) {
+        return writeBehindGet( inWB, inKey, outValue );
+        }
+    return DB_get( inDB, inKey, outValue );
+    }
+
+
+
+static void mapDBPut( DB *inDB, WriteBehindDB *inWB, 
+                      const void *inKey, const void *inValue ) {
+    if( inWB != NULL ) {
+        writeBehindPut( inWB, inKey, inValue );
+        }
+    else {
+        DB_put( inDB, inKey, inValue );
+        }
+    }
+
+
+
+// inKeys and outValues packed back to back
+// outResults[i] set to 0 if key i found, 1 if not found (or on error,
+// like mapDBGet's callers assume)
+static void mapDBGetBatch( DB *inDB, WriteBehindDB *inWB,
+                           unsigned int inKeySize, unsigned int inValueSize,
+                           int inNumKeys, const unsigned char *inKeys,
+                           unsigned char *outValues, int *outResults ) {
+    
+    // dirty values are newer than anything in DB
+    // look those up first, and send the rest to the DB
+    int *dbIndices = new int[ inNumKeys ];
+    int numDBKeys = 0;
+    
+    unsigned char *dbKeys = new unsigned char[ inNumKeys * inKeySize ];
+    
+    for( int i=0; i<inNumKeys; i++ ) {
+        const unsigned char *key = &( inKeys[ i * inKeySize ] );
+        
+        if( inWB != NULL &&
+            writeBehindGetDirty( inWB, key, 
+                                 &( outValues[ i * inValueSize ] ) ) ) {
+            outResults[i] = 0;
+            }
+        else {
+            memcpy( &( dbKeys[ numDBKeys * inKeySize ] ), key, inKeySize );
+            dbIndices[ numDBKeys ] = i;
+            numDBKeys++;
+            }
+        }
+    
+    if( numDBKeys > 0 ) {
+        unsigned char *dbValues = new unsigned char[ numDBKeys * inValueSize ];
+        int *dbResults = new int[ numDBKeys ];
+        
+        if( inWB != NULL ) {
+            writeBehindLockEngine( inWB );
+            }
+        
+        #ifdef DB_getBatch
+        if( DB_getBatch( inDB, numDBKeys, dbKeys, dbValues, dbResults ) ) {
+            for( int i=0; i<numDBKeys; i++ ) {
+                dbResults[i] = 1;
+                }
+            }
+        #else
+        for( int i=0; i<numDBKeys; i++ ) {
+            dbResults[i] = DB_get( inDB, &( dbKeys[ i * inKeySize ] ),
+                                   &( dbValues[ i * inValueSize ] ) );
+            }
+        #endif
+
+        if( inWB != NULL ) {
+            writeBehindUnlockEngine( inWB );
+            }
+        
+        for( int i=0; i<numDBKeys; i++ ) {
+            int dest = dbIndices[i];
+            
+            if( dbResults[i] == 0 ) {
+                memcpy( &( outValues[ dest * inValueSize ] ),
+                        &( dbValues[ i * inValueSize ] ), inValueSize );
+                outResults[ dest ] = 0;
+                }
+            else {
+                outResults[ dest ] = 1;
+                }
+            }
+        
+        delete [] dbValues;
+        delete [] dbResults;
+        }
+    
+    delete [] dbKeys;
+    delete [] dbIndices;
+    }
+
+
+
+// background thread may be writing to DB while we iterate,
+// and iterator may return values that are older than dirty ones
+static int mapDBIteratorNext( DB_Iterator *inDBi, WriteBehindDB *inWB, 
+                              void *outKey, void *outValue ) {
+    if( inWB == NULL ) {
+        return DB_Iterator_next( inDBi, outKey, outValue );
+        }
+    
+    writeBehindLockEngine( inWB );
+    int result = DB_Iterator_next( inDBi, outKey, outValue );
+    writeBehindUnlockEngine( inWB );
+    
+    if( result > 0 ) {
+        writeBehindGetDirty( inWB, outKey, outValue );
+        }
+    return result;
+    }
+
+
+
+static void mapDBIteratorInit( DB *inDB, WriteBehindDB *inWB,
+                               DB_Iterator *inDBi ) {
+    if( inWB != NULL ) {
+        writeBehindLockEngine( inWB );
+        }
+    
+    DB_Iterator_init( inDB, inDBi );
+
+    if( inWB != NULL ) {
+        writeBehindUnlockEngine( inWB );
+        }
+    }
+
+
+
 static int randSeed = 124567;
 //static JenkinsRandomSource randSource( randSeed );
 static CustomRandomSource randSource( randSeed );
@@ -393,13 +623,8 @@ static CustomRandomSource randSource( randSeed );
 
 
 #define DECAY_SLOT 1
-#define NUM_CONT_SLOT 2
-#define FIRST_CONT_SLOT 3
 
-#define NO_DECAY_SLOT -1
-
-
-// decay slots for contained items start after container slots
+// contained items and their decay times are in contDB
 
 
 // 15 minutes
@@ -425,7 +650,7 @@ typedef struct LiveDecayRecord {
         int x, y;
         
         // 0 means main object decay
-        // 1 - NUM_CONT_SLOT means contained object decay
+        // 1 and up means contained object decay, in slot - 1
         int slot;
         
         timeSec_t etaTimeSeconds;
@@ -481,6 +706,10 @@ liveDecayRecordLastLookTimeMaxContainedHashTable( 1024, defaultContRecord );
 
 static CoordinateTimeTracking lookTimeTracking;
 
+// look regions and stale cleanings, if recordLookRegions is set,
+// for replaying with lookTimeTrackingTest
+static FILE *lookRecordFile = NULL;
+
 
 
 // track currently in-process movements so that we can be queried
@@ -603,8 +832,7 @@ static Homeland *getHomeland( int inX, int inY,
                               char includeExpired = false ) {
     double t = Time::getCurrentTime();
     
-    int staleTime = 
-        SettingsManager::getIntSetting( "homelandStaleSeconds", 3600 );
+    int staleTime = cachedSettings.homelandStaleSeconds;
     
     double tooOldTime = t - staleTime;
 
@@ -784,6 +1012,8 @@ static void eveDBPut( const char *inEmail, int inX, int inY, int inRadius ) {
 
 static void dbFloorPut( int inX, int inY, int inValue );
 
+static void freeChunkScratchSpace();
+
 
 
 
@@ -824,16 +1054,12 @@ double sigmoid( double inInput, double inKnee ) {
 // optimization:
 // cache biomeIndex results in RAM
 
-// 3.1 MB of RAM for this.
-#define BIOME_CACHE_SIZE 131072
-
 typedef struct BiomeCacheRecord {
-        int x, y;
         int biome, secondPlace;
         double secondPlaceGap;
     } BiomeCacheRecord;
     
-static BiomeCacheRecord biomeCache[ BIOME_CACHE_SIZE ];
+static SetAssociativeCache<BiomeCacheRecord> biomeCache( "Biome" );
 
 
 #define CACHE_PRIME_A 776509273
@@ -841,23 +1067,9 @@ static BiomeCacheRecord biomeCache[ BIOME_CACHE_SIZE ];
 #define CACHE_PRIME_C 528383237
 #define CACHE_PRIME_D 148497157
 
-static int computeXYCacheHash( int inKeyA, int inKeyB ) {
-    
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B ) % BIOME_CACHE_SIZE;
-    if( hashKey < 0 ) {
-        hashKey += BIOME_CACHE_SIZE;
-        }
-    return hashKey;
-    }
-
-
-
 static void initBiomeCache() {
-    BiomeCacheRecord blankRecord = { 0, 0, -2, 0, 0 };
-    for( int i=0; i<BIOME_CACHE_SIZE; i++ ) {
-        biomeCache[i] = blankRecord;
-        }
+    biomeCache.init( 
+        SettingsManager::getIntSetting( "biomeCacheEntries", 131072 ) );
     }
 
     
@@ -867,14 +1079,13 @@ static void initBiomeCache() {
 static int biomeGetCached( int inX, int inY, 
                            int *outSecondPlaceIndex,
                            double *outSecondPlaceGap ) {
-    BiomeCacheRecord r =
-        biomeCache[ computeXYCacheHash( inX, inY ) ];
+    BiomeCacheRecord *r = biomeCache.lookup( inX, inY );
 
-    if( r.x == inX && r.y == inY ) {
-        *outSecondPlaceIndex = r.secondPlace;
-        *outSecondPlaceGap = r.secondPlaceGap;
+    if( r != NULL ) {
+        *outSecondPlaceIndex = r->secondPlace;
+        *outSecondPlaceGap = r->secondPlaceGap;
         
-        return r.biome;
+        return r->biome;
         }
     else {
         return -2;
@@ -885,9 +1096,9 @@ static int biomeGetCached( int inX, int inY,
 
 static void biomePutCached( int inX, int inY, int inBiome, int inSecondPlace,
                             double inSecondPlaceGap ) {
-    BiomeCacheRecord r = { inX, inY, inBiome, inSecondPlace, inSecondPlaceGap };
+    BiomeCacheRecord r = { inBiome, inSecondPlace, inSecondPlaceGap };
     
-    biomeCache[ computeXYCacheHash( inX, inY ) ] = r;
+    biomeCache.insert( inX, inY, r );
     }
 
 
@@ -921,43 +1132,22 @@ static int getSpecialBiomeIndexForYBand( int inY, char *outOfBand = NULL ) {
 
 
 
-// new code, topographic rings
-static int computeMapBiomeIndex( int inX, int inY, 
-                                 int *outSecondPlaceIndex = NULL,
-                                 double *outSecondPlaceGap = NULL ) {
-        
+// picks biome for a cell from its raw topographic altitude
+// (the biomeRandSeed fractal)
+//
+// shared by computeMapBiomeIndex and fillBiomeCacheRect
+// may change the XY random seed
+static int pickBiomeForAltitude( int inX, int inY, double inAltitude,
+                                 int *outSecondPlaceIndex,
+                                 double *outSecondPlaceGap ) {
+    
+    int pickedBiome = -1;
+    
     int secondPlace = -1;
     
     double secondPlaceGap = 0;
-
-
-    int pickedBiome = biomeGetCached( inX, inY, &secondPlace, &secondPlaceGap );
-        
-    if( pickedBiome != -2 ) {
-        // hit cached
-
-        if( outSecondPlaceIndex != NULL ) {
-            *outSecondPlaceIndex = secondPlace;
-            }
-        if( outSecondPlaceGap != NULL ) {
-            *outSecondPlaceGap = secondPlaceGap;
-            }
     
-        return pickedBiome;
-        }
-
-    // else cache miss
-    pickedBiome = -1;
-
-
-    // try topographical altitude mapping
-
-    setXYRandomSeed( biomeRandSeedA, biomeRandSeedB );
-
-    double randVal = 
-        ( getXYFractal( inX, inY,
-                        0.55, 
-                        0.83332 + 0.08333 * numBiomes ) );
+    double randVal = inAltitude;
 
     // push into range 0..1, based on sampled min/max values
     randVal -= 0.099668;
@@ -1100,6 +1290,53 @@ static int computeMapBiomeIndex( int inX, int inY,
         }
 
 
+    *outSecondPlaceIndex = secondPlace;
+    *outSecondPlaceGap = secondPlaceGap;
+    
+    return pickedBiome;
+    }
+
+
+
+// new code, topographic rings
+static int computeMapBiomeIndex( int inX, int inY, 
+                                 int *outSecondPlaceIndex = NULL,
+                                 double *outSecondPlaceGap = NULL ) {
+        
+    int secondPlace = -1;
+    
+    double secondPlaceGap = 0;
+
+
+    int pickedBiome = biomeGetCached( inX, inY, &secondPlace, &secondPlaceGap );
+        
+    if( pickedBiome != -2 ) {
+        // hit cached
+
+        if( outSecondPlaceIndex != NULL ) {
+            *outSecondPlaceIndex = secondPlace;
+            }
+        if( outSecondPlaceGap != NULL ) {
+            *outSecondPlaceGap = secondPlaceGap;
+            }
+    
+        return pickedBiome;
+        }
+
+    // else cache miss
+
+    // try topographical altitude mapping
+
+    setXYRandomSeed( biomeRandSeedA, biomeRandSeedB );
+
+    double randVal = 
+        ( getXYFractal( inX, inY,
+                        0.55, 
+                        0.83332 + 0.08333 * numBiomes ) );
+
+    pickedBiome = pickBiomeForAltitude( inX, inY, randVal, 
+                                        &secondPlace, &secondPlaceGap );
+
     biomePutCached( inX, inY, pickedBiome, secondPlace, secondPlaceGap );
     
     
@@ -1116,6 +1353,78 @@ static int computeMapBiomeIndex( int inX, int inY,
 
 
 
+// fills biomeCache for the cells of a rectangle that aren't cached yet,
+// with the same results as computeMapBiomeIndex
+//
+// if inMask is not NULL, only cells with non-zero entries
+// (inMask[ y * inWidth + x ]) are filled
+static void fillBiomeCacheRect( int inX, int inY, int inWidth, int inHeight,
+                                const char *inMask = NULL ) {
+    int numCells = inWidth * inHeight;
+    
+    if( numCells <= 0 ) {
+        return;
+        }
+    
+    char *missMask = new char[ numCells ];
+    int numMisses = 0;
+    
+    for( int y=0; y<inHeight; y++ ) {
+        for( int x=0; x<inWidth; x++ ) {
+            int i = y * inWidth + x;
+            
+            missMask[i] = false;
+            
+            if( inMask != NULL && ! inMask[i] ) {
+                continue;
+                }
+            
+            if( biomeCache.peek( inX + x, inY + y ) == NULL ) {
+                missMask[i] = true;
+                numMisses++;
+                }
+            }
+        }
+    
+    if( numMisses > 0 ) {
+        double *altitudes = new double[ numCells ];
+        
+        setXYRandomSeed( biomeRandSeedA, biomeRandSeedB );
+        
+        getXYFractalRect( inX, inY, inWidth, inHeight,
+                          0.55,
+                          0.83332 + 0.08333 * numBiomes,
+                          altitudes, missMask );
+        
+        for( int y=0; y<inHeight; y++ ) {
+            for( int x=0; x<inWidth; x++ ) {
+                int i = y * inWidth + x;
+                
+                if( ! missMask[i] ) {
+                    continue;
+                    }
+                
+                int secondPlace;
+                double secondPlaceGap;
+                
+                int pickedBiome = 
+                    pickBiomeForAltitude( inX + x, inY + y, altitudes[i],
+                                          &secondPlace, &secondPlaceGap );
+                
+                biomePutCached( inX + x, inY + y, 
+                                pickedBiome, secondPlace, secondPlaceGap );
+                }
+            }
+        
+        delete [] altitudes;
+        }
+    
+    delete [] missMask;
+    }
+
+
+
+
 // old code, separate height fields per biome that compete
 // and create a patchwork layout
 static int computeMapBiomeIndexOld( int inX, int inY, 
@@ -1310,46 +1619,25 @@ static int yLimit = 2147481977;
 
 
 typedef struct BaseMapCacheRecord {
-        int x, y;
         int id;
         char gridPlacement;
     } BaseMapCacheRecord;
 
 
-// should be a power of 2
-// cache will contain squared number of records
-#define BASE_MAP_CACHE_SIZE 256
-
-// if BASE_MAP_CACHE_SIZE is a power of 2, then this is the bit mask
-// of solid 1's that can limit an integer to that range
-static int mapCacheBitMask = BASE_MAP_CACHE_SIZE - 1;
-
-BaseMapCacheRecord baseMapCache[ BASE_MAP_CACHE_SIZE ][ BASE_MAP_CACHE_SIZE ];
+static SetAssociativeCache<BaseMapCacheRecord> baseMapCache( "Base map" );
 
 static void mapCacheClear() {
-    for( int y=0; y<BASE_MAP_CACHE_SIZE; y++ ) {
-        for( int x=0; x<BASE_MAP_CACHE_SIZE; x++ ) {
-            baseMapCache[y][x].x = 0;
-            baseMapCache[y][x].y = 0;
-            baseMapCache[y][x].id = -1;
-            }
-        }
-    }
-
-
-
-static BaseMapCacheRecord *mapCacheRecordLookup( int inX, int inY ) {
-    // apply bitmask to x and y
-    return &( baseMapCache[ inY & mapCacheBitMask ][ inX & mapCacheBitMask ] ); 
+    baseMapCache.init( 
+        SettingsManager::getIntSetting( "baseMapCacheEntries", 65536 ) );
     }
 
 
 
 // returns -1 if not in cache
 static int mapCacheLookup( int inX, int inY, char *outGridPlacement = NULL ) {
-    BaseMapCacheRecord *r = mapCacheRecordLookup( inX, inY );
+    BaseMapCacheRecord *r = baseMapCache.lookup( inX, inY );
     
-    if( r->x == inX && r->y == inY ) {
+    if( r != NULL ) {
         if( outGridPlacement != NULL ) {
             *outGridPlacement = r->gridPlacement;
             }
@@ -1363,12 +1651,9 @@ static int mapCacheLookup( int inX, int inY, char *outGridPlacement = NULL ) {
 
 static void mapCacheInsert( int inX, int inY, int inID, 
                             char inGridPlacement = false ) {
-    BaseMapCacheRecord *r = mapCacheRecordLookup( inX, inY );
+    BaseMapCacheRecord r = { inID, inGridPlacement };
     
-    r->x = inX;
-    r->y = inY;
-    r->id = inID;
-    r->gridPlacement = inGridPlacement;
+    baseMapCache.insert( inX, inY, r );
     }
 
     
@@ -1376,30 +1661,141 @@ static void mapCacheInsert( int inX, int inY, int inID,
 static int getBaseMapCallCount = 0;
 
 
-static int getBaseMap( int inX, int inY, char *outGridPlacement = NULL ) {
-    
-    if( inX > xLimit || inX < -xLimit ||
-        inY > yLimit || inY < -yLimit ) {
-    
-        return edgeObjectID;
-        }
-    
-    int cachedID = mapCacheLookup( inX, inY, outGridPlacement );
-    
-    if( cachedID != -1 ) {
-        return cachedID;
-        }
-    
-    getBaseMapCallCount ++;
 
+// the pieces of getBaseMap that come after the noise lookups,
+// shared with getBaseMapRect
 
-    if( outGridPlacement != NULL ) {
-        *outGridPlacement = false;
-        }
-    
 
-    // see if any of our grids apply
-    setXYRandomSeed( 9753 );
+// inDensityFractal is the seed 5379 fractal at the cell
+// natural object placed if seed 9877 random value is below this
+static double getNaturalObjectDensity( double inDensityFractal ) {
+    
+    // correction
+    double density = sigmoid( inDensityFractal, 0.1 );
+    
+    // scale
+    density *= .4;
+    // good for zoom in to map for teaser
+    //density = .70;
+
+    return density;
+    }
+
+
+
+// randomly let objects from second place biome peek through
+//
+// inRandom is seed 348763 random value at the cell
+static char secondPlacePeeksThrough( double inRandom, 
+                                     double inSecondPlaceGap ) {
+    // if gap is 0, this should happen 50 percent of the time
+
+    // if gap is 1.0, it should never happen
+
+    // larger values make second place less likely
+    double secondPlaceReduction = 10.0;
+
+    return ( inRandom > .5 + secondPlaceReduction * inSecondPlaceGap );
+    }
+
+
+
+// picks natural object for a cell in inPickedBiome, where 
+// inSpecialObjectIndex is 10x more common than it would be otherwise
+//
+// inRandom is seed 4593873 random value at the cell
+//
+// returns 0 if nothing picked
+static int pickNaturalObject( int inPickedBiome, int inSecondPlace,
+                              int inSpecialObjectIndex, double inRandom ) {
+    
+    int numObjects = naturalMapIDs[inPickedBiome].size();
+    
+    float oldSpecialChance = 
+        naturalMapChances[inPickedBiome].getElementDirect( 
+            inSpecialObjectIndex );
+    
+    float newSpecialChance = oldSpecialChance * 10;
+    
+    *( naturalMapChances[inPickedBiome].getElement( inSpecialObjectIndex ) )
+        = newSpecialChance;
+    
+    float oldTotalChanceWeight = totalChanceWeight[inPickedBiome];
+    
+    totalChanceWeight[inPickedBiome] -= oldSpecialChance;
+    totalChanceWeight[inPickedBiome] += newSpecialChance;
+    
+
+    // pick one of our natural objects at random
+
+    // pick value between 0 and total weight
+    double randValue = totalChanceWeight[inPickedBiome] * inRandom;
+
+    // walk through objects, summing weights, until one crosses threshold
+    int i = 0;
+    float weightSum = 0;        
+    
+    while( weightSum < randValue && i < numObjects ) {
+        weightSum += naturalMapChances[inPickedBiome].getElementDirect( i );
+        i++;
+        }
+    
+    i--;
+    
+
+    // restore chance of special object
+    *( naturalMapChances[inPickedBiome].getElement( inSpecialObjectIndex ) )
+        = oldSpecialChance;
+
+    totalChanceWeight[inPickedBiome] = oldTotalChanceWeight;
+
+    if( i >= 0 ) {
+        int returnID = naturalMapIDs[inPickedBiome].getElementDirect( i );
+        
+        if( inPickedBiome == inSecondPlace ) {
+            // object peeking through from second place biome
+
+            // make sure it's not a moving object (animal)
+            // those are locked to their target biome only
+            TransRecord *t = getPTrans( -1, returnID );
+            if( t != NULL && t->move != 0 ) {
+                // put empty tile there instead
+                returnID = 0;
+                }
+            }
+        
+        return returnID;
+        }
+    
+    return 0;
+    }
+
+
+
+static int getBaseMap( int inX, int inY, char *outGridPlacement = NULL ) {
+    
+    if( inX > xLimit || inX < -xLimit ||
+        inY > yLimit || inY < -yLimit ) {
+    
+        return edgeObjectID;
+        }
+    
+    int cachedID = mapCacheLookup( inX, inY, outGridPlacement );
+    
+    if( cachedID != -1 ) {
+        return cachedID;
+        }
+    
+    getBaseMapCallCount ++;
+
+
+    if( outGridPlacement != NULL ) {
+        *outGridPlacement = false;
+        }
+    
+
+    // see if any of our grids apply
+    setXYRandomSeed( 9753 );
 
     for( int g=0; g < gridPlacements.size(); g++ ) {
         MapGridPlacement *gp = gridPlacements.getElement( g );
@@ -1454,15 +1850,8 @@ static int getBaseMap( int inX, int inY, char *outGridPlacement = NULL ) {
     
     // first step:  save rest of work if density tells us that
     // nothing is here anyway
-    double density = getXYFractal( inX, inY, 0.1, 0.25 );
-    
-    // correction
-    density = sigmoid( density, 0.1 );
-    
-    // scale
-    density *= .4;
-    // good for zoom in to map for teaser
-    //density = .70;
+    double density = 
+        getNaturalObjectDensity( getXYFractal( inX, inY, 0.1, 0.25 ) );
     
     setXYRandomSeed( 9877 );
     
@@ -1497,21 +1886,14 @@ static int getBaseMap( int inX, int inY, char *outGridPlacement = NULL ) {
 
         
         // randomly let objects from second place biome peek through
-        
-        // if gap is 0, this should happen 50 percent of the time
-
-        // if gap is 1.0, it should never happen
-
-        // larger values make second place less likely
-        double secondPlaceReduction = 10.0;
 
         //printf( "Second place gap = %f, random(%d,%d)=%f\n", secondPlaceGap,
         //        inX, inY, getXYRandom( 2087 + inX, 793 + inY ) );
         
         setXYRandomSeed( 348763 );
         
-        if( getXYRandom( inX, inY ) > 
-            .5 + secondPlaceReduction * secondPlaceGap ) {
+        if( secondPlacePeeksThrough( getXYRandom( inX, inY ), 
+                                     secondPlaceGap ) ) {
         
             // note that lastCheckedBiome is NOT changed, so ground
             // shows the true, first-place biome, but object placement
@@ -1557,76 +1939,246 @@ static int getBaseMap( int inX, int inY, char *outGridPlacement = NULL ) {
 
 
 
-        float oldSpecialChance = 
-            naturalMapChances[pickedBiome].getElementDirect( 
-                specialObjectIndex );
-        
-        float newSpecialChance = oldSpecialChance * 10;
-        
-        *( naturalMapChances[pickedBiome].getElement( specialObjectIndex ) )
-            = newSpecialChance;
-        
-        float oldTotalChanceWeight = totalChanceWeight[pickedBiome];
+        // pick one of our natural objects at random
+        setXYRandomSeed( 4593873 );
         
-        totalChanceWeight[pickedBiome] -= oldSpecialChance;
-        totalChanceWeight[pickedBiome] += newSpecialChance;
+        int returnID = pickNaturalObject( pickedBiome, secondPlace,
+                                          specialObjectIndex,
+                                          getXYRandom( inX, inY ) );
         
+        mapCacheInsert( inX, inY, returnID );
+        return returnID;
+        }
+    else {
+        mapCacheInsert( inX, inY, 0 );
+        return 0;
+        }
+    
+    }
 
-        // pick one of our natural objects at random
 
-        // pick value between 0 and total weight
+
+
+// true if inX,inY is on one of the object grids checked by getBaseMap
+// (whether or not the biome there permits the grid object)
+static char isOnAnyMapGrid( int inX, int inY ) {
+    for( int g=0; g < gridPlacements.size(); g++ ) {
+        MapGridPlacement *gp = gridPlacements.getElement( g );
+
+        // grid wiggle is off in getBaseMap
+        if( ( inX + gp->phaseX ) % gp->spacingX == 0 &&
+            ( inY + gp->phaseY ) % gp->spacingY == 0 ) {
+            return true;
+            }
+        }
+    return false;
+    }
+
+
+
+// fills baseMapCache for every cell of a rectangle, with the same results
+// as calling getBaseMap for each cell
+//
+// For cells that aren't cached yet, each noise field is computed for the
+// whole rectangle at once (and biomeCache is filled along the way), 
+// instead of re-seeding and evaluating it cell by cell.
+//
+// Unlike getBaseMap, leaves lastCheckedBiome alone.
+static void getBaseMapRect( int inX, int inY, int inWidth, int inHeight ) {
+    int numCells = inWidth * inHeight;
+    
+    if( numCells <= 0 ) {
+        return;
+        }
+    
+    int oldLastCheckedBiome = lastCheckedBiome;
+    int oldLastCheckedBiomeX = lastCheckedBiomeX;
+    int oldLastCheckedBiomeY = lastCheckedBiomeY;
+    
+
+    // cells still being worked on
+    char *mask = new char[ numCells ];
+    int numLeft = 0;
+    
+    for( int y=0; y<inHeight; y++ ) {
+        for( int x=0; x<inWidth; x++ ) {
+            int i = y * inWidth + x;
+            int cellX = inX + x;
+            int cellY = inY + y;
+            
+            mask[i] = false;
+            
+            if( cellX > xLimit || cellX < -xLimit ||
+                cellY > yLimit || cellY < -yLimit ) {
+                // edge, never cached
+                continue;
+                }
+            
+            if( baseMapCache.peek( cellX, cellY ) != NULL ) {
+                continue;
+                }
+            
+            if( isOnAnyMapGrid( cellX, cellY ) ) {
+                // rare, let getBaseMap sort out grid objects
+                getBaseMap( cellX, cellY );
+                continue;
+                }
+            
+            mask[i] = true;
+            numLeft ++;
+            }
+        }
+    
+    if( numLeft == 0 ) {
+        delete [] mask;
+        return;
+        }
+    
+    getBaseMapCallCount += numLeft;
+    
+
+    double *values = new double[ numCells ];
+    double *rolls = new double[ numCells ];
+    
+
+    // density first, most cells end here
+    setXYRandomSeed( 5379 );
+    getXYFractalRect( inX, inY, inWidth, inHeight, 0.1, 0.25, values, mask );
+    
+    setXYRandomSeed( 9877 );
+    getXYRandomRect( inX, inY, inWidth, inHeight, rolls, mask );
+    
+    for( int i=0; i<numCells; i++ ) {
+        if( mask[i] && 
+            ! ( rolls[i] < getNaturalObjectDensity( values[i] ) ) ) {
+            
+            mapCacheInsert( inX + i % inWidth, inY + i / inWidth, 0 );
+            mask[i] = false;
+            numLeft --;
+            }
+        }
+    
+
+    // biomes for cells that have something
+    int *pickedBiomes = new int[ numCells ];
+    int *secondPlaces = new int[ numCells ];
+    double *secondPlaceGaps = new double[ numCells ];
+    
+    if( numLeft > 0 ) {
+        fillBiomeCacheRect( inX, inY, inWidth, inHeight, mask );
         
-        setXYRandomSeed( 4593873 );
+        setXYRandomSeed( 348763 );
+        getXYRandomRect( inX, inY, inWidth, inHeight, rolls, mask );
+        }
+    
+    // cells that share a number of natural objects also share 
+    // object noise seeds and scale
+    SimpleVector<int> objectCounts;
+    
+    for( int i=0; i<numCells; i++ ) {
+        if( ! mask[i] ) {
+            continue;
+            }
         
-        double randValue = 
-            totalChanceWeight[pickedBiome] * getXYRandom( inX, inY );
-
-        // walk through objects, summing weights, until one crosses threshold
-        int i = 0;
-        float weightSum = 0;        
+        int cellX = inX + i % inWidth;
+        int cellY = inY + i / inWidth;
+        
+        int pickedBiome = getMapBiomeIndex( cellX, cellY, 
+                                            &( secondPlaces[i] ),
+                                            &( secondPlaceGaps[i] ) );
+        
+        if( pickedBiome == -1 ) {
+            mapCacheInsert( cellX, cellY, 0 );
+            mask[i] = false;
+            continue;
+            }
         
-        while( weightSum < randValue && i < numObjects ) {
-            weightSum += naturalMapChances[pickedBiome].getElementDirect( i );
-            i++;
+        if( secondPlacePeeksThrough( rolls[i], secondPlaceGaps[i] ) ) {
+            pickedBiome = secondPlaces[i];
             }
         
-        i--;
+        pickedBiomes[i] = pickedBiome;
         
+        int numObjects = naturalMapIDs[pickedBiome].size();
+        
+        if( numObjects == 0 ) {
+            mapCacheInsert( cellX, cellY, 0 );
+            mask[i] = false;
+            continue;
+            }
+        
+        if( objectCounts.getElementIndex( numObjects ) == -1 ) {
+            objectCounts.push_back( numObjects );
+            }
+        }
+    
 
-        // restore chance of special object
-        *( naturalMapChances[pickedBiome].getElement( specialObjectIndex ) )
-            = oldSpecialChance;
-
-        totalChanceWeight[pickedBiome] = oldTotalChanceWeight;
-
-        if( i >= 0 ) {
-            int returnID = naturalMapIDs[pickedBiome].getElementDirect( i );
+    // special object in this region is 10x more common than it 
+    // would be otherwise
+    int *specialObjectIndices = new int[ numCells ];
+    double *maxValues = new double[ numCells ];
+    char *groupMask = new char[ numCells ];
+    
+    for( int i=0; i<numCells; i++ ) {
+        specialObjectIndices[i] = -1;
+        maxValues[i] = -DBL_MAX;
+        }
+    
+    for( int c=0; c<objectCounts.size(); c++ ) {
+        int numObjects = objectCounts.getElementDirect( c );
+        
+        for( int i=0; i<numCells; i++ ) {
+            groupMask[i] = 
+                mask[i] && 
+                naturalMapIDs[ pickedBiomes[i] ].size() == numObjects;
+            }
+        
+        for( int o=0; o<numObjects; o++ ) {
+            setXYRandomSeed( 793 * o + 123 );
             
-            if( pickedBiome == secondPlace ) {
-                // object peeking through from second place biome
-
-                // make sure it's not a moving object (animal)
-                // those are locked to their target biome only
-                TransRecord *t = getPTrans( -1, returnID );
-                if( t != NULL && t->move != 0 ) {
-                    // put empty tile there instead
-                    returnID = 0;
+            getXYFractalRect( inX, inY, inWidth, inHeight,
+                              0.3, 
+                              0.15 + 0.016666 * numObjects,
+                              values, groupMask );
+            
+            for( int i=0; i<numCells; i++ ) {
+                if( groupMask[i] && values[i] > maxValues[i] ) {
+                    maxValues[i] = values[i];
+                    specialObjectIndices[i] = o;
                     }
                 }
-
-            mapCacheInsert( inX, inY, returnID );
-            return returnID;
-            }
-        else {
-            mapCacheInsert( inX, inY, 0 );
-            return 0;
             }
         }
-    else {
-        mapCacheInsert( inX, inY, 0 );
-        return 0;
+    
+    
+    setXYRandomSeed( 4593873 );
+    getXYRandomRect( inX, inY, inWidth, inHeight, rolls, mask );
+    
+    for( int i=0; i<numCells; i++ ) {
+        if( mask[i] ) {
+            int returnID = pickNaturalObject( pickedBiomes[i], 
+                                              secondPlaces[i],
+                                              specialObjectIndices[i], 
+                                              rolls[i] );
+            
+            mapCacheInsert( inX + i % inWidth, inY + i / inWidth, returnID );
+            }
         }
     
+
+    delete [] mask;
+    delete [] values;
+    delete [] rolls;
+    delete [] pickedBiomes;
+    delete [] secondPlaces;
+    delete [] secondPlaceGaps;
+    delete [] specialObjectIndices;
+    delete [] maxValues;
+    delete [] groupMask;
+    
+    lastCheckedBiome = oldLastCheckedBiome;
+    lastCheckedBiomeX = oldLastCheckedBiomeX;
+    lastCheckedBiomeY = oldLastCheckedBiomeY;
     }
 
 
@@ -2040,80 +2592,85 @@ int printObjectSamples( int inXCenter, int inYCenter ) {
 // optimization:
 // cache dbGet results in RAM
 
-// 2.6 MB of RAM for this.
-#define DB_CACHE_SIZE 131072
+// sized by mapDBCacheEntries setting
+// keyed by x, y, slot, subCont
+static SetAssociativeCache<int> dbCache( "Map DB" );
+static SetAssociativeCache<timeSec_t> dbTimeCache( "Map time DB" );
 
-typedef struct DBCacheRecord {
-        int x, y, slot, subCont;
-        int value;
-    } DBCacheRecord;
-    
-static DBCacheRecord dbCache[ DB_CACHE_SIZE ];
+// keyed by x, y
+static SetAssociativeCache<signed char> blockingCache( "Blocking" );
+static SetAssociativeCache<int> floorCache( "Floor DB" );
+static SetAssociativeCache<timeSec_t> floorTimeCache( "Floor time DB" );
 
 
+// 0 to only log cache stats at shutdown
+static double mapCacheStatsLogSeconds = 600;
+static double lastMapCacheStatsLogTime = 0;
 
-static int computeDBCacheHash( int inKeyA, int inKeyB, 
-                               int inKeyC, int inKeyD ) {
-    
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B + 
-                    inKeyC * CACHE_PRIME_C +
-                    inKeyD * CACHE_PRIME_D ) % DB_CACHE_SIZE;
-    if( hashKey < 0 ) {
-        hashKey += DB_CACHE_SIZE;
-        }
-    return hashKey;
-    }
 
 
+// decoded contDB blobs, one per tile
+// tiles with nothing contained are cached too, as empty
+#define CONTENTS_CACHE_SIZE 8192
 
-static int computeBLCacheHash( int inKeyA, int inKeyB ) {
-    
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B ) % DB_CACHE_SIZE;
+typedef struct ContentsCacheRecord {
+        int x, y;
+        char valid;
+        TileContents contents;
+    } ContentsCacheRecord;
+
+static ContentsCacheRecord contentsCache[ CONTENTS_CACHE_SIZE ];
+
+
+
+static ContentsCacheRecord *getContentsCacheRecord( int inX, int inY ) {
+    int hashKey = ( inX * CACHE_PRIME_A + 
+                    inY * CACHE_PRIME_B ) % CONTENTS_CACHE_SIZE;
     if( hashKey < 0 ) {
-        hashKey += DB_CACHE_SIZE;
+        hashKey += CONTENTS_CACHE_SIZE;
         }
-    return hashKey;
+    return &( contentsCache[ hashKey ] );
     }
 
 
 
-typedef struct DBTimeCacheRecord {
-        int x, y, slot, subCont;
-        timeSec_t timeVal;
-    } DBTimeCacheRecord;
+// NULL on miss
+static TileContents *contentsGetCached( int inX, int inY ) {
+    ContentsCacheRecord *r = getContentsCacheRecord( inX, inY );
     
-static DBTimeCacheRecord dbTimeCache[ DB_CACHE_SIZE ];
+    if( r->valid && r->x == inX && r->y == inY ) {
+        return &( r->contents );
+        }
+    return NULL;
+    }
 
 
 
-typedef struct BlockingCacheRecord {
-        int x, y;
-        // -1 if not present
-        signed char blocking;
-    } BlockingCacheRecord;
-    
-static BlockingCacheRecord blockingCache[ DB_CACHE_SIZE ];
+// returned pointer is into contentsCache, and is only good until
+// the next contents get
+static TileContents *getTileContents( int inX, int inY );
 
 
 
 
 
 static void initDBCaches() {
-    DBCacheRecord blankRecord = { 0, 0, 0, 0, -2 };
-    for( int i=0; i<DB_CACHE_SIZE; i++ ) {
-        dbCache[i] = blankRecord;
-        }
-    // 1 for empty (because 0 is a valid value)
-    DBTimeCacheRecord blankTimeRecord = { 0, 0, 0, 0, 1 };
-    for( int i=0; i<DB_CACHE_SIZE; i++ ) {
-        dbTimeCache[i] = blankTimeRecord;
-        }
-    // -1 for empty
-    BlockingCacheRecord blankBlockingRecord = { 0, 0, -1 };
-    for( int i=0; i<DB_CACHE_SIZE; i++ ) {
-        blockingCache[i] = blankBlockingRecord;
+    int numEntries = 
+        SettingsManager::getIntSetting( "mapDBCacheEntries", 131072 );
+    
+    dbCache.init( numEntries );
+    dbTimeCache.init( numEntries );
+    blockingCache.init( numEntries );
+    floorCache.init( numEntries );
+    floorTimeCache.init( numEntries );
+    
+    mapCacheStatsLogSeconds = 
+        SettingsManager::getDoubleSetting( "mapCacheStatsLogSeconds", 600 );
+    lastMapCacheStatsLogTime = Time::getCurrentTime();
+    
+    for( int i=0; i<CONTENTS_CACHE_SIZE; i++ ) {
+        contentsCache[i].valid = false;
+        clearTileContents( &( contentsCache[i].contents ) );
         }
     }
 
@@ -2122,13 +2679,10 @@ static void initDBCaches() {
 
 // returns -2 on miss
 static int dbGetCached( int inX, int inY, int inSlot, int inSubCont ) {
-    DBCacheRecord r =
-        dbCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ];
+    int *r = dbCache.lookup( inX, inY, inSlot, inSubCont );
 
-    if( r.x == inX && r.y == inY && 
-        r.slot == inSlot && r.subCont == inSubCont &&
-        r.value != -2 ) {
-        return r.value;
+    if( r != NULL ) {
+        return *r;
         }
     else {
         return -2;
@@ -2139,9 +2693,7 @@ static int dbGetCached( int inX, int inY, int inSlot, int inSubCont ) {
 
 static void dbPutCached( int inX, int inY, int inSlot, int inSubCont, 
                         int inValue ) {
-    DBCacheRecord r = { inX, inY, inSlot, inSubCont, inValue };
-    
-    dbCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ] = r;
+    dbCache.insert( inX, inY, inSlot, inSubCont, inValue );
     }
 
 
@@ -2150,13 +2702,10 @@ static void dbPutCached( int inX, int inY, int inSlot, int inSubCont,
 
 // returns 1 on miss
 static int dbTimeGetCached( int inX, int inY, int inSlot, int inSubCont ) {
-    DBTimeCacheRecord r =
-        dbTimeCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ];
+    timeSec_t *r = dbTimeCache.lookup( inX, inY, inSlot, inSubCont );
 
-    if( r.x == inX && r.y == inY && 
-        r.slot == inSlot && r.subCont == inSubCont &&
-        r.timeVal != 1 ) {
-        return r.timeVal;
+    if( r != NULL ) {
+        return *r;
         }
     else {
         return 1;
@@ -2167,9 +2716,49 @@ static int dbTimeGetCached( int inX, int inY, int inSlot, int inSubCont ) {
 
 static void dbTimePutCached( int inX, int inY, int inSlot, int inSubCont, 
                          timeSec_t inValue ) {
-    DBTimeCacheRecord r = { inX, inY, inSlot, inSubCont, inValue };
-    
-    dbTimeCache[ computeDBCacheHash( inX, inY, inSlot, inSubCont ) ] = r;
+    dbTimeCache.insert( inX, inY, inSlot, inSubCont, inValue );
+    }
+
+
+
+
+
+// returns -2 on miss
+static int floorGetCached( int inX, int inY ) {
+    int *r = floorCache.lookup( inX, inY );
+
+    if( r != NULL ) {
+        return *r;
+        }
+    else {
+        return -2;
+        }
+    }
+
+
+
+static void floorPutCached( int inX, int inY, int inValue ) {
+    floorCache.insert( inX, inY, inValue );
+    }
+
+
+
+// returns 1 on miss
+static timeSec_t floorTimeGetCached( int inX, int inY ) {
+    timeSec_t *r = floorTimeCache.lookup( inX, inY );
+
+    if( r != NULL ) {
+        return *r;
+        }
+    else {
+        return 1;
+        }
+    }
+
+
+
+static void floorTimePutCached( int inX, int inY, timeSec_t inValue ) {
+    floorTimeCache.insert( inX, inY, inValue );
     }
 
 
@@ -2178,12 +2767,10 @@ static void dbTimePutCached( int inX, int inY, int inSlot, int inSubCont,
 
 // returns -1 on miss
 static signed char blockingGetCached( int inX, int inY ) {
-    BlockingCacheRecord r =
-        blockingCache[ computeBLCacheHash( inX, inY ) ];
+    signed char *r = blockingCache.lookup( inX, inY );
 
-    if( r.x == inX && r.y == inY &&
-        r.blocking != -1 ) {
-        return r.blocking;
+    if( r != NULL ) {
+        return *r;
         }
     else {
         return -1;
@@ -2193,20 +2780,215 @@ static signed char blockingGetCached( int inX, int inY ) {
 
 
 static void blockingPutCached( int inX, int inY, char inBlocking ) {
-    BlockingCacheRecord r = { inX, inY, inBlocking };
-    
-    blockingCache[ computeBLCacheHash( inX, inY ) ] = r;
+    blockingCache.insert( inX, inY, inBlocking );
     }
 
 
 static void blockingClearCached( int inX, int inY ) {
+    blockingCache.remove( inX, inY );
+    }
+
+
+
+static void logMapCacheStats() {
+    dbCache.logStats();
+    dbTimeCache.logStats();
+    floorCache.logStats();
+    floorTimeCache.logStats();
+    blockingCache.logStats();
+    biomeCache.logStats();
+    baseMapCache.logStats();
+    }
+
+
+
+
+// shared cache of compressed chunk bodies
+// players standing together get sent the same chunks, and only the
+// header (relative position) differs between them, so build and zip
+// each body once
+
+// map writes bump a generation counter for the 16x16 region they land in
+// a cached body is stale once any region under it has a newer generation
+// than the body
+#define CHUNK_REGION_SHIFT 4
+
+// direct-mapped, so two regions can share a slot
+// this only causes extra rebuilds, never stale data
+#define CHUNK_REGION_TABLE_SIZE 65536
+
+static unsigned int chunkRegionGenerations[ CHUNK_REGION_TABLE_SIZE ];
+
+static unsigned int chunkWriteGeneration = 0;
+
+
+#define CHUNK_CACHE_SIZE 512
+
+typedef struct ChunkCacheRecord {
+        int x, y, w, h, format;
+        unsigned int generation;
+        double buildTime;
+        int rawSize;
+        int compressedSize;
+        // NULL if empty
+        unsigned char *compressedData;
+    } ChunkCacheRecord;
+
+static ChunkCacheRecord chunkCache[ CHUNK_CACHE_SIZE ];
+
+// decays that are due get applied when a cell is looked at, and a
+// cache hit doesn't look, so bodies only live this long even if
+// nothing writes to them
+static double chunkCacheMaxAge = 2.0;
+
+static int chunkCacheHits = 0;
+static int chunkCacheMisses = 0;
+
+
+
+static int computeChunkRegionHash( int inRegionX, int inRegionY ) {
+    int hashKey = ( inRegionX * CACHE_PRIME_A + 
+                    inRegionY * CACHE_PRIME_B ) % CHUNK_REGION_TABLE_SIZE;
+    if( hashKey < 0 ) {
+        hashKey += CHUNK_REGION_TABLE_SIZE;
+        }
+    return hashKey;
+    }
+
+
+
+static int computeChunkCacheHash( int inX, int inY, int inW, int inH, 
+                                  int inFormat ) {
+    int hashKey = ( inX * CACHE_PRIME_A + 
+                    inY * CACHE_PRIME_B + 
+                    inW * CACHE_PRIME_C +
+                    ( inH + inFormat ) * CACHE_PRIME_D ) % CHUNK_CACHE_SIZE;
+    if( hashKey < 0 ) {
+        hashKey += CHUNK_CACHE_SIZE;
+        }
+    return hashKey;
+    }
+
+
+
+// called from every map write that can change what a chunk shows
+static void chunkCacheNoteWrite( int inX, int inY ) {
+    chunkWriteGeneration++;
+    
+    chunkRegionGenerations[ 
+        computeChunkRegionHash( inX >> CHUNK_REGION_SHIFT,
+                                inY >> CHUNK_REGION_SHIFT ) ] = 
+        chunkWriteGeneration;
+    }
+
+
+
+static void clearChunkCache() {
+    for( int i=0; i<CHUNK_CACHE_SIZE; i++ ) {
+        if( chunkCache[i].compressedData != NULL ) {
+            delete [] chunkCache[i].compressedData;
+            }
+        chunkCache[i].compressedData = NULL;
+        }
+    }
+
+
+
+static void initChunkCache() {
+    for( int i=0; i<CHUNK_CACHE_SIZE; i++ ) {
+        chunkCache[i].compressedData = NULL;
+        }
+    clearChunkCache();
     
-    BlockingCacheRecord *r =
-        &( blockingCache[ computeBLCacheHash( inX, inY ) ] );
+    for( int i=0; i<CHUNK_REGION_TABLE_SIZE; i++ ) {
+        chunkRegionGenerations[i] = 0;
+        }
+    chunkWriteGeneration = 0;
+    }
+
 
-    if( r->x == inX && r->y == inY ) {
-        r->blocking = -1;
+
+// returns a copy of the cached body, destroyed by caller, or NULL on miss
+static unsigned char *chunkCacheLookup( int inX, int inY, int inW, int inH,
+                                        int inFormat,
+                                        int *outRawSize,
+                                        int *outCompressedSize ) {
+    ChunkCacheRecord *r = 
+        &( chunkCache[ computeChunkCacheHash( inX, inY, inW, inH, 
+                                              inFormat ) ] );
+    
+    if( r->compressedData == NULL ||
+        r->x != inX || r->y != inY || r->w != inW || r->h != inH ||
+        r->format != inFormat ) {
+        chunkCacheMisses++;
+        return NULL;
         }
+    
+    char stale = 
+        ( Time::getCurrentTime() - r->buildTime > chunkCacheMaxAge );
+    
+    int regionStartX = inX >> CHUNK_REGION_SHIFT;
+    int regionStartY = inY >> CHUNK_REGION_SHIFT;
+    int regionEndX = ( inX + inW - 1 ) >> CHUNK_REGION_SHIFT;
+    int regionEndY = ( inY + inH - 1 ) >> CHUNK_REGION_SHIFT;
+    
+    for( int y=regionStartY; y<=regionEndY && !stale; y++ ) {
+        for( int x=regionStartX; x<=regionEndX; x++ ) {
+            if( chunkRegionGenerations[ computeChunkRegionHash( x, y ) ] >
+                r->generation ) {
+                stale = true;
+                break;
+                }
+            }
+        }
+    
+    if( stale ) {
+        delete [] r->compressedData;
+        r->compressedData = NULL;
+        chunkCacheMisses++;
+        return NULL;
+        }
+    
+    chunkCacheHits++;
+    
+    *outRawSize = r->rawSize;
+    *outCompressedSize = r->compressedSize;
+    
+    unsigned char *data = new unsigned char[ r->compressedSize ];
+    memcpy( data, r->compressedData, r->compressedSize );
+    
+    return data;
+    }
+
+
+
+// inGeneration is chunkWriteGeneration from before body was built
+// inCompressedData is copied
+static void chunkCacheInsert( int inX, int inY, int inW, int inH, 
+                              int inFormat,
+                              unsigned int inGeneration,
+                              int inRawSize,
+                              unsigned char *inCompressedData, 
+                              int inCompressedSize ) {
+    ChunkCacheRecord *r = 
+        &( chunkCache[ computeChunkCacheHash( inX, inY, inW, inH, 
+                                              inFormat ) ] );
+    
+    if( r->compressedData != NULL ) {
+        delete [] r->compressedData;
+        }
+    
+    r->x = inX;
+    r->y = inY;
+    r->w = inW;
+    r->h = inH;
+    r->format = inFormat;
+    r->generation = inGeneration;
+    r->buildTime = Time::getCurrentTime();
+    r->rawSize = inRawSize;
+    r->compressedSize = inCompressedSize;
+    r->compressedData = new unsigned char[ inCompressedSize ];
+    memcpy( r->compressedData, inCompressedData, inCompressedSize );
     }
 
 
@@ -2230,7 +3012,7 @@ int cellsLookedAtToInit = 0;
 // If lookTimeDBEmpty, this call just opens the target DB normally without
 // shrinking it.
 //
-// Can handle max key and value size of 16 and 12 bytes
+// Can handle max key size of 16 bytes
 // Assumes that first 8 bytes of key are xy as 32-bit ints
 int DB_open_timeShrunk(
 	DB *db,
@@ -2264,10 +3046,10 @@ int DB_open_timeShrunk(
     
             DB_Iterator_init( db, &dbi );
     
-            // key and value size that are big enough to handle all of our DB
+            // key size that is big enough to handle all of our DB
             unsigned char key[16];
     
-            unsigned char value[12];
+            unsigned char *value = new unsigned char[ value_size ];
     
             while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
                 int x = valueToInt( key );
@@ -2277,6 +3059,8 @@ int DB_open_timeShrunk(
                 
                 dbLookTimePut( x, y, MAP_TIMESEC );
                 }
+            
+            delete [] value;
             }
         return error;
         }
@@ -2327,10 +3111,10 @@ int DB_open_timeShrunk(
     
     DB_Iterator_init( &oldDB, &dbi );
     
-    // key and value size that are big enough to handle all of our DB
+    // key size that is big enough to handle all of our DB
     unsigned char key[16];
     
-    unsigned char value[12];
+    unsigned char *value = new unsigned char[ value_size ];
     
     int total = 0;
     int stale = 0;
@@ -2377,6 +3161,7 @@ int DB_open_timeShrunk(
         AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
                         dbTempName );
         delete [] dbTempName;
+        delete [] value;
         DB_close( &oldDB );
         return error;
         }
@@ -2403,6 +3188,8 @@ int DB_open_timeShrunk(
 
 
     
+    delete [] value;
+    
     AppLog::infoF( "Cleaned %d / %d stale map cells from %s", stale, total,
                    path );
 
@@ -2492,6 +3279,9 @@ int cleanMap() {
     
     int totalDBRecordCount = 0;
     
+    // container slots from before contents.db
+    int numOldContainerRecords = 0;
+    
     int totalSetCount = 0;
     int numClearedCount = 0;
     int totalNumContained = 0;
@@ -2501,8 +3291,11 @@ int cleanMap() {
         totalDBRecordCount++;
         
         int s = valueToInt( &( key[8] ) );
-        int b = valueToInt( &( key[12] ) );
        
+        if( s != 0 && s != DECAY_SLOT ) {
+            numOldContainerRecords++;
+            }
+        
         if( s == 0 ) {
             int id = valueToInt( value );
             
@@ -2538,13 +3331,25 @@ int cleanMap() {
                     }
                 }
             }
-        if( s == 2 && b == 0 ) {
-            int numSlots = valueToInt( value );
+        }
+    
+    
+    // first chunk of each tile's contents blob
+    DB_Iterator_init( &contDB, &dbi );
+    
+    unsigned char contKey[ CONTENTS_KEY_SIZE ];
+    unsigned char contValue[ CONTENTS_CHUNK_SIZE ];
+    
+    while( DB_Iterator_next( &dbi, contKey, contValue ) > 0 ) {
+        if( valueToInt( &( contKey[8] ) ) == 0 ) {
+            int x = valueToInt( contKey );
+            int y = valueToInt( &( contKey[4] ) );
+            
+            int numSlots = getNumContained( x, y );
+            
             if( numSlots > 0 ) {
                 totalNumContained += numSlots;
                 
-                int x = valueToInt( key );
-                int y = valueToInt( &( key[4] ) );
                 xContToCheck.push_back( x );
                 yContToCheck.push_back( y );
                 }
@@ -2703,6 +3508,13 @@ int cleanMap() {
     AppLog::infoF( "...%d database records total (%d max hash bin depth).", 
                    totalDBRecordCount, DB_maxStack );
     
+    if( numOldContainerRecords > 0 ) {
+        AppLog::infoF( 
+            "...%d old container records left in map.db, already moved to "
+            "contents.db.  dbConvert4 can remove them, with the server "
+            "stopped.", numOldContainerRecords );
+        }
+    
     printf( "\n" );
 
     skipTrackingMapChanges = false;
@@ -2829,10 +3641,8 @@ static char loadIntoMapFromFile( FILE *inFile,
 
 
 
-static inline void changeContained( int inX, int inY, int inSlot, 
-                                    int inSubCont, int inID ) {
-    dbPut( inX, inY, FIRST_CONT_SLOT + inSlot, inID, inSubCont );    
-    }
+static void changeContained( int inX, int inY, int inSlot, 
+                             int inSubCont, int inID );
 
 
 
@@ -2960,37 +3770,28 @@ static void setupMapChangeLogFile() {
         }
 
     // always close file and start a new one when this is called
-
-    if( mapChangeLogFile != NULL ) {
-        fclose( mapChangeLogFile );
-        mapChangeLogFile = NULL;
-        }
+    closeMapChangeLog();
     
+    mapChangeLogTimeStart = Time::getCurrentTime();
 
     if( logFolder.isDirectory() ) {
         
-        if( mapChangeLogFile == NULL ) {
-
-            // file does not exist
-            char *newFileName = 
-                autoSprintf( "%.ftime_mapLog.txt",
-                             Time::getCurrentTime() );
+        // binary, mapChangeLogTool converts it to the old text format
+        char *newFileName = 
+            autoSprintf( "%.ftime_mapLog.bin",
+                         mapChangeLogTimeStart );
             
-            File *f = logFolder.getChildFile( newFileName );
+        File *f = logFolder.getChildFile( newFileName );
             
-            delete [] newFileName;
+        delete [] newFileName;
             
-            char *fullName = f->getFullFileName();
+        char *fullName = f->getFullFileName();
             
-            delete f;
+        delete f;
         
-            mapChangeLogFile = fopen( fullName, "a" );
-            delete [] fullName;
-            }
+        openMapChangeLog( fullName, mapChangeLogTimeStart );
+        delete [] fullName;
         }
-
-    mapChangeLogTimeStart = Time::getCurrentTime();
-    fprintf( mapChangeLogFile, "startTime: %.2f\n", mapChangeLogTimeStart );
     }
 
 
@@ -3169,7 +3970,7 @@ void reseedMap( char inForceFresh ) {
                 
     setupMapChangeLogFile();
 
-    if( !set && mapChangeLogFile != NULL ) {
+    if( !set && isMapChangeLogOpen() ) {
         // whenever we actually change the seed, save it to a separate
         // file in log folder
 
@@ -3215,8 +4016,13 @@ char initMap() {
     recentlyUsedPrimaryEvePositionPlayerIDs.deleteAll();
     
 
+    initMapChangeLog( 
+        SettingsManager::getDoubleSetting( "mapChangeLogFlushSeconds", 10 ),
+        SettingsManager::getIntSetting( "mapChangeLogBlockBytes", 65536 ) );
+
     initDBCaches();
     initBiomeCache();
+    initChunkCache();
 
     mapCacheClear();
     
@@ -3226,12 +4032,16 @@ char initMap() {
         SettingsManager::getFloatSetting( "minEveCampRespawnAge", 60.0f );
     
 
-    barrierRadius = SettingsManager::getIntSetting( "barrierRadius", 250 );
-    barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+    barrierRadius = cachedSettings.barrierRadius;
+    barrierOn = cachedSettings.barrierOn;
     
     longTermCullEnabled =
         SettingsManager::getIntSetting( "longTermNoLookCullEnabled", 1 );
 
+    if( SettingsManager::getIntSetting( "recordLookRegions", 0 ) ) {
+        lookRecordFile = fopen( "lookRegions.txt", "w" );
+        }
+
     
     SimpleVector<int> *list = 
         SettingsManager::getIntSettingMulti( "barrierObjects" );
@@ -3400,6 +4210,8 @@ char initMap() {
         }
 
     LINEARDB3_setMaxLoad( 0.80 );
+    LINEARDB3_setMmapMode( 
+        SettingsManager::getIntSetting( "mapDBMmapMode", 0 ) );
     
     if( ! skipLookTimeCleanup ) {
         DB lookTimeDB_old;
@@ -3554,6 +4366,8 @@ char initMap() {
     
     lookTimeDBOpen = true;
     
+    replayMapDBJournal( &lookTimeDB, lookTimeDBName, 8, 8 );
+    
     
 
 
@@ -3568,28 +4382,12 @@ char initMap() {
                              // s is the slot number 
                              // s=0 for base object
                              // s=1 decay ETA seconds (wall clock time)
-                             // s=2 for count of contained objects
-                             // s=3 first contained object
-                             // s=4 second contained object
-                             // s=... remaining contained objects
-                             // Then decay ETA for each slot, in order,
-                             //   after that.
-                             // s = -1
-                             //  is a special flag slot set to 0 if NONE
-                             //  of the contained items have ETA decay
-                             //  or 1 if some of the contained items might 
-                             //  have ETA decay.
-                             //  (this saves us from having to check each
-                             //   one)
-                             // If a contained object id is negative,
-                             // that indicates that it sub-contains
-                             // other objects in its corresponding b slot
-                             //
-                             // b is for indexing sub-container slots
-                             // b=0 is the main object 
-                             // b=1 is the first sub-slot, etc.
-                         4 // one int, object ID at x,y in slot (s-3)
-                           // OR contained count if s=2
+                             // b is always 0
+                             // Contained objects used to be in slots
+                             // s=-1 and s>=2, indexed by b for 
+                             // sub-containers, but they are in
+                             // contents.db now (see dbConvert4.cpp)
+                         4 // one int, object ID at x,y
                          );
     
     if( error ) {
@@ -3598,6 +4396,8 @@ char initMap() {
         }
     
     dbOpen = true;
+    
+    replayMapDBJournal( &db, "map.db", 16, 4 );
 
 
 
@@ -3610,32 +4410,78 @@ char initMap() {
                          80000,
                          16, // four 32-bit ints, xysb
                          // s is the slot number 
-                         // s=0 for base object
                          // s=1 decay ETA seconds (wall clock time)
-                         // s=2 for count of contained objects
-                         // s=3 first contained object
-                         // s=4 second contained object
-                         // s=... remaining contained objects
-                         // Then decay ETA for each slot, in order,
-                         //   after that.
-                             // If a contained object id is negative,
-                             // that indicates that it sub-contains
-                             // other objects in its corresponding b slot
-                             //
-                             // b is for indexing sub-container slots
-                             // b=0 is the main object 
-                             // b=1 is the first sub-slot, etc.
+                         // b is always 0
                          8 // one 64-bit double, representing an ETA time
                            // in whatever binary format and byte order
                            // "double" on the server platform uses
                          );
     
     if( error ) {
-        AppLog::errorF( "Error %d opening map time KissDB", error );
+        AppLog::errorF( "Error %d opening map time KissDB", error );
+        return false;
+        }
+    
+    timeDBOpen = true;
+    
+    replayMapDBJournal( &timeDB, "mapTime.db", 16, 8 );
+
+
+
+    // each tile's contained objects, sub-contained objects, and their
+    // decay ETAs, in one blob split across fixed-size chunks
+    // see tileContents.h
+    error = DB_open_timeShrunk( &contDB, 
+                         "contents.db", 
+                         KISSDB_OPEN_MODE_RWCREAT,
+                         80000,
+                         CONTENTS_KEY_SIZE, // three 32-bit ints, xy and
+                                            // chunk number
+                         CONTENTS_CHUNK_SIZE
+                         );
+    
+    if( error ) {
+        AppLog::errorF( "Error %d opening map contents KissDB", error );
         return false;
         }
     
-    timeDBOpen = true;
+    contDBOpen = true;
+    
+    replayMapDBJournal( &contDB, "contents.db", 
+                        CONTENTS_KEY_SIZE, CONTENTS_CHUNK_SIZE );
+
+    
+    // objects may have lost slots since their containers were filled,
+    // so never less than the default
+    int maxSlots = CONTENTS_DEFAULT_MAX_SLOTS;
+    
+    int numObjectsForSlots;
+    ObjectRecord **objectsForSlots = getAllObjects( &numObjectsForSlots );
+    
+    for( int i=0; i<numObjectsForSlots; i++ ) {
+        if( objectsForSlots[i]->numSlots > maxSlots ) {
+            maxSlots = objectsForSlots[i]->numSlots;
+            }
+        }
+    delete [] objectsForSlots;
+    
+    setContentsMaxSlots( maxSlots );
+    
+    
+    if( ! isContentsDBConverted( &contDB ) ) {
+        // world from before contents.db, or fresh one
+        // done here, not in cleanMap, so that it can't be skipped
+        AppLog::info( "Moving containers from map.db into contents.db..." );
+        
+        int numSkipped;
+        int numMoved = convertOldContainers( &db, &timeDB, &contDB,
+                                             &numSkipped );
+        
+        DB_syncToDisk( &contDB );
+        
+        AppLog::infoF( "...moved %d tiles, %d tiles already had "
+                       "contents records", numMoved, numSkipped );
+        }
 
 
 
@@ -3714,6 +4560,8 @@ char initMap() {
         }
     
     floorDBOpen = true;
+    
+    replayMapDBJournal( &floorDB, "floor.db", 8, 4 );
 
 
 
@@ -3733,6 +4581,8 @@ char initMap() {
         }
     
     floorTimeDBOpen = true;
+    
+    replayMapDBJournal( &floorTimeDB, "floorTime.db", 8, 8 );
 
 
 
@@ -4283,7 +5133,24 @@ char initMap() {
     reseedMap( false );
         
     
-
+    if( SettingsManager::getIntSetting( "writeBehindOn", 1 ) ) {
+        // start after init-time cleanup above, which iterates over
+        // DBs and writes to them directly
+        initWriteBehind( 
+            SettingsManager::getDoubleSetting( 
+                "writeBehindFlushIntervalSeconds", 1.0 ),
+            SettingsManager::getIntSetting( 
+                "writeBehindMaxPendingRecords", 200000 ) );
+        
+        dbWB = wrapMapDB( &db, "map.db", 16, 4 );
+        timeDBWB = wrapMapDB( &timeDB, "mapTime.db", 16, 8 );
+        contDBWB = wrapMapDB( &contDB, "contents.db", 
+                              CONTENTS_KEY_SIZE, CONTENTS_CHUNK_SIZE );
+        floorDBWB = wrapMapDB( &floorDB, "floor.db", 8, 4 );
+        floorTimeDBWB = wrapMapDB( &floorTimeDB, "floorTime.db", 8, 8 );
+        lookTimeDBWB = wrapMapDB( &lookTimeDB, "lookTime.db", 8, 8 );
+        }
+    
     
     // for debugging the map
     // printObjectSamples();
@@ -4372,15 +5239,34 @@ static void rememberDummy( FILE *inFile, int inX, int inY,
 
 
 void freeMap( char inSkipCleanup ) {
-    if( mapChangeLogFile != NULL ) {
-        fclose( mapChangeLogFile );
-        mapChangeLogFile = NULL;
+    freeMapChangeLog();
+
+    if( lookRecordFile != NULL ) {
+        fclose( lookRecordFile );
+        lookRecordFile = NULL;
         }
+
+    freeChunkScratchSpace();
+    
+    AppLog::infoF( "Chunk cache:  %d hits, %d misses", 
+                   chunkCacheHits, chunkCacheMisses );
+    clearChunkCache();
+    
+    logMapCacheStats();
     
     printf( "%d calls to getBaseMap\n", getBaseMapCallCount );
 
     skipTrackingMapChanges = true;
     
+    // get all pending writes into DBs before cleanup and close
+    freeWriteBehind();
+    dbWB = NULL;
+    timeDBWB = NULL;
+    contDBWB = NULL;
+    floorDBWB = NULL;
+    floorTimeDBWB = NULL;
+    lookTimeDBWB = NULL;
+    
     if( lookTimeDBOpen ) {
         DB_close( &lookTimeDB );
         lookTimeDBOpen = false;
@@ -4433,7 +5319,6 @@ void freeMap( char inSkipCleanup ) {
             while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
         
                 int s = valueToInt( &( key[8] ) );
-                int b = valueToInt( &( key[12] ) );
        
                 if( s == 0 ) {
                     int id = valueToInt( value );
@@ -4468,11 +5353,29 @@ void freeMap( char inSkipCleanup ) {
                             }
                         }
                     }
-                else if( s == 2 ) {
-                    int numSlots = valueToInt( value );
-                    if( numSlots > 0 ) {
-                        int x = valueToInt( key );
-                        int y = valueToInt( &( key[4] ) );
+                }
+            
+            
+            // first chunk of each tile's contents blob
+            DB_Iterator_init( &contDB, &dbi );
+            
+            unsigned char contKey[ CONTENTS_KEY_SIZE ];
+            unsigned char contValue[ CONTENTS_CHUNK_SIZE ];
+            
+            while( DB_Iterator_next( &dbi, contKey, contValue ) > 0 ) {
+                if( valueToInt( &( contKey[8] ) ) != 0 ) {
+                    continue;
+                    }
+                
+                int x = valueToInt( contKey );
+                int y = valueToInt( &( contKey[4] ) );
+                
+                TileContents *contents = getTileContents( x, y );
+                
+                for( int b=0; b<contents->containers.size(); b++ ) {
+                    if( contents->containers.getElement( b )->
+                        ids.size() > 0 ) {
+                        
                         xContToCheck.push_back( x );
                         yContToCheck.push_back( y );
                         bContToCheck.push_back( b );
@@ -4586,6 +5489,11 @@ void freeMap( char inSkipCleanup ) {
         timeDBOpen = false;
         }
 
+    if( contDBOpen ) {
+        DB_close( &contDB );
+        contDBOpen = false;
+        }
+
     if( biomeDBOpen ) {
         DB_close( &biomeDB );
         biomeDBOpen = false;
@@ -4674,8 +5582,22 @@ void wipeMapFiles() {
     deleteFileByName( "lookTime.db" );
     deleteFileByName( "map.db" );
     deleteFileByName( "mapTime.db" );
+    deleteFileByName( "contents.db" );
     deleteFileByName( "playerStats.db" );
     deleteFileByName( "meta.db" );
+    
+    const char *journaledDBs[6] = { "floor.db", "floorTime.db", "lookTime.db",
+                                    "map.db", "mapTime.db", "contents.db" };
+    for( int i=0; i<6; i++ ) {
+        char *journalName = getJournalPath( journaledDBs[i] );
+        char *flushingName = autoSprintf( "%s.flushing", journalName );
+        
+        deleteFileByName( journalName );
+        deleteFileByName( flushingName );
+        
+        delete [] journalName;
+        delete [] flushingName;
+        }
     }
 
 
@@ -4700,7 +5622,7 @@ static int dbGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
     // look for changes to default in database
     intQuadToKey( inX, inY, inSlot, inSubCont, key );
     
-    int result = DB_get( &db, key, value );
+    int result = mapDBGet( &db, dbWB, key, value );
     
     
     
@@ -4738,7 +5660,7 @@ static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
     // look for changes to default in database
     intQuadToKey( inX, inY, inSlot, inSubCont, key );
     
-    int result = DB_get( &timeDB, key, value );
+    int result = mapDBGet( &timeDB, timeDBWB, key, value );
     
     timeSec_t timeVal;
     
@@ -4757,44 +5679,228 @@ static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
 
 
 
+
+// reads contents blobs for these cells into contentsCache
+// one batch get for first chunks, and one more for the rest of any
+// blobs that don't fit in one chunk
+static void loadTileContents( SimpleVector<GridPos> *inCells ) {
+    int num = inCells->size();
+    
+    if( num == 0 ) {
+        return;
+        }
+    
+    unsigned char *keys = new unsigned char[ num * CONTENTS_KEY_SIZE ];
+    unsigned char *values = new unsigned char[ num * CONTENTS_CHUNK_SIZE ];
+    int *results = new int[ num ];
+    
+    for( int i=0; i<num; i++ ) {
+        GridPos *p = inCells->getElement( i );
+        contentsChunkToKey( p->x, p->y, 0, 
+                            &( keys[ i * CONTENTS_KEY_SIZE ] ) );
+        }
+    
+    mapDBGetBatch( &contDB, contDBWB, CONTENTS_KEY_SIZE, CONTENTS_CHUNK_SIZE,
+                   num, keys, values, results );
+    
+
+    // index in extra chunks of each cell's chunk 1, or -1,
+    // or -2 if chunk 0 has a corrupt length
+    int *extraStart = new int[ num ];
+    SimpleVector<unsigned char> extraKeys;
+    int numExtra = 0;
+    
+    for( int i=0; i<num; i++ ) {
+        extraStart[i] = -1;
+        
+        if( results[i] != 0 ) {
+            continue;
+            }
+        
+        int numChunks = 
+            getNumContentsChunks( &( values[ i * CONTENTS_CHUNK_SIZE ] ) );
+        
+        if( numChunks < 0 ) {
+            extraStart[i] = -2;
+            }
+        else if( numChunks > 1 ) {
+            GridPos *p = inCells->getElement( i );
+            
+            extraStart[i] = numExtra;
+            
+            for( int c=1; c<numChunks; c++ ) {
+                unsigned char key[ CONTENTS_KEY_SIZE ];
+                contentsChunkToKey( p->x, p->y, c, key );
+                extraKeys.appendArray( key, CONTENTS_KEY_SIZE );
+                numExtra++;
+                }
+            }
+        }
+    
+    unsigned char *extraValues = NULL;
+    int *extraResults = NULL;
+    
+    if( numExtra > 0 ) {
+        unsigned char *extraKeyArray = extraKeys.getElementArray();
+        
+        extraValues = new unsigned char[ numExtra * CONTENTS_CHUNK_SIZE ];
+        extraResults = new int[ numExtra ];
+        
+        mapDBGetBatch( &contDB, contDBWB, 
+                       CONTENTS_KEY_SIZE, CONTENTS_CHUNK_SIZE,
+                       numExtra, extraKeyArray, extraValues, extraResults );
+        
+        delete [] extraKeyArray;
+        }
+    
+
+    for( int i=0; i<num; i++ ) {
+        GridPos *p = inCells->getElement( i );
+        
+        ContentsCacheRecord *r = getContentsCacheRecord( p->x, p->y );
+        
+        r->x = p->x;
+        r->y = p->y;
+        r->valid = true;
+        
+        unsigned char *firstChunk = &( values[ i * CONTENTS_CHUNK_SIZE ] );
+        
+        char ok = true;
+        
+        if( results[i] != 0 ) {
+            // nothing contained here
+            clearTileContents( &( r->contents ) );
+            }
+        else if( extraStart[i] == -2 ) {
+            clearTileContents( &( r->contents ) );
+            ok = false;
+            }
+        else if( extraStart[i] == -1 ) {
+            ok = unpackTileContents( firstChunk, &( r->contents ) );
+            }
+        else {
+            int numChunks = getNumContentsChunks( firstChunk );
+            
+            unsigned char *blob = 
+                new unsigned char[ numChunks * CONTENTS_CHUNK_SIZE ];
+            
+            memcpy( blob, firstChunk, CONTENTS_CHUNK_SIZE );
+            
+            for( int c=1; c<numChunks; c++ ) {
+                int e = extraStart[i] + c - 1;
+                
+                if( extraResults[e] != 0 ) {
+                    ok = false;
+                    break;
+                    }
+                memcpy( &( blob[ c * CONTENTS_CHUNK_SIZE ] ),
+                        &( extraValues[ e * CONTENTS_CHUNK_SIZE ] ),
+                        CONTENTS_CHUNK_SIZE );
+                }
+            
+            if( ok ) {
+                ok = unpackTileContents( blob, &( r->contents ) );
+                }
+            else {
+                clearTileContents( &( r->contents ) );
+                }
+            delete [] blob;
+            }
+        
+        if( ! ok ) {
+            AppLog::errorF( "Corrupt contents record at (%d,%d), "
+                            "treating it as empty", p->x, p->y );
+            }
+        }
+    
+    if( extraValues != NULL ) {
+        delete [] extraValues;
+        delete [] extraResults;
+        }
+    delete [] extraStart;
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    }
+
+
+
+static TileContents *getTileContents( int inX, int inY ) {
+    TileContents *cached = contentsGetCached( inX, inY );
+    
+    if( cached != NULL ) {
+        return cached;
+        }
+    
+    SimpleVector<GridPos> cells;
+    GridPos p = { inX, inY };
+    cells.push_back( p );
+    
+    loadTileContents( &cells );
+    
+    return contentsGetCached( inX, inY );
+    }
+
+
+
 static int dbFloorGet( int inX, int inY ) {
+    int cachedVal = floorGetCached( inX, inY );
+    if( cachedVal != -2 ) {
+        return cachedVal;
+        }
+
     unsigned char key[9];
     unsigned char value[4];
 
     // look for changes to default in database
     intPairToKey( inX, inY, key );
     
-    int result = DB_get( &floorDB, key, value );
+    int result = mapDBGet( &floorDB, floorDBWB, key, value );
     
+    int returnVal;
+
     if( result == 0 ) {
         // found
-        int returnVal = valueToInt( value );
-        
-        return returnVal;
+        returnVal = valueToInt( value );
         }
     else {
-        return -1;
+        returnVal = -1;
         }
+
+    floorPutCached( inX, inY, returnVal );
+    
+    return returnVal;
     }
 
 
 
 // returns 0 if not found
 static timeSec_t dbFloorTimeGet( int inX, int inY ) {
+    timeSec_t cachedVal = floorTimeGetCached( inX, inY );
+    if( cachedVal != 1 ) {
+        return cachedVal;
+        }
+
     unsigned char key[8];
     unsigned char value[8];
 
     intPairToKey( inX, inY, key );
     
-    int result = DB_get( &floorTimeDB, key, value );
+    int result = mapDBGet( &floorTimeDB, floorTimeDBWB, key, value );
     
+    timeSec_t timeVal;
+
     if( result == 0 ) {
         // found
-        return valueToTime( value );
+        timeVal = valueToTime( value );
         }
     else {
-        return 0;
+        timeVal = 0;
         }
+    
+    floorTimePutCached( inX, inY, timeVal );
+
+    return timeVal;
     }
 
 
@@ -4804,38 +5910,250 @@ timeSec_t dbLookTimeGet( int inX, int inY ) {
     unsigned char key[8];
     unsigned char value[8];
 
-    intPairToKey( inX/100, inY/100, key );
+    intPairToKey( inX/100, inY/100, key );
+    
+    int result = mapDBGet( &lookTimeDB, lookTimeDBWB, key, value );
+    
+    if( result == 0 ) {
+        // found
+        return valueToTime( value );
+        }
+    else {
+        return 0;
+        }
+    }
+
+
+
+
+// Prefetching fills the DB caches for a set of map cells with a few
+// batch lookups, so that walking through those cells afterwards hits RAM
+// instead of doing one DB lookup per record.
+//
+// The same values end up in the caches that the one-at-a-time gets would
+// have put there.
+
+typedef struct PrefetchRecord {
+        int x, y, slot, subCont;
+    } PrefetchRecord;
+
+
+
+// batch dbGet, results go into dbCache
+static void prefetchDBRecords( SimpleVector<PrefetchRecord> *inRecords ) {
+    int num = inRecords->size();
+    
+    if( num == 0 ) {
+        return;
+        }
+    
+    unsigned char *keys = new unsigned char[ num * 16 ];
+    unsigned char *values = new unsigned char[ num * 4 ];
+    int *results = new int[ num ];
+    
+    for( int i=0; i<num; i++ ) {
+        PrefetchRecord *r = inRecords->getElement( i );
+        intQuadToKey( r->x, r->y, r->slot, r->subCont, &( keys[ i * 16 ] ) );
+        }
+    
+    mapDBGetBatch( &db, dbWB, 16, 4, num, keys, values, results );
+    
+    for( int i=0; i<num; i++ ) {
+        PrefetchRecord *r = inRecords->getElement( i );
+        
+        int val = -1;
+        if( results[i] == 0 ) {
+            val = valueToInt( &( values[ i * 4 ] ) );
+            }
+        dbPutCached( r->x, r->y, r->slot, r->subCont, val );
+        }
+
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    }
+
+
+
+// batch dbTimeGet, results go into dbTimeCache
+static void prefetchTimeDBRecords( SimpleVector<PrefetchRecord> *inRecords ) {
+    int num = inRecords->size();
+    
+    if( num == 0 ) {
+        return;
+        }
+    
+    unsigned char *keys = new unsigned char[ num * 16 ];
+    unsigned char *values = new unsigned char[ num * 8 ];
+    int *results = new int[ num ];
+    
+    for( int i=0; i<num; i++ ) {
+        PrefetchRecord *r = inRecords->getElement( i );
+        intQuadToKey( r->x, r->y, r->slot, r->subCont, &( keys[ i * 16 ] ) );
+        }
+    
+    mapDBGetBatch( &timeDB, timeDBWB, 16, 8, num, keys, values, results );
+    
+    for( int i=0; i<num; i++ ) {
+        PrefetchRecord *r = inRecords->getElement( i );
+        
+        timeSec_t val = 0;
+        if( results[i] == 0 ) {
+            val = valueToTime( &( values[ i * 8 ] ) );
+            }
+        dbTimePutCached( r->x, r->y, r->slot, r->subCont, val );
+        }
+
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    }
+
+
+
+// batch dbFloorGet or dbFloorTimeGet, results go into floor caches
+static void prefetchFloorRecords( SimpleVector<GridPos> *inCells,
+                                  char inTime ) {
+    int num = inCells->size();
+    
+    if( num == 0 ) {
+        return;
+        }
+    
+    unsigned char *keys = new unsigned char[ num * 8 ];
+    unsigned char *values = new unsigned char[ num * 8 ];
+    int *results = new int[ num ];
+    
+    for( int i=0; i<num; i++ ) {
+        GridPos *p = inCells->getElement( i );
+        intPairToKey( p->x, p->y, &( keys[ i * 8 ] ) );
+        }
+    
+    if( inTime ) {
+        mapDBGetBatch( &floorTimeDB, floorTimeDBWB, 8, 8, num, 
+                       keys, values, results );
+        }
+    else {
+        mapDBGetBatch( &floorDB, floorDBWB, 8, 4, num, 
+                       keys, values, results );
+        }
+    
+    for( int i=0; i<num; i++ ) {
+        GridPos *p = inCells->getElement( i );
+        
+        if( inTime ) {
+            timeSec_t val = 0;
+            if( results[i] == 0 ) {
+                val = valueToTime( &( values[ i * 8 ] ) );
+                }
+            floorTimePutCached( p->x, p->y, val );
+            }
+        else {
+            int val = -1;
+            if( results[i] == 0 ) {
+                val = valueToInt( &( values[ i * 4 ] ) );
+                }
+            floorPutCached( p->x, p->y, val );
+            }
+        }
+
+    delete [] keys;
+    delete [] values;
+    delete [] results;
+    }
+
+
+
+static void addDBPrefetch( SimpleVector<PrefetchRecord> *inList,
+                           int inX, int inY, int inSlot, int inSubCont ) {
+    if( dbCache.peek( inX, inY, inSlot, inSubCont ) == NULL ) {
+        PrefetchRecord r = { inX, inY, inSlot, inSubCont };
+        inList->push_back( r );
+        }
+    }
+
+
+static void addTimeDBPrefetch( SimpleVector<PrefetchRecord> *inList,
+                               int inX, int inY, int inSlot, int inSubCont ) {
+    if( dbTimeCache.peek( inX, inY, inSlot, inSubCont ) == NULL ) {
+        PrefetchRecord r = { inX, inY, inSlot, inSubCont };
+        inList->push_back( r );
+        }
+    }
+
+
+
+// if inDecayTimesOnly, just fetches floor and object decay times,
+// otherwise fetches everything that getMapObject, getMapFloor and
+// getContained read for these cells
+static void prefetchMapCells( SimpleVector<GridPos> *inCells,
+                              char inDecayTimesOnly ) {
+    
+    SimpleVector<PrefetchRecord> dbList;
+    SimpleVector<PrefetchRecord> timeList;
+    SimpleVector<GridPos> floorList;
+    SimpleVector<GridPos> floorTimeList;
+    SimpleVector<GridPos> contentsList;
+    
+    for( int i=0; i<inCells->size(); i++ ) {
+        GridPos p = inCells->getElementDirect( i );
+        
+        addTimeDBPrefetch( &timeList, p.x, p.y, DECAY_SLOT, 0 );
+        
+        if( floorTimeCache.peek( p.x, p.y ) == NULL ) {
+            floorTimeList.push_back( p );
+            }
+        
+        if( inDecayTimesOnly ) {
+            continue;
+            }
+
+        addDBPrefetch( &dbList, p.x, p.y, 0, 0 );
+        
+        if( floorCache.peek( p.x, p.y ) == NULL ) {
+            floorList.push_back( p );
+            }
+        
+        if( contentsGetCached( p.x, p.y ) == NULL ) {
+            contentsList.push_back( p );
+            }
+        }
+
+    prefetchDBRecords( &dbList );
+    prefetchTimeDBRecords( &timeList );
+    prefetchFloorRecords( &floorList, false );
+    prefetchFloorRecords( &floorTimeList, true );
     
-    int result = DB_get( &lookTimeDB, key, value );
-    
-    if( result == 0 ) {
-        // found
-        return valueToTime( value );
-        }
-    else {
-        return 0;
-        }
+    // contents and sub-contents come with the tile's blob
+    loadTileContents( &contentsList );
     }
 
 
 
-
-static void dbPut( int inX, int inY, int inSlot, int inValue, 
-                   int inSubCont ) {
+// prefetches all cells in rectangle, end exclusive
+static void prefetchMapRegion( int inStartX, int inStartY, 
+                               int inEndX, int inEndY ) {
+    SimpleVector<GridPos> cells;
     
-    if( inSlot == 0 && inSubCont == 0 ) {
-        // object has changed
-        // clear blocking cache
-        blockingClearCached( inX, inY );
+    for( int y=inStartY; y<inEndY; y++ ) {
+        for( int x=inStartX; x<inEndX; x++ ) {
+            GridPos p = { x, y };
+            cells.push_back( p );
+            }
         }
+    prefetchMapCells( &cells, false );
     
+    // chunk cells not in the database fall through to the base map
+    getBaseMapRect( inStartX, inStartY, 
+                    inEndX - inStartX, inEndY - inStartY );
+    }
+
+
+
 
+static void trackMapChange( int inX, int inY ) {
     if( ! skipTrackingMapChanges ) {
         
-        // count all slot changes as changes, because we're storing
-        // time in a separate database now (so we don't need to worry
-        // about time changes being reported as map changes)
-        
         char found = false;
         for( int i=0; i<mapChangePosSinceLastStep.size(); i++ ) {
             
@@ -4856,16 +6174,32 @@ static void dbPut( int inX, int inY, int inSlot, int inValue,
             mapChangePosSinceLastStep.push_back( p );
             }
         }
+    }
+
+
+
+static void dbPut( int inX, int inY, int inSlot, int inValue, 
+                   int inSubCont ) {
+    
+    if( inSlot == 0 && inSubCont == 0 ) {
+        // object has changed
+        // clear blocking cache
+        blockingClearCached( inX, inY );
+        }
     
+    // count all slot changes as changes, because we're storing
+    // time in a separate database now (so we don't need to worry
+    // about time changes being reported as map changes)
+    trackMapChange( inX, inY );
     
 
+
     if( apocalypsePossible && inValue > 0 && inSlot == 0 && inSubCont == 0 ) {
         // a primary tile put
         // check if this triggers the apocalypse
         if( isApocalypseTrigger( inValue ) &&
             getNumPlayers() >=
-            SettingsManager::getIntSetting( "minActivePlayersForApocalypse", 
-                                            15 ) ) {
+            cachedSettings.minActivePlayersForApocalypse ) {
             apocalypseTriggered = true;
             apocalypseLocation.x = inX;
             apocalypseLocation.y = inY;
@@ -4895,9 +6229,11 @@ static void dbPut( int inX, int inY, int inSlot, int inValue,
     intToValue( inValue, value );
             
     
-    DB_put( &db, key, value );
+    mapDBPut( &db, dbWB, key, value );
 
     dbPutCached( inX, inY, inSlot, inSubCont, inValue );
+    
+    chunkCacheNoteWrite( inX, inY );
     }
 
 
@@ -4916,7 +6252,7 @@ static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
     timeToValue( inTime, value );
             
     
-    DB_put( &timeDB, key, value );
+    mapDBPut( &timeDB, timeDBWB, key, value );
 
     dbTimePutCached( inX, inY, inSlot, inSubCont, inTime );
     }
@@ -4924,6 +6260,37 @@ static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
 
 
 
+// inContents must be from getTileContents( inX, inY )
+// inIDsChanged is false when only ETAs have changed, which don't get
+// reported as map changes
+static void putTileContents( int inX, int inY, TileContents *inContents,
+                             char inIDsChanged ) {
+    if( inIDsChanged ) {
+        trackMapChange( inX, inY );
+        }
+    
+    int numChunks;
+    unsigned char *chunks = packTileContents( inContents, &numChunks );
+    
+    // extra chunks left over from a bigger blob are never read
+    for( int c=0; c<numChunks; c++ ) {
+        unsigned char key[ CONTENTS_KEY_SIZE ];
+        contentsChunkToKey( inX, inY, c, key );
+        
+        mapDBPut( &contDB, contDBWB, key, 
+                  &( chunks[ c * CONTENTS_CHUNK_SIZE ] ) );
+        }
+    
+    delete [] chunks;
+    
+    if( inIDsChanged ) {
+        chunkCacheNoteWrite( inX, inY );
+        }
+    }
+
+
+
+
 static void dbFloorPut( int inX, int inY, int inValue ) {
     
 
@@ -4959,7 +6326,11 @@ static void dbFloorPut( int inX, int inY, int inValue ) {
     intToValue( inValue, value );
             
     
-    DB_put( &floorDB, key, value );
+    mapDBPut( &floorDB, floorDBWB, key, value );
+    
+    floorPutCached( inX, inY, inValue );
+
+    chunkCacheNoteWrite( inX, inY );
     }
 
 
@@ -4975,7 +6346,9 @@ static void dbFloorTimePut( int inX, int inY, timeSec_t inTime ) {
     timeToValue( inTime, value );
             
     
-    DB_put( &floorTimeDB, key, value );
+    mapDBPut( &floorTimeDB, floorTimeDBWB, key, value );
+
+    floorTimePutCached( inX, inY, inTime );
     }
 
 
@@ -4991,7 +6364,7 @@ void dbLookTimePut( int inX, int inY, timeSec_t inTime ) {
     timeToValue( inTime, value );
             
     
-    DB_put( &lookTimeDB, key, value );
+    mapDBPut( &lookTimeDB, lookTimeDBWB, key, value );
     }
 
 
@@ -5117,85 +6490,122 @@ void checkDecayContained( int inX, int inY, int inSubCont = 0 );
 
 
 
-int *getContainedRaw( int inX, int inY, int *outNumContained, 
-                      int inSubCont ) {
-    int num = getNumContained( inX, inY, inSubCont );
-
-    *outNumContained = num;
-    
-    if( num == 0 ) {
+// NULL if tile has no such container
+static ContainerContents *getContainerIfPresent( TileContents *inContents,
+                                                 int inSubCont ) {
+    if( inSubCont >= inContents->containers.size() ) {
         return NULL;
         }
-   
-    int *contained = new int[ num ];
+    return inContents->containers.getElement( inSubCont );
+    }
+
+
 
-    int trueNum = 0;
+static void changeContained( int inX, int inY, int inSlot, 
+                             int inSubCont, int inID ) {
+    TileContents *contents = getTileContents( inX, inY );
     
-    for( int i=0; i<num; i++ ) {
-        int result = dbGet( inX, inY, FIRST_CONT_SLOT + i, inSubCont );
-        if( result == -1 ) {
-            result = 0;
-            }
-        if( result != 0 ) {
-            contained[trueNum] = result;
-            trueNum++;
-            }        
+    ContainerContents *c = getContainerContents( contents, inSubCont );
+    
+    while( c->ids.size() <= inSlot ) {
+        c->ids.push_back( 0 );
+        c->etas.push_back( 0 );
         }
+    *( c->ids.getElement( inSlot ) ) = inID;
     
-    *outNumContained = trueNum;
+    putTileContents( inX, inY, contents, true );
+    }
+
 
-    if( trueNum < num ) {
-        // fix filled count permanently in DB
-        dbPut( inX, inY, NUM_CONT_SLOT, trueNum, inSubCont );
+
+// returns container's record in contents cache, with any empty slots
+// dropped, or NULL if it holds nothing
+// only good until the next contents get
+static ContainerContents *getContainedRecord( int inX, int inY, 
+                                              int inSubCont ) {
+    TileContents *contents = getTileContents( inX, inY );
+    
+    ContainerContents *c = getContainerIfPresent( contents, inSubCont );
+    
+    if( c == NULL || c->ids.size() == 0 ) {
+        return NULL;
         }
+    
+    int num = c->ids.size();
 
-    if( trueNum > 0 ) {
-        return contained;
+    if( c->ids.getElementIndex( 0 ) != -1 ) {
+        // drop empty slots, along with their ETAs, permanently in DB
+        SimpleVector<int> ids;
+        SimpleVector<timeSec_t> etas;
+        
+        for( int i=0; i<num; i++ ) {
+            int id = c->ids.getElementDirect( i );
+            
+            if( id != 0 ) {
+                ids.push_back( id );
+                etas.push_back( c->etas.getElementDirect( i ) );
+                }
+            }
+        c->ids.deleteAll();
+        c->ids.push_back_other( &ids );
+        c->etas.deleteAll();
+        c->etas.push_back_other( &etas );
+        
+        putTileContents( inX, inY, contents, true );
+        
+        if( c->ids.size() == 0 ) {
+            return NULL;
+            }
         }
-    else {
-        delete [] contained;
+    
+    return c;
+    }
+
+
+
+int *getContainedRaw( int inX, int inY, int *outNumContained, 
+                      int inSubCont ) {
+    *outNumContained = 0;
+    
+    ContainerContents *c = getContainedRecord( inX, inY, inSubCont );
+    
+    if( c == NULL ) {
         return NULL;
         }
+    
+    *outNumContained = c->ids.size();
+
+    return c->ids.getElementArray();
     }
 
 
 
 // returns true if no contained items will decay
 char getSlotItemsNoDecay( int inX, int inY, int inSubCont ) {
-    int result = dbGet( inX, inY, NO_DECAY_SLOT, inSubCont );
+    ContainerContents *c = 
+        getContainerIfPresent( getTileContents( inX, inY ), inSubCont );
     
-    if( result != -1 ) {
-        // found
-        return ( result == 0 );
-        }
-    else {
-        // default, some may decay
-        return false;
+    if( c == NULL ) {
+        return true;
         }
-    }
-
-
-void setSlotItemsNoDecay( int inX, int inY, int inSubCont, char inNoDecay ) {
-    int val = 1;
-    if( inNoDecay ) {
-        val = 0;
+    
+    for( int i=0; i<c->etas.size(); i++ ) {
+        if( c->etas.getElementDirect( i ) != 0 ) {
+            return false;
+            }
         }
-    dbPut( inX, inY, NO_DECAY_SLOT, val, inSubCont );
+    return true;
     }
 
 
 
 
-int *getContained( int inX, int inY, int *outNumContained, int inSubCont ) {
-    if( ! getSlotItemsNoDecay( inX, inY, inSubCont ) ) {
-        checkDecayContained( inX, inY, inSubCont );
-        }
-    int *result = getContainedRaw( inX, inY, outNumContained, inSubCont );
-    
-    // look at these slots if they are subject to live decay
+// look at these slots if they are subject to live decay
+static void lookAtContained( int inX, int inY, int inNumContained,
+                             int inSubCont ) {
     timeSec_t currentTime = MAP_TIMESEC;
     
-    for( int i=0; i<*outNumContained; i++ ) {
+    for( int i=0; i<inNumContained; i++ ) {
         timeSec_t *oldLookTime =
             liveDecayRecordLastLookTimeHashTable.lookupPointer( inX, inY,
                                                                 i + 1,
@@ -5205,57 +6615,72 @@ int *getContained( int inX, int inY, int *outNumContained, int inSubCont ) {
             *oldLookTime = currentTime;
             }
         }
-    
-    return result;
     }
 
 
-int *getContainedNoLook( int inX, int inY, int *outNumContained, 
-                         int inSubCont = 0 ) {
+
+int *getContained( int inX, int inY, int *outNumContained, int inSubCont ) {
     if( ! getSlotItemsNoDecay( inX, inY, inSubCont ) ) {
         checkDecayContained( inX, inY, inSubCont );
         }
-    return getContainedRaw( inX, inY, outNumContained, inSubCont );
+    int *result = getContainedRaw( inX, inY, outNumContained, inSubCont );
+    
+    lookAtContained( inX, inY, *outNumContained, inSubCont );
+    
+    return result;
     }
 
 
 
-// gets DB slot number where a given container slot's decay time is stored
-// if inNumContained is -1, it will be looked up in database
-static int getContainerDecaySlot( int inX, int inY, int inSlot, 
-                                  int inSubCont = 0,
-                                  int inNumContained = -1 ) {
-    if( inNumContained == -1 ) {    
-        inNumContained = getNumContained( inX, inY, inSubCont );
+// same as getContained, but returns the IDs in the contents cache
+// instead of a copy
+// only good until the next map call
+static int *getContainedNoCopy( int inX, int inY, int *outNumContained, 
+                                int inSubCont = 0 ) {
+    if( ! getSlotItemsNoDecay( inX, inY, inSubCont ) ) {
+        checkDecayContained( inX, inY, inSubCont );
+        }
+    
+    *outNumContained = 0;
+    int *result = NULL;
+    
+    ContainerContents *c = getContainedRecord( inX, inY, inSubCont );
+    
+    if( c != NULL ) {
+        *outNumContained = c->ids.size();
+        result = c->ids.getElement( 0 );
         }
     
-    return FIRST_CONT_SLOT + inNumContained + inSlot;
+    lookAtContained( inX, inY, *outNumContained, inSubCont );
+    
+    return result;
     }
 
 
+int *getContainedNoLook( int inX, int inY, int *outNumContained, 
+                         int inSubCont = 0 ) {
+    if( ! getSlotItemsNoDecay( inX, inY, inSubCont ) ) {
+        checkDecayContained( inX, inY, inSubCont );
+        }
+    return getContainedRaw( inX, inY, outNumContained, inSubCont );
+    }
 
 
 
 timeSec_t *getContainedEtaDecay( int inX, int inY, int *outNumContained,
                                  int inSubCont ) {
-    int num = getNumContained( inX, inY, inSubCont );
-
-    *outNumContained = num;
+    *outNumContained = 0;
     
-    if( num == 0 ) {
+    ContainerContents *c = 
+        getContainerIfPresent( getTileContents( inX, inY ), inSubCont );
+    
+    if( c == NULL || c->etas.size() == 0 ) {
         return NULL;
         }
-   
-    timeSec_t *containedEta = new timeSec_t[ num ];
-
-    for( int i=0; i<num; i++ ) {
-        // can be 0 if not found, which is okay
-        containedEta[i] = dbTimeGet( inX, inY, 
-                                     getContainerDecaySlot( inX, inY, i,
-                                                            inSubCont, num ),
-                                     inSubCont );
-        }
-    return containedEta;
+    
+    *outNumContained = c->etas.size();
+    
+    return c->etas.getElementArray();
     }
 
 
@@ -6382,11 +7807,60 @@ int getMapObjectRaw( int inX, int inY ) {
 void lookAtRegion( int inXStart, int inYStart, int inXEnd, int inYEnd ) {
     timeSec_t currentTime = MAP_TIMESEC;
     
+    if( lookRecordFile != NULL ) {
+        fprintf( lookRecordFile, "l %.3f %d %d %d %d\n", currentTime,
+                 inXStart, inYStart, inXEnd, inYEnd );
+        }
+
+    // find cells we haven't looked at in a while, and fetch their
+    // decay times in one batch
+    SimpleVector<GridPos> staleCells;
+    
+    for( int y=inYStart; y<=inYEnd; y++ ) {
+        for( int x=inXStart; x<=inXEnd; x++ ) {
+            if( ! lookTimeTracking.checkExists( x, y, currentTime ) ) {
+                GridPos p = { x, y };
+                staleCells.push_back( p );
+                }
+            }
+        }
+    
+    prefetchMapCells( &staleCells, true );
+    
+    // then fetch the rest for cells with decays coming up
+    SimpleVector<GridPos> decayingCells;
+    
+    for( int i=0; i<staleCells.size(); i++ ) {
+        GridPos p = staleCells.getElementDirect( i );
+        
+        timeSec_t etaDecay = getEtaDecay( p.x, p.y );
+        
+        if( etaDecay != 0 &&
+            etaDecay < currentTime + maxSecondsForActiveDecayTracking ) {
+            decayingCells.push_back( p );
+            }
+        }
+    
+    prefetchMapCells( &decayingCells, false );
+    
+    
+    int nextStaleIndex = 0;
+
     for( int y=inYStart; y<=inYEnd; y++ ) {
         for( int x=inXStart; x<=inXEnd; x++ ) {
         
+            char stale = false;
             
-            if( ! lookTimeTracking.checkExists( x, y, currentTime ) ) {
+            if( nextStaleIndex < staleCells.size() ) {
+                GridPos *p = staleCells.getElement( nextStaleIndex );
+                
+                if( p->x == x && p->y == y ) {
+                    stale = true;
+                    nextStaleIndex++;
+                    }
+                }
+            
+            if( stale ) {
                 
                 // we haven't looked at this spot in a while
                 
@@ -6481,6 +7955,47 @@ void lookAtRegion( int inXStart, int inYStart, int inXEnd, int inYEnd ) {
 
 
 
+void lookAtNewRegionPart( int inOldXStart, int inOldYStart,
+                          int inOldXEnd, int inOldYEnd,
+                          int inXStart, int inYStart, 
+                          int inXEnd, int inYEnd ) {
+    
+    if( inOldXStart > inXEnd || inOldXEnd < inXStart ||
+        inOldYStart > inYEnd || inOldYEnd < inYStart ) {
+        // no overlap, all new
+        lookAtRegion( inXStart, inYStart, inXEnd, inYEnd );
+        return;
+        }
+
+    // full-width rows above and below old region
+    if( inYStart < inOldYStart ) {
+        lookAtRegion( inXStart, inYStart, inXEnd, inOldYStart - 1 );
+        }
+    if( inYEnd > inOldYEnd ) {
+        lookAtRegion( inXStart, inOldYEnd + 1, inXEnd, inYEnd );
+        }
+    
+    // columns to left and right of old region, in rows it shares
+    int overlapYStart = inYStart;
+    int overlapYEnd = inYEnd;
+    
+    if( inOldYStart > overlapYStart ) {
+        overlapYStart = inOldYStart;
+        }
+    if( inOldYEnd < overlapYEnd ) {
+        overlapYEnd = inOldYEnd;
+        }
+    
+    if( inXStart < inOldXStart ) {
+        lookAtRegion( inXStart, overlapYStart, inOldXStart - 1, overlapYEnd );
+        }
+    if( inXEnd > inOldXEnd ) {
+        lookAtRegion( inOldXEnd + 1, overlapYStart, inXEnd, overlapYEnd );
+        }
+    }
+
+
+
 int getMapObject( int inX, int inY ) {
 
     // look at this map cell
@@ -6519,24 +8034,185 @@ char isMapObjectInTransit( int inX, int inY ) {
             }
         }
     
-    return false;
-    }
-
-
-
-int getMapBiome( int inX, int inY ) {
-    return biomes[getMapBiomeIndex( inX, inY )];
+    return false;
+    }
+
+
+
+int getMapBiome( int inX, int inY ) {
+    return biomes[getMapBiomeIndex( inX, inY )];
+    }
+
+
+
+
+// scratch space for binary chunk bodies, reused across calls so that
+// encoding a chunk doesn't allocate per cell
+// (map is only touched from the main server thread)
+static unsigned char *chunkScratchBuffer = NULL;
+static int chunkScratchBufferSize = 0;
+
+
+// makes sure scratch buffer can hold inNeeded bytes, keeping the first
+// inUsed bytes
+static void ensureChunkScratchSpace( int inUsed, int inNeeded ) {
+    if( inNeeded <= chunkScratchBufferSize ) {
+        return;
+        }
+    
+    int newSize = chunkScratchBufferSize * 2;
+    
+    if( newSize < 4096 ) {
+        newSize = 4096;
+        }
+    while( newSize < inNeeded ) {
+        newSize *= 2;
+        }
+    
+    unsigned char *newBuffer = new unsigned char[ newSize ];
+    
+    if( chunkScratchBuffer != NULL ) {
+        memcpy( newBuffer, chunkScratchBuffer, inUsed );
+        delete [] chunkScratchBuffer;
+        }
+    chunkScratchBuffer = newBuffer;
+    chunkScratchBufferSize = newSize;
+    }
+
+
+
+// top-level contained IDs of the cell being encoded, copied out of the
+// contents cache, which sub container gets can change
+static int *chunkContainedScratch = NULL;
+static int chunkContainedScratchSize = 0;
+
+
+
+static void freeChunkScratchSpace() {
+    if( chunkScratchBuffer != NULL ) {
+        delete [] chunkScratchBuffer;
+        chunkScratchBuffer = NULL;
+        }
+    chunkScratchBufferSize = 0;
+    
+    if( chunkContainedScratch != NULL ) {
+        delete [] chunkContainedScratch;
+        chunkContainedScratch = NULL;
+        }
+    chunkContainedScratchSize = 0;
+    }
+
+
+
+// appends inValue to scratch buffer at *inOutPos as a varint
+static inline void chunkScratchPut( int *inOutPos, int inValue ) {
+    ensureChunkScratchSpace( *inOutPos, 
+                             *inOutPos + CHUNK_VAR_INT_MAX_BYTES );
+    
+    *inOutPos += writeChunkVarInt( &( chunkScratchBuffer[ *inOutPos ] ), 
+                                   inValue );
+    }
+
+
+
+// MB version of chunk body
+// same cells and same look/decay side effects as the text version,
+// but each cell is written straight into the scratch buffer as varints
+// instead of being formatted into strings
+// returns zipped body, raw size in outRawSize
+static unsigned char *getBinaryChunkBody( int inStartX, int inStartY, 
+                                          int inEndX, int inEndY,
+                                          int *outRawSize,
+                                          int *outCompressedSize ) {
+    int pos = 0;
+    
+    prefetchMapRegion( inStartX, inStartY, inEndX, inEndY );
+
+    for( int y=inStartY; y<inEndY; y++ ) {
+        for( int x=inStartX; x<inEndX; x++ ) {
+            
+            lastCheckedBiome = -1;
+            
+            int objID = getMapObject( x, y );
+
+            if( lastCheckedBiome == -1 ||
+                lastCheckedBiomeX != x ||
+                lastCheckedBiomeY != y ) {
+                // biome wasn't checked in order to compute
+                // getMapObject
+
+                // get it ourselves
+                
+                lastCheckedBiome = biomes[getMapBiomeIndex( x, y )];
+                }
+            
+            chunkScratchPut( &pos, lastCheckedBiome );
+            chunkScratchPut( &pos, hideIDForClient( getMapFloor( x, y ) ) );
+            chunkScratchPut( &pos, hideIDForClient( objID ) );
+            
+            int numContained = 0;
+
+            if( objID > 0 && getObject( objID )->numSlots > 0 ) {
+                int *contained = getContainedNoCopy( x, y, &numContained );
+                
+                if( numContained > chunkContainedScratchSize ) {
+                    if( chunkContainedScratch != NULL ) {
+                        delete [] chunkContainedScratch;
+                        }
+                    chunkContainedScratchSize = 2 * numContained;
+                    chunkContainedScratch = 
+                        new int[ chunkContainedScratchSize ];
+                    }
+                
+                if( numContained > 0 ) {
+                    memcpy( chunkContainedScratch, contained, 
+                            numContained * sizeof( int ) );
+                    }
+                }
+            
+            chunkScratchPut( &pos, numContained );
+            
+            for( int i=0; i<numContained; i++ ) {
+                int contID = chunkContainedScratch[i];
+                
+                int numSubContained = 0;
+                int *subContained = NULL;
+                
+                if( contID < 0 ) {
+                    // a sub container
+                    contID *= -1;
+                    
+                    subContained = getContainedNoCopy( x, y, 
+                                                       &numSubContained,
+                                                       i + 1 );
+                    }
+                
+                chunkScratchPut( &pos, hideIDForClient( contID ) );
+                chunkScratchPut( &pos, numSubContained );
+                
+                // nothing here touches the map, so subContained stays good
+                for( int s=0; s<numSubContained; s++ ) {
+                    chunkScratchPut( &pos, hideIDForClient( subContained[s] ) );
+                    }
+                }
+            }
+        }
+    
+    *outRawSize = pos;
+    
+    return zipCompress( chunkScratchBuffer, pos, outCompressedSize );
     }
 
 
 
-
-// returns properly formatted chunk message for chunk centered
-// around x,y
-unsigned char *getChunkMessage( int inStartX, int inStartY, 
-                                int inWidth, int inHeight,
-                                GridPos inRelativeToPos,
-                                int *outMessageLength ) {
+// MC version of chunk body
+// returns zipped body, raw size in outRawSize
+static unsigned char *getTextChunkBody( int inStartX, int inStartY, 
+                                        int inEndX, int inEndY,
+                                        int *outRawSize,
+                                        int *outCompressedSize ) {
+    int inWidth = inEndX - inStartX;
+    int inHeight = inEndY - inStartY;
     
     int chunkCells = inWidth * inHeight;
     
@@ -6551,38 +8227,13 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
     int **subContainedStackSizes = new int*[chunkCells];
     int ***subContainedStacks = new int**[chunkCells];
     
+    prefetchMapRegion( inStartX, inStartY, inEndX, inEndY );
 
-    int endY = inStartY + inHeight;
-    int endX = inStartX + inWidth;
-
-    if( endY < inStartY ) {
-        // wrapped around in integer space
-        // pull inStartY back from edge
-        inStartY -= inHeight;
-        endY = inStartY + inHeight;
-        }
-    if( endX < inStartX ) {
-        // wrapped around in integer space
-        // pull inStartY back from edge
-        inStartX -= inWidth;
-        endX = inStartX + inWidth;
-        }
-    
-
-
-    timeSec_t curTime = MAP_TIMESEC;
-
-    // look at four corners of chunk whenever we fetch one
-    dbLookTimePut( inStartX, inStartY, curTime );
-    dbLookTimePut( inStartX, endY, curTime );
-    dbLookTimePut( endX, inStartY, curTime );
-    dbLookTimePut( endX, endY, curTime );
-    
-    for( int y=inStartY; y<endY; y++ ) {
+    for( int y=inStartY; y<inEndY; y++ ) {
         int chunkY = y - inStartY;
         
 
-        for( int x=inStartX; x<endX; x++ ) {
+        for( int x=inStartX; x<inEndX; x++ ) {
             int chunkX = x - inStartX;
             
             int cI = chunkY * inWidth + chunkX;
@@ -6716,34 +8367,113 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
 
     unsigned char *chunkData = chunkDataBuffer.getElementArray();
     
-    int compressedSize;
     unsigned char *compressedChunkData =
         zipCompress( chunkData, chunkDataBuffer.size(),
-                     &compressedSize );
+                     outCompressedSize );
+
+    delete [] chunkData;
+    
+    *outRawSize = chunkDataBuffer.size();
+    
+    return compressedChunkData;
+    }
+
+
+
 
+// returns properly formatted chunk message for chunk centered
+// around x,y
+unsigned char *getChunkMessage( int inStartX, int inStartY, 
+                                int inWidth, int inHeight,
+                                GridPos inRelativeToPos,
+                                int *outMessageLength,
+                                int inFormat ) {
+    
+    int endY = inStartY + inHeight;
+    int endX = inStartX + inWidth;
+
+    if( endY < inStartY ) {
+        // wrapped around in integer space
+        // pull inStartY back from edge
+        inStartY -= inHeight;
+        endY = inStartY + inHeight;
+        }
+    if( endX < inStartX ) {
+        // wrapped around in integer space
+        // pull inStartY back from edge
+        inStartX -= inWidth;
+        endX = inStartX + inWidth;
+        }
+    
+
+
+    timeSec_t curTime = MAP_TIMESEC;
+
+    // look at four corners of chunk whenever we fetch one
+    dbLookTimePut( inStartX, inStartY, curTime );
+    dbLookTimePut( inStartX, endY, curTime );
+    dbLookTimePut( endX, inStartY, curTime );
+    dbLookTimePut( endX, endY, curTime );
+    
 
+    int rawSize;
+    int compressedSize;
+    
+    // body doesn't depend on who it's for, only the header does
+    unsigned char *compressedChunkData = 
+        chunkCacheLookup( inStartX, inStartY, inWidth, inHeight, inFormat,
+                          &rawSize, &compressedSize );
+    
+    if( compressedChunkData == NULL ) {
+        
+        // any write that lands while we're building makes this stale
+        unsigned int generation = chunkWriteGeneration;
+        
+        if( inFormat == CHUNK_FORMAT_BINARY ) {
+            compressedChunkData = 
+                getBinaryChunkBody( inStartX, inStartY, endX, endY,
+                                    &rawSize, &compressedSize );
+            }
+        else {
+            compressedChunkData = 
+                getTextChunkBody( inStartX, inStartY, endX, endY,
+                                  &rawSize, &compressedSize );
+            }
+        
+        chunkCacheInsert( inStartX, inStartY, inWidth, inHeight, inFormat,
+                          generation, rawSize, 
+                          compressedChunkData, compressedSize );
+        }
+    
+    
+    const char *tag = "MC";
+    
+    if( inFormat == CHUNK_FORMAT_BINARY ) {
+        tag = "MB";
+        }
 
-    char *header = autoSprintf( "MC\n%d %d %d %d\n%d %d\n#", 
+    char *header = autoSprintf( "%s\n%d %d %d %d\n%d %d\n#", 
+                                tag,
                                 inWidth, inHeight,
                                 inStartX - inRelativeToPos.x, 
                                 inStartY - inRelativeToPos.y, 
-                                chunkDataBuffer.size(),
+                                rawSize,
                                 compressedSize );
     
-    SimpleVector<unsigned char> buffer;
-    buffer.appendArray( (unsigned char*)header, strlen( header ) );
-    delete [] header;
-
+    int headerLength = strlen( header );
     
-    buffer.appendArray( compressedChunkData, compressedSize );
+    unsigned char *message = 
+        new unsigned char[ headerLength + compressedSize ];
     
-    delete [] chunkData;
-    delete [] compressedChunkData;
+    memcpy( message, header, headerLength );
+    memcpy( &( message[ headerLength ] ), compressedChunkData, 
+            compressedSize );
     
-
+    delete [] header;
+    delete [] compressedChunkData;
     
-    *outMessageLength = buffer.size();
-    return buffer.getElementArray();
+    *outMessageLength = headerLength + compressedSize;
+    return message;
     }
 
 
@@ -7516,7 +9246,7 @@ void setMapObjectRaw( int inX, int inY, int inID ) {
 
 static void logMapChange( int inX, int inY, int inID ) {
     // log it?
-    if( mapChangeLogFile != NULL ) {
+    if( isMapChangeLogOpen() ) {
         
         double timeDelta = Time::getCurrentTime() - mapChangeLogTimeStart;
 
@@ -7526,51 +9256,43 @@ static void logMapChange( int inX, int inY, int inID ) {
             timeDelta = Time::getCurrentTime() - mapChangeLogTimeStart;
             }
         
+        if( timeDelta < 0 ) {
+            // clock set back
+            timeDelta = 0;
+            }
         
 
         ObjectRecord *o = getObject( inID );
         
-        const char *extraFlag = "";
+        MapChangeLogRecord r;
         
-        if( o != NULL && o->floor ) {
-            extraFlag = "f";
-            }
+        r.time = lrint( timeDelta * 100 );
+        r.x = inX;
+        r.y = inY;
+        r.floor = ( o != NULL && o->floor );
+        r.kind = MAP_LOG_PLAIN;
+        r.id = inID;
+        r.dummyIndex = 0;
         
         int respPlayer = currentResponsiblePlayer;
         
         if( respPlayer != -1 && respPlayer < 0 ) {
             respPlayer = - respPlayer;
             }
+        r.responsiblePlayer = respPlayer;
 
         if( o != NULL && o->isUseDummy ) {
-            fprintf( mapChangeLogFile, 
-                     "%.2f %d %d %s%du%d %d\n",
-                     timeDelta,
-                     inX, inY,
-                     extraFlag,
-                     o->useDummyParent,
-                     o->thisUseDummyIndex,
-                     respPlayer );
+            r.kind = MAP_LOG_USE_DUMMY;
+            r.id = o->useDummyParent;
+            r.dummyIndex = o->thisUseDummyIndex;
             }
         else if( o != NULL && o->isVariableDummy ) {
-            fprintf( mapChangeLogFile, 
-                     "%.2f %d %d %s%dv%d %d\n", 
-                     timeDelta,
-                     inX, inY,
-                     extraFlag,
-                     o->variableDummyParent,
-                     o->thisVariableDummyIndex,
-                     respPlayer );
-            }
-        else {        
-            fprintf( mapChangeLogFile, 
-                     "%.2f %d %d %s%d %d\n", 
-                     timeDelta,
-                     inX, inY,
-                     extraFlag,
-                     inID,
-                     respPlayer );
+            r.kind = MAP_LOG_VARIABLE_DUMMY;
+            r.id = o->variableDummyParent;
+            r.dummyIndex = o->thisVariableDummyIndex;
             }
+        
+        logMapChangeRecord( &r );
         }
     }
 
@@ -7686,13 +9408,45 @@ timeSec_t getEtaDecay( int inX, int inY ) {
 
 
 
+// live-tracks every decaying item in a container
+static void trackContainedETAs( int inX, int inY, int inSubCont ) {
+    ContainerContents *c = 
+        getContainerIfPresent( getTileContents( inX, inY ), inSubCont );
+    
+    if( c == NULL ) {
+        return;
+        }
+    
+    // copy, because trackETA may look at other tiles' contents
+    int num = c->etas.size();
+    timeSec_t *etas = c->etas.getElementArray();
+    
+    for( int i=0; i<num; i++ ) {
+        if( etas[i] != 0 ) {
+            trackETA( inX, inY, i + 1, etas[i], inSubCont );
+            }
+        }
+    delete [] etas;
+    }
+
+
+
 void setSlotEtaDecay( int inX, int inY, int inSlot,
                       timeSec_t inAbsoluteTimeInSeconds, int inSubCont ) {
-    dbTimePut( inX, inY, getContainerDecaySlot( inX, inY, inSlot, inSubCont ),
-               inAbsoluteTimeInSeconds, inSubCont );
+    TileContents *contents = getTileContents( inX, inY );
+    
+    ContainerContents *c = getContainerIfPresent( contents, inSubCont );
+    
+    if( c == NULL || inSlot >= c->etas.size() ) {
+        // no item there to decay
+        return;
+        }
+    
+    *( c->etas.getElement( inSlot ) ) = inAbsoluteTimeInSeconds;
+    
+    putTileContents( inX, inY, contents, false );
+    
     if( inAbsoluteTimeInSeconds != 0 ) {
-        setSlotItemsNoDecay( inX, inY, inSubCont, false );
-
         trackETA( inX, inY, inSlot + 1, inAbsoluteTimeInSeconds,
                   inSubCont );
         }
@@ -7700,10 +9454,13 @@ void setSlotEtaDecay( int inX, int inY, int inSlot,
 
 
 timeSec_t getSlotEtaDecay( int inX, int inY, int inSlot, int inSubCont ) {
-    // 0 if not found
-    return dbTimeGet( inX, inY, getContainerDecaySlot( inX, inY, inSlot, 
-                                                       inSubCont ),
-                      inSubCont );
+    ContainerContents *c = 
+        getContainerIfPresent( getTileContents( inX, inY ), inSubCont );
+    
+    if( c == NULL || inSlot >= c->etas.size() ) {
+        return 0;
+        }
+    return c->etas.getElementDirect( inSlot );
     }
 
 
@@ -7713,9 +9470,6 @@ timeSec_t getSlotEtaDecay( int inX, int inY, int inSlot, int inSubCont ) {
 
 void addContained( int inX, int inY, int inContainedID, 
                    timeSec_t inEtaDecay, int inSubCont ) {
-    int oldNum;
-    
-
     timeSec_t curTime = MAP_TIMESEC;
 
     if( inEtaDecay != 0 ) {    
@@ -7725,57 +9479,36 @@ void addContained( int inX, int inY, int inContainedID,
             etaOffset / getMapContainerTimeStretch( inX, inY, inSubCont );
         }
     
+    // apply decay to what's there before adding to the end
+    int oldNum;
     int *oldContained = getContained( inX, inY, &oldNum, inSubCont );
 
-    timeSec_t *oldContainedETA = getContainedEtaDecay( inX, inY, &oldNum,
-                                                       inSubCont );
-
-    int *newContained = new int[ oldNum + 1 ];
-    
-    if( oldNum != 0 ) {
-        memcpy( newContained, oldContained, oldNum * sizeof( int ) );
-        }
-    
-    newContained[ oldNum ] = inContainedID;
-    
     if( oldContained != NULL ) {
         delete [] oldContained;
         }
     
-    timeSec_t *newContainedETA = new timeSec_t[ oldNum + 1 ];
-    
-    if( oldNum != 0 ) {    
-        memcpy( newContainedETA, 
-                oldContainedETA, oldNum * sizeof( timeSec_t ) );
-        }
-    
-    newContainedETA[ oldNum ] = inEtaDecay;
+    TileContents *contents = getTileContents( inX, inY );
     
-    if( oldContainedETA != NULL ) {
-        delete [] oldContainedETA;
-        }
+    ContainerContents *c = getContainerContents( contents, inSubCont );
     
-    int newNum = oldNum + 1;
+    c->ids.push_back( inContainedID );
+    c->etas.push_back( inEtaDecay );
     
-    setContained( inX, inY, newNum, newContained, inSubCont );
-    setContainedEtaDecay( inX, inY, newNum, newContainedETA, inSubCont );
+    putTileContents( inX, inY, contents, true );
     
-    delete [] newContained;
-    delete [] newContainedETA;
+    trackContainedETAs( inX, inY, inSubCont );
     }
 
 
 int getNumContained( int inX, int inY, int inSubCont ) {
-    int result = dbGet( inX, inY, NUM_CONT_SLOT, inSubCont );
+    ContainerContents *c = 
+        getContainerIfPresent( getTileContents( inX, inY ), inSubCont );
     
-    if( result != -1 ) {
-        // found
-        return result;
-        }
-    else {
+    if( c == NULL ) {
         // default, empty container
         return 0;
         }
+    return c->ids.size();
     }
 
 
@@ -7783,30 +9516,58 @@ int getNumContained( int inX, int inY, int inSubCont ) {
 
 
 
+// ETAs of slots that are still there are kept, and new slots don't decay,
+// until setContainedEtaDecay is called
 void setContained( int inX, int inY, int inNumContained, int *inContained,
                    int inSubCont ) {
-    dbPut( inX, inY, NUM_CONT_SLOT, inNumContained, inSubCont );
-    for( int i=0; i<inNumContained; i++ ) {
-        changeContained( inX, inY, i, inSubCont, inContained[i] );
+    TileContents *contents = getTileContents( inX, inY );
+    
+    if( inNumContained == 0 &&
+        getContainerIfPresent( contents, inSubCont ) == NULL ) {
+        // already empty, nothing to store
+        trackMapChange( inX, inY );
+        return;
+        }
+
+    ContainerContents *c = getContainerContents( contents, inSubCont );
+    
+    c->ids.deleteAll();
+    c->ids.appendArray( inContained, inNumContained );
+    
+    if( c->etas.size() > inNumContained ) {
+        c->etas.shrink( inNumContained );
+        }
+    while( c->etas.size() < inNumContained ) {
+        c->etas.push_back( 0 );
         }
+    
+    putTileContents( inX, inY, contents, true );
     }
 
 
 void setContainedEtaDecay( int inX, int inY, int inNumContained, 
                            timeSec_t *inContainedEtaDecay, int inSubCont ) {
-    char someDecay = false;
-    for( int i=0; i<inNumContained; i++ ) {
-        dbTimePut( inX, inY, 
-                   getContainerDecaySlot( inX, inY, i, inSubCont,
-                                          inNumContained ),
-                   inContainedEtaDecay[i], inSubCont );
-        
-        if( inContainedEtaDecay[i] != 0 ) {
-            someDecay = true;
-            trackETA( inX, inY, i + 1, inContainedEtaDecay[i], inSubCont );
-            }
+    TileContents *contents = getTileContents( inX, inY );
+    
+    ContainerContents *c = getContainerIfPresent( contents, inSubCont );
+    
+    if( c == NULL ) {
+        return;
+        }
+    
+    int num = c->etas.size();
+    
+    if( inNumContained < num ) {
+        num = inNumContained;
         }
-    setSlotItemsNoDecay( inX, inY, inSubCont, !someDecay );
+    
+    for( int i=0; i<num; i++ ) {
+        *( c->etas.getElement( i ) ) = inContainedEtaDecay[i];
+        }
+    
+    putTileContents( inX, inY, contents, false );
+    
+    trackContainedETAs( inX, inY, inSubCont );
     }
 
 
@@ -7814,26 +9575,20 @@ void setContainedEtaDecay( int inX, int inY, int inNumContained,
 
 
 int getContained( int inX, int inY, int inSlot, int inSubCont ) {
-    int num = getNumContained( inX, inY, inSubCont );
+    ContainerContents *c = 
+        getContainerIfPresent( getTileContents( inX, inY ), inSubCont );
     
-    if( num == 0 ) {
+    if( c == NULL || c->ids.size() == 0 ) {
         return 0;
         }
+    
+    int num = c->ids.size();
 
     if( inSlot == -1 || inSlot > num - 1 ) {
         inSlot = num - 1;
         }
     
-    
-    int result = dbGet( inX, inY, FIRST_CONT_SLOT + inSlot, inSubCont );
-    
-    if( result != -1 ) {    
-        return result;
-        }
-    else {
-        // nothing in that slot
-        return 0;
-        }
+    return c->ids.getElementDirect( inSlot );
     }
 
 
@@ -7853,14 +9608,11 @@ int removeContained( int inX, int inY, int inSlot, timeSec_t *outEtaDecay,
         }
     
     
-    int result = dbGet( inX, inY, FIRST_CONT_SLOT + inSlot, inSubCont );
+    int result = getContained( inX, inY, inSlot, inSubCont );
 
     timeSec_t curTime = MAP_TIMESEC;
     
-    timeSec_t resultEta = dbTimeGet( inX, inY, 
-                                     getContainerDecaySlot( 
-                                         inX, inY, inSlot, inSubCont, num ),
-                                     inSubCont );
+    timeSec_t resultEta = getSlotEtaDecay( inX, inY, inSlot, inSubCont );
 
     if( resultEta != 0 ) {    
         timeSec_t etaOffset = resultEta - curTime;
@@ -7872,98 +9624,80 @@ int removeContained( int inX, int inY, int inSlot, timeSec_t *outEtaDecay,
     
     *outEtaDecay = resultEta;
     
+
+    // apply decay to what stays behind
     int oldNum;
     int *oldContained = getContained( inX, inY, &oldNum, inSubCont );
 
-    timeSec_t *oldContainedETA = getContainedEtaDecay( inX, inY, &oldNum,
-                                                       inSubCont );
-
-    SimpleVector<int> newContainedList;
-    SimpleVector<timeSec_t> newContainedETAList;
-
-    SimpleVector<int> newSubContainedNumList;
-    SimpleVector<int*> newSubContainedList;
-    SimpleVector<timeSec_t*> newSubContainedEtaList;
-        
-    
-    for( int i=0; i<oldNum; i++ ) {
-        if( i != inSlot ) {
-            newContainedList.push_back( oldContained[i] );
-            newContainedETAList.push_back( oldContainedETA[i] );
-            
-            if( inSubCont == 0 ) {
-                int num;
-                
-                newSubContainedList.push_back(
-                    getContained( inX, inY, &num, i + 1 ) );
-                newSubContainedNumList.push_back( num );
-
-                newSubContainedEtaList.push_back(
-                    getContainedEtaDecay( inX, inY, &num, i + 1 ) );
-                }
-            }
+    if( oldContained != NULL ) {
+        delete [] oldContained;
         }
-    clearAllContained( inX, inY );
     
-    int *newContained = newContainedList.getElementArray();
-    timeSec_t *newContainedETA = newContainedETAList.getElementArray();
-
-    int newNum = oldNum - 1;
-
-    setContained( inX, inY, newNum, newContained, inSubCont );
-    setContainedEtaDecay( inX, inY, newNum, newContainedETA, inSubCont );
-
     if( inSubCont == 0 ) {
-        for( int i=0; i<newNum; i++ ) {
-            int *idList = newSubContainedList.getElementDirect( i );
-            timeSec_t *etaList = newSubContainedEtaList.getElementDirect( i );
-            
-            if( idList != NULL ) {
-                int num = newSubContainedNumList.getElementDirect( i );
-                
-                setContained( inX, inY, num, idList, i + 1 );
-                setContainedEtaDecay( inX, inY, num, etaList, i + 1 );
+        for( int i=0; i<oldNum; i++ ) {
+            if( i != inSlot ) {
+                int numSub;
+                int *subContained = getContained( inX, inY, &numSub, i + 1 );
                 
-                delete [] idList;
-                delete [] etaList;
+                if( subContained != NULL ) {
+                    delete [] subContained;
+                    }
                 }
             }
         }
     
 
+    TileContents *contents = getTileContents( inX, inY );
     
-    delete [] oldContained;
-    delete [] oldContainedETA;
-    delete [] newContained;
-    delete [] newContainedETA;
-
-    if( result != -1 ) {    
-        return result;
+    ContainerContents *c = getContainerIfPresent( contents, inSubCont );
+    
+    if( c != NULL && inSlot < c->ids.size() ) {
+        c->ids.deleteElement( inSlot );
+        c->etas.deleteElement( inSlot );
         }
-    else {
-        // nothing in that slot
-        return 0;
+    
+    if( inSubCont == 0 && inSlot + 1 < contents->containers.size() ) {
+        // sub containers of later slots move down with them
+        contents->containers.deleteElement( inSlot + 1 );
+        }
+    
+    putTileContents( inX, inY, contents, true );
+    
+    
+    trackContainedETAs( inX, inY, inSubCont );
+    
+    if( inSubCont == 0 ) {
+        for( int i=0; i<oldNum - 1; i++ ) {
+            trackContainedETAs( inX, inY, i + 1 );
+            }
         }
+
+    return result;
     }
 
 
 
 void clearAllContained( int inX, int inY, int inSubCont ) {
-    int oldNum = getNumContained( inX, inY, inSubCont );
-
-    if( inSubCont == 0 ) {
-        // clear sub container slots too, if any
+    TileContents *contents = getTileContents( inX, inY );
     
-        for( int i=0; i<oldNum; i++ ) {
-            if( getNumContained( inX, inY, i + 1 ) > 0 ) {
-                dbPut( inX, inY, NUM_CONT_SLOT, 0, i + 1 );
-                }
+    if( inSubCont == 0 ) {
+        // clear sub containers too, if any
+        if( contents->containers.size() == 0 ) {
+            return;
             }
+        clearTileContents( contents );
         }
+    else {
+        ContainerContents *c = getContainerIfPresent( contents, inSubCont );
     
-    if( oldNum != 0 ) {
-        dbPut( inX, inY, NUM_CONT_SLOT, 0, inSubCont );
+        if( c == NULL || c->ids.size() == 0 ) {
+            return;
+            }
+        c->ids.deleteAll();
+        c->etas.deleteAll();
         }
+    
+    putTileContents( inX, inY, contents, true );
     }
 
 
@@ -8025,15 +9759,28 @@ void shrinkContainer( int inX, int inY, int inNumNewSlots, int inSubCont ) {
         
 
         // now clear old extra contents from original spot
-        dbPut( inX, inY, NUM_CONT_SLOT, inNumNewSlots, inSubCont );
+        TileContents *contents = getTileContents( inX, inY );
+        
+        ContainerContents *c = getContainerContents( contents, inSubCont );
+        
+        c->ids.shrink( inNumNewSlots );
+        c->etas.shrink( inNumNewSlots );
         
         if( inSubCont == 0 ) {    
             // clear sub cont slots too
-            for( int i=inNumNewSlots; i<oldNum; i++ ) {
-                dbPut( inX, inY, NUM_CONT_SLOT, 0, i + 1 );
+            for( int i=inNumNewSlots; 
+                 i<oldNum && i + 1 < contents->containers.size(); i++ ) {
+                
+                ContainerContents *sub = 
+                    contents->containers.getElement( i + 1 );
+                
+                sub->ids.deleteAll();
+                sub->etas.deleteAll();
                 }
             }
         
+        putTileContents( inX, inY, contents, true );
+        
         }
     }
 
@@ -8337,8 +10084,27 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
     timeSec_t curTime = MAP_TIMESEC;
 
     
+    // journal last step's DB writes, hand batch to background writer
+    stepWriteBehind();
+
+    
     lookTimeTracking.cleanStale( curTime - noLookCountAsStaleSeconds );
 
+    stepMapChangeLog();
+
+    if( lookRecordFile != NULL ) {
+        fprintf( lookRecordFile, "c %.3f\n", 
+                 curTime - noLookCountAsStaleSeconds );
+        }
+
+    if( mapCacheStatsLogSeconds > 0 &&
+        Time::getCurrentTime() - lastMapCacheStatsLogTime > 
+        mapCacheStatsLogSeconds ) {
+        
+        logMapCacheStats();
+        lastMapCacheStatsLogTime = Time::getCurrentTime();
+        }
+
 
     while( liveDecayQueue.size() > 0 && 
            liveDecayQueue.checkMinPriority() <= curTime ) {
@@ -9441,8 +11207,7 @@ GridPos getNextCloseLandingPos( GridPos inCurPos,
     GridPos closestPos;
     double closestDist = DBL_MAX;
 
-    double maxDist = SettingsManager::getDoubleSetting( "maxFlightDistance",
-                                                        10000 );
+    double maxDist = cachedSettings.maxFlightDistance;
     
     for( int i=0; i<flightLandingPos.size(); i++ ) {
         GridPos thisPos = flightLandingPos.getElementDirect( i );
@@ -9499,8 +11264,7 @@ GridPos getClosestLandingPos( GridPos inTargetPos, char *outFound ) {
     GridPos closestPos;
     double closestDist = DBL_MAX;
 
-    double maxDist = SettingsManager::getDoubleSetting( "maxFlightDistance",
-                                                        10000 );
+    double maxDist = cachedSettings.maxFlightDistance;
     
     for( int i=0; i<flightLandingPos.size(); i++ ) {
         GridPos thisPos = flightLandingPos.getElementDirect( i );
@@ -9551,8 +11315,7 @@ GridPos getNextFlightLandingPos( int inCurrentX, int inCurrentY,
     GridPos closestPos;
     double closestDist = DBL_MAX;
 
-    double maxDist = SettingsManager::getDoubleSetting( "maxFlightDistance",
-                                                        10000 );
+    double maxDist = cachedSettings.maxFlightDistance;
 
     GridPos curPos = { inCurrentX, inCurrentY };
 
@@ -9744,8 +11507,20 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
         noCullItemList.push_back_other( list );
         delete list;
 
-        barrierRadius = SettingsManager::getIntSetting( "barrierRadius", 250 );
-        barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+        int oldBarrierRadius = barrierRadius;
+        int oldBarrierOn = barrierOn;
+        
+        barrierRadius = cachedSettings.barrierRadius;
+        barrierOn = cachedSettings.barrierOn;
+        
+        if( barrierRadius != oldBarrierRadius || barrierOn != oldBarrierOn ) {
+            // cached chunks may show old barrier
+            clearChunkCache();
+            }
+        
+        chunkCacheMaxAge = 
+            SettingsManager::getDoubleSetting( "chunkCacheMaxAgeSeconds", 
+                                               2.0 );
         }
 
 
@@ -9756,7 +11531,7 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
 
     
     if( !tileCullingIteratorSet ) {
-        DB_Iterator_init( &db, &tileCullingIterator );
+        mapDBIteratorInit( &db, dbWB, &tileCullingIterator );
         tileCullingIteratorSet = true;
         numTilesSeenByIterator = 0;
         }
@@ -9768,11 +11543,11 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
 
     for( int i=0; i<numTilesExaminedPerCullStep; i++ ) {        
         int result = 
-            DB_Iterator_next( &tileCullingIterator, tileKey, value );
+            mapDBIteratorNext( &tileCullingIterator, dbWB, tileKey, value );
 
         if( result <= 0 ) {
             // restart the iterator back at the beginning
-            DB_Iterator_init( &db, &tileCullingIterator );
+            mapDBIteratorInit( &db, dbWB, &tileCullingIterator );
             if( numTilesSeenByIterator != 0 ) {
                 AppLog::infoF( "Map cull iterated through %d tile db entries.",
                                numTilesSeenByIterator );
@@ -9847,7 +11622,7 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
     
 
     if( !floorCullingIteratorSet ) {
-        DB_Iterator_init( &floorDB, &floorCullingIterator );
+        mapDBIteratorInit( &floorDB, floorDBWB, &floorCullingIterator );
         floorCullingIteratorSet = true;
         numFloorsSeenByIterator = 0;
         }
@@ -9855,11 +11630,12 @@ void stepMapLongTermCulling( int inNumCurrentPlayers ) {
 
     for( int i=0; i<numTilesExaminedPerCullStep; i++ ) {        
         int result = 
-            DB_Iterator_next( &floorCullingIterator, floorKey, value );
+            mapDBIteratorNext( &floorCullingIterator, floorDBWB, 
+                               floorKey, value );
 
         if( result <= 0 ) {
             // restart the iterator back at the beginning
-            DB_Iterator_init( &floorDB, &floorCullingIterator );
+            mapDBIteratorInit( &floorDB, floorDBWB, &floorCullingIterator );
             if( numFloorsSeenByIterator != 0 ) {
                 AppLog::infoF( "Map cull iterated through %d floor db entries.",
                                numFloorsSeenByIterator );
@@ -77,14 +77,22 @@ void mapEveDeath( const char *inEmail, double inAge, GridPos inDeathMapPos );
 
 
 
+// body encodings for map chunk messages
+// text MC is the default, clients can ask for MB with a CFMT message
+#define CHUNK_FORMAT_TEXT 0
+#define CHUNK_FORMAT_BINARY 1
+
+
 // returns properly formatted chunk message for chunk in rectangle shape
 // with bottom-left corner at x,y
 // coordinates in message will be relative to inRelativeToPos
 // note that inStartX,Y are absolute world coordinates
+// inFormat is one of the CHUNK_FORMAT_ values above
 unsigned char *getChunkMessage( int inStartX, int inStartY, 
                                 int inWidth, int inHeight,
                                 GridPos inRelativeToPos,
-                                int *outMessageLength );
+                                int *outMessageLength,
+                                int inFormat = CHUNK_FORMAT_TEXT );
 
 
 // sets the player responsible for subsequent map changes
@@ -215,6 +223,14 @@ int getNextDecayDelta();
 void lookAtRegion( int inXStart, int inYStart, int inXEnd, int inYEnd );
 
 
+// looks only at the part of a region that's outside of the region
+// looked at before, for when a looker moves
+void lookAtNewRegionPart( int inOldXStart, int inOldYStart,
+                          int inOldXEnd, int inOldYEnd,
+                          int inXStart, int inYStart, 
+                          int inXEnd, int inYEnd );
+
+
 
 // any change lines resulting from step are appended to inMapChanges
 // any change positions are added to end of inChangePosList
@@ -0,0 +1,275 @@
+#include "mapChangeLog.h"
+
+#include <stdio.h>
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/system/Time.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/log/AppLog.h"
+
+
+
+typedef struct PendingLogWrite {
+        FILE *file;
+
+        // NULL for a close with nothing to write
+        unsigned char *data;
+        int length;
+
+        char closeAfter;
+    } PendingLogWrite;
+
+
+
+static char logRunning = false;
+
+static double flushInterval = 10.0;
+static int blockBytes = 65536;
+
+
+// only touched by main thread
+static FILE *currentFile = NULL;
+
+static SimpleVector<unsigned char> blockRecordBytes;
+static int blockNumRecords = 0;
+static double blockStartTime = 0;
+static MapChangeLogDeltaState blockState;
+
+
+// guards writeQueue and stopSignal
+static MutexLock queueLock;
+static SimpleVector<PendingLogWrite> writeQueue;
+static char stopSignal = false;
+
+static BinarySemaphore writeReadySemaphore;
+
+
+static int numRecordsLogged = 0;
+static int numBlocksWritten = 0;
+static double numBytesWritten = 0;
+
+
+
+// returns false if queue empty
+static char popWrite( PendingLogWrite *outWrite ) {
+    char found = false;
+
+    queueLock.lock();
+    if( writeQueue.size() > 0 ) {
+        *outWrite = writeQueue.getElementDirect( 0 );
+        writeQueue.deleteElement( 0 );
+        found = true;
+        }
+    queueLock.unlock();
+
+    return found;
+    }
+
+
+
+class MapChangeLogThread : public Thread {
+
+        virtual void run() {
+
+            char stop = false;
+
+            while( ! stop ) {
+                writeReadySemaphore.wait();
+
+                PendingLogWrite w;
+
+                while( popWrite( &w ) ) {
+                    if( w.data != NULL ) {
+                        int numWritten = fwrite( w.data, 1, w.length,
+                                                 w.file );
+
+                        if( numWritten != w.length ) {
+                            AppLog::error(
+                                "Failed to write map change log block" );
+                            }
+                        delete [] w.data;
+                        }
+
+                    if( w.closeAfter ) {
+                        fclose( w.file );
+                        }
+                    else {
+                        fflush( w.file );
+                        }
+                    }
+
+                queueLock.lock();
+                stop = stopSignal;
+                queueLock.unlock();
+                }
+            }
+
+    };
+
+
+static MapChangeLogThread *logThread = NULL;
+
+
+
+static void queueWrite( unsigned char *inData, int inLength,
+                        char inCloseAfter ) {
+    PendingLogWrite w = { currentFile, inData, inLength, inCloseAfter };
+
+    queueLock.lock();
+    writeQueue.push_back( w );
+    queueLock.unlock();
+
+    writeReadySemaphore.signal();
+    }
+
+
+
+static void handOffBlock( char inCloseAfter ) {
+    if( blockNumRecords == 0 ) {
+        if( inCloseAfter ) {
+            queueWrite( NULL, 0, true );
+            }
+        return;
+        }
+
+    SimpleVector<unsigned char> block;
+
+    encodeMapChangeLogBlock( blockNumRecords, &blockRecordBytes, &block );
+
+    numBlocksWritten++;
+    numBytesWritten += block.size();
+
+    queueWrite( block.getElementArray(), block.size(), inCloseAfter );
+
+    blockRecordBytes.deleteAll();
+    blockNumRecords = 0;
+    resetMapChangeLogDeltaState( &blockState );
+    }
+
+
+
+void initMapChangeLog( double inFlushIntervalSeconds, int inBlockBytes ) {
+    if( logRunning ) {
+        return;
+        }
+
+    flushInterval = inFlushIntervalSeconds;
+    blockBytes = inBlockBytes;
+
+    numRecordsLogged = 0;
+    numBlocksWritten = 0;
+    numBytesWritten = 0;
+
+    stopSignal = false;
+
+    blockRecordBytes.deleteAll();
+    blockNumRecords = 0;
+    resetMapChangeLogDeltaState( &blockState );
+
+    logThread = new MapChangeLogThread();
+    logThread->start();
+
+    logRunning = true;
+    }
+
+
+
+void freeMapChangeLog() {
+    if( ! logRunning ) {
+        return;
+        }
+
+    closeMapChangeLog();
+
+    queueLock.lock();
+    stopSignal = true;
+    queueLock.unlock();
+
+    writeReadySemaphore.signal();
+
+    logThread->join();
+    delete logThread;
+    logThread = NULL;
+
+    logRunning = false;
+
+    AppLog::infoF( "Map change log:  %d records in %d blocks, %.0f bytes",
+                   numRecordsLogged, numBlocksWritten, numBytesWritten );
+    }
+
+
+
+char openMapChangeLog( const char *inPath, timeSec_t inStartTime ) {
+    closeMapChangeLog();
+
+    if( ! logRunning ) {
+        return false;
+        }
+
+    currentFile = fopen( inPath, "wb" );
+
+    if( currentFile == NULL ) {
+        AppLog::errorF( "Failed to open map change log %s", inPath );
+        return false;
+        }
+
+    unsigned char *header = new unsigned char[ MAP_CHANGE_LOG_HEADER_LENGTH ];
+
+    encodeMapChangeLogHeader( inStartTime, header );
+
+    queueWrite( header, MAP_CHANGE_LOG_HEADER_LENGTH, false );
+
+    return true;
+    }
+
+
+
+char isMapChangeLogOpen() {
+    return ( currentFile != NULL );
+    }
+
+
+
+void closeMapChangeLog() {
+    if( currentFile == NULL ) {
+        return;
+        }
+
+    handOffBlock( true );
+
+    currentFile = NULL;
+    }
+
+
+
+void logMapChangeRecord( MapChangeLogRecord *inRecord ) {
+    if( currentFile == NULL ) {
+        return;
+        }
+
+    if( blockNumRecords == 0 ) {
+        blockStartTime = Time::getCurrentTime();
+        }
+
+    encodeMapChangeLogRecord( inRecord, &blockState, &blockRecordBytes );
+    blockNumRecords++;
+    numRecordsLogged++;
+
+    if( blockRecordBytes.size() >= blockBytes ) {
+        handOffBlock( false );
+        }
+    }
+
+
+
+void stepMapChangeLog() {
+    if( currentFile != NULL &&
+        blockNumRecords > 0 &&
+        Time::getCurrentTime() - blockStartTime >= flushInterval ) {
+
+        handOffBlock( false );
+        }
+    }
@@ -0,0 +1,36 @@
+#include "mapChangeLogFormat.h"
+
+
+// Buffers map change records into blocks in RAM, and hands full blocks
+// to a background thread that writes them, so logging a change doesn't
+// cost a formatted write.
+
+
+// blocks are handed off when they reach inBlockBytes, or when their
+// oldest record is inFlushIntervalSeconds old
+void initMapChangeLog( double inFlushIntervalSeconds, int inBlockBytes );
+
+
+// writes out everything, and stops background thread
+void freeMapChangeLog();
+
+
+
+// closes current log, if any, and starts a new one at inPath
+// returns false on failure, leaving no log open
+char openMapChangeLog( const char *inPath, timeSec_t inStartTime );
+
+
+char isMapChangeLogOpen();
+
+
+void closeMapChangeLog();
+
+
+
+// ignored if no log open
+void logMapChangeRecord( MapChangeLogRecord *inRecord );
+
+
+// call periodically, to hand off blocks that have waited too long
+void stepMapChangeLog();
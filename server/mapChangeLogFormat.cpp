@@ -0,0 +1,242 @@
+#include "mapChangeLogFormat.h"
+
+#include "dbCommon.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+
+
+void resetMapChangeLogDeltaState( MapChangeLogDeltaState *inState ) {
+    inState->time = 0;
+    inState->x = 0;
+    inState->y = 0;
+    inState->responsiblePlayer = 0;
+    }
+
+
+
+void encodeMapChangeLogHeader( timeSec_t inStartTime,
+                               unsigned char *outHeader ) {
+    memcpy( outHeader, MAP_CHANGE_LOG_MAGIC, MAP_CHANGE_LOG_MAGIC_LENGTH );
+    timeToValue( inStartTime, &( outHeader[ MAP_CHANGE_LOG_MAGIC_LENGTH ] ) );
+    }
+
+
+
+char decodeMapChangeLogHeader( unsigned char *inHeader,
+                               timeSec_t *outStartTime ) {
+    if( memcmp( inHeader, MAP_CHANGE_LOG_MAGIC,
+                MAP_CHANGE_LOG_MAGIC_LENGTH ) != 0 ) {
+        return false;
+        }
+    *outStartTime = valueToTime( &( inHeader[ MAP_CHANGE_LOG_MAGIC_LENGTH ] ) );
+    return true;
+    }
+
+
+
+// 7 bits per byte, high bit set on all but the last byte
+static void pushVarint( uint64_t inV, SimpleVector<unsigned char> *outBytes ) {
+    while( inV >= 0x80 ) {
+        outBytes->push_back( (unsigned char)( inV | 0x80 ) );
+        inV >>= 7;
+        }
+    outBytes->push_back( (unsigned char)inV );
+    }
+
+
+
+// small negative values get small codes too
+static uint64_t zigZag( int64_t inV ) {
+    return ( (uint64_t)inV << 1 ) ^ (uint64_t)( inV >> 63 );
+    }
+
+
+static int64_t unZigZag( uint64_t inV ) {
+    return (int64_t)( inV >> 1 ) ^ -(int64_t)( inV & 1 );
+    }
+
+
+
+// returns false if varint runs past inEnd
+static char readVarint( unsigned char **ioPos, unsigned char *inEnd,
+                        uint64_t *outV ) {
+    uint64_t v = 0;
+    int shift = 0;
+
+    while( *ioPos < inEnd && shift < 64 ) {
+        unsigned char b = **ioPos;
+        (*ioPos)++;
+
+        v |= (uint64_t)( b & 0x7F ) << shift;
+
+        if( ! ( b & 0x80 ) ) {
+            *outV = v;
+            return true;
+            }
+        shift += 7;
+        }
+    return false;
+    }
+
+
+
+static char readZigZag( unsigned char **ioPos, unsigned char *inEnd,
+                        int64_t *outV ) {
+    uint64_t v;
+    if( ! readVarint( ioPos, inEnd, &v ) ) {
+        return false;
+        }
+    *outV = unZigZag( v );
+    return true;
+    }
+
+
+
+void encodeMapChangeLogRecord( MapChangeLogRecord *inRecord,
+                               MapChangeLogDeltaState *inState,
+                               SimpleVector<unsigned char> *outBytes ) {
+
+    pushVarint( zigZag( (int64_t)inRecord->time - inState->time ), outBytes );
+    pushVarint( zigZag( (int64_t)inRecord->x - inState->x ), outBytes );
+    pushVarint( zigZag( (int64_t)inRecord->y - inState->y ), outBytes );
+
+    // id, kind and floor flag share one varint
+    pushVarint( zigZag( inRecord->id ) << 3 |
+                inRecord->kind << 1 |
+                ( inRecord->floor ? 1 : 0 ), outBytes );
+
+    if( inRecord->kind != MAP_LOG_PLAIN ) {
+        pushVarint( zigZag( inRecord->dummyIndex ), outBytes );
+        }
+
+    pushVarint( zigZag( (int64_t)inRecord->responsiblePlayer -
+                        inState->responsiblePlayer ), outBytes );
+
+    inState->time = inRecord->time;
+    inState->x = inRecord->x;
+    inState->y = inRecord->y;
+    inState->responsiblePlayer = inRecord->responsiblePlayer;
+    }
+
+
+
+void encodeMapChangeLogBlock( int inNumRecords,
+                              SimpleVector<unsigned char> *inRecordBytes,
+                              SimpleVector<unsigned char> *outBlock ) {
+    SimpleVector<unsigned char> countBytes;
+    pushVarint( inNumRecords, &countBytes );
+
+    unsigned char lengthBytes[4];
+    intToValue( countBytes.size() + inRecordBytes->size(), lengthBytes );
+
+    outBlock->appendArray( lengthBytes, 4 );
+    outBlock->push_back_other( &countBytes );
+    outBlock->push_back_other( inRecordBytes );
+    }
+
+
+
+char decodeMapChangeLogBlock( unsigned char *inPayload, int inLength,
+                              SimpleVector<MapChangeLogRecord> *outRecords ) {
+    unsigned char *pos = inPayload;
+    unsigned char *end = &( inPayload[ inLength ] );
+
+    uint64_t numRecords;
+
+    if( ! readVarint( &pos, end, &numRecords ) ) {
+        return false;
+        }
+
+    MapChangeLogDeltaState state;
+    resetMapChangeLogDeltaState( &state );
+
+    for( uint64_t i=0; i<numRecords; i++ ) {
+        int64_t dTime, dX, dY, dPlayer;
+        uint64_t idCode;
+
+        if( ! readZigZag( &pos, end, &dTime ) ||
+            ! readZigZag( &pos, end, &dX ) ||
+            ! readZigZag( &pos, end, &dY ) ||
+            ! readVarint( &pos, end, &idCode ) ) {
+            return false;
+            }
+
+        MapChangeLogRecord r;
+
+        r.time = (int)( state.time + dTime );
+        r.x = (int)( state.x + dX );
+        r.y = (int)( state.y + dY );
+        r.floor = idCode & 1;
+        r.kind = ( idCode >> 1 ) & 3;
+        r.id = (int)unZigZag( idCode >> 3 );
+        r.dummyIndex = 0;
+
+        if( r.kind != MAP_LOG_PLAIN ) {
+            int64_t index;
+            if( ! readZigZag( &pos, end, &index ) ) {
+                return false;
+                }
+            r.dummyIndex = (int)index;
+            }
+
+        if( ! readZigZag( &pos, end, &dPlayer ) ) {
+            return false;
+            }
+        r.responsiblePlayer = (int)( state.responsiblePlayer + dPlayer );
+
+        state.time = r.time;
+        state.x = r.x;
+        state.y = r.y;
+        state.responsiblePlayer = r.responsiblePlayer;
+
+        outRecords->push_back( r );
+        }
+
+    return pos == end;
+    }
+
+
+
+void formatMapChangeLogRecord( MapChangeLogRecord *inRecord, char *outLine ) {
+    const char *extraFlag = "";
+
+    if( inRecord->floor ) {
+        extraFlag = "f";
+        }
+
+    char timeString[20];
+
+    // same as %.2f of time in seconds, without float rounding
+    sprintf( timeString, "%d.%02d",
+             inRecord->time / 100, inRecord->time % 100 );
+
+    if( inRecord->kind == MAP_LOG_USE_DUMMY ) {
+        sprintf( outLine, "%s %d %d %s%du%d %d\n",
+                 timeString,
+                 inRecord->x, inRecord->y,
+                 extraFlag,
+                 inRecord->id,
+                 inRecord->dummyIndex,
+                 inRecord->responsiblePlayer );
+        }
+    else if( inRecord->kind == MAP_LOG_VARIABLE_DUMMY ) {
+        sprintf( outLine, "%s %d %d %s%dv%d %d\n",
+                 timeString,
+                 inRecord->x, inRecord->y,
+                 extraFlag,
+                 inRecord->id,
+                 inRecord->dummyIndex,
+                 inRecord->responsiblePlayer );
+        }
+    else {
+        sprintf( outLine, "%s %d %d %s%d %d\n",
+                 timeString,
+                 inRecord->x, inRecord->y,
+                 extraFlag,
+                 inRecord->id,
+                 inRecord->responsiblePlayer );
+        }
+    }
@@ -0,0 +1,92 @@
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+// Binary map change log, written by map.cpp and read by mapChangeLogTool.
+//
+// File is a header (MAP_CHANGE_LOG_MAGIC, then start time as an 8-byte
+// timeSec_t) followed by blocks.
+//
+// Each block is a 4-byte payload length, then the payload:  varint record
+// count, then the records.
+// Records store time, x, y and responsible player as zig-zag varint deltas
+// from the record before, starting from 0 in each block, so any block can
+// be decoded on its own.
+//
+// Times are hundredths of a second since the log's start time, which is
+// the precision of the old text log.
+
+
+#define MAP_CHANGE_LOG_MAGIC "OHOLMCL1"
+#define MAP_CHANGE_LOG_MAGIC_LENGTH 8
+
+#define MAP_CHANGE_LOG_HEADER_LENGTH 16
+
+
+// kind of id logged
+#define MAP_LOG_PLAIN 0
+#define MAP_LOG_USE_DUMMY 1
+#define MAP_LOG_VARIABLE_DUMMY 2
+
+
+typedef struct MapChangeLogRecord {
+        // hundredths of a second since start time
+        int time;
+        int x, y;
+        char floor;
+        // one of the kinds above
+        char kind;
+        // dummy parent for the dummy kinds
+        int id;
+        int dummyIndex;
+        int responsiblePlayer;
+    } MapChangeLogRecord;
+
+
+
+// state carried from one record to the next while encoding or decoding
+// a block
+typedef struct MapChangeLogDeltaState {
+        int time;
+        int x, y;
+        int responsiblePlayer;
+    } MapChangeLogDeltaState;
+
+
+void resetMapChangeLogDeltaState( MapChangeLogDeltaState *inState );
+
+
+
+// outHeader must have room for MAP_CHANGE_LOG_HEADER_LENGTH bytes
+void encodeMapChangeLogHeader( timeSec_t inStartTime,
+                               unsigned char *outHeader );
+
+// returns false if inHeader isn't a map change log header
+char decodeMapChangeLogHeader( unsigned char *inHeader,
+                               timeSec_t *outStartTime );
+
+
+
+void encodeMapChangeLogRecord( MapChangeLogRecord *inRecord,
+                               MapChangeLogDeltaState *inState,
+                               SimpleVector<unsigned char> *outBytes );
+
+
+// wraps inNumRecords encoded records in a block, with its length and
+// record count, ready to write to the file
+void encodeMapChangeLogBlock( int inNumRecords,
+                              SimpleVector<unsigned char> *inRecordBytes,
+                              SimpleVector<unsigned char> *outBlock );
+
+
+// decodes a block's payload (after its 4-byte length)
+// returns false if payload is corrupt, leaving records decoded before
+// the corruption in outRecords
+char decodeMapChangeLogBlock( unsigned char *inPayload, int inLength,
+                              SimpleVector<MapChangeLogRecord> *outRecords );
+
+
+
+// formats record as a line of the old text log, including newline
+// outLine must have room for 100 chars
+void formatMapChangeLogRecord( MapChangeLogRecord *inRecord, char *outLine );
@@ -0,0 +1,464 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+
+#include "minorGems/util/SimpleVector.h"
+
+#include "mapChangeLogFormat.h"
+#include "dbCommon.h"
+
+
+// index covers square regions of this many cells
+#define INDEX_REGION_SIZE 64
+
+
+
+void usage() {
+    printf( "Usage:\n\n" );
+    printf( "mapChangeLogTool text log.bin [out.txt]\n" );
+    printf( "mapChangeLogTool index log.bin\n" );
+    printf( "mapChangeLogTool query log.bin x y startTime endTime\n\n" );
+
+    printf( "text converts a binary map change log to the old text format,\n"
+            "written next to it as .txt unless out.txt given ('-' for "
+            "stdout).\n\n" );
+    printf( "index writes log.bin.idx, listing which blocks of the log touch "
+            "each %dx%d\n"
+            "region of the map, and when.\n\n",
+            INDEX_REGION_SIZE, INDEX_REGION_SIZE );
+    printf( "query prints changes at x,y between two Unix times, in the text "
+            "format,\n"
+            "building or refreshing the index first if needed.\n\n" );
+
+    printf( "Example:\n" );
+    printf( "mapChangeLogTool query 1700000000time_mapLog.bin 10 -25 "
+            "1700003600 1700007200\n\n" );
+    exit( 1 );
+    }
+
+
+
+typedef struct LogBlock {
+        // of length, from start of file
+        long offset;
+        SimpleVector<MapChangeLogRecord> records;
+    } LogBlock;
+
+
+
+static FILE *openLog( const char *inPath, timeSec_t *outStartTime ) {
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        printf( "Failed to open %s\n", inPath );
+        exit( 1 );
+        }
+
+    unsigned char header[ MAP_CHANGE_LOG_HEADER_LENGTH ];
+
+    if( fread( header, 1, MAP_CHANGE_LOG_HEADER_LENGTH, f ) !=
+        MAP_CHANGE_LOG_HEADER_LENGTH ||
+        ! decodeMapChangeLogHeader( header, outStartTime ) ) {
+
+        printf( "%s is not a binary map change log\n", inPath );
+        exit( 1 );
+        }
+    return f;
+    }
+
+
+
+// reads block at current position in inFile
+// returns false at end of file, or if last block was cut short
+static char readBlock( FILE *inFile, LogBlock *outBlock ) {
+    outBlock->offset = ftell( inFile );
+    outBlock->records.deleteAll();
+
+    unsigned char lengthBytes[4];
+
+    if( fread( lengthBytes, 1, 4, inFile ) != 4 ) {
+        return false;
+        }
+
+    int length = valueToInt( lengthBytes );
+
+    if( length <= 0 ) {
+        printf( "Bad block length %d at offset %ld\n",
+                length, outBlock->offset );
+        return false;
+        }
+
+    unsigned char *payload = new unsigned char[ length ];
+
+    if( (int)fread( payload, 1, length, inFile ) != length ) {
+        // server died mid-write
+        printf( "Block at offset %ld cut short\n", outBlock->offset );
+        delete [] payload;
+        return false;
+        }
+
+    if( ! decodeMapChangeLogBlock( payload, length, &( outBlock->records ) ) ) {
+        printf( "Block at offset %ld corrupt, kept %d records from it\n",
+                outBlock->offset, outBlock->records.size() );
+        }
+
+    delete [] payload;
+    return true;
+    }
+
+
+
+static void convertToText( const char *inPath, const char *inOutPath ) {
+    timeSec_t startTime;
+    FILE *f = openLog( inPath, &startTime );
+
+    FILE *out;
+    char *outPath = NULL;
+
+    if( inOutPath != NULL && strcmp( inOutPath, "-" ) == 0 ) {
+        out = stdout;
+        }
+    else {
+        if( inOutPath != NULL ) {
+            outPath = new char[ strlen( inOutPath ) + 1 ];
+            strcpy( outPath, inOutPath );
+            }
+        else {
+            outPath = new char[ strlen( inPath ) + 5 ];
+            strcpy( outPath, inPath );
+
+            char *ext = strrchr( outPath, '.' );
+            if( ext != NULL && strcmp( ext, ".bin" ) == 0 ) {
+                *ext = '\0';
+                }
+            strcat( outPath, ".txt" );
+            }
+
+        out = fopen( outPath, "w" );
+
+        if( out == NULL ) {
+            printf( "Failed to open %s for writing\n", outPath );
+            exit( 1 );
+            }
+        }
+
+    fprintf( out, "startTime: %.2f\n", startTime );
+
+    LogBlock block;
+    int numRecords = 0;
+    char line[100];
+
+    while( readBlock( f, &block ) ) {
+        for( int i=0; i<block.records.size(); i++ ) {
+            formatMapChangeLogRecord( block.records.getElement( i ), line );
+            fputs( line, out );
+            }
+        numRecords += block.records.size();
+        }
+
+    fclose( f );
+
+    if( out != stdout ) {
+        fclose( out );
+        printf( "Wrote %d records to %s\n", numRecords, outPath );
+        delete [] outPath;
+        }
+    }
+
+
+
+typedef struct IndexEntry {
+        int regionX, regionY;
+        long blockOffset;
+        int firstTime, lastTime;
+    } IndexEntry;
+
+
+
+static int compareEntries( const void *inA, const void *inB ) {
+    const IndexEntry *a = (const IndexEntry*)inA;
+    const IndexEntry *b = (const IndexEntry*)inB;
+
+    if( a->regionX != b->regionX ) {
+        return ( a->regionX < b->regionX ) ? -1 : 1;
+        }
+    if( a->regionY != b->regionY ) {
+        return ( a->regionY < b->regionY ) ? -1 : 1;
+        }
+    if( a->blockOffset != b->blockOffset ) {
+        return ( a->blockOffset < b->blockOffset ) ? -1 : 1;
+        }
+    return 0;
+    }
+
+
+
+// rounds down for negative coordinates too
+static int toRegion( int inV ) {
+    if( inV < 0 ) {
+        return - ( ( - inV - 1 ) / INDEX_REGION_SIZE ) - 1;
+        }
+    return inV / INDEX_REGION_SIZE;
+    }
+
+
+
+static long getFileLength( const char *inPath ) {
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        return -1;
+        }
+    fseek( f, 0, SEEK_END );
+    long length = ftell( f );
+    fclose( f );
+
+    return length;
+    }
+
+
+
+static char *getIndexPath( const char *inPath ) {
+    char *indexPath = new char[ strlen( inPath ) + 5 ];
+    sprintf( indexPath, "%s.idx", inPath );
+    return indexPath;
+    }
+
+
+
+static void buildIndex( const char *inPath, char inPrintSummary = true ) {
+    timeSec_t startTime;
+    FILE *f = openLog( inPath, &startTime );
+
+    SimpleVector<IndexEntry> entries;
+
+    LogBlock block;
+    long coveredLength = ftell( f );
+
+    while( readBlock( f, &block ) ) {
+        coveredLength = ftell( f );
+
+        int numRecords = block.records.size();
+
+        if( numRecords == 0 ) {
+            continue;
+            }
+
+        // one entry per record, then sort and merge, leaving one entry
+        // per region touched by this block
+        IndexEntry *blockEntries = new IndexEntry[ numRecords ];
+
+        for( int i=0; i<numRecords; i++ ) {
+            MapChangeLogRecord *r = block.records.getElement( i );
+
+            IndexEntry entry = { toRegion( r->x ), toRegion( r->y ),
+                                 block.offset, r->time, r->time };
+            blockEntries[i] = entry;
+            }
+
+        qsort( blockEntries, numRecords, sizeof( IndexEntry ),
+               compareEntries );
+
+        IndexEntry merged = blockEntries[0];
+
+        for( int i=1; i<numRecords; i++ ) {
+            IndexEntry *e = &( blockEntries[i] );
+
+            if( e->regionX == merged.regionX &&
+                e->regionY == merged.regionY ) {
+
+                if( e->firstTime < merged.firstTime ) {
+                    merged.firstTime = e->firstTime;
+                    }
+                if( e->lastTime > merged.lastTime ) {
+                    merged.lastTime = e->lastTime;
+                    }
+                }
+            else {
+                entries.push_back( merged );
+                merged = *e;
+                }
+            }
+        entries.push_back( merged );
+
+        delete [] blockEntries;
+        }
+    fclose( f );
+
+
+    IndexEntry *sorted = entries.getElementArray();
+
+    qsort( sorted, entries.size(), sizeof( IndexEntry ), compareEntries );
+
+    char *indexPath = getIndexPath( inPath );
+
+    FILE *out = fopen( indexPath, "w" );
+
+    if( out == NULL ) {
+        printf( "Failed to open %s for writing\n", indexPath );
+        exit( 1 );
+        }
+
+    fprintf( out, "mapChangeLogIndex %d %ld\n",
+             INDEX_REGION_SIZE, coveredLength );
+
+    for( int i=0; i<entries.size(); i++ ) {
+        fprintf( out, "%d %d %ld %d %d\n",
+                 sorted[i].regionX, sorted[i].regionY,
+                 sorted[i].blockOffset,
+                 sorted[i].firstTime, sorted[i].lastTime );
+        }
+    fclose( out );
+
+    if( inPrintSummary ) {
+        printf( "Indexed %d region entries in %s\n",
+                entries.size(), indexPath );
+        }
+
+    delete [] sorted;
+    delete [] indexPath;
+    }
+
+
+
+// returns false if index missing, from an older build, or doesn't cover
+// whole log
+static char readIndex( const char *inPath,
+                       SimpleVector<IndexEntry> *outEntries ) {
+    char *indexPath = getIndexPath( inPath );
+
+    FILE *f = fopen( indexPath, "r" );
+    delete [] indexPath;
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    int regionSize;
+    long coveredLength;
+
+    if( fscanf( f, "mapChangeLogIndex %d %ld",
+                &regionSize, &coveredLength ) != 2 ||
+        regionSize != INDEX_REGION_SIZE ||
+        coveredLength != getFileLength( inPath ) ) {
+        fclose( f );
+        return false;
+        }
+
+    IndexEntry entry;
+
+    while( fscanf( f, "%d %d %ld %d %d",
+                   &entry.regionX, &entry.regionY,
+                   &entry.blockOffset,
+                   &entry.firstTime, &entry.lastTime ) == 5 ) {
+        outEntries->push_back( entry );
+        }
+    fclose( f );
+
+    return true;
+    }
+
+
+
+static void query( const char *inPath, int inX, int inY,
+                   double inStartTime, double inEndTime ) {
+    SimpleVector<IndexEntry> entries;
+
+    if( ! readIndex( inPath, &entries ) ) {
+        buildIndex( inPath, false );
+
+        entries.deleteAll();
+        readIndex( inPath, &entries );
+        }
+
+    timeSec_t logStartTime;
+    FILE *f = openLog( inPath, &logStartTime );
+
+    // to log's hundredths of a second
+    double t1 = floor( ( inStartTime - logStartTime ) * 100 );
+    double t2 = ceil( ( inEndTime - logStartTime ) * 100 );
+
+    int rx = toRegion( inX );
+    int ry = toRegion( inY );
+
+    // output is a valid text log
+    printf( "startTime: %.2f\n", logStartTime );
+
+    LogBlock block;
+    int numBlocks = 0;
+    int numFound = 0;
+    char line[100];
+
+    // entries for one region are sorted by block offset
+    for( int i=0; i<entries.size(); i++ ) {
+        IndexEntry *e = entries.getElement( i );
+
+        if( e->regionX != rx || e->regionY != ry ||
+            e->lastTime < t1 || e->firstTime > t2 ) {
+            continue;
+            }
+
+        fseek( f, e->blockOffset, SEEK_SET );
+
+        if( ! readBlock( f, &block ) ) {
+            continue;
+            }
+        numBlocks++;
+
+        for( int r=0; r<block.records.size(); r++ ) {
+            MapChangeLogRecord *rec = block.records.getElement( r );
+
+            if( rec->x == inX && rec->y == inY &&
+                rec->time >= t1 && rec->time <= t2 ) {
+
+                formatMapChangeLogRecord( rec, line );
+                fputs( line, stdout );
+                numFound++;
+                }
+            }
+        }
+    fclose( f );
+
+    fprintf( stderr, "%d changes found in %d blocks\n",
+             numFound, numBlocks );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs < 3 ) {
+        usage();
+        }
+
+    const char *command = inArgs[1];
+    const char *path = inArgs[2];
+
+    if( strcmp( command, "text" ) == 0 &&
+        ( inNumArgs == 3 || inNumArgs == 4 ) ) {
+
+        convertToText( path, ( inNumArgs == 4 ) ? inArgs[3] : NULL );
+        }
+    else if( strcmp( command, "index" ) == 0 && inNumArgs == 3 ) {
+        buildIndex( path );
+        }
+    else if( strcmp( command, "query" ) == 0 && inNumArgs == 7 ) {
+        int x, y;
+        double t1, t2;
+
+        if( sscanf( inArgs[3], "%d", &x ) != 1 ||
+            sscanf( inArgs[4], "%d", &y ) != 1 ||
+            sscanf( inArgs[5], "%lf", &t1 ) != 1 ||
+            sscanf( inArgs[6], "%lf", &t2 ) != 1 ) {
+            usage();
+            }
+        query( path, x, y, t1, t2 );
+        }
+    else {
+        usage();
+        }
+
+    return 0;
+    }
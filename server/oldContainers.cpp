@@ -0,0 +1,185 @@
+#include "lineardb3.h"
+#include "oldContainers.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "minorGems/util/SimpleVector.h"
+
+#include "dbCommon.h"
+#include "tileContents.h"
+
+
+// old map.db and mapTime.db slot layout, from before contents.db
+#define NUM_CONT_SLOT 2
+#define FIRST_CONT_SLOT 3
+
+
+// chunk number of marker record, never used by a real tile
+#define CONVERTED_MARKER_CHUNK -1
+
+
+
+typedef struct OldContainer {
+        int x, y, b;
+        int num;
+    } OldContainer;
+
+
+
+static int compareContainers( const void *inA, const void *inB ) {
+    const OldContainer *a = (const OldContainer*)inA;
+    const OldContainer *b = (const OldContainer*)inB;
+
+    if( a->x != b->x ) {
+        return ( a->x < b->x ) ? -1 : 1;
+        }
+    if( a->y != b->y ) {
+        return ( a->y < b->y ) ? -1 : 1;
+        }
+    if( a->b != b->b ) {
+        return ( a->b < b->b ) ? -1 : 1;
+        }
+    return 0;
+    }
+
+
+
+char isContentsDBConverted( LINEARDB3 *inContDB ) {
+    unsigned char key[ CONTENTS_KEY_SIZE ];
+    unsigned char value[ CONTENTS_CHUNK_SIZE ];
+
+    contentsChunkToKey( 0, 0, CONVERTED_MARKER_CHUNK, key );
+
+    return ( LINEARDB3_get( inContDB, key, value ) == 0 );
+    }
+
+
+
+int convertOldContainers( LINEARDB3 *inMapDB, LINEARDB3 *inTimeDB,
+                          LINEARDB3 *inContDB, int *outNumSkipped ) {
+
+    SimpleVector<OldContainer> containers;
+
+    unsigned char key[16];
+    unsigned char value[8];
+
+    LINEARDB3_Iterator dbi;
+
+    LINEARDB3_Iterator_init( inMapDB, &dbi );
+
+    while( LINEARDB3_Iterator_next( &dbi, key, value ) > 0 ) {
+        int s = valueToInt( &( key[8] ) );
+
+        if( s == NUM_CONT_SLOT ) {
+            int num = valueToInt( value );
+
+            if( num > 0 ) {
+                OldContainer c = { valueToInt( key ),
+                                   valueToInt( &( key[4] ) ),
+                                   valueToInt( &( key[12] ) ),
+                                   num };
+                containers.push_back( c );
+                }
+            }
+        }
+
+    OldContainer *sorted = containers.getElementArray();
+
+    qsort( sorted, containers.size(), sizeof( OldContainer ),
+           compareContainers );
+
+
+    unsigned char contKey[ CONTENTS_KEY_SIZE ];
+    unsigned char contValue[ CONTENTS_CHUNK_SIZE ];
+
+    int numMoved = 0;
+    *outNumSkipped = 0;
+
+    int i = 0;
+    while( i < containers.size() ) {
+        int x = sorted[i].x;
+        int y = sorted[i].y;
+
+        int tileStart = i;
+
+        while( i < containers.size() &&
+               sorted[i].x == x && sorted[i].y == y ) {
+            i++;
+            }
+
+        contentsChunkToKey( x, y, 0, contKey );
+
+        if( LINEARDB3_get( inContDB, contKey, contValue ) == 0 ) {
+            // already has a newer record, or moved before an interruption
+            (*outNumSkipped)++;
+            continue;
+            }
+
+        TileContents t;
+
+        for( int k=tileStart; k<i; k++ ) {
+            int b = sorted[k].b;
+            int num = sorted[k].num;
+
+            if( b < 0 ) {
+                continue;
+                }
+
+            ContainerContents *c = getContainerContents( &t, b );
+
+            for( int s=0; s<num; s++ ) {
+                intQuadToKey( x, y, FIRST_CONT_SLOT + s, b, key );
+
+                if( LINEARDB3_get( inMapDB, key, value ) != 0 ) {
+                    continue;
+                    }
+
+                int id = valueToInt( value );
+
+                if( id == 0 ) {
+                    // empty slots are dropped by server when read
+                    continue;
+                    }
+
+                // decay slots came after container slots
+                timeSec_t eta = 0;
+
+                intQuadToKey( x, y, FIRST_CONT_SLOT + num + s, b, key );
+
+                if( LINEARDB3_get( inTimeDB, key, value ) == 0 ) {
+                    eta = valueToTime( value );
+                    }
+
+                c->ids.push_back( id );
+                c->etas.push_back( eta );
+                }
+            }
+
+        int numChunks;
+        unsigned char *chunks = packTileContents( &t, &numChunks );
+
+        // chunk 0 last, so an interrupted tile is moved again next time
+        for( int c=numChunks-1; c>=0; c-- ) {
+            contentsChunkToKey( x, y, c, contKey );
+            LINEARDB3_put( inContDB, contKey,
+                           &( chunks[ c * CONTENTS_CHUNK_SIZE ] ) );
+            }
+        delete [] chunks;
+
+        numMoved++;
+        }
+
+    delete [] sorted;
+
+
+    // tiles must be on disk before the marker that says they are there
+    LINEARDB3_syncToDisk( inContDB );
+
+    memset( contValue, 0, CONTENTS_CHUNK_SIZE );
+    contentsChunkToKey( 0, 0, CONVERTED_MARKER_CHUNK, contKey );
+
+    LINEARDB3_put( inContDB, contKey, contValue );
+
+    return numMoved;
+    }
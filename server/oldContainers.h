@@ -0,0 +1,23 @@
+// Moving containers from the old map.db / mapTime.db slots into
+// contents.db, shared by the server (on startup) and dbConvert4.
+//
+// lineardb3.h must be included first.
+
+
+// true if contents.db has been marked as holding everything that was
+// in the old container slots
+char isContentsDBConverted( LINEARDB3 *inContDB );
+
+
+// moves each tile's old container slots into one contents.db record
+// tiles that already have a contents record keep it, because it was
+// written after the old slots
+// the old slots are left in map.db and mapTime.db, where they are ignored
+//
+// safe to run again if interrupted, and marks contents.db as converted
+// when done
+//
+// returns number of tiles moved, and sets outNumSkipped to the number
+// of tiles that already had a contents record
+int convertOldContainers( LINEARDB3 *inMapDB, LINEARDB3 *inTimeDB,
+                          LINEARDB3 *inContDB, int *outNumSkipped );
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#include "backupSnapshot.h"
+
+
+void usage() {
+    printf( "Usage:\n" );
+    printf( "restoreBackup snapshot_file output_db_file\n\n" );
+    
+    printf( "Example:\n" );
+    printf( "restoreBackup backups/map_2019_03_01__08_00_02.snap map.db\n\n" );
+
+    printf( "Earlier snapshots that a diff snapshot depends on must be in\n"
+            "the same folder as snapshot_file.\n\n" );
+    
+    exit( 1 );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+    
+    if( inNumArgs != 3 ) {
+        usage();
+        }
+
+    char *snapshotFileName = inArgs[1];
+    char *outFileName = inArgs[2];
+    
+    if( ! restoreDBSnapshot( snapshotFileName, outFileName ) ) {
+        printf( "Failed to restore %s into %s\n", 
+                snapshotFileName, outFileName );
+        return 1;
+        }
+    
+    printf( "Restored %s into %s\n", snapshotFileName, outFileName );
+    
+    return 0;
+    }
@@ -11,7 +11,6 @@
 #include "minorGems/util/SettingsManager.h"
 #include "minorGems/util/SimpleVector.h"
 #include "minorGems/network/SocketServer.h"
-#include "minorGems/network/SocketPoll.h"
 #include "minorGems/network/web/WebRequest.h"
 #include "minorGems/network/web/URLUtils.h"
 
@@ -37,6 +36,7 @@
 #include "../gameSource/animationBank.h"
 #include "../gameSource/categoryBank.h"
 #include "../commonSource/sayLimit.h"
+#include "../commonSource/messageBuffer.h"
 
 #include "lifeLog.h"
 #include "foodLog.h"
@@ -59,6 +59,11 @@
 #include "specialBiomes.h"
 #include "cravings.h"
 #include "offspringTracker.h"
+#include "PositionBucketIndex.h"
+#include "PlayerOutputQueue.h"
+#include "socketEvents.h"
+#include "HashTable.h"
+#include "settingsCache.h"
 
 
 #include "minorGems/util/random/JenkinsRandomSource.h"
@@ -73,6 +78,9 @@
 
 static FILE *familyDataLogFile = NULL;
 
+// getTrans lookups, if recordTransLookups is set
+static FILE *transLookupFile = NULL;
+
 
 static JenkinsRandomSource randSource;
 
@@ -619,7 +627,7 @@ typedef struct PastLifeStats {
 // for incoming socket connections that are still in the login process
 typedef struct FreshConnection {
         Socket *sock;
-        SimpleVector<char> *sockBuffer;
+        MessageBuffer *sockBuffer;
 
         unsigned int sequenceNumber;
         char *sequenceNumberString;
@@ -824,6 +832,9 @@ typedef struct LiveObject {
         int lastSentMapX;
         int lastSentMapY;
         
+        // CHUNK_FORMAT_ that client asked for with CFMT
+        int chunkFormat;
+        
         // path dest for the last full path that we checked completely
         // for getting too close to player's known map chunk
         GridPos mapChunkPathCheckedDest;
@@ -901,8 +912,11 @@ typedef struct LiveObject {
         
 
         Socket *sock;
-        SimpleVector<char> *sockBuffer;
+        MessageBuffer *sockBuffer;
         
+        // messages waiting to be written to sock
+        PlayerOutputQueue *outputQueue;
+
         // indicates that some messages were sent to this player this 
         // frame, and they need a FRAME terminator message
         char gotPartOfThisFrame;
@@ -1055,6 +1069,9 @@ typedef struct LiveObject {
 
         timeSec_t lastRegionLookTime;
         
+        // center of region last looked at, full or partial
+        GridPos lastRegionLookPos;
+
         double playerCrossingCheckTime;
         
 
@@ -1121,6 +1138,33 @@ SimpleVector<LiveObject> players;
 SimpleVector<LiveObject> tutorialLoadingPlayers;
 
 
+// player id -> index in players, so getLiveObject doesn't need to scan
+// must be kept in sync everywhere players is added to or removed from
+static HashTable<int> playerIndexTable( 1024, -1 );
+
+// can be turned off to compare against old linear scan
+static char playerIndexTableOn = true;
+
+
+
+static void addToPlayerIndexTable( int inIndex ) {
+    playerIndexTable.insert( players.getElement( inIndex )->id, 0, 0, 0,
+                             inIndex );
+    }
+
+
+
+// call after any deletion from players, since deletion shifts
+// indices of everyone after the deleted player
+static void rebuildPlayerIndexTable() {
+    playerIndexTable.clear();
+    
+    for( int i=0; i<players.size(); i++ ) {
+        addToPlayerIndexTable( i );
+        }
+    }
+
+
 int getNumPlayers() {
     return players.size();
     }
@@ -1669,7 +1713,40 @@ static void addDeadlyMapSpot( GridPos inPos ) {
 
 
 
+// define to check every index table miss against a full scan
+//#define CHECK_PLAYER_INDEX_TABLE
+
+
 LiveObject *getLiveObject( int inID ) {
+    
+    if( playerIndexTableOn ) {
+        char found;
+        int i = playerIndexTable.lookup( inID, 0, 0, 0, &found );
+        
+        if( found && i < players.size() ) {
+            LiveObject *o = players.getElement( i );
+            
+            if( o->id == inID ) {
+                return o;
+                }
+            }
+        
+        // table is kept in sync, so a miss means no such player
+        // (dead parents, stale follow IDs, etc.), and costs nothing
+        
+        #ifdef CHECK_PLAYER_INDEX_TABLE
+        for( int j=0; j<players.size(); j++ ) {
+            if( players.getElement( j )->id == inID ) {
+                AppLog::errorF( "Player index table out of date for "
+                                "player %d", inID );
+                return players.getElement( j );
+                }
+            }
+        #endif
+        
+        return NULL;
+        }
+
     for( int i=0; i<players.size(); i++ ) {
         LiveObject *o = players.getElement( i );
         
@@ -2188,6 +2265,8 @@ void quitCleanup() {
         }
     tutorialLoadingPlayers.deleteAll();
     
+    rebuildPlayerIndexTable();
+    
 
 
     for( int i=0; i<players.size(); i++ ) {
@@ -2203,6 +2282,10 @@ void quitCleanup() {
             delete nextPlayer->sockBuffer;
             nextPlayer->sockBuffer = NULL;
             }
+        if( nextPlayer->outputQueue != NULL ) {
+            delete nextPlayer->outputQueue;
+            nextPlayer->outputQueue = NULL;
+            }
 
         delete nextPlayer->lineage;
 
@@ -2269,6 +2352,7 @@ void quitCleanup() {
         delete nextPlayer->babyIDs;        
         }
     players.deleteAll();
+    playerIndexTable.clear();
 
 
     for( int i=0; i<pastPlayers.size(); i++ ) {
@@ -2282,6 +2366,8 @@ void quitCleanup() {
 
     freeLineageLimit();
     
+    freeBackup();
+
     freePlayerStats();
     freeLineageLog();
     
@@ -2311,9 +2397,17 @@ void quitCleanup() {
     
     freeOffspringTracker();
     
+    freeSettingsCache();
+    
 
     freeMap();
 
+    if( transLookupFile != NULL ) {
+        setTransLookupRecordFile( NULL );
+        fclose( transLookupFile );
+        transLookupFile = NULL;
+        }
+
     freeTransBank();
     freeCategoryBank();
     freeObjectBank();
@@ -2525,11 +2619,16 @@ int numConnections = 0;
 
 // reads all waiting data from socket and stores it in buffer
 // returns true if socket still good, false on error
-char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
+char readSocketFull( Socket *inSock, MessageBuffer *inBuffer ) {
 
-    char buffer[512];
+    if( ! socketMayHaveData( inSock ) ) {
+        // no new bytes since we last read it dry
+        return true;
+        }
+
+    char buffer[16384];
     
-    int numRead = inSock->receive( (unsigned char*)buffer, 512, 0 );
+    int numRead = inSock->receive( (unsigned char*)buffer, 16384, 0 );
     
     if( numRead == -1 ) {
 
@@ -2538,8 +2637,7 @@ char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
             // probably some kind of heap corruption.
 
             // save a bug report
-            int allow = 
-                SettingsManager::getIntSetting( "allowBugReports", 0 );
+            int allow = cachedSettings.allowBugReports;
 
             if( allow ) {
                 char *bugName = 
@@ -2564,9 +2662,15 @@ char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
         }
     
     while( numRead > 0 ) {
-        inBuffer->appendArray( buffer, numRead );
+        inBuffer->append( (unsigned char*)buffer, numRead );
 
-        numRead = inSock->receive( (unsigned char*)buffer, 512, 0 );
+        numRead = inSock->receive( (unsigned char*)buffer, 16384, 0 );
+        }
+
+    if( numRead == -2 ) {
+        // would block
+        // (after an error, leave it marked, so next read reports it)
+        socketDrained( inSock );
         }
 
     return true;
@@ -2575,12 +2679,12 @@ char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
 
 
 // NULL if there's no full message available
-char *getNextClientMessage( SimpleVector<char> *inBuffer ) {
+char *getNextClientMessage( MessageBuffer *inBuffer ) {
     // find first terminal character #
 
-    int index = inBuffer->getElementIndex( '#' );
-        
-    if( index == -1 ) {
+    MessageView view;
+    
+    if( ! inBuffer->findMessage( &view ) ) {
 
         if( inBuffer->size() > 200 ) {
             // 200 characters with no message terminator?
@@ -2597,32 +2701,20 @@ char *getNextClientMessage( SimpleVector<char> *inBuffer ) {
         return NULL;
         }
     
-    if( index > 1 && 
-        inBuffer->getElementDirect( 0 ) == 'K' &&
-        inBuffer->getElementDirect( 1 ) == 'A' ) {
+    if( view.length > 1 && 
+        view.start[0] == 'K' &&
+        view.start[1] == 'A' ) {
         
         // a KA (keep alive) message
         // short-cicuit the processing here
         
-        inBuffer->deleteStartElements( index + 1 );
+        inBuffer->consume( view.length + 1 );
         return NULL;
         }
     
-        
-
-    char *message = new char[ index + 1 ];
     
-    // all but terminal character
-    for( int i=0; i<index; i++ ) {
-        message[i] = inBuffer->getElementDirect( i );
-        }
-    
-    // delete from buffer, including terminal character
-    inBuffer->deleteStartElements( index + 1 );
-    
-    message[ index ] = '\0';
-    
-    return message;
+    // removes message and terminal character from buffer
+    return inBuffer->takeMessage( &view );
     }
 
 
@@ -2661,6 +2753,7 @@ typedef enum messageType {
     LEAD,
     UNFOL,
     FLIP,
+    CFMT,
     UNKNOWN
     } messageType;
 
@@ -3089,6 +3182,16 @@ ClientMessage parseMessage( LiveObject *inPlayer, char *inMessage ) {
     else if( strcmp( nameBuffer, "FLIP" ) == 0 ) {
         m.type = FLIP;
         }
+    else if( strcmp( nameBuffer, "CFMT" ) == 0 ) {
+        m.type = CFMT;
+        numRead = sscanf( inMessage, 
+                          "%99s %d %d %d", 
+                          nameBuffer, &( m.x ), &( m.y ), &( m.i ) );
+        
+        if( numRead != 4 ) {
+            m.type = UNKNOWN;
+            }
+        }
     else {
         m.type = UNKNOWN;
         }
@@ -3285,8 +3388,8 @@ static void restockPostWindowFamilies() {
     familyCountsAfterEveWindow.deleteAll();
     nextBabyFamilyIndex = 0;
     
-    int barrierRadius = SettingsManager::getIntSetting( "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
 
 
     if( postWindowFamilyLogFile != NULL ) {
@@ -3367,9 +3470,8 @@ static void restockPostWindowFamilies() {
 
 static void logFamilyCounts() {
     if( postWindowFamilyLogFile != NULL ) {
-        int barrierRadius = 
-            SettingsManager::getIntSetting( "barrierRadius", 250 );
-        int barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+        int barrierRadius = cachedSettings.barrierRadius;
+        int barrierOn = cachedSettings.barrierOn;
         
 
         fprintf( postWindowFamilyLogFile, "%.2f ", Time::getCurrentTime() );
@@ -3967,6 +4069,81 @@ static double periodicStepTime = 0.25;
 static double lastPeriodicStepTime = 0;
 
 
+// main loop timing, for benchmarking
+// time spent waiting for sockets is not counted
+static char logMainLoopTiming = false;
+static double mainLoopTimingLogInterval = 10;
+static double lastMainLoopTimingLogTime = 0;
+static int mainLoopTimingSteps = 0;
+static double mainLoopTimingTotal = 0;
+static double mainLoopTimingMax = 0;
+// every step's work time since last log, for percentiles
+static SimpleVector<double> mainLoopTimingSamples;
+
+
+static int compareDoubles( const void *inA, const void *inB ) {
+    double a = *( (double*)inA );
+    double b = *( (double*)inB );
+    
+    if( a < b ) {
+        return -1;
+        }
+    if( a > b ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+// inSorted must be non-empty
+static double getPercentile( SimpleVector<double> *inSorted, 
+                             double inFraction ) {
+    int i = (int)( inFraction * ( inSorted->size() - 1 ) );
+    return inSorted->getElementDirect( i );
+    }
+
+
+
+static void recordMainLoopStep( double inWorkSeconds ) {
+    if( ! logMainLoopTiming ) {
+        return;
+        }
+    
+    mainLoopTimingSteps++;
+    mainLoopTimingTotal += inWorkSeconds;
+    mainLoopTimingSamples.push_back( inWorkSeconds );
+    
+    if( inWorkSeconds > mainLoopTimingMax ) {
+        mainLoopTimingMax = inWorkSeconds;
+        }
+    
+    double curTime = Time::getCurrentTime();
+    
+    if( curTime - lastMainLoopTimingLogTime > mainLoopTimingLogInterval ) {
+        
+        qsort( mainLoopTimingSamples.getElement( 0 ),
+               mainLoopTimingSamples.size(), sizeof( double ),
+               compareDoubles );
+        
+        AppLog::infoF( "Main loop timing:  %d players, %d steps, "
+                       "ave %.3f ms, p50 %.3f ms, p99 %.3f ms, "
+                       "p99.9 %.3f ms, max %.3f ms",
+                       getNumPlayers(), mainLoopTimingSteps,
+                       1000 * mainLoopTimingTotal / mainLoopTimingSteps,
+                       1000 * getPercentile( &mainLoopTimingSamples, 0.5 ),
+                       1000 * getPercentile( &mainLoopTimingSamples, 0.99 ),
+                       1000 * getPercentile( &mainLoopTimingSamples, 0.999 ),
+                       1000 * mainLoopTimingMax );
+        
+        lastMainLoopTimingLogTime = curTime;
+        mainLoopTimingSteps = 0;
+        mainLoopTimingTotal = 0;
+        mainLoopTimingMax = 0;
+        mainLoopTimingSamples.deleteAll();
+        }
+    }
+
+
 
 
 // recompute heat for fixed number of players per timestep
@@ -4812,7 +4989,6 @@ static int getMaxChunkDimension() {
     }
 
 
-static SocketPoll sockPoll;
 
 
 
@@ -4855,7 +5031,7 @@ static void setPlayerDisconnected( LiveObject *inPlayer,
     if( inPlayer->sock != NULL ) {
         // also, stop polling their socket, which will trigger constant
         // socket events from here on out, and cause us to busy-loop
-        sockPoll.removeSocket( inPlayer->sock );
+        removeEventSocket( inPlayer->sock );
 
         delete inPlayer->sock;
         inPlayer->sock = NULL;
@@ -4864,6 +5040,100 @@ static void setPlayerDisconnected( LiveObject *inPlayer,
         delete inPlayer->sockBuffer;
         inPlayer->sockBuffer = NULL;
         }
+    if( inPlayer->outputQueue != NULL ) {
+        delete inPlayer->outputQueue;
+        inPlayer->outputQueue = NULL;
+        }
+    }
+
+
+
+// queues a message for inPlayer, to be written to their socket by
+// flushPlayerOutputQueues at the end of this step
+//
+// returns inLength, or -1 if their queue is over outputQueueDisconnectKB
+// even after dropping stale updates (treat like a failed socket write)
+static int sendToPlayerQueue( LiveObject *inPlayer,
+                              unsigned char *inMessage, int inLength,
+                              QueuedUpdateKind inKind = QUEUED_OTHER,
+                              SimpleVector<int> *inUpdatedIDs = NULL ) {
+    
+    PlayerOutputQueue *q = inPlayer->outputQueue;
+    
+    if( q == NULL ) {
+        return -1;
+        }
+    
+    q->add( inMessage, inLength, inKind, inUpdatedIDs );
+    
+    int limit = cachedSettings.outputQueueDisconnectKB * 1024;
+    
+    if( q->getNumBytes() > limit ) {
+        q->dropStaleUpdates();
+        
+        if( q->getNumBytes() > limit ) {
+            AppLog::infoF( "Player %d has %d bytes waiting to be sent, "
+                           "over limit of %d KB",
+                           inPlayer->id, q->getNumBytes(),
+                           cachedSettings.outputQueueDisconnectKB );
+            return -1;
+            }
+        }
+    
+    return inLength;
+    }
+
+
+
+// writes as much of each player's queued output as their socket will
+// take without blocking
+static void flushPlayerOutputQueues() {
+    
+    int dropLimit = cachedSettings.outputQueueDropStaleKB * 1024;
+    
+    for( int i=0; i<players.size(); i++ ) {
+        LiveObject *o = players.getElement( i );
+        
+        if( o->sock == NULL || o->outputQueue == NULL ) {
+            continue;
+            }
+        
+        PlayerOutputQueue *q = o->outputQueue;
+        
+        if( q->getNumBytes() == 0 ) {
+            continue;
+            }
+        
+        if( q->getNumBytes() > dropLimit ) {
+            // client is falling behind
+            // position updates that are already out of date can go
+            int numDropped = q->dropStaleUpdates();
+            
+            if( numDropped > 0 ) {
+                AppLog::infoF( "Player %d falling behind, dropped %d bytes "
+                               "of stale PU/PM, %d bytes still waiting",
+                               o->id, numDropped, q->getNumBytes() );
+                }
+            }
+        
+        if( ! q->flush( o->sock ) ) {
+            setPlayerDisconnected( o, "Socket write failed" );
+            }
+        }
+    }
+
+
+
+static char anyPlayerOutputQueued() {
+    for( int i=0; i<players.size(); i++ ) {
+        LiveObject *o = players.getElement( i );
+        
+        if( o->sock != NULL && o->outputQueue != NULL &&
+            o->outputQueue->getNumBytes() > 0 ) {
+            return true;
+            }
+        }
+    return false;
     }
 
 
@@ -4897,9 +5167,8 @@ void sendGlobalMessage( char *inMessage,
                 minGlobalMessageSpacingSeconds ) {
                 
                 int numSent = 
-                    o->sock->send( (unsigned char*)fullMessage, 
-                                   len, 
-                                   false, false );
+                    sendToPlayerQueue( o, (unsigned char*)fullMessage, 
+                                       len );
                 
                 o->lastGlobalMessageTime = curTime;
                 
@@ -5107,6 +5376,8 @@ int sendMapChunkMessage( LiveObject *inO,
     
     int numSent = 0;
 
+    int chunkFormat = inO->chunkFormat;
+
     
 
     if( ! inO->firstMapSent ) {
@@ -5119,12 +5390,12 @@ int sendMapChunkMessage( LiveObject *inO,
                                                           chunkDimensionX,
                                                           chunkDimensionY,
                                                           inO->birthPos,
-                                                          &messageLength );
+                                                          &messageLength,
+                                                          chunkFormat );
                 
         numSent += 
-            inO->sock->send( mapChunkMessage, 
-                             messageLength, 
-                             false, false );
+            sendToPlayerQueue( inO, mapChunkMessage, 
+                               messageLength );
                 
         delete [] mapChunkMessage;
         }
@@ -5202,13 +5473,13 @@ int sendMapChunkMessage( LiveObject *inO,
                                                               horBarW,
                                                               horBarH,
                                                               inO->birthPos,
-                                                              &len );
+                                                              &len,
+                                                              chunkFormat );
             messageLength += len;
             
             numSent += 
-                inO->sock->send( mapChunkMessage, 
-                                 len, 
-                                 false, false );
+                sendToPlayerQueue( inO, mapChunkMessage, 
+                                   len );
             
             delete [] mapChunkMessage;
             }
@@ -5219,13 +5490,13 @@ int sendMapChunkMessage( LiveObject *inO,
                                                               vertBarW,
                                                               vertBarH,
                                                               inO->birthPos,
-                                                              &len );
+                                                              &len,
+                                                              chunkFormat );
             messageLength += len;
             
             numSent += 
-                inO->sock->send( mapChunkMessage, 
-                                 len, 
-                                 false, false );
+                sendToPlayerQueue( inO, mapChunkMessage, 
+                                   len );
             
             delete [] mapChunkMessage;
             }
@@ -5552,8 +5823,8 @@ char findDropSpot( LiveObject *inDroppingPlayer,
                    int inX, int inY, int inSourceX, int inSourceY, 
                    GridPos *outSpot ) {
 
-    int barrierRadius = SettingsManager::getIntSetting( "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
 
     int targetBiome = getMapBiome( inX, inY );
     int targetFloor = getMapFloor( inX, inY );
@@ -5757,8 +6028,8 @@ char findDropSpot( LiveObject *inDroppingPlayer,
 GridPos findClosestEmptyMapSpot( int inX, int inY, int inMaxPointsToCheck,
                                  char *outFound ) {
 
-    int barrierRadius = SettingsManager::getIntSetting( "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
 
 
     GridPos center = { inX, inY };
@@ -6984,6 +7255,30 @@ static char *getUpdateLineFromRecord(
 
 
 
+// returns the line that getUpdateLineFromRecord would give for
+// inRecord if it is the same for every receiver, or NULL if it
+// depends on the receiver
+static char *getSharedUpdateLine( UpdateRecord *inRecord ) {
+    if( ! inRecord->posUsed ) {
+        GridPos zeroPos = { 0, 0 };
+        return getUpdateLineFromRecord( inRecord, zeroPos, zeroPos );
+        }
+    return NULL;
+    }
+
+
+
+// the line that far-away receivers get for inRecord (with hidden 
+// coordinates), the same for every far-away receiver
+static char *getFarUpdateLine( UpdateRecord *inRecord ) {
+    return autoSprintf( inRecord->formatString,
+                        1977, 1977,
+                        1977, 1977,
+                        1977, 1977 );
+    }
+
+
+
 static SimpleVector<int> newEmotPlayerIDs;
 static SimpleVector<int> newEmotIndices;
 // 0 if no ttl specified
@@ -7627,11 +7922,8 @@ static int isPlayerCountable( LiveObject *p, int inLineageEveID = -1,
 // ONLY in that family
 static int countFertileMothers( int inLineageEveID = -1, int inRace = -1 ) {
     
-    int barrierRadius = 
-        SettingsManager::getIntSetting( 
-            "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( 
-        "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
     
     int c = 0;
     
@@ -7668,11 +7960,8 @@ static int countFertileMothers( int inLineageEveID = -1, int inRace = -1 ) {
 // ONLY in that family
 static int countGirls( int inLineageEveID = -1, int inRace = -1 ) {
     
-    int barrierRadius = 
-        SettingsManager::getIntSetting( 
-            "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( 
-        "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
     
     int c = 0;
     
@@ -7706,11 +7995,8 @@ static int countGirls( int inLineageEveID = -1, int inRace = -1 ) {
 
 static int countHelplessBabies() {
     
-    int barrierRadius = 
-        SettingsManager::getIntSetting( 
-            "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( 
-        "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
     
     int c = 0;
     
@@ -7746,11 +8032,8 @@ static int countHelplessBabies() {
 // always ignores tutorial and donkytown players
 static int countLivingPlayers() {
     
-    int barrierRadius = 
-        SettingsManager::getIntSetting( 
-            "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( 
-        "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
     
     int c = 0;
     
@@ -7811,11 +8094,8 @@ static int countNonHelpless( GridPos inPos, double inRadius,
 
 static int countFamilies() {
     
-    int barrierRadius = 
-        SettingsManager::getIntSetting( 
-            "barrierRadius", 250 );
-    int barrierOn = SettingsManager::getIntSetting( 
-        "barrierOn", 1 );
+    int barrierRadius = cachedSettings.barrierRadius;
+    int barrierOn = cachedSettings.barrierOn;
     
     SimpleVector<int> uniqueLines;
 
@@ -8276,13 +8556,161 @@ static char nextLogInTwin = false;
 static int firstTwinID = -1;
 
 
+
+// what the mother search needs to know about one fertile mother,
+// gathered once per login, so search passes don't redo the work
+typedef struct MotherCandidate {
+        LiveObject *player;
+        GridPos pos;
+
+        // on birth cooldown, or has too many living children
+        char onCooldown;
+
+        // has the forced offspring lineage in her lineage
+        char inForcedLineage;
+
+        // cursed babies only born to cursed mothers
+        // non-cursed babies never born to cursed mothers
+        char curseLevelMatches;
+    } MotherCandidate;
+
+
+typedef struct MotherSearch {
+        SimpleVector<MotherCandidate> candidates;
+
+        // baby's email, then tempTwinEmails
+        int numEmails;
+
+        // numEmails entries per candidate, -1 until looked up
+        // looked up only when a pass needs them, and then kept for
+        // later passes
+        SimpleVector<signed char> linePermitted;
+        SimpleVector<signed char> curseBlocked;
+    } MotherSearch;
+
+
+typedef struct MotherSearchPass {
+        char checkCooldown;
+        char checkLineageLimit;
+        char forceLineage;
+        char checkCurses;
+    } MotherSearchPass;
+
+
+#define MOTHER_OK 0
+#define MOTHER_ON_COOLDOWN 1
+#define MOTHER_LINEAGE_BLOCKED 2
+#define MOTHER_CURSE_BLOCKED 3
+#define MOTHER_CURSE_LEVEL_MISMATCH 4
+#define MOTHER_NEEDS_LINE_CHECK 5
+#define MOTHER_NEEDS_CURSE_CHECK 6
+
+
+
+// touches nothing but inSearch
+// returns one of the MOTHER_ codes above
+// for the NEEDS codes, outCheckIndex is set to the entry that needs
+// looking up before candidate can be judged
+static int evaluateMotherCandidate( MotherSearch *inSearch, int inCandidate,
+                                    MotherSearchPass *inPass,
+                                    int *outCheckIndex ) {
+    MotherCandidate *c = inSearch->candidates.getElement( inCandidate );
+
+    if( inPass->checkCooldown && c->onCooldown ) {
+        return MOTHER_ON_COOLDOWN;
+        }
+
+    int base = inCandidate * inSearch->numEmails;
+
+    signed char *line = inSearch->linePermitted.getElement( 0 );
+    signed char *curse = inSearch->curseBlocked.getElement( 0 );
+
+    int result = MOTHER_OK;
+
+    for( int s=0; s<inSearch->numEmails; s++ ) {
+        int i = base + s;
+
+        if( s == 0 && inPass->checkLineageLimit && inPass->forceLineage ) {
+            // baby is being forced to be born to their descendants,
+            // instead of normal lineage ban
+            if( ! c->inForcedLineage ) {
+                result = MOTHER_LINEAGE_BLOCKED;
+                break;
+                }
+            }
+        else if( inPass->checkLineageLimit ) {
+            if( line[i] == -1 ) {
+                *outCheckIndex = i;
+                result = MOTHER_NEEDS_LINE_CHECK;
+                break;
+                }
+            if( ! line[i] ) {
+                result = MOTHER_LINEAGE_BLOCKED;
+                break;
+                }
+            }
+
+        if( inPass->checkCurses ) {
+            if( curse[i] == -1 ) {
+                *outCheckIndex = i;
+                result = MOTHER_NEEDS_CURSE_CHECK;
+                break;
+                }
+            if( curse[i] ) {
+                result = MOTHER_CURSE_BLOCKED;
+                break;
+                }
+            }
+        }
+
+    if( result == MOTHER_OK && ! c->curseLevelMatches ) {
+        result = MOTHER_CURSE_LEVEL_MISMATCH;
+        }
+
+    return result;
+    }
+
+
+
+static void runMotherCheck( MotherSearch *inSearch, const char *inBabyEmail,
+                            int inCheckIndex, char inCurseCheck ) {
+    int s = inCheckIndex % inSearch->numEmails;
+
+    GridPos pos =
+        inSearch->candidates.getElement(
+            inCheckIndex / inSearch->numEmails )->pos;
+
+    const char *email = inBabyEmail;
+
+    if( s > 0 ) {
+        email = tempTwinEmails.getElementDirect( s - 1 );
+        }
+
+    if( ! inCurseCheck ) {
+        *( inSearch->linePermitted.getElement( inCheckIndex ) ) =
+            isLinePermitted( email, pos );
+        }
+    else if( s == 0 ) {
+        *( inSearch->curseBlocked.getElement( inCheckIndex ) ) =
+            isBirthLocationCurseBlocked( email, pos );
+        }
+    else {
+        // non-cached version for twin emails
+        // (otherwise, we interfere with caching done
+        //  for our email)
+        *( inSearch->curseBlocked.getElement( inCheckIndex ) ) =
+            isBirthLocationCurseBlockedNoCache( email, pos );
+        }
+    }
+
+
 // inAllowOrForceReconnect is 0 for forbidden reconnect, 1 to allow, 
 // 2 to require
 // returns ID of new player,
 // or -1 if this player reconnected to an existing ID
 int processLoggedInPlayer( int inAllowOrForceReconnect,
                            Socket *inSock,
-                           SimpleVector<char> *inSockBuffer,
+                           MessageBuffer *inSockBuffer,
                            char *inEmail,
                            int inTutorialNumber,
                            CurseStatus inCurseStatus,
@@ -8369,12 +8797,19 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
                 delete o->sockBuffer;
                 o->sockBuffer = NULL;
                 }
+            if( o->outputQueue != NULL ) {
+                delete o->outputQueue;
+                o->outputQueue = NULL;
+                }
             
             o->sock = inSock;
             o->sockBuffer = inSockBuffer;
+            o->outputQueue = new PlayerOutputQueue();
             
             // they are connecting again, need to send them everything again
             o->firstMapSent = false;
+            // new client may not know about MB, wait for CFMT again
+            o->chunkFormat = CHUNK_FORMAT_TEXT;
             o->firstMessageSent = false;
             o->inFlight = false;
 
@@ -8707,125 +9142,136 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
     clearOffspringLineageID( newObject.email );
     
 
-    for( int p=0; p<3; p++ ) {
+    // gather everything about fertile mothers that doesn't change between
+    // passes once, so each pass is cheap
+
+    // living children of each player, indexed like players
+    SimpleVector<int> livingChildren;
+    for( int i=0; i<numPlayers; i++ ) {
+        livingChildren.push_back( 0 );
+        }
     
-        for( int i=0; i<numPlayers; i++ ) {
-            LiveObject *player = players.getElement( i );
-            
-            if( player->error ) {
-                continue;
-                }
-            
-            if( player->isTutorial ) {
-                continue;
-                }
-            
-            if( player->vogMode ) {
-                continue;
-                }
+    for( int i=0; i<numPlayers; i++ ) {
+        LiveObject *o = players.getElement( i );
+        
+        if( o->error || o->parentID == -1 ) {
+            continue;
+            }
+        LiveObject *mother = getLiveObject( o->parentID );
+        
+        if( mother != NULL ) {
+            ( *( livingChildren.getElement( 
+                     mother - players.getElement( 0 ) ) ) ) ++;
+            }
+        }
+    
+    MotherSearch motherSearch;
+    motherSearch.numEmails = 1 + tempTwinEmails.size();
+    
+    for( int i=0; i<numPlayers; i++ ) {
+        LiveObject *player = players.getElement( i );
+        
+        if( player->error ) {
+            continue;
+            }
+        
+        if( player->isTutorial ) {
+            continue;
+            }
+        
+        if( player->vogMode ) {
+            continue;
+            }
 
-            GridPos motherPos = getPlayerPos( player );
-            int homeStatus = isBirthland( motherPos.x, motherPos.y,
-                                          player->lineageEveID,
-                                          player->displayID );
-            
-            if( homeStatus == -1 ||
-                ( homeStatus == 0 &&
-                  player->everHomesick ) ) {
-                // mother can't have babies here
-                continue;
-                }
-                
+        GridPos motherPos = getPlayerPos( player );
+        int homeStatus = isBirthland( motherPos.x, motherPos.y,
+                                      player->lineageEveID,
+                                      player->displayID );
+        
+        if( homeStatus == -1 ||
+            ( homeStatus == 0 &&
+              player->everHomesick ) ) {
+            // mother can't have babies here
+            continue;
+            }
             
-            if( player->lastSidsBabyEmail != NULL &&
-                strcmp( player->lastSidsBabyEmail,
-                        newObject.email ) == 0 ) {
-                // this baby JUST committed SIDS for this mother
-                // skip her
-                // (don't ever send SIDS baby to same mother twice in a row)
-                continue;
-                }
+        
+        if( player->lastSidsBabyEmail != NULL &&
+            strcmp( player->lastSidsBabyEmail,
+                    newObject.email ) == 0 ) {
+            // this baby JUST committed SIDS for this mother
+            // skip her
+            // (don't ever send SIDS baby to same mother twice in a row)
+            continue;
+            }
 
-            if( isFertileAge( player ) ) {
-                numOfAge ++;
-                
-                if( checkCooldown &&
-                    ( Time::timeSec() < player->birthCoolDown 
-                      ||
-                      countLivingChildren( player->id ) >= 
-                      maxLivingChildrenPerMother ) ) {    
-                    continue;
-                    }
-                
-                GridPos motherPos = getPlayerPos( player );
-                
-                if( checkLineageLimit &&
-                    forceOffspringLineageID != -1 ) {
-                    // we're trying to force this player to be born
-                    // to their descendants
-                    if( player->lineage->getElementIndex( 
-                            forceOffspringLineageID ) == -1 ) {
-                        // this possible mother is NOT
-                        // a descendant
-                        // skip
-                        continue;
-                        }
-                    }
-                // otherwise, respect normal lineage ban
-                else if( checkLineageLimit &&
-                    ! isLinePermitted( newObject.email, motherPos ) ) {
-                    // this line forbidden for new player
-                    continue;
-                    }
+        if( ! isFertileAge( player ) ) {
+            continue;
+            }
+        
+        MotherCandidate c;
+        c.player = player;
+        c.pos = motherPos;
+        
+        c.onCooldown = 
+            ( Time::timeSec() < player->birthCoolDown 
+              ||
+              livingChildren.getElementDirect( i ) >= 
+              maxLivingChildrenPerMother );
+        
+        c.inForcedLineage = 
+            ( forceOffspringLineageID != -1 &&
+              player->lineage->getElementIndex( 
+                  forceOffspringLineageID ) != -1 );
+        
+        c.curseLevelMatches =
+            ( inCurseStatus.curseLevel <= 0 && 
+              player->curseStatus.curseLevel <= 0 ) 
+            || 
+            ( inCurseStatus.curseLevel > 0 && 
+              player->curseStatus.curseLevel > 0 );
+        
+        motherSearch.candidates.push_back( c );
+        
+        for( int s=0; s<motherSearch.numEmails; s++ ) {
+            motherSearch.linePermitted.push_back( -1 );
+            motherSearch.curseBlocked.push_back( -1 );
+            }
+        }
 
-                if( usePersonalCurses &&
-                    isBirthLocationCurseBlocked( newObject.email, 
-                                                 motherPos ) ) {
-                    // this spot forbidden
-                    // because someone nearby cursed new player
-                    numBirthLocationsCurseBlocked++;
-                    continue;
-                    }
-            
-                // test any twins also
-                char twinBanned = false;
-                for( int s=0; s<tempTwinEmails.size(); s++ ) {
-                    if( checkLineageLimit &&
-                        ! isLinePermitted( tempTwinEmails.getElementDirect( s ),
-                                           motherPos ) ) {
-                        twinBanned = true;
-                        break;
-                        }
+    numOfAge = motherSearch.candidates.size();
+    
 
-                    if( usePersonalCurses &&
-                        // non-cached version for twin emails
-                        // (otherwise, we interfere with caching done
-                        //  for our email)
-                        isBirthLocationCurseBlockedNoCache( 
-                            tempTwinEmails.getElementDirect( s ), 
-                            motherPos ) ) {
-                        twinBanned = true;
-                        
-                        numBirthLocationsCurseBlocked++;
-                        
-                        break;
-                        }
-                    }
+    for( int p=0; p<3; p++ ) {
+    
+        MotherSearchPass pass = { checkCooldown, checkLineageLimit,
+                                  forceOffspringLineageID != -1,
+                                  (char)( usePersonalCurses != 0 ) };
+        
+        for( int i=0; i<motherSearch.candidates.size(); i++ ) {
+            int checkIndex;
+            
+            int status = evaluateMotherCandidate( &motherSearch, i, &pass,
+                                                  &checkIndex );
+            
+            while( status == MOTHER_NEEDS_LINE_CHECK ||
+                   status == MOTHER_NEEDS_CURSE_CHECK ) {
                 
-                if( twinBanned ) {
-                    continue;
-                    }
+                runMotherCheck( &motherSearch, newObject.email, checkIndex,
+                                status == MOTHER_NEEDS_CURSE_CHECK );
                 
+                status = evaluateMotherCandidate( &motherSearch, i, &pass,
+                                                  &checkIndex );
+                }
             
-                if( ( inCurseStatus.curseLevel <= 0 && 
-                      player->curseStatus.curseLevel <= 0 ) 
-                    || 
-                    ( inCurseStatus.curseLevel > 0 && 
-                      player->curseStatus.curseLevel > 0 ) ) {
-                    // cursed babies only born to cursed mothers
-                    // non-cursed babies never born to cursed mothers
-                    parentChoices.push_back( player );
-                    }
+            if( status == MOTHER_CURSE_BLOCKED ) {
+                // this spot forbidden
+                // because someone nearby cursed new player (or twin)
+                numBirthLocationsCurseBlocked++;
+                }
+            else if( status == MOTHER_OK ) {
+                parentChoices.push_back( 
+                    motherSearch.candidates.getElementDirect( i ).player );
                 }
             }
         
@@ -8849,7 +9295,6 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
             
             checkCooldown = false;
             numBirthLocationsCurseBlocked = 0;
-            numOfAge = 0;
             }
         else if( p == 1 ) {
             if( parentChoices.size() == 0 && numOfAge > 0 ) {
@@ -8865,7 +9310,6 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
                 
                 checkLineageLimit = false;
                 numBirthLocationsCurseBlocked = 0;
-                numOfAge = 0;
                 }
             }
         
@@ -9400,6 +9844,8 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
     
 
     newObject.lastRegionLookTime = 0;
+    newObject.lastRegionLookPos.x = 0;
+    newObject.lastRegionLookPos.y = 0;
     newObject.playerCrossingCheckTime = 0;
     
     
@@ -9685,8 +10131,7 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
 
         tutorialCount ++;
 
-        int maxPlayers = 
-            SettingsManager::getIntSetting( "maxPlayers", 200 );
+        int maxPlayers = cachedSettings.maxPlayers;
 
         if( tutorialCount > maxPlayers ) {
             // wrap back to 0 so we don't keep getting farther
@@ -9973,6 +10418,7 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
     newObject.pathToDest = NULL;
     newObject.pathTruncated = 0;
     newObject.firstMapSent = false;
+    newObject.chunkFormat = CHUNK_FORMAT_TEXT;
     newObject.lastSentMapX = 0;
     newObject.lastSentMapY = 0;
     newObject.moveStartTime = Time::getCurrentTime();
@@ -10015,6 +10461,7 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
 
     newObject.sock = inSock;
     newObject.sockBuffer = inSockBuffer;
+    newObject.outputQueue = new PlayerOutputQueue();
     
     newObject.gotPartOfThisFrame = false;
     
@@ -10454,6 +10901,7 @@ int processLoggedInPlayer( int inAllowOrForceReconnect,
         }
     else {
         players.push_back( newObject );            
+        addToPlayerIndexTable( players.size() - 1 );
         }
 
     if( newObject.isEve ) {
@@ -10764,6 +11212,7 @@ static void processWaitingTwinConnection( FreshConnection inConnection ) {
                 newTwinPlayer.isTutorial = true;
 
                 players.deleteElement( players.size() - 1 );
+                playerIndexTable.remove( newTwinPlayer.id, 0, 0, 0 );
                 
                 tutorialLoadingPlayers.push_back( newTwinPlayer );
                 }
@@ -12120,9 +12569,8 @@ void sendMessageToPlayer( LiveObject *inPlayer,
         }
 
     int numSent = 
-        inPlayer->sock->send( message, 
-                              len, 
-                              false, false );
+        sendToPlayerQueue( inPlayer, message, 
+                           len );
         
     if( numSent != len ) {
         setPlayerDisconnected( inPlayer, "Socket write failed" );
@@ -12703,10 +13151,9 @@ void apocalypseStep() {
                 if( !nextPlayer->error && nextPlayer->connected ) {
                     
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             (unsigned char*)message, 
-                            messageLength,
-                            false, false );
+                            messageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -12840,10 +13287,9 @@ void apocalypseStep() {
                         if( !nextPlayer->error && nextPlayer->connected ) {
                     
                             int numSent = 
-                                nextPlayer->sock->send( 
+                                sendToPlayerQueue( nextPlayer, 
                                     (unsigned char*)message, 
-                                    messageLength,
-                                    false, false );
+                                    messageLength );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                     
@@ -12894,10 +13340,9 @@ void monumentStep() {
 
 
                 int numSent = 
-                    nextPlayer->sock->send( 
+                    sendToPlayerQueue( nextPlayer, 
                         (unsigned char*)message, 
-                        messageLength,
-                        false, false );
+                        messageLength );
                 
                 nextPlayer->gotPartOfThisFrame = true;
                 
@@ -13264,9 +13709,7 @@ static void checkSickStaggerTime( LiveObject *inPlayer ) {
         // if they are taken care of until
         // the sickness passes
         
-        int staggerTime = 
-            SettingsManager::getIntSetting(
-                "deathStaggerTime", 20 );
+        int staggerTime = cachedSettings.deathStaggerTime;
         
         double currentTime = 
             Time::getCurrentTime();
@@ -14257,9 +14700,7 @@ void executeKillAction( int inKillerIndex,
 
                     // if not already dying
                     if( ! hitPlayer->dying ) {
-                        int staggerTime = 
-                            SettingsManager::getIntSetting(
-                                "deathStaggerTime", 20 );
+                        int staggerTime = cachedSettings.deathStaggerTime;
                                             
                         double currentTime = 
                             Time::getCurrentTime();
@@ -16825,6 +17266,8 @@ int main() {
         return 1;
         }
     
+    initSettingsCache();
+    
     familyDataLogFile = fopen( "familyDataLog.txt", "a" );
 
     if( familyDataLogFile != NULL ) {
@@ -16865,6 +17308,9 @@ int main() {
     requireClientPassword =
         SettingsManager::getIntSetting( "requireClientPassword", 1 );
     
+    playerIndexTableOn = 
+        SettingsManager::getIntSetting( "playerIndexTableOn", 1 );
+    
     requireTicketServerCheck =
         SettingsManager::getIntSetting( "requireTicketServerCheck", 1 );
     
@@ -17070,7 +17516,7 @@ int main() {
     
 
     initLifeLog();
-    //initBackup();
+    initBackup();
     
     initPlayerStats();
     initLineageLog();
@@ -17105,6 +17551,15 @@ int main() {
     while( initTransBankStep() < 1.0 );
     initTransBankFinish();
     
+    if( SettingsManager::getIntSetting( "recordTransLookups", 0 ) ) {
+        // for replaying with transLookupBenchmark
+        transLookupFile = fopen( "transLookups.txt", "w" );
+        
+        if( transLookupFile != NULL ) {
+            setTransLookupRecordFile( transLookupFile );
+            }
+        }
+
 
     // defaults to one hour
     int epochSeconds = 
@@ -17198,7 +17653,7 @@ int main() {
     
     SocketServer *server = new SocketServer( port, 256 );
     
-    sockPoll.addSocketServer( server );
+    initSocketEvents( server );
     
     AppLog::infoF( "Listening for connection on port %d", port );
 
@@ -17208,9 +17663,8 @@ int main() {
     char someClientMessageReceived = false;
     
     
-    int shutdownMode = SettingsManager::getIntSetting( "shutdownMode", 0 );
-    int forceShutdownMode = 
-            SettingsManager::getIntSetting( "forceShutdownMode", 0 );
+    int shutdownMode = cachedSettings.shutdownMode;
+    int forceShutdownMode = cachedSettings.forceShutdownMode;
         
     
     // test code for printing sample eve locations
@@ -17234,16 +17688,28 @@ int main() {
     */
 
 
+    // start of last step, and how much of it was spent waiting in poll
+    double lastStepStartTime = -1;
+    double lastStepWaitTime = 0;
+
     while( !quit ) {
 
         double curStepTime = Time::getCurrentTime();
         
+        // pick up any settings changed by operator since last step
+        updateSettingsCache();
+        
+        if( lastStepStartTime != -1 ) {
+            recordMainLoopStep( 
+                curStepTime - lastStepStartTime - lastStepWaitTime );
+            }
+        lastStepStartTime = curStepTime;
+        
         // flush past players hourly
         if( curStepTime - lastPastPlayerFlushTime > 3600 ) {
             
             // default one week
-            int pastPlayerFlushTime = 
-                SettingsManager::getIntSetting( "pastPlayerFlushTime", 604000 );
+            int pastPlayerFlushTime = cachedSettings.pastPlayerFlushTime;
             
             for( int i=0; i<pastPlayers.size(); i++ ) {
                 DeadObject *o = pastPlayers.getElement( i );
@@ -17271,9 +17737,10 @@ int main() {
         
         
         if( periodicStepThisStep ) {
-            shutdownMode = SettingsManager::getIntSetting( "shutdownMode", 0 );
-            forceShutdownMode = 
-                SettingsManager::getIntSetting( "forceShutdownMode", 0 );
+            logMainLoopTiming = cachedSettings.logMainLoopTiming;
+            
+            shutdownMode = cachedSettings.shutdownMode;
+            forceShutdownMode = cachedSettings.forceShutdownMode;
             
             if( checkReadOnly() ) {
                 // read-only file system causes all kinds of weird 
@@ -17307,10 +17774,9 @@ int main() {
                     }
 
                 if( nextPlayer->connected ) {    
-                    nextPlayer->sock->send( 
+                    sendToPlayerQueue( nextPlayer, 
                         (unsigned char*)shutdownMessage, 
-                        messageLength,
-                        false, false );
+                        messageLength );
                 
                     nextPlayer->gotPartOfThisFrame = true;
                     }
@@ -17348,7 +17814,7 @@ int main() {
             
             updateSpecialBiomes( players.size() );
             
-            //checkBackup();
+            checkBackup();
 
             stepFoodLog();
             stepFailureLog();
@@ -17368,18 +17834,15 @@ int main() {
 
             // don't send global arc messages if Eve injection on
             // arcs never end
-            int eveInjectionOn = 
-                SettingsManager::getIntSetting( "eveInjectionOn", 0 );
+            int eveInjectionOn = cachedSettings.eveInjectionOn;
             
             if( arcMilestone != -1 && ! eveInjectionOn ) {
 
                 int familyLimitAfterEveWindow = 
-                    SettingsManager::getIntSetting( 
-                        "familyLimitAfterEveWindow", 15 );
+                    cachedSettings.familyLimitAfterEveWindow;
                 
                 int minFamiliesAfterEveWindow = 
-                    SettingsManager::getIntSetting( 
-                        "minFamiliesAfterEveWindow", 5 );
+                    cachedSettings.minFamiliesAfterEveWindow;
 
                 char eveWindow = isEveWindow();
 
@@ -17606,7 +18069,7 @@ int main() {
             }
         
         
-        SocketOrServer *readySock =  NULL;
+        char serverReady = false;
 
         // at bare minimum, run our periodic steps at a fixed
         // frequency
@@ -17657,6 +18120,12 @@ int main() {
             pollTimeout = 0.01;
             }
 
+        if( pollTimeout > 0.01 && anyPlayerOutputQueued() ) {
+            // some sockets were full last step
+            // SocketPoll can't tell us when they drain, so check back soon
+            pollTimeout = 0.01;
+            }
+
         if( someClientMessageReceived ) {
             // don't wait at all
             // we need to check for next message right away
@@ -17681,13 +18150,16 @@ int main() {
         // come in, and only wake up when some timed action needs to be
         // handled
         
-        readySock = sockPoll.wait( (int)( pollTimeout * 1000 ) );
+        double waitStartTime = Time::getCurrentTime();
+        
+        serverReady = waitSocketEvents( (int)( pollTimeout * 1000 ) );
+        
+        lastStepWaitTime = Time::getCurrentTime() - waitStartTime;
         
         
         
         
-        if( readySock != NULL && !readySock->isSocket ) {
-            // server ready
+        if( serverReady ) {
             Socket *sock = server->acceptConnection( 0 );
 
             if( sock != NULL ) {
@@ -17752,8 +18224,7 @@ int main() {
                 
                 char *message;
                 
-                int maxPlayers = 
-                    SettingsManager::getIntSetting( "maxPlayers", 200 );
+                int maxPlayers = cachedSettings.maxPlayers;
                 
                 int currentPlayers = players.size() + newConnections.size();
                     
@@ -17830,10 +18301,10 @@ int main() {
                     }
                 else {
                     // first message sent okay
-                    newConnection.sockBuffer = new SimpleVector<char>();
+                    newConnection.sockBuffer = new MessageBuffer();
                     
 
-                    sockPoll.addSocket( sock );
+                    addEventSocket( sock );
 
                     newConnections.push_back( newConnection );
                     }
@@ -18157,9 +18628,7 @@ int main() {
                                         "%d", 
                                         &( nextConnection->twinCount ) );
 
-                                int maxCount = 
-                                    SettingsManager::getIntSetting( 
-                                        "maxTwinPartySize", 4 );
+                                int maxCount = cachedSettings.maxTwinPartySize;
                                 
                                 if( nextConnection->twinCount > maxCount ) {
                                     nextConnection->twinCount = maxCount;
@@ -18420,7 +18889,7 @@ int main() {
                                        nextConnection->errorCauseString );
                         
                         if( nextConnection->sock != NULL ) {
-                            sockPoll.removeSocket( nextConnection->sock );
+                            removeEventSocket( nextConnection->sock );
                             }
                         
                         deleteMembers( nextConnection );
@@ -18464,6 +18933,7 @@ int main() {
             
 
             players.push_back( *nextPlayer );
+            addToPlayerIndexTable( players.size() - 1 );
 
             tutorialLoadingPlayers.deleteElement( i );
             
@@ -18481,6 +18951,7 @@ int main() {
                                uniqueID );
             
                 players.push_back( *twinPlayer );
+                addToPlayerIndexTable( players.size() - 1 );
 
                 tutorialLoadingPlayers.deleteElement( i );
                 
@@ -18692,9 +19163,7 @@ int main() {
                             // if was sick, they had a long stagger
                             // time set, so cutting it in half makes no sense
                         
-                            int staggerTime = 
-                                SettingsManager::getIntSetting(
-                                    "deathStaggerTime", 20 );
+                            int staggerTime = cachedSettings.deathStaggerTime;
                         
                             double currentTime = 
                                 Time::getCurrentTime();
@@ -18822,10 +19291,29 @@ int main() {
                 }
             
             
-            if( curLookTime - nextPlayer->lastRegionLookTime > 5 ) {
+            GridPos *lookPos = &( nextPlayer->lastRegionLookPos );
+            
+            if( curLookTime - nextPlayer->lastRegionLookTime > 
+                cachedSettings.regionLookRefreshSeconds ) {
+                // full refresh, keeps live tracking going around
+                // players who stand still
                 lookAtRegion( nextPlayer->xd - 8, nextPlayer->yd - 7,
                               nextPlayer->xd + 8, nextPlayer->yd + 7 );
                 nextPlayer->lastRegionLookTime = curLookTime;
+                
+                lookPos->x = nextPlayer->xd;
+                lookPos->y = nextPlayer->yd;
+                }
+            else if( lookPos->x != nextPlayer->xd || 
+                     lookPos->y != nextPlayer->yd ) {
+                // moved since last look, just look at newly exposed strip
+                lookAtNewRegionPart( lookPos->x - 8, lookPos->y - 7,
+                                     lookPos->x + 8, lookPos->y + 7,
+                                     nextPlayer->xd - 8, nextPlayer->yd - 7,
+                                     nextPlayer->xd + 8, nextPlayer->yd + 7 );
+                
+                lookPos->x = nextPlayer->xd;
+                lookPos->y = nextPlayer->yd;
                 }
 
             char *message = NULL;
@@ -18875,8 +19363,7 @@ int main() {
                     // with a protocol change before the server gets updated
                     }
                 else if( m.type == BUG ) {
-                    int allow = 
-                        SettingsManager::getIntSetting( "allowBugReports", 0 );
+                    int allow = cachedSettings.allowBugReports;
 
                     if( allow ) {
                         char *bugName = 
@@ -18912,29 +19399,13 @@ int main() {
                     }
                 else if( m.type == MAP ) {
                     
-                    int allow = 
-                        SettingsManager::getIntSetting( "allowMapRequests", 0 );
+                    int allow = cachedSettings.allowMapRequests;
                     
 
                     if( allow ) {
-                        
-                        SimpleVector<char *> *list = 
-                            SettingsManager::getSetting( 
-                                "mapRequestAllowAccounts" );
-                        
-                        allow = false;
-                        
-                        for( int i=0; i<list->size(); i++ ) {
-                            if( strcmp( nextPlayer->email,
-                                        list->getElementDirect( i ) ) == 0 ) {
-                                
-                                allow = true;
-                                break;
-                                }
-                            }
-                        
-                        list->deallocateStringElements();
-                        delete list;
+                        allow = cachedListContains( 
+                            &( cachedSettings.mapRequestAllowAccounts ),
+                            nextPlayer->email );
                         }
                     
 
@@ -18958,12 +19429,12 @@ int main() {
                                              chunkDimensionX,
                                              chunkDimensionY,
                                              centerPos,
-                                             &length );
+                                             &length,
+                                             nextPlayer->chunkFormat );
                         
                         int numSent = 
-                            nextPlayer->sock->send( mapChunkMessage, 
-                                                    length, 
-                                                    false, false );
+                            sendToPlayerQueue( nextPlayer, mapChunkMessage, 
+                                               length );
                         
                         nextPlayer->gotPartOfThisFrame = true;
                         
@@ -18985,28 +19456,12 @@ int main() {
                         }
                     }
                 else if( m.type == VOGS ) {
-                    int allow = 
-                        SettingsManager::getIntSetting( "allowVOGMode", 0 );
+                    int allow = cachedSettings.allowVOGMode;
 
                     if( allow ) {
-                        
-                        SimpleVector<char *> *list = 
-                            SettingsManager::getSetting( 
-                                "vogAllowAccounts" );
-                        
-                        allow = false;
-                        
-                        for( int i=0; i<list->size(); i++ ) {
-                            if( strcmp( nextPlayer->email,
-                                        list->getElementDirect( i ) ) == 0 ) {
-                                
-                                allow = true;
-                                break;
-                                }
-                            }
-                        
-                        list->deallocateStringElements();
-                        delete list;
+                        allow = cachedListContains( 
+                            &( cachedSettings.vogAllowAccounts ),
+                            nextPlayer->email );
                         }
                     
 
@@ -19211,6 +19666,16 @@ int main() {
                             nextPlayer->xd, nextPlayer->yd );
                         }
                     }
+                else if( m.type == CFMT ) {
+                    // client telling us which map chunk encoding it can read
+                    // only takes effect for chunks sent after this
+                    if( m.i == CHUNK_FORMAT_BINARY ) {
+                        nextPlayer->chunkFormat = CHUNK_FORMAT_BINARY;
+                        }
+                    else {
+                        nextPlayer->chunkFormat = CHUNK_FORMAT_TEXT;
+                        }
+                    }
                 else if( m.type == PING ) {
                     // immediately send pong
                     char *message = autoSprintf( "PONG\n%d#", m.id );
@@ -19275,9 +19740,7 @@ int main() {
                             adult = getLiveObject( holdingAdultID );
                             }
 
-                        int babyBonesID = 
-                            SettingsManager::getIntSetting( 
-                                "babyBones", -1 );
+                        int babyBonesID = cachedSettings.babyBones;
                         
                         if( adult != NULL ) {
                             
@@ -19393,8 +19856,7 @@ int main() {
                         else {
                             
                             int babyBonesGroundID = 
-                                SettingsManager::getIntSetting( 
-                                    "babyBonesGround", -1 );
+                                cachedSettings.babyBonesGround;
                             
                             if( babyBonesGroundID != -1 ) {
                                 nextPlayer->customGraveID = babyBonesGroundID;
@@ -24440,14 +24902,11 @@ int main() {
                         // ignore new EMOT requres from player if emot
                         // frozen
                         
-                        if( m.i <= SettingsManager::getIntSetting( 
-                                "allowedEmotRange", 6 ) ) {
-                            
-                            SimpleVector<int> *forbidden =
-                                SettingsManager::getIntSettingMulti( 
-                                    "forbiddenEmots" );
+                        if( m.i <= cachedSettings.allowedEmotRange ) {
                             
-                            if( forbidden->getElementIndex( m.i ) == -1 ) {
+                            if( ! cachedListContains( 
+                                    &( cachedSettings.forbiddenEmots ),
+                                    m.i ) ) {
                                 // not forbidden
                                 
                                 double curTime = Time::getCurrentTime();
@@ -24504,7 +24963,6 @@ int main() {
                                         }
                                     }
                                 }
-                            delete forbidden;
                             }
                         } 
                     }
@@ -24765,8 +25223,7 @@ int main() {
                     nextPlayer->curseStatus.curseLevel == 0 &&
                     ! isEveWindow() ) {
                     int minFamiliesAfterEveWindow =
-                        SettingsManager::getIntSetting( 
-                            "minFamiliesAfterEveWindow", 5 );
+                        cachedSettings.minFamiliesAfterEveWindow;
                     if( minFamiliesAfterEveWindow > 0 ) {
                         // is this the last player of this family?
 
@@ -24871,7 +25328,7 @@ int main() {
                 else {
                     if( nextPlayer->sock != NULL ) {
                         // stop listening for activity on this socket
-                        sockPoll.removeSocket( nextPlayer->sock );
+                        removeEventSocket( nextPlayer->sock );
                         }
                     }
                 
@@ -24935,12 +25392,10 @@ int main() {
                     }
 
 
-                if( SettingsManager::getIntSetting( 
-                        "babyApocalypsePossible", 1 ) 
+                if( cachedSettings.babyApocalypsePossible 
                     &&
                     players.size() > 
-                    SettingsManager::getIntSetting(
-                        "minActivePlayersForBabyApocalypse", 15 ) ) {
+                    cachedSettings.minActivePlayersForBabyApocalypse ) {
                     
                     double curTime = Time::getCurrentTime();
                     
@@ -24948,11 +25403,8 @@ int main() {
                     
                         // player was born as a baby
                         
-                        int barrierRadius = 
-                            SettingsManager::getIntSetting( 
-                                "barrierRadius", 250 );
-                        int barrierOn = SettingsManager::getIntSetting( 
-                            "barrierOn", 1 );
+                        int barrierRadius = cachedSettings.barrierRadius;
+                        int barrierOn = cachedSettings.barrierOn;
 
                         char insideBarrier = true;
                         
@@ -24964,8 +25416,8 @@ int main() {
                             }
                               
 
-                        float threshold = SettingsManager::getFloatSetting( 
-                            "babySurvivalYearsBeforeApocalypse", 15.0f );
+                        float threshold = 
+                            cachedSettings.babySurvivalYearsBeforeApocalypse;
                         
                         if( insideBarrier && age > threshold ) {
                             // baby passed threshold, update last-passed time
@@ -24978,9 +25430,8 @@ int main() {
                             
                             if( lastBabyPassedThresholdTime > 0 &&
                                 curTime - lastBabyPassedThresholdTime >
-                                SettingsManager::getIntSetting(
-                                    "babySurvivalWindowSecondsBeforeApocalypse",
-                                    3600 ) ) {
+                                cachedSettings.
+                                babySurvivalWindowSecondsBeforeApocalypse ) {
                                 // we're outside the window
                                 // people have been dying young for a long time
                                 
@@ -25878,16 +26329,13 @@ int main() {
 
                                 int radiusLimit = -1;
                                 
-                                int barrierOn = SettingsManager::getIntSetting( 
-                                    "barrierOn", 1 );
+                                int barrierOn = cachedSettings.barrierOn;
                                 int barrierBlocksPlanes = 
-                                    SettingsManager::getIntSetting( 
-                                    "barrierBlocksPlanes", 1 );
+                                    cachedSettings.barrierBlocksPlanes;
                                 
                                 if( barrierOn && barrierBlocksPlanes ) {
                                     int barrierRadius = 
-                                        SettingsManager::getIntSetting( 
-                                            "barrierRadius", 250 );
+                                        cachedSettings.barrierRadius;
                                     radiusLimit = barrierRadius;
                                     }
 
@@ -26485,7 +26933,7 @@ int main() {
 
             if( nextPlayer->posForced &&
                 nextPlayer->connected &&
-                SettingsManager::getIntSetting( "requireClientForceAck", 1 ) ) {
+                cachedSettings.requireClientForceAck ) {
                 // block additional moves/actions from this player until
                 // we get a FORCE response, syncing them up with
                 // their forced position.
@@ -26976,6 +27424,57 @@ int main() {
         SimpleVector<int> playersReceivingPlayerUpdate;
         
 
+        // bucket updates and moves by position, so each player below
+        // only looks at the ones that might be in range of them, instead
+        // of all of them
+        // global updates go to everyone, so they're kept off to the side
+        int fanOutRadius = getMaxChunkDimension() * 2;
+        
+        PositionBucketIndex updateIndex( fanOutRadius );
+        SimpleVector<int> globalUpdateIndices;
+        
+        for( int u=0; u<newUpdatesPos.size(); u++ ) {
+            ChangePosition *p = newUpdatesPos.getElement( u );
+            
+            if( p->global ) {
+                globalUpdateIndices.push_back( u );
+                }
+            else {
+                updateIndex.add( p->x, p->y, u );
+                }
+            }
+        updateIndex.finishAdding();
+        
+        PositionBucketIndex moveIndex( fanOutRadius );
+        
+        for( int u=0; u<movesPos.size(); u++ ) {
+            ChangePosition *p = movesPos.getElement( u );
+            moveIndex.add( p->x, p->y, u );
+            }
+        moveIndex.finishAdding();
+        
+        
+        // update lines that don't depend on receiver, formatted once
+        // here and shared by everyone below
+        // NULL where line must be formatted per receiver
+        SimpleVector<char*> sharedUpdateLines;
+        // for global updates, which far-away players also get
+        SimpleVector<char*> farUpdateLines;
+        
+        for( int u=0; u<newUpdates.size(); u++ ) {
+            UpdateRecord *r = newUpdates.getElement( u );
+            
+            sharedUpdateLines.push_back( getSharedUpdateLine( r ) );
+            
+            if( newUpdatesPos.getElement( u )->global && r->posUsed ) {
+                farUpdateLines.push_back( getFarUpdateLine( r ) );
+                }
+            else {
+                farUpdateLines.push_back( NULL );
+                }
+            }
+        
+
         for( int i=0; i<numLive; i++ ) {
             
             LiveObject *nextPlayer = players.getElement(i);
@@ -27036,8 +27535,7 @@ int main() {
                 
                 // next send info about valley lines
 
-                int valleySpacing = 
-                    SettingsManager::getIntSetting( "valleySpacing", 40 );
+                int valleySpacing = cachedSettings.valleySpacing;
                                   
                 char *valleyMessage = 
                     autoSprintf( "VS\n"
@@ -27343,10 +27841,9 @@ int main() {
                 unsigned char *followM = getFollowingMessage( true, &followL );
                 
                 if( followM != NULL && nextPlayer->connected ) {
-                    nextPlayer->sock->send( 
+                    sendToPlayerQueue( nextPlayer, 
                         followM, 
-                        followL, 
-                        false, false );
+                        followL );
                     delete [] followM;
                     }
 
@@ -27357,10 +27854,9 @@ int main() {
                 unsigned char *exileM = getExileMessage( true, &exileL );
                 
                 if( exileM != NULL && nextPlayer->connected ) {
-                    nextPlayer->sock->send( 
+                    sendToPlayerQueue( nextPlayer, 
                         exileM, 
-                        exileL, 
-                        false, false );
+                        exileL );
                     delete [] exileM;
                     }
                 
@@ -27933,10 +28429,9 @@ int main() {
                 // are holding post-wound come later                
                 if( dyingMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             dyingMessage, 
-                            dyingMessageLength, 
-                            false, false );
+                            dyingMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
 
@@ -27950,10 +28445,9 @@ int main() {
                 // EVERYONE gets info about now-healed players           
                 if( healingMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             healingMessage, 
-                            healingMessageLength, 
-                            false, false );
+                            healingMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -27967,10 +28461,9 @@ int main() {
                 // EVERYONE gets info about emots           
                 if( emotMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             emotMessage, 
-                            emotMessageLength, 
-                            false, false );
+                            emotMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -27984,10 +28477,9 @@ int main() {
                 // everyone gets wiggle message
                 if( wiggleMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             (unsigned char*)wiggleMessage, 
-                            wiggleMessageLength, 
-                            false, false );
+                            wiggleMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28012,8 +28504,16 @@ int main() {
                 if( newUpdates.size() > 0 && nextPlayer->connected ) {
 
                     double minUpdateDist = maxDist2 * 2;                    
+                    
+                    // globals, plus whatever is bucketed near us,
+                    // in newUpdates order
+                    SimpleVector<int> nearUpdates;
+                    nearUpdates.push_back_other( &globalUpdateIndices );
+                    updateIndex.getNear( playerXD, playerYD, 
+                                         fanOutRadius, &nearUpdates );
 
-                    for( int u=0; u<newUpdatesPos.size(); u++ ) {
+                    for( int n=0; n<nearUpdates.size(); n++ ) {
+                        int u = nearUpdates.getElementDirect( n );
                         ChangePosition *p = newUpdatesPos.getElement( u );
                         
                         // update messages can be global when a new
@@ -28045,7 +28545,14 @@ int main() {
                         int updateMessageLength = 0;
                         SimpleVector<char> updateChars;
                         
-                        for( int u=0; u<newUpdates.size(); u++ ) {
+                        // players that this PU is about
+                        SimpleVector<int> updateIDs;
+                        // don't let a lagging queue drop a forced update
+                        // that this player still has to acknowledge
+                        char updateDroppable = true;
+                        
+                        for( int n=0; n<nearUpdates.size(); n++ ) {
+                            int u = nearUpdates.getElementDirect( n );
                             ChangePosition *p = newUpdatesPos.getElement( u );
                         
                             double d = intDist( p->x, p->y, 
@@ -28064,14 +28571,48 @@ int main() {
                                 }
                             
                             
-                            char *line =
-                                getUpdateLineFromRecord( 
-                                    newUpdates.getElement( u ),
-                                    nextPlayer->birthPos,
-                                    getPlayerPos( nextPlayer ) );
+                            char *sharedLine = 
+                                sharedUpdateLines.getElementDirect( u );
                             
-                            updateChars.appendElementString( line );
-                            delete [] line;
+                            if( sharedLine == NULL ) {
+                                UpdateRecord *r = newUpdates.getElement( u );
+                                
+                                GridPos updatePos = { r->absolutePosX,
+                                                      r->absolutePosY };
+                                
+                                if( distance( updatePos, 
+                                              getPlayerPos( nextPlayer ) ) >
+                                    getMaxChunkDimension() * 2 ) {
+                                    // same far-away line as 
+                                    // getUpdateLineFromRecord would make
+                                    sharedLine = 
+                                        farUpdateLines.getElementDirect( u );
+                                    }
+                                }
+                            
+                            int updateID = 
+                                newUpdatePlayerIDs.getElementDirect( u );
+                            
+                            updateIDs.push_back( updateID );
+                            
+                            if( updateID == nextPlayer->id &&
+                                nextPlayer->waitingForForceResponse ) {
+                                updateDroppable = false;
+                                }
+                            
+                            if( sharedLine != NULL ) {
+                                updateChars.appendElementString( sharedLine );
+                                }
+                            else {
+                                char *line =
+                                    getUpdateLineFromRecord( 
+                                        newUpdates.getElement( u ),
+                                        nextPlayer->birthPos,
+                                        getPlayerPos( nextPlayer ) );
+                            
+                                updateChars.appendElementString( line );
+                                delete [] line;
+                                }
                             }
                         
 
@@ -28102,11 +28643,17 @@ int main() {
                             playersReceivingPlayerUpdate.push_back( 
                                 nextPlayer->id );
                             
+                            QueuedUpdateKind kind = QUEUED_OTHER;
+                            
+                            if( updateDroppable ) {
+                                kind = QUEUED_PU;
+                                }
+                            
                             int numSent = 
-                                nextPlayer->sock->send( 
+                                sendToPlayerQueue( nextPlayer, 
                                     updateMessage, 
-                                    updateMessageLength, 
-                                    false, false );
+                                    updateMessageLength,
+                                    kind, &updateIDs );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                             
@@ -28127,7 +28674,12 @@ int main() {
                     
                     double minUpdateDist = getMaxChunkDimension() * 2;
                     
-                    for( int u=0; u<movesPos.size(); u++ ) {
+                    SimpleVector<int> nearMoves;
+                    moveIndex.getNear( playerXD, playerYD, 
+                                       fanOutRadius, &nearMoves );
+                    
+                    for( int n=0; n<nearMoves.size(); n++ ) {
+                        int u = nearMoves.getElementDirect( n );
                         ChangePosition *p = movesPos.getElement( u );
                         
                         // move messages are never global
@@ -28147,8 +28699,10 @@ int main() {
                     if( minUpdateDist <= maxDist ) {
                         
                         SimpleVector<MoveRecord> closeMoves;
+                        SimpleVector<int> closeMoveIDs;
                         
-                        for( int u=0; u<movesPos.size(); u++ ) {
+                        for( int n=0; n<nearMoves.size(); n++ ) {
+                            int u = nearMoves.getElementDirect( n );
                             ChangePosition *p = movesPos.getElement( u );
                             
                             // move messages are never global
@@ -28161,6 +28715,8 @@ int main() {
                                 }
                             closeMoves.push_back( 
                                 moveList.getElementDirect( u ) );
+                            closeMoveIDs.push_back(
+                                moveList.getElement( u )->playerID );
                             }
                         
                         if( closeMoves.size() > 0 ) {
@@ -28185,10 +28741,10 @@ int main() {
                                 }
 
                             int numSent = 
-                                nextPlayer->sock->send( 
+                                sendToPlayerQueue( nextPlayer, 
                                     moveMessage, 
-                                    moveMessageLength, 
-                                    false, false );
+                                    moveMessageLength,
+                                    QUEUED_PM, &closeMoveIDs );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                             
@@ -28252,10 +28808,9 @@ int main() {
                         }
                         
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             outOfRangeMessage, 
-                            outOfRangeMessageLength, 
-                            false, false );
+                            outOfRangeMessageLength );
                         
                     nextPlayer->gotPartOfThisFrame = true;
 
@@ -28351,10 +28906,9 @@ int main() {
                         if( mapChangeMessage != NULL ) {
 
                             int numSent = 
-                                nextPlayer->sock->send( 
+                                sendToPlayerQueue( nextPlayer, 
                                     mapChangeMessage, 
-                                    mapChangeMessageLength, 
-                                    false, false );
+                                    mapChangeMessageLength );
                             
                             nextPlayer->gotPartOfThisFrame = true;
                             
@@ -28583,10 +29137,9 @@ int main() {
                         
                         
                         int numSent = 
-                            nextPlayer->sock->send( 
+                            sendToPlayerQueue( nextPlayer, 
                                 message, 
-                                messageLen, 
-                                false, false );
+                                messageLen );
                         
                         delete [] message;
                         
@@ -28664,10 +29217,9 @@ int main() {
                             }
 
                         int numSent = 
-                            nextPlayer->sock->send( 
+                            sendToPlayerQueue( nextPlayer, 
                                 (unsigned char*)message,
-                                len, 
-                                false, false );
+                                len );
                         
                         delete [] message;
                         
@@ -28731,10 +29283,9 @@ int main() {
 
                     if( deleteUpdateMessage != NULL ) {
                         int numSent = 
-                            nextPlayer->sock->send( 
+                            sendToPlayerQueue( nextPlayer, 
                                 deleteUpdateMessage, 
-                                deleteUpdateMessageLength, 
-                                false, false );
+                                deleteUpdateMessageLength );
                     
                         nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28752,10 +29303,9 @@ int main() {
                 // EVERYONE gets lineage info for new babies
                 if( lineageMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             lineageMessage, 
-                            lineageMessageLength, 
-                            false, false );
+                            lineageMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28769,10 +29319,9 @@ int main() {
                 // EVERYONE gets curse info
                 if( cursesMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             cursesMessage, 
-                            cursesMessageLength, 
-                            false, false );
+                            cursesMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28785,10 +29334,9 @@ int main() {
                 // EVERYONE gets newly-given names
                 if( namesMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             namesMessage, 
-                            namesMessageLength, 
-                            false, false );
+                            namesMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28802,10 +29350,9 @@ int main() {
                 // EVERYONE gets following message
                 if( followingMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             followingMessage, 
-                            followingMessageLength, 
-                            false, false );
+                            followingMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28819,10 +29366,9 @@ int main() {
                 // EVERYONE gets exile message
                 if( exileMessage != NULL && nextPlayer->connected ) {
                     int numSent = 
-                        nextPlayer->sock->send( 
+                        sendToPlayerQueue( nextPlayer, 
                             exileMessage, 
-                            exileMessageLength, 
-                            false, false );
+                            exileMessageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28895,10 +29441,9 @@ int main() {
                         int messageLength = strlen( foodMessage );
                         
                         int numSent = 
-                            nextPlayer->sock->send( 
+                            sendToPlayerQueue( nextPlayer, 
                                 (unsigned char*)foodMessage, 
-                                messageLength,
-                                false, false );
+                                messageLength );
                         
                         nextPlayer->gotPartOfThisFrame = true;
                         
@@ -28934,10 +29479,9 @@ int main() {
                     int messageLength = strlen( heatMessage );
                     
                     int numSent = 
-                         nextPlayer->sock->send( 
+                         sendToPlayerQueue( nextPlayer, 
                              (unsigned char*)heatMessage, 
-                             messageLength,
-                             false, false );
+                             messageLength );
                     
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -28963,10 +29507,9 @@ int main() {
                     int messageLength = strlen( tokenMessage );
                     
                     int numSent = 
-                         nextPlayer->sock->send( 
+                         sendToPlayerQueue( nextPlayer, 
                              (unsigned char*)tokenMessage, 
-                             messageLength,
-                             false, false );
+                             messageLength );
 
                     nextPlayer->gotPartOfThisFrame = true;
                     
@@ -29024,6 +29567,15 @@ int main() {
             delete [] r->formatString;
             }
         
+        for( int u=0; u<sharedUpdateLines.size(); u++ ) {
+            if( sharedUpdateLines.getElementDirect( u ) != NULL ) {
+                delete [] sharedUpdateLines.getElementDirect( u );
+                }
+            if( farUpdateLines.getElementDirect( u ) != NULL ) {
+                delete [] farUpdateLines.getElementDirect( u );
+                }
+            }
+        
         for( int u=0; u<newDeleteUpdates.size(); u++ ) {
             UpdateRecord *r = newDeleteUpdates.getElement( u );
             delete [] r->formatString;
@@ -29091,10 +29643,9 @@ int main() {
             
             if( nextPlayer->gotPartOfThisFrame && nextPlayer->connected ) {
                 int numSent = 
-                    nextPlayer->sock->send( 
+                    sendToPlayerQueue( nextPlayer, 
                         (unsigned char*)frameMessage, 
-                        frameMessageLength,
-                        false, false );
+                        frameMessageLength );
 
                 if( numSent != frameMessageLength ) {
                     setPlayerDisconnected( nextPlayer, "Socket write failed" );
@@ -29104,6 +29655,10 @@ int main() {
             }
         
 
+        // everything queued this step goes out together
+        flushPlayerOutputQueues();
+        
+
         
         // handle closing any that have an error
         for( int i=0; i<players.size(); i++ ) {
@@ -29121,7 +29676,7 @@ int main() {
                 addPastPlayer( nextPlayer );
 
                 if( nextPlayer->sock != NULL ) {
-                    sockPoll.removeSocket( nextPlayer->sock );
+                    removeEventSocket( nextPlayer->sock );
                 
                     delete nextPlayer->sock;
                     nextPlayer->sock = NULL;
@@ -29132,6 +29687,11 @@ int main() {
                     nextPlayer->sockBuffer = NULL;
                     }
                 
+                if( nextPlayer->outputQueue != NULL ) {
+                    delete nextPlayer->outputQueue;
+                    nextPlayer->outputQueue = NULL;
+                    }
+                
                 delete nextPlayer->lineage;
                 
                 delete nextPlayer->ancestorIDs;
@@ -29194,6 +29754,8 @@ int main() {
                 delete nextPlayer->babyIDs;
 
                 players.deleteElement( i );
+                // everyone after i has moved down
+                rebuildPlayerIndexTable();
                 i--;
                 }
             }
@@ -29215,6 +29777,7 @@ int main() {
 
     // Closing the server socket makes these connection requests fail
     // instantly (instead of relying on client timeouts).
+    freeSocketEvents();
     delete server;
 
     quitCleanup();
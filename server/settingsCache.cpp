@@ -0,0 +1,303 @@
+#include "settingsCache.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "minorGems/util/SettingsManager.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/system/Time.h"
+
+
+
+CachedSettings cachedSettings;
+
+
+static double lastCheckTime = 0;
+
+static double checkInterval = 1.0;
+
+
+
+typedef enum CachedSettingType {
+    CACHED_INT,
+    CACHED_FLOAT,
+    CACHED_DOUBLE,
+    // default ignored, lists start empty
+    CACHED_INT_LIST,
+    CACHED_STRING_LIST
+    } CachedSettingType;
+
+
+
+typedef struct CachedSettingEntry {
+        const char *name;
+        CachedSettingType type;
+
+        // where the value lives in CachedSettings
+        size_t offset;
+
+        double defaultValue;
+
+        char *filePath;
+
+        // 0 and -1 if file doesn't exist
+        time_t fileModTime;
+        off_t fileSize;
+
+        // file was modified in the same second that we last looked at it
+        // mod times only have 1-second resolution, so another write in
+        // that second won't change the mod time.
+        // Keep re-reading until the mod time is in the past.
+        char recheck;
+    } CachedSettingEntry;
+
+
+
+// field names match setting names
+#define CACHED_SETTING( inType, inName, inDefault ) \
+    { #inName, inType, offsetof( CachedSettings, inName ), inDefault, \
+      NULL, 0, -1, false }
+
+
+static CachedSettingEntry entries[] = {
+    // default one week
+    CACHED_SETTING( CACHED_INT, pastPlayerFlushTime, 604000 ),
+
+    CACHED_SETTING( CACHED_INT, shutdownMode, 0 ),
+    CACHED_SETTING( CACHED_INT, forceShutdownMode, 0 ),
+    CACHED_SETTING( CACHED_INT, logMainLoopTiming, 0 ),
+
+    CACHED_SETTING( CACHED_INT, eveInjectionOn, 0 ),
+    CACHED_SETTING( CACHED_INT, maxPlayers, 200 ),
+    CACHED_SETTING( CACHED_INT, maxTwinPartySize, 4 ),
+    CACHED_SETTING( CACHED_INT, deathStaggerTime, 20 ),
+
+    CACHED_SETTING( CACHED_INT, allowBugReports, 0 ),
+    CACHED_SETTING( CACHED_INT, allowMapRequests, 0 ),
+    CACHED_SETTING( CACHED_INT, allowVOGMode, 0 ),
+    CACHED_SETTING( CACHED_INT, allowedEmotRange, 6 ),
+
+    CACHED_SETTING( CACHED_STRING_LIST, mapRequestAllowAccounts, 0 ),
+    CACHED_SETTING( CACHED_STRING_LIST, vogAllowAccounts, 0 ),
+    CACHED_SETTING( CACHED_INT_LIST, forbiddenEmots, 0 ),
+
+    CACHED_SETTING( CACHED_INT, babyBones, -1 ),
+    CACHED_SETTING( CACHED_INT, babyBonesGround, -1 ),
+
+    CACHED_SETTING( CACHED_INT, minFamiliesAfterEveWindow, 5 ),
+    CACHED_SETTING( CACHED_INT, familyLimitAfterEveWindow, 15 ),
+
+    CACHED_SETTING( CACHED_INT, babyApocalypsePossible, 1 ),
+    CACHED_SETTING( CACHED_INT, minActivePlayersForBabyApocalypse, 15 ),
+    CACHED_SETTING( CACHED_FLOAT, babySurvivalYearsBeforeApocalypse, 15.0 ),
+    CACHED_SETTING( CACHED_INT, babySurvivalWindowSecondsBeforeApocalypse,
+                    3600 ),
+    CACHED_SETTING( CACHED_INT, minActivePlayersForApocalypse, 15 ),
+
+    CACHED_SETTING( CACHED_INT, barrierOn, 1 ),
+    CACHED_SETTING( CACHED_INT, barrierRadius, 250 ),
+    CACHED_SETTING( CACHED_INT, barrierBlocksPlanes, 1 ),
+
+    CACHED_SETTING( CACHED_INT, requireClientForceAck, 1 ),
+    CACHED_SETTING( CACHED_INT, valleySpacing, 40 ),
+
+    CACHED_SETTING( CACHED_INT, homelandStaleSeconds, 3600 ),
+    CACHED_SETTING( CACHED_DOUBLE, maxFlightDistance, 10000 ),
+
+    CACHED_SETTING( CACHED_INT, outputQueueDropStaleKB, 512 ),
+    CACHED_SETTING( CACHED_INT, outputQueueDisconnectKB, 8192 ),
+
+    // must stay under noLookCountAsStaleSeconds in map.cpp
+    CACHED_SETTING( CACHED_INT, regionLookRefreshSeconds, 5 )
+    };
+
+
+static int numEntries = sizeof( entries ) / sizeof( CachedSettingEntry );
+
+
+
+static void freeEntryList( CachedSettingEntry *inEntry ) {
+    char *dest = (char*)( &cachedSettings ) + inEntry->offset;
+
+    if( inEntry->type == CACHED_INT_LIST ) {
+        CachedIntList *list = (CachedIntList*)dest;
+
+        if( list->values != NULL ) {
+            delete [] list->values;
+            }
+        list->values = NULL;
+        list->num = 0;
+        }
+    else if( inEntry->type == CACHED_STRING_LIST ) {
+        CachedStringList *list = (CachedStringList*)dest;
+
+        if( list->values != NULL ) {
+            for( int i=0; i<list->num; i++ ) {
+                delete [] list->values[i];
+                }
+            delete [] list->values;
+            }
+        list->values = NULL;
+        list->num = 0;
+        }
+    }
+
+
+
+static void readEntry( CachedSettingEntry *inEntry ) {
+    char *dest = (char*)( &cachedSettings ) + inEntry->offset;
+
+    freeEntryList( inEntry );
+
+    switch( inEntry->type ) {
+        case CACHED_INT:
+            *( (int*)dest ) =
+                SettingsManager::getIntSetting(
+                    inEntry->name, (int)inEntry->defaultValue );
+            break;
+        case CACHED_FLOAT:
+            *( (float*)dest ) =
+                SettingsManager::getFloatSetting(
+                    inEntry->name, (float)inEntry->defaultValue );
+            break;
+        case CACHED_DOUBLE:
+            *( (double*)dest ) =
+                SettingsManager::getDoubleSetting(
+                    inEntry->name, inEntry->defaultValue );
+            break;
+        case CACHED_INT_LIST: {
+            CachedIntList *list = (CachedIntList*)dest;
+
+            SimpleVector<int> *values =
+                SettingsManager::getIntSettingMulti( inEntry->name );
+
+            list->num = values->size();
+            list->values = values->getElementArray();
+
+            delete values;
+            break;
+            }
+        case CACHED_STRING_LIST: {
+            CachedStringList *list = (CachedStringList*)dest;
+
+            SimpleVector<char*> *values =
+                SettingsManager::getSetting( inEntry->name );
+
+            // strings now owned by list
+            list->num = values->size();
+            list->values = values->getElementArray();
+
+            delete values;
+            break;
+            }
+        }
+    }
+
+
+
+char cachedListContains( CachedIntList *inList, int inValue ) {
+    for( int i=0; i<inList->num; i++ ) {
+        if( inList->values[i] == inValue ) {
+            return true;
+            }
+        }
+    return false;
+    }
+
+
+
+char cachedListContains( CachedStringList *inList, const char *inValue ) {
+    for( int i=0; i<inList->num; i++ ) {
+        if( strcmp( inList->values[i], inValue ) == 0 ) {
+            return true;
+            }
+        }
+    return false;
+    }
+
+
+
+// returns true if file has changed since last call
+static char statEntry( CachedSettingEntry *inEntry ) {
+    struct stat fileInfo;
+
+    time_t modTime = 0;
+    off_t size = -1;
+
+    if( stat( inEntry->filePath, &fileInfo ) == 0 ) {
+        modTime = fileInfo.st_mtime;
+        size = fileInfo.st_size;
+        }
+
+    char changed =
+        inEntry->recheck ||
+        modTime != inEntry->fileModTime ||
+        size != inEntry->fileSize;
+
+    inEntry->fileModTime = modTime;
+    inEntry->fileSize = size;
+
+    inEntry->recheck = ( size != -1 && modTime >= time( NULL ) );
+
+    return changed;
+    }
+
+
+
+void initSettingsCache() {
+    for( int i=0; i<numEntries; i++ ) {
+        CachedSettingEntry *e = &( entries[i] );
+
+        if( e->filePath == NULL ) {
+            e->filePath = autoSprintf( "settings/%s.ini", e->name );
+            }
+
+        // stat before reading, so that a write between the two
+        // is caught on next update
+        statEntry( e );
+        readEntry( e );
+        }
+
+    lastCheckTime = Time::getCurrentTime();
+    }
+
+
+
+char updateSettingsCache() {
+    double curTime = Time::getCurrentTime();
+
+    if( curTime - lastCheckTime < checkInterval ) {
+        return false;
+        }
+    lastCheckTime = curTime;
+
+
+    char anyChanged = false;
+
+    for( int i=0; i<numEntries; i++ ) {
+        CachedSettingEntry *e = &( entries[i] );
+
+        if( statEntry( e ) ) {
+            readEntry( e );
+            anyChanged = true;
+            }
+        }
+
+    return anyChanged;
+    }
+
+
+
+void freeSettingsCache() {
+    for( int i=0; i<numEntries; i++ ) {
+        if( entries[i].filePath != NULL ) {
+            delete [] entries[i].filePath;
+            entries[i].filePath = NULL;
+            }
+        freeEntryList( &( entries[i] ) );
+        }
+    }
@@ -0,0 +1,101 @@
+// typed in-memory snapshot of settings that are read on hot paths
+// (per step, per message, per placement search).
+//
+// SettingsManager opens and parses a file for every get call.  Here,
+// values are loaded once at startup, and after that, a value is only
+// re-read when the modification time or size of its .ini file changes.
+//
+// So settings can still be changed live by editing settings/*.ini,
+// and hot paths read plain struct fields.
+
+
+
+// whitespace-separated values from a multi-value setting
+typedef struct CachedIntList {
+        int *values;
+        int num;
+    } CachedIntList;
+
+typedef struct CachedStringList {
+        char **values;
+        int num;
+    } CachedStringList;
+
+
+
+typedef struct CachedSettings {
+        int pastPlayerFlushTime;
+
+        int shutdownMode;
+        int forceShutdownMode;
+        int logMainLoopTiming;
+
+        int eveInjectionOn;
+        int maxPlayers;
+        int maxTwinPartySize;
+        int deathStaggerTime;
+
+        int allowBugReports;
+        int allowMapRequests;
+        int allowVOGMode;
+        int allowedEmotRange;
+
+        CachedStringList mapRequestAllowAccounts;
+        CachedStringList vogAllowAccounts;
+        CachedIntList forbiddenEmots;
+
+        int babyBones;
+        int babyBonesGround;
+
+        int minFamiliesAfterEveWindow;
+        int familyLimitAfterEveWindow;
+
+        int babyApocalypsePossible;
+        int minActivePlayersForBabyApocalypse;
+        float babySurvivalYearsBeforeApocalypse;
+        int babySurvivalWindowSecondsBeforeApocalypse;
+        int minActivePlayersForApocalypse;
+
+        int barrierOn;
+        int barrierRadius;
+        int barrierBlocksPlanes;
+
+        int requireClientForceAck;
+        int valleySpacing;
+
+        int homelandStaleSeconds;
+        double maxFlightDistance;
+
+        int outputQueueDropStaleKB;
+        int outputQueueDisconnectKB;
+
+        int regionLookRefreshSeconds;
+    } CachedSettings;
+
+
+
+// read-only outside of settingsCache.cpp
+extern CachedSettings cachedSettings;
+
+
+
+char cachedListContains( CachedIntList *inList, int inValue );
+
+char cachedListContains( CachedStringList *inList, const char *inValue );
+
+
+
+// loads all values
+void initSettingsCache();
+
+
+// checks settings files for changes, at most once per second,
+// and re-reads any values whose files have changed
+//
+// cheap to call every main loop step
+//
+// returns true if any value was re-read
+char updateSettingsCache();
+
+
+void freeSettingsCache();
@@ -0,0 +1,273 @@
+#include "socketEvents.h"
+
+#include "minorGems/network/SocketPoll.h"
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/SettingsManager.h"
+#include "minorGems/util/log/AppLog.h"
+
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+
+
+static SocketServer *eventServer = NULL;
+
+static char useEpoll = false;
+
+
+// fallback
+static SocketPoll sockPoll;
+
+
+
+#ifdef __linux__
+
+static int epollFD = -1;
+
+static int serverFD = -1;
+
+
+// indexed by file descriptor
+static SimpleVector<Socket*> fdSockets;
+static SimpleVector<char> fdMayHaveData;
+
+
+#define MAX_EVENTS_PER_WAIT 256
+
+static struct epoll_event events[ MAX_EVENTS_PER_WAIT ];
+
+
+
+// minorGems keeps the descriptor as the first int of the native object
+static int getFD( void *inNativeObjectPointer ) {
+    return ( (int*)inNativeObjectPointer )[0];
+    }
+
+
+
+static void growFDTables( int inFD ) {
+    while( fdSockets.size() <= inFD ) {
+        fdSockets.push_back( NULL );
+        fdMayHaveData.push_back( false );
+        }
+    }
+
+#endif
+
+
+
+void initSocketEvents( SocketServer *inServer ) {
+    eventServer = inServer;
+
+    useEpoll = false;
+
+#ifdef __linux__
+    if( SettingsManager::getIntSetting( "useEpoll", 1 ) ) {
+
+        epollFD = epoll_create1( 0 );
+
+        if( epollFD == -1 ) {
+            AppLog::errorF( "epoll_create1 failed (%s), "
+                            "falling back to SocketPoll",
+                            strerror( errno ) );
+            }
+        else {
+            serverFD = getFD( inServer->mNativeObjectPointer );
+
+            // level-triggered, because we only accept one connection
+            // per wait
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = serverFD;
+
+            if( epoll_ctl( epollFD, EPOLL_CTL_ADD, serverFD, &ev ) == -1 ) {
+                AppLog::errorF( "Adding server socket to epoll failed (%s), "
+                                "falling back to SocketPoll",
+                                strerror( errno ) );
+                close( epollFD );
+                epollFD = -1;
+                }
+            else {
+                useEpoll = true;
+                }
+            }
+        }
+#endif
+
+    if( useEpoll ) {
+        AppLog::info( "Waiting for sockets with epoll" );
+        }
+    else {
+        sockPoll.addSocketServer( inServer );
+        }
+    }
+
+
+
+void freeSocketEvents() {
+#ifdef __linux__
+    if( epollFD != -1 ) {
+        close( epollFD );
+        epollFD = -1;
+        }
+    fdSockets.deleteAll();
+    fdMayHaveData.deleteAll();
+#endif
+
+    if( ! useEpoll && eventServer != NULL ) {
+        sockPoll.removeSocketServer( eventServer );
+        }
+    eventServer = NULL;
+    useEpoll = false;
+    }
+
+
+
+void addEventSocket( Socket *inSock ) {
+    if( ! useEpoll ) {
+        sockPoll.addSocket( inSock );
+        return;
+        }
+
+#ifdef __linux__
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    growFDTables( fd );
+
+    // a socket deleted without removeEventSocket left its descriptor
+    // number behind (closing it already took it out of the epoll set)
+    *( fdSockets.getElement( fd ) ) = inSock;
+
+    // bytes may have arrived before it was added
+    *( fdMayHaveData.getElement( fd ) ) = true;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+
+    if( epoll_ctl( epollFD, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+        if( errno == EEXIST ) {
+            epoll_ctl( epollFD, EPOLL_CTL_MOD, fd, &ev );
+            }
+        else {
+            AppLog::errorF( "Adding socket %d to epoll failed (%s)",
+                            fd, strerror( errno ) );
+            }
+        }
+#endif
+    }
+
+
+
+void removeEventSocket( Socket *inSock ) {
+    if( ! useEpoll ) {
+        sockPoll.removeSocket( inSock );
+        return;
+        }
+
+#ifdef __linux__
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    if( fd >= 0 && fd < fdSockets.size() &&
+        fdSockets.getElementDirect( fd ) == inSock ) {
+
+        epoll_ctl( epollFD, EPOLL_CTL_DEL, fd, NULL );
+
+        *( fdSockets.getElement( fd ) ) = NULL;
+        *( fdMayHaveData.getElement( fd ) ) = false;
+        }
+#endif
+    }
+
+
+
+char waitSocketEvents( int inTimeoutMS ) {
+    if( ! useEpoll ) {
+        SocketOrServer *readySock = sockPoll.wait( inTimeoutMS );
+
+        return ( readySock != NULL && ! readySock->isSocket );
+        }
+
+    char serverReady = false;
+
+#ifdef __linux__
+    int timeout = inTimeoutMS;
+
+    int numEvents = MAX_EVENTS_PER_WAIT;
+
+    // a full batch means more may be waiting, keep collecting them
+    while( numEvents == MAX_EVENTS_PER_WAIT ) {
+
+        numEvents = epoll_wait( epollFD, events, MAX_EVENTS_PER_WAIT,
+                                timeout );
+
+        if( numEvents == -1 ) {
+            if( errno != EINTR ) {
+                AppLog::errorF( "epoll_wait failed (%s)", strerror( errno ) );
+                }
+            break;
+            }
+
+        for( int i=0; i<numEvents; i++ ) {
+            int fd = events[i].data.fd;
+
+            if( fd == serverFD ) {
+                serverReady = true;
+                }
+            else if( fd < fdMayHaveData.size() ) {
+                // errors and hangups are found by reading, too
+                *( fdMayHaveData.getElement( fd ) ) = true;
+                }
+            }
+
+        timeout = 0;
+        }
+#endif
+
+    return serverReady;
+    }
+
+
+
+char socketMayHaveData( Socket *inSock ) {
+    if( ! useEpoll ) {
+        return true;
+        }
+
+#ifdef __linux__
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    if( fd < 0 || fd >= fdSockets.size() ||
+        fdSockets.getElementDirect( fd ) != inSock ) {
+        // not one of ours
+        return true;
+        }
+
+    return fdMayHaveData.getElementDirect( fd );
+#else
+    return true;
+#endif
+    }
+
+
+
+void socketDrained( Socket *inSock ) {
+    if( ! useEpoll ) {
+        return;
+        }
+
+#ifdef __linux__
+    int fd = getFD( inSock->mNativeObjectPointer );
+
+    if( fd >= 0 && fd < fdSockets.size() &&
+        fdSockets.getElementDirect( fd ) == inSock ) {
+
+        *( fdMayHaveData.getElement( fd ) ) = false;
+        }
+#endif
+    }
@@ -0,0 +1,37 @@
+// waits for socket activity in the main loop, in place of SocketPoll
+//
+// On Linux, one epoll set holds the server socket and all client sockets.
+// Client sockets are edge-triggered: one wait collects every socket that
+// got new bytes, and each stays marked until it has been read until it
+// would block.  Unmarked sockets don't need to be read at all.
+//
+// Elsewhere (or if useEpoll is 0), falls back to SocketPoll, and every
+// socket is always treated as possibly having new bytes.
+
+
+#include "minorGems/network/Socket.h"
+#include "minorGems/network/SocketServer.h"
+
+
+
+void initSocketEvents( SocketServer *inServer );
+
+void freeSocketEvents();
+
+
+void addEventSocket( Socket *inSock );
+
+// call before deleting inSock
+void removeEventSocket( Socket *inSock );
+
+
+// waits until some socket is ready or inTimeoutMS passes
+// returns true if inServer has a connection waiting
+char waitSocketEvents( int inTimeoutMS );
+
+
+// false only if inSock is known to have no unread bytes
+char socketMayHaveData( Socket *inSock );
+
+// call after a receive on inSock reports that it would block
+void socketDrained( Socket *inSock );
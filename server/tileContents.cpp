@@ -0,0 +1,166 @@
+#include "tileContents.h"
+
+#include "dbCommon.h"
+
+#include "minorGems/util/crc32.h"
+
+#include <string.h>
+
+
+
+// length, checksum, container count
+#define HEADER_LENGTH 12
+
+
+static int maxBlobLength = 0;
+
+
+
+void contentsChunkToKey( int inX, int inY, int inChunk,
+                         unsigned char *outKey ) {
+    intPairToKey( inX, inY, outKey );
+    intToValue( inChunk, &( outKey[8] ) );
+    }
+
+
+
+void clearTileContents( TileContents *inContents ) {
+    inContents->containers.deleteAll();
+    }
+
+
+
+ContainerContents *getContainerContents( TileContents *inContents,
+                                         int inSubCont ) {
+    while( inContents->containers.size() <= inSubCont ) {
+        ContainerContents empty;
+        inContents->containers.push_back( empty );
+        }
+    return inContents->containers.getElement( inSubCont );
+    }
+
+
+
+unsigned char *packTileContents( TileContents *inContents,
+                                 int *outNumChunks ) {
+    int numContainers = inContents->containers.size();
+
+    while( numContainers > 0 &&
+           inContents->containers.getElement( numContainers - 1 )->
+               ids.size() == 0 ) {
+        numContainers--;
+        }
+
+    int length = HEADER_LENGTH;
+
+    for( int c=0; c<numContainers; c++ ) {
+        length += 4 + 12 * inContents->containers.getElement( c )->ids.size();
+        }
+
+    int numChunks =
+        ( length + CONTENTS_CHUNK_SIZE - 1 ) / CONTENTS_CHUNK_SIZE;
+
+    unsigned char *chunks =
+        new unsigned char[ numChunks * CONTENTS_CHUNK_SIZE ];
+
+    memset( chunks, 0, numChunks * CONTENTS_CHUNK_SIZE );
+
+    intToValue( length, chunks );
+    intToValue( numContainers, &( chunks[8] ) );
+
+    unsigned char *next = &( chunks[ HEADER_LENGTH ] );
+
+    for( int c=0; c<numContainers; c++ ) {
+        ContainerContents *cont = inContents->containers.getElement( c );
+
+        int num = cont->ids.size();
+
+        intToValue( num, next );
+        next += 4;
+
+        for( int i=0; i<num; i++ ) {
+            intToValue( cont->ids.getElementDirect( i ), next );
+            timeToValue( cont->etas.getElementDirect( i ), &( next[4] ) );
+            next += 12;
+            }
+        }
+
+    // covers everything after itself, so a blob with chunks from
+    // different writes doesn't match
+    intToValue( (int)crc32( &( chunks[8] ), length - 8 ), &( chunks[4] ) );
+
+    *outNumChunks = numChunks;
+    return chunks;
+    }
+
+
+
+void setContentsMaxSlots( int inMaxSlots ) {
+    // every container, and every slot of the tile's container holding a
+    // full sub container
+    maxBlobLength = HEADER_LENGTH +
+        ( inMaxSlots + 1 ) * 4 +
+        ( inMaxSlots + inMaxSlots * inMaxSlots ) * 12;
+    }
+
+
+
+int getNumContentsChunks( unsigned char *inFirstChunk ) {
+    if( maxBlobLength == 0 ) {
+        setContentsMaxSlots( CONTENTS_DEFAULT_MAX_SLOTS );
+        }
+    
+    int length = valueToInt( inFirstChunk );
+
+    if( length < HEADER_LENGTH || length > maxBlobLength ) {
+        return -1;
+        }
+    return ( length + CONTENTS_CHUNK_SIZE - 1 ) / CONTENTS_CHUNK_SIZE;
+    }
+
+
+
+char unpackTileContents( unsigned char *inChunks,
+                         TileContents *outContents ) {
+    clearTileContents( outContents );
+
+    if( getNumContentsChunks( inChunks ) < 0 ) {
+        return false;
+        }
+
+    int length = valueToInt( inChunks );
+
+    if( (int)crc32( &( inChunks[8] ), length - 8 ) !=
+        valueToInt( &( inChunks[4] ) ) ) {
+        return false;
+        }
+
+    int numContainers = valueToInt( &( inChunks[8] ) );
+
+    int pos = HEADER_LENGTH;
+
+    for( int c=0; c<numContainers; c++ ) {
+        if( pos + 4 > length ) {
+            clearTileContents( outContents );
+            return false;
+            }
+
+        int num = valueToInt( &( inChunks[pos] ) );
+        pos += 4;
+
+        if( num < 0 || num > ( length - pos ) / 12 ) {
+            clearTileContents( outContents );
+            return false;
+            }
+
+        ContainerContents *cont = getContainerContents( outContents, c );
+
+        for( int i=0; i<num; i++ ) {
+            cont->ids.push_back( valueToInt( &( inChunks[pos] ) ) );
+            cont->etas.push_back( valueToTime( &( inChunks[pos + 4] ) ) );
+            pos += 12;
+            }
+        }
+
+    return true;
+    }
@@ -0,0 +1,68 @@
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+// Everything contained at one map tile, stored in contents.db as one blob.
+//
+// containers[0] is the container on the tile itself, containers[i+1] is
+// the sub container held in its slot i.
+// ids and etas are parallel, with an eta of 0 meaning no decay.
+typedef struct ContainerContents {
+        SimpleVector<int> ids;
+        SimpleVector<timeSec_t> etas;
+    } ContainerContents;
+
+
+typedef struct TileContents {
+        SimpleVector<ContainerContents> containers;
+    } TileContents;
+
+
+
+// blobs are split across fixed-size DB values, keyed by x, y and
+// chunk number, with the blob's length in the first 4 bytes of chunk 0,
+// then a checksum of the rest of the blob
+#define CONTENTS_KEY_SIZE 12
+#define CONTENTS_CHUNK_SIZE 128
+
+
+// until setContentsMaxSlots is called
+#define CONTENTS_DEFAULT_MAX_SLOTS 255
+
+
+
+void contentsChunkToKey( int inX, int inY, int inChunk,
+                         unsigned char *outKey );
+
+
+// empties inContents
+void clearTileContents( TileContents *inContents );
+
+
+// returns container inSubCont, adding empty ones up to it if needed
+ContainerContents *getContainerContents( TileContents *inContents,
+                                         int inSubCont );
+
+
+// packs inContents into chunks, returned array is
+// *outNumChunks * CONTENTS_CHUNK_SIZE bytes
+// Empty containers at the end are not stored.
+unsigned char *packTileContents( TileContents *inContents,
+                                 int *outNumChunks );
+
+
+// blobs longer than containers of inMaxSlots slots can fill are
+// treated as corrupt
+void setContentsMaxSlots( int inMaxSlots );
+
+
+// number of chunks in the blob that starts with inFirstChunk
+// returns -1 if its length is corrupt
+int getNumContentsChunks( unsigned char *inFirstChunk );
+
+
+// inChunks holds all of a blob's chunks back to back
+// returns false if the blob is corrupt, or its chunks are from different
+// writes, leaving outContents empty
+char unpackTileContents( unsigned char *inChunks,
+                         TileContents *outContents );